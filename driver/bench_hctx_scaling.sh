@@ -0,0 +1,134 @@
+#!/bin/bash
+
+# IOPS scaling benchmark for uringblk hardware queues
+# Reloads the module with each nr_hw_queues value, runs the same fio job
+# against /dev/uringblk0 and reports IOPS and the per-hctx request spread.
+#
+# Usage: bench_hctx_scaling.sh [-q "1 2 4 8"] [-j jobs] [-d iodepth]
+#                              [-t seconds] [-b bs] [-w randread|randwrite]
+
+set -e
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+MODULE_NAME="uringblk_driver"
+MODULE_PATH="${SCRIPT_DIR}/${MODULE_NAME}.ko"
+DEVICE="/dev/uringblk0"
+SYSFS="/sys/block/uringblk0/uringblk"
+
+# Benchmark configuration
+QUEUE_COUNTS="1 2 4 8"
+JOBS=$(nproc)
+IODEPTH=32
+RUNTIME=10
+BS="4k"
+RW="randread"
+CAPACITY_MB=1024
+
+log_info() {
+    echo -e "${BLUE}[INFO]${NC} $1"
+}
+
+log_success() {
+    echo -e "${GREEN}[SUCCESS]${NC} $1"
+}
+
+log_warning() {
+    echo -e "${YELLOW}[WARNING]${NC} $1"
+}
+
+log_error() {
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+cleanup() {
+    sudo rmmod ${MODULE_NAME} 2>/dev/null || true
+}
+
+trap cleanup EXIT
+
+while getopts "q:j:d:t:b:w:h" opt; do
+    case $opt in
+        q) QUEUE_COUNTS="$OPTARG" ;;
+        j) JOBS="$OPTARG" ;;
+        d) IODEPTH="$OPTARG" ;;
+        t) RUNTIME="$OPTARG" ;;
+        b) BS="$OPTARG" ;;
+        w) RW="$OPTARG" ;;
+        *) sed -n '3,8p' "$0"; exit 0 ;;
+    esac
+done
+
+check_prerequisites() {
+    if [[ ! -f "$MODULE_PATH" ]]; then
+        log_error "Module not found: $MODULE_PATH"
+        log_info "Please run 'make module' first"
+        exit 1
+    fi
+    if ! command -v fio &> /dev/null; then
+        log_error "Required tool not found: fio"
+        exit 1
+    fi
+}
+
+load_module() {
+    local queues="$1"
+
+    sudo rmmod ${MODULE_NAME} 2>/dev/null || true
+    sudo insmod "$MODULE_PATH" nr_hw_queues="$queues" capacity_mb=$CAPACITY_MB
+    for _ in $(seq 1 50); do
+        [[ -b "$DEVICE" ]] && return 0
+        sleep 0.1
+    done
+    log_error "$DEVICE did not appear"
+    exit 1
+}
+
+# Prints "<read iops> <write iops>" from fio terse output
+run_fio() {
+    sudo fio --name=hctx_scaling --filename="$DEVICE" --direct=1 \
+        --ioengine=io_uring --rw="$RW" --bs="$BS" --iodepth="$IODEPTH" \
+        --numjobs="$JOBS" --runtime="$RUNTIME" --time_based \
+        --group_reporting --minimal | awk -F';' '{ print $8, $49 }'
+}
+
+main() {
+    local base=""
+    local results=()
+
+    check_prerequisites
+
+    log_info "fio $RW bs=$BS iodepth=$IODEPTH jobs=$JOBS runtime=${RUNTIME}s"
+
+    for queues in $QUEUE_COUNTS; do
+        local iops rd wr
+
+        load_module "$queues"
+        echo 1 | sudo tee "$SYSFS/stats_reset" > /dev/null
+
+        read -r rd wr < <(run_fio)
+        iops=$((rd + wr))
+        [[ -z "$base" ]] && base=$iops
+
+        results+=("$(printf "%-12s %-12s %s" "$queues" "$iops" \
+            "$(awk -v a="$iops" -v b="$base" 'BEGIN { printf "%.2fx", b ? a / b : 0 }')")")
+
+        log_info "nr_hw_queues=$queues: $iops IOPS"
+        sed 's/^/    hctx /' "$SYSFS/hctx_stats"
+    done
+
+    echo
+    printf "%-12s %-12s %s\n" "hw_queues" "IOPS" "scaling"
+    for line in "${results[@]}"; do
+        echo "$line"
+    done
+
+    log_success "Benchmark complete"
+}
+
+main "$@"
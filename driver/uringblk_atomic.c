@@ -0,0 +1,420 @@
+/*
+ * uringblk_atomic.c - Atomic writes through a data journal
+ *
+ * With atomic_write_kb set, the device backend writes are all or nothing
+ * for any write that stays within one naturally aligned atomic write
+ * unit, the way NVMe AWUPF works. Requests are kept from crossing unit
+ * boundaries with chunk_sectors, so a database page of up to the unit
+ * size never tears.
+ *
+ * Writes no larger than the physical block size of the lower device
+ * are atomic on their own and go down the normal path. Larger ones go
+ * through a journal of AW_SLOTS slots at the end of the lower
+ * device, each one page of header followed by one unit of data:
+ *
+ *  1. header and data are written to a free slot with FUA,
+ *  2. the data is written in place with FUA,
+ *  3. the header is cleared with FUA and the request completes.
+ *
+ * A crash before 1 completes leaves the old data, one after it leaves a
+ * slot whose checksums match and which is written in place again when
+ * the device is next created. Slots are replayed in sequence order.
+ * Since headers are cleared before the request completes, a replay
+ * never overwrites data from a later request.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/crc32c.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/wait.h>
+
+#include "uringblk_driver.h"
+
+#define AW_SLOTS        16
+#define AW_MAX_KB       64
+#define AW_MAGIC        0x4d4f5441626c6275ULL  /* "ublATOM" */
+
+static unsigned int atomic_write_kb;
+module_param(atomic_write_kb, uint, 0444);
+MODULE_PARM_DESC(atomic_write_kb, "Atomic write unit of device backends in KB, a power of two up to 64, 0 for none (default: 0)");
+
+/* On disk, at the start of a slot's header page */
+struct aw_rec {
+    __le64 magic;
+    __le64 seq;
+    __le64 sector;                 /* Target, in 512-byte sectors */
+    __le32 len;                    /* Bytes of data following the header page */
+    __le32 data_crc;
+    __le32 hdr_crc;                /* Over the fields above */
+} __packed;
+
+struct uringblk_atomic {
+    struct block_device *bdev;
+    sector_t jstart;               /* First sector of the journal */
+    unsigned int unit;             /* Atomic write unit in bytes */
+    unsigned int direct_max;       /* Lower device writes this size atomically */
+    atomic64_t seq;
+    unsigned long free;            /* Bitmap of free slots */
+    wait_queue_head_t wait;        /* Writers waiting for a slot */
+    void *bufs[AW_SLOTS];      /* Header page and one unit each */
+};
+
+struct aw_found {
+    u64 seq;
+    unsigned int slot;
+};
+
+bool uringblk_atomic_enabled(void)
+{
+    return atomic_write_kb != 0;
+}
+
+static size_t aw_slot_size(struct uringblk_atomic *at)
+{
+    return PAGE_SIZE + at->unit;
+}
+
+static sector_t aw_slot_sector(struct uringblk_atomic *at, unsigned int slot)
+{
+    return at->jstart + ((slot * aw_slot_size(at)) >> SECTOR_SHIFT);
+}
+
+static u32 aw_hdr_crc(const struct aw_rec *rec)
+{
+    return crc32c(~0, rec, offsetof(struct aw_rec, hdr_crc));
+}
+
+static int aw_clear_slot(struct uringblk_atomic *at, unsigned int slot, blk_opf_t flags)
+{
+    memset(at->bufs[slot], 0, PAGE_SIZE);
+    return uringblk_bio_rw_kern(at->bdev, REQ_OP_WRITE | REQ_SYNC | flags,
+                                aw_slot_sector(at, slot), at->bufs[slot], PAGE_SIZE);
+}
+
+/* Valid slots hold a write that may not have reached its place */
+static bool aw_read_slot(struct uringblk_atomic *at, unsigned int slot, u64 *seq)
+{
+    struct aw_rec *rec = at->bufs[slot];
+    u32 len;
+
+    if (uringblk_bio_rw_kern(at->bdev, REQ_OP_READ, aw_slot_sector(at, slot),
+                             rec, PAGE_SIZE))
+        return false;
+    if (le64_to_cpu(rec->magic) != AW_MAGIC ||
+        le32_to_cpu(rec->hdr_crc) != aw_hdr_crc(rec))
+        return false;
+
+    len = le32_to_cpu(rec->len);
+    if (!len || len > at->unit || !IS_ALIGNED(len, SECTOR_SIZE) ||
+        (le64_to_cpu(rec->sector) << SECTOR_SHIFT) + len > (u64)at->jstart << SECTOR_SHIFT)
+        return false;
+    if (uringblk_bio_rw_kern(at->bdev, REQ_OP_READ, aw_slot_sector(at, slot) +
+                             (PAGE_SIZE >> SECTOR_SHIFT), at->bufs[slot] + PAGE_SIZE, len))
+        return false;
+    if (le32_to_cpu(rec->data_crc) != crc32c(~0, at->bufs[slot] + PAGE_SIZE, len))
+        return false;
+
+    *seq = le64_to_cpu(rec->seq);
+    return true;
+}
+
+static int aw_replay_cmp(const void *a, const void *b)
+{
+    const struct aw_found *x = a, *y = b;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* Finish the writes a crash interrupted, oldest first */
+static int aw_replay(struct uringblk_atomic *at)
+{
+    struct aw_found found[AW_SLOTS];
+    unsigned int i, n = 0;
+    u64 seq, max_seq = 0;
+    int ret;
+
+    for (i = 0; i < AW_SLOTS; i++) {
+        if (!aw_read_slot(at, i, &seq))
+            continue;
+        found[n].seq = seq;
+        found[n].slot = i;
+        n++;
+        max_seq = max(max_seq, seq);
+    }
+    sort(found, n, sizeof(found[0]), aw_replay_cmp, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct aw_rec *rec = at->bufs[found[i].slot];
+
+        ret = uringblk_bio_rw_kern(at->bdev, REQ_OP_WRITE | REQ_SYNC | REQ_FUA,
+                                   le64_to_cpu(rec->sector), at->bufs[found[i].slot] + PAGE_SIZE,
+                                   le32_to_cpu(rec->len));
+        if (ret)
+            return ret;
+    }
+
+    /* Every slot starts out empty, including ones holding torn records */
+    for (i = 0; i < AW_SLOTS; i++) {
+        ret = aw_clear_slot(at, i, 0);
+        if (ret)
+            return ret;
+    }
+    ret = blkdev_issue_flush(at->bdev);
+    if (ret)
+        return ret;
+
+    atomic64_set(&at->seq, max_seq);
+    if (n)
+        pr_info("uringblk: replayed %u atomic writes from the journal\n", n);
+    return 0;
+}
+
+static void aw_free(struct uringblk_atomic *at)
+{
+    unsigned int i;
+
+    for (i = 0; i < AW_SLOTS; i++)
+        kvfree(at->bufs[i]);
+    kfree(at);
+}
+
+/**
+ * uringblk_atomic_init - Set up the journal of a device backend
+ * @dev: Device whose backend has been initialized
+ *
+ * The journal takes the end of the lower device, the capacity shrinks
+ * to stay clear of it. Writes left in it by a crash are replayed.
+ */
+int uringblk_atomic_init(struct uringblk_device *dev)
+{
+    struct bdev_handle *bdev_handle = dev->backend.private_data;
+    struct uringblk_atomic *at;
+    unsigned int unit = atomic_write_kb << 10;
+    loff_t jstart;
+    unsigned int i;
+    int ret;
+
+    if (dev->backend.type != URINGBLK_BACKEND_DEVICE) {
+        pr_info("uringblk: atomic writes are only provided by the device backend\n");
+        return 0;
+    }
+    if (dev->config.zoned_mode || dev->wbcache) {
+        pr_err("uringblk: atomic writes cannot be used in zoned mode or with the write-back cache\n");
+        return -EINVAL;
+    }
+    if (!is_power_of_2(atomic_write_kb) || atomic_write_kb > AW_MAX_KB ||
+        unit < uringblk_logical_block_size ||
+        bdev_logical_block_size(bdev_handle->bdev) > PAGE_SIZE) {
+        pr_err("uringblk: invalid atomic_write_kb %u\n", atomic_write_kb);
+        return -EINVAL;
+    }
+
+    at = kzalloc(sizeof(*at), GFP_KERNEL);
+    if (!at)
+        return -ENOMEM;
+
+    at->bdev = bdev_handle->bdev;
+    at->unit = unit;
+    at->direct_max = bdev_physical_block_size(at->bdev);
+    init_waitqueue_head(&at->wait);
+    bitmap_fill(&at->free, AW_SLOTS);
+
+    jstart = round_down(bdev_nr_bytes(at->bdev) - AW_SLOTS * aw_slot_size(at),
+                        PAGE_SIZE);
+    if (jstart < (loff_t)unit) {
+        ret = -ENOSPC;
+        goto err_free;
+    }
+    at->jstart = jstart >> SECTOR_SHIFT;
+    if (dev->backend.capacity > jstart)
+        dev->backend.capacity = round_down(jstart, uringblk_logical_block_size);
+
+    for (i = 0; i < AW_SLOTS; i++) {
+        at->bufs[i] = kvmalloc(aw_slot_size(at), GFP_KERNEL);
+        if (!at->bufs[i]) {
+            ret = -ENOMEM;
+            goto err_free;
+        }
+    }
+
+    ret = aw_replay(at);
+    if (ret) {
+        pr_err("uringblk: failed to replay the atomic write journal: %d\n", ret);
+        goto err_free;
+    }
+
+    dev->atomic = at;
+    dev->features |= URINGBLK_FEAT_ATOMIC_WRITE;
+    pr_info("uringblk: %u KB atomic writes, journal at sector %llu\n",
+            atomic_write_kb, (unsigned long long)at->jstart);
+    return 0;
+
+err_free:
+    aw_free(at);
+    return ret;
+}
+
+void uringblk_atomic_exit(struct uringblk_device *dev)
+{
+    if (!dev->atomic)
+        return;
+
+    aw_free(dev->atomic);
+    dev->atomic = NULL;
+}
+
+/* Requests never cross a unit boundary, whole pages of the unit size fit one */
+void uringblk_atomic_setup_queue(struct uringblk_device *dev)
+{
+    if (dev->atomic)
+        blk_queue_chunk_sectors(dev->disk->queue, dev->atomic->unit >> SECTOR_SHIFT);
+}
+
+void uringblk_atomic_limits(struct uringblk_device *dev, struct uringblk_limits *limits)
+{
+    struct uringblk_atomic *at = dev->atomic;
+
+    if (!at)
+        return;
+
+    limits->atomic_write_unit_min = uringblk_logical_block_size;
+    limits->atomic_write_unit_max = at->unit;
+    limits->atomic_write_max_bytes = at->unit;
+    limits->atomic_write_boundary = at->unit;
+}
+
+/* Whether a write of @len bytes at @sector is atomic */
+bool uringblk_atomic_fits(struct uringblk_device *dev, sector_t sector, u32 len)
+{
+    struct uringblk_atomic *at = dev->atomic;
+
+    return at && len <= at->unit &&
+           ((sector << SECTOR_SHIFT) & (at->unit - 1)) + len <= at->unit;
+}
+
+static int aw_get_slot(struct uringblk_atomic *at)
+{
+    unsigned int slot;
+
+    for_each_set_bit(slot, &at->free, AW_SLOTS) {
+        if (test_and_clear_bit(slot, &at->free))
+            return slot;
+    }
+    return -1;
+}
+
+static void aw_put_slot(struct uringblk_atomic *at, unsigned int slot)
+{
+    set_bit(slot, &at->free);
+    wake_up(&at->wait);
+}
+
+/* Copy @len bytes from @off into the request's data to @buf */
+static void aw_copy_rq(struct request *rq, unsigned int off, void *buf, unsigned int len)
+{
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    unsigned int pos = 0;
+
+    rq_for_each_segment(bvec, rq, iter) {
+        unsigned int seg = bvec.bv_len;
+
+        /* Copying moves off to the end of each segment it touches */
+        if (pos + seg > off) {
+            unsigned int skip = off - pos;
+            unsigned int n = min(seg - skip, len);
+
+            bvec.bv_offset += skip;
+            bvec.bv_len = n;
+            memcpy_from_bvec(buf, &bvec);
+            buf += n;
+            off += n;
+            len -= n;
+            if (!len)
+                break;
+        }
+        pos += seg;
+    }
+}
+
+static int aw_write_journaled(struct uringblk_atomic *at, unsigned int slot,
+                                  sector_t sector, unsigned int len)
+{
+    struct aw_rec *rec = at->bufs[slot];
+    void *data = at->bufs[slot] + PAGE_SIZE;
+    int ret;
+
+    memset(rec, 0, PAGE_SIZE);
+    rec->magic = cpu_to_le64(AW_MAGIC);
+    rec->seq = cpu_to_le64(atomic64_inc_return(&at->seq));
+    rec->sector = cpu_to_le64(sector);
+    rec->len = cpu_to_le32(len);
+    rec->data_crc = cpu_to_le32(crc32c(~0, data, len));
+    rec->hdr_crc = cpu_to_le32(aw_hdr_crc(rec));
+
+    ret = uringblk_bio_rw_kern(at->bdev, REQ_OP_WRITE | REQ_SYNC | REQ_FUA,
+                               aw_slot_sector(at, slot), rec, PAGE_SIZE + len);
+    if (ret)
+        return ret;
+    ret = uringblk_bio_rw_kern(at->bdev, REQ_OP_WRITE | REQ_SYNC | REQ_FUA,
+                               sector, data, len);
+    if (ret)
+        return ret;
+    return aw_clear_slot(at, slot, REQ_FUA);
+}
+
+/**
+ * uringblk_atomic_queue_rq - Write a multi-block request through the journal
+ * @dev: Device with atomic writes
+ * @rq: Started request
+ *
+ * Returns true if the request has been completed. Writes the lower device
+ * takes atomically are left to the normal path. A request the block
+ * layer did not split at unit boundaries, a URING_CMD, is written unit by
+ * unit.
+ */
+bool uringblk_atomic_queue_rq(struct uringblk_device *dev, struct request *rq)
+{
+    struct uringblk_atomic *at = dev->atomic;
+    sector_t sector = blk_rq_pos(rq);
+    unsigned int off = 0, total = blk_rq_bytes(rq);
+    blk_status_t status = BLK_STS_OK;
+    int slot;
+
+    if (req_op(rq) != REQ_OP_WRITE || total <= at->direct_max)
+        return false;
+
+    wait_event(at->wait, (slot = aw_get_slot(at)) >= 0);
+
+    while (off < total) {
+        unsigned int len = min_t(unsigned int, total - off,
+                                 at->unit - ((sector << SECTOR_SHIFT) & (at->unit - 1)));
+        int ret;
+
+        aw_copy_rq(rq, off, at->bufs[slot] + PAGE_SIZE, len);
+        if (len > at->direct_max)
+            ret = aw_write_journaled(at, slot, sector, len);
+        else
+            ret = uringblk_bio_rw_kern(at->bdev, REQ_OP_WRITE | REQ_SYNC |
+                                       (rq->cmd_flags & REQ_FUA), sector,
+                                       at->bufs[slot] + PAGE_SIZE, len);
+        if (ret) {
+            pr_err_ratelimited("uringblk: atomic write failed at sector %llu: %d\n",
+                               (unsigned long long)sector, ret);
+            status = BLK_STS_IOERR;
+            break;
+        }
+
+        sector += len >> SECTOR_SHIFT;
+        off += len;
+    }
+
+    aw_put_slot(at, slot);
+    uringblk_complete_rq(rq, status);
+    return true;
+}
@@ -0,0 +1,465 @@
+/*
+ * uringblk_bio.c - Request remapping onto lower block devices
+ *
+ * Requests for bdev-backed storage are not copied: every bio of the
+ * request is cloned onto the lower device, sharing its bvecs, and the
+ * request completes when the last clone does. Per-request state lives
+ * in the blk-mq pdu (struct uringblk_cmd).
+ *
+ * REQ_POLLED requests keep their REQ_POLLED clones and are tracked on
+ * their poll hctx; ->poll() drives the lower device with bio_poll() and
+ * hands the finished requests back through the caller's io_comp_batch.
+ */
+
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "uringblk_driver.h"
+
+#define URINGBLK_POLL_BATCH 16  /* Lower bios polled per ->poll() call */
+#define URINGBLK_BIO_DEFER_MAX 64 /* Lower bios held back per hw queue */
+
+/* Batch of the ->poll() call running on this CPU, if any */
+static DEFINE_PER_CPU(struct io_comp_batch *, uringblk_poll_iob);
+
+int uringblk_bio_init(struct uringblk_device *dev)
+{
+    return bioset_init(&dev->bio_set, BIO_POOL_SIZE, 0, BIOSET_NEED_BVECS);
+}
+
+void uringblk_bio_exit(struct uringblk_device *dev)
+{
+    bioset_exit(&dev->bio_set);
+}
+
+/*
+ * The submitter holds one reference on cmd->pending for the whole
+ * submission loop, so a fast lower completion cannot end the request
+ * before every clone has been issued.
+ */
+void uringblk_cmd_start(struct request *rq)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+    atomic_set(&cmd->pending, 1);
+    cmd->status = BLK_STS_OK;
+}
+
+void uringblk_cmd_set_error(struct request *rq, blk_status_t status)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+    /* Keep the first error, later ones add nothing */
+    if (!READ_ONCE(cmd->status))
+        WRITE_ONCE(cmd->status, status);
+}
+
+void uringblk_cmd_put(struct request *rq)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+    if (atomic_dec_and_test(&cmd->pending))
+        uringblk_complete_rq(rq, READ_ONCE(cmd->status));
+}
+
+/* Default lower completion, custom ones must end by calling it */
+void uringblk_bio_endio(struct bio *bio)
+{
+    struct request *rq = bio->bi_private;
+    blk_status_t status = bio->bi_status;
+
+    /* Discard is advisory, a lower device without it is not an error */
+    if (status == BLK_STS_NOTSUPP && bio_op(bio) == REQ_OP_DISCARD)
+        status = BLK_STS_OK;
+
+    if (status) {
+        pr_err_ratelimited("uringblk: lower I/O failed at sector %llu: %d\n",
+                           (unsigned long long)bio->bi_iter.bi_sector,
+                           blk_status_to_errno(status));
+        uringblk_cmd_set_error(rq, status);
+    }
+
+    bio_put(bio);
+    uringblk_cmd_put(rq);
+}
+
+/**
+ * uringblk_bio_submit - Issue a lower bio on behalf of a request
+ * @rq: Request the bio belongs to
+ * @bio: Bio allocated from the device bio_set
+ *
+ * Takes a reference on the request's pending count that the completion
+ * drops again. A bi_end_io already set by the caller is kept.
+ *
+ * The bio is not issued yet but queued on the request's hw queue until
+ * blk-mq ends the dispatch batch, see uringblk_bio_commit(). Only a
+ * bounded number is held back so that the bio_set mempool cannot run
+ * dry on bios that are waiting for their own batch.
+ */
+void uringblk_bio_submit(struct request *rq, struct bio *bio)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct uringblk_queue *uq = rq->mq_hctx->driver_data;
+    unsigned long flags;
+    bool full;
+
+    if (!bio->bi_end_io)
+        bio->bi_end_io = uringblk_bio_endio;
+    bio->bi_private = rq;
+    atomic_inc(&cmd->pending);
+
+    spin_lock_irqsave(&uq->lock, flags);
+    bio_list_add(&uq->deferred, bio);
+    full = ++uq->nr_deferred >= URINGBLK_BIO_DEFER_MAX;
+    spin_unlock_irqrestore(&uq->lock, flags);
+
+    if (full)
+        uringblk_bio_commit(uq);
+}
+
+/**
+ * uringblk_plug_begin - Start a plug of our own for lower bios
+ * @plug: Plug to start
+ *
+ * blk-mq calls ->queue_rqs and ->queue_rq while flushing the plug of
+ * the submitting task, and a nested blk_start_plug() is a no-op then.
+ * Lower bios would queue their requests on the very list being walked
+ * and be taken for ours, so the task's plug is put aside until
+ * uringblk_plug_end().
+ *
+ * Return: the plug to restore.
+ */
+struct blk_plug *uringblk_plug_begin(struct blk_plug *plug)
+{
+    struct blk_plug *outer = current->plug;
+
+    current->plug = NULL;
+    blk_start_plug(plug);
+    return outer;
+}
+
+/* Issue what @plug collected and give the task its plug back */
+void uringblk_plug_end(struct blk_plug *plug, struct blk_plug *outer)
+{
+    blk_finish_plug(plug);
+    current->plug = outer;
+}
+
+/**
+ * uringblk_bio_commit - Issue the lower bios held back on a hw queue
+ * @uq: Hardware queue context
+ *
+ * Called once blk-mq has handed over the last request of a batch, so
+ * the lower device sees the whole batch under a single plug.
+ */
+void uringblk_bio_commit(struct uringblk_queue *uq)
+{
+    struct blk_plug plug, *outer;
+    struct bio_list bios;
+    struct bio *bio;
+
+    if (bio_list_empty(&uq->deferred))
+        return;
+
+    spin_lock_irq(&uq->lock);
+    bios = uq->deferred;
+    bio_list_init(&uq->deferred);
+    uq->nr_deferred = 0;
+    spin_unlock_irq(&uq->lock);
+
+    outer = uringblk_plug_begin(&plug);
+    while ((bio = bio_list_pop(&bios)))
+        submit_bio(bio);
+    uringblk_plug_end(&plug, outer);
+}
+
+/**
+ * uringblk_bio_clone - Clone a request bio onto a lower device
+ * @dev: Device owning the bio_set
+ * @src: Bio of the request
+ * @bdev: Lower device
+ * @sector: Start sector on @bdev
+ *
+ * The clone shares the bvecs of @src, so no data is copied. It is
+ * issued from a blocking context and must not inherit REQ_NOWAIT.
+ * Zone appends have already been placed by uringblk_zoned.c.
+ */
+struct bio *uringblk_bio_clone(struct uringblk_device *dev, struct bio *src,
+                               struct block_device *bdev, sector_t sector)
+{
+    struct bio *clone;
+
+    clone = bio_alloc_clone(bdev, src, GFP_NOIO, &dev->bio_set);
+    if (!clone)
+        return NULL;
+
+    clone->bi_opf &= ~REQ_NOWAIT;
+    /* Lower devices are not zoned, an emulated append is a plain write */
+    if (bio_op(src) == REQ_OP_ZONE_APPEND)
+        clone->bi_opf = (clone->bi_opf & ~REQ_OP_MASK) | REQ_OP_WRITE;
+    clone->bi_iter.bi_sector = sector;
+    return clone;
+}
+
+/**
+ * uringblk_bio_remap_rq - Remap a whole request onto a lower device
+ * @dev: uringblk device
+ * @rq: Started request
+ * @bdev: Lower device, addressed 1:1 with the request sectors
+ *
+ * Every bio of the request is cloned, so multi-segment requests are
+ * carried in full up to the queue limits. The request is completed
+ * from the lower completions; the return value is always BLK_STS_OK.
+ */
+blk_status_t uringblk_bio_remap_rq(struct uringblk_device *dev,
+                                   struct request *rq,
+                                   struct block_device *bdev)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct blk_plug plug;
+    struct bio *bio, *clone;
+
+    uringblk_cmd_start(rq);
+
+    /* Flush requests carry no data, send an empty preflush write */
+    if (req_op(rq) == REQ_OP_FLUSH) {
+        clone = bio_alloc_bioset(bdev, 0, REQ_OP_WRITE | REQ_PREFLUSH,
+                                 GFP_NOIO, &dev->bio_set);
+        if (clone)
+            uringblk_bio_submit(rq, clone);
+        else
+            uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+        uringblk_cmd_put(rq);
+        return BLK_STS_OK;
+    }
+
+    blk_start_plug(&plug);
+    __rq_for_each_bio(bio, rq) {
+        clone = uringblk_bio_clone(dev, bio, bdev, bio->bi_iter.bi_sector);
+        if (!clone) {
+            uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+            break;
+        }
+        /* One clone is enough to find the lower queue to poll */
+        if ((rq->cmd_flags & REQ_POLLED) && !cmd->poll_bio)
+            uringblk_bio_poll_track(rq, clone);
+        uringblk_bio_submit(rq, clone);
+    }
+    blk_finish_plug(&plug);
+
+    uringblk_cmd_put(rq);
+    return BLK_STS_OK;
+}
+
+/**
+ * uringblk_bio_open_members - Open a comma-separated list of lower devices
+ * @paths: Device paths separated by commas
+ * @members: Filled with the opened devices
+ * @max: Size of @members
+ *
+ * Returns the number of devices opened or a negative errno, in which
+ * case nothing is left open. A device may only be listed once.
+ */
+int uringblk_bio_open_members(const char *paths, struct bdev_handle **members,
+                              unsigned int max)
+{
+    struct bdev_handle *handle;
+    char *list, *cur, *path;
+    unsigned int nr = 0, i;
+    int ret = 0;
+
+    list = kstrdup(paths, GFP_KERNEL);
+    if (!list)
+        return -ENOMEM;
+
+    cur = list;
+    while (!ret && (path = strsep(&cur, ",")) != NULL) {
+        path = strim(path);
+        if (!*path)
+            continue;
+
+        if (nr == max) {
+            pr_err("uringblk: at most %u lower devices are supported\n", max);
+            ret = -E2BIG;
+            break;
+        }
+
+        handle = bdev_open_by_path(path, BLK_OPEN_READ | BLK_OPEN_WRITE, NULL, NULL);
+        if (IS_ERR(handle)) {
+            ret = PTR_ERR(handle);
+            pr_err("uringblk: failed to open lower device %s: %d\n", path, ret);
+            break;
+        }
+
+        for (i = 0; i < nr; i++) {
+            if (members[i]->bdev == handle->bdev) {
+                pr_err("uringblk: %s is listed twice\n", path);
+                bdev_release(handle);
+                ret = -EINVAL;
+                break;
+            }
+        }
+        if (!ret)
+            members[nr++] = handle;
+    }
+    kfree(list);
+
+    if (ret) {
+        uringblk_bio_release_members(members, nr);
+        return ret;
+    }
+    return nr;
+}
+
+void uringblk_bio_release_members(struct bdev_handle **members, unsigned int nr)
+{
+    while (nr)
+        bdev_release(members[--nr]);
+}
+
+static struct page *uringblk_kern_page(void *buf)
+{
+    if (is_vmalloc_addr(buf))
+        return vmalloc_to_page(buf);
+    return virt_to_page(buf);
+}
+
+/**
+ * uringblk_bio_rw_kern - Synchronous I/O on a kernel buffer
+ * @bdev: Lower device
+ * @opf: Operation and flags
+ * @sector: Start sector on @bdev
+ * @buf: Linear or vmalloc'ed buffer, sector aligned length
+ * @len: Length in bytes
+ *
+ * The buffer is mapped page by page into a chain of bios, so no bounce
+ * page is needed and only this caller waits for the chain.
+ */
+int uringblk_bio_rw_kern(struct block_device *bdev, blk_opf_t opf, sector_t sector,
+                         void *buf, size_t len)
+{
+    unsigned int nr_vecs;
+    struct bio *bio = NULL;
+    int ret;
+
+    while (len) {
+        nr_vecs = bio_max_segs(DIV_ROUND_UP(offset_in_page(buf) + len, PAGE_SIZE));
+        bio = blk_next_bio(bio, bdev, nr_vecs, opf, GFP_NOIO);
+        bio->bi_iter.bi_sector = sector;
+
+        while (len) {
+            unsigned int off = offset_in_page(buf);
+            unsigned int n = min_t(size_t, len, PAGE_SIZE - off);
+
+            if (bio_add_page(bio, uringblk_kern_page(buf), n, off) != n)
+                break;
+            buf += n;
+            len -= n;
+            sector += n >> SECTOR_SHIFT;
+        }
+    }
+
+    if (!bio)
+        return 0;
+
+    ret = submit_bio_wait(bio);
+    bio_put(bio);
+    return ret;
+}
+
+/*
+ * IOPOLL support
+ */
+void uringblk_bio_poll_track(struct request *rq, struct bio *bio)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct uringblk_queue *uq = rq->mq_hctx->driver_data;
+    unsigned long flags;
+
+    /* Released by uringblk_bio_poll_done() when the request completes */
+    bio_get(bio);
+    cmd->poll_bio = bio;
+
+    spin_lock_irqsave(&uq->lock, flags);
+    list_add_tail(&cmd->poll_node, &uq->poll_list);
+    spin_unlock_irqrestore(&uq->lock, flags);
+}
+
+void uringblk_bio_poll_done(struct request *rq)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct uringblk_queue *uq = rq->mq_hctx->driver_data;
+    unsigned long flags;
+
+    if (!cmd->poll_bio)
+        return;
+
+    spin_lock_irqsave(&uq->lock, flags);
+    list_del(&cmd->poll_node);
+    spin_unlock_irqrestore(&uq->lock, flags);
+
+    bio_put(cmd->poll_bio);
+    cmd->poll_bio = NULL;
+}
+
+/*
+ * Completions running inside uringblk_bio_poll() on this CPU can join
+ * the poller's batch. Interrupt completions never do.
+ */
+struct io_comp_batch *uringblk_bio_poll_batch(void)
+{
+    if (!in_task())
+        return NULL;
+    return this_cpu_read(uringblk_poll_iob);
+}
+
+/**
+ * uringblk_bio_poll - Poll the lower bios of a poll hctx
+ * @uq: Poll queue context
+ * @iob: Batch of the caller, may be NULL
+ *
+ * Lower completions are reaped into a private batch and finished
+ * before returning, so that the upper requests they complete can be
+ * added to @iob. Returns the number of lower completions found.
+ */
+int uringblk_bio_poll(struct uringblk_queue *uq, struct io_comp_batch *iob)
+{
+    struct bio *bios[URINGBLK_POLL_BATCH];
+    DEFINE_IO_COMP_BATCH(lower);
+    struct uringblk_cmd *cmd;
+    int nr = 0, found = 0, i;
+
+    spin_lock_irq(&uq->lock);
+    list_for_each_entry(cmd, &uq->poll_list, poll_node) {
+        bio_get(cmd->poll_bio);
+        bios[nr++] = cmd->poll_bio;
+        if (nr == URINGBLK_POLL_BATCH)
+            break;
+    }
+    spin_unlock_irq(&uq->lock);
+
+    if (!nr)
+        return 0;
+
+    /* Stay on this CPU while uringblk_poll_iob points at @iob */
+    preempt_disable();
+    this_cpu_write(uringblk_poll_iob, iob);
+    for (i = 0; i < nr; i++)
+        found += bio_poll(bios[i], &lower, BLK_POLL_ONESHOT);
+    if (!rq_list_empty(lower.req_list))
+        lower.complete(&lower);
+    this_cpu_write(uringblk_poll_iob, NULL);
+    preempt_enable();
+
+    for (i = 0; i < nr; i++)
+        bio_put(bios[i]);
+
+    return found;
+}
@@ -0,0 +1,98 @@
+/*
+ * uringblk_ctl.c - Control device for runtime provisioning
+ *
+ * /dev/uringblk-control adds, removes and grows devices without
+ * reloading the module, the way loop-control and ublk-control do.
+ * Every command takes a struct uringblk_ctl_dev, either through an
+ * ioctl or as a URING_CMD whose cmd_op is the ioctl number and whose
+ * sqe->addr points at the struct. Devices other than the one being
+ * changed are not touched.
+ */
+
+#include <linux/module.h>
+#include <linux/miscdevice.h>
+#include <linux/capability.h>
+#include <linux/uaccess.h>
+#include <linux/io_uring.h>
+#include <linux/io_uring/cmd.h>
+
+#include "uringblk_driver.h"
+
+static int uringblk_ctl_run(unsigned int op, void __user *argp)
+{
+    struct uringblk_ctl_dev info;
+    struct uringblk_device *dev;
+    int ret;
+
+    if (!capable(CAP_SYS_ADMIN))
+        return -EPERM;
+    if (copy_from_user(&info, argp, sizeof(info)))
+        return -EFAULT;
+
+    switch (op) {
+    case URINGBLK_CTL_ADD_DEV:
+        ret = uringblk_add_device(&info);
+        if (ret < 0)
+            return ret;
+        info.minor = ret;
+        /* The device exists either way, user space finds it by name */
+        if (copy_to_user(argp, &info, sizeof(info)))
+            return -EFAULT;
+        return 0;
+    case URINGBLK_CTL_DEL_DEV:
+        return uringblk_remove_device(info.minor);
+    case URINGBLK_CTL_RESIZE_DEV:
+        dev = uringblk_device_get(info.minor);
+        if (!dev)
+            return -ENODEV;
+        ret = uringblk_resize_device(dev, info.capacity);
+        uringblk_device_put(dev);
+        return ret;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static long uringblk_ctl_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    return uringblk_ctl_run(cmd, (void __user *)arg);
+}
+
+static int uringblk_ctl_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+    /* Creating and tearing down devices sleeps, let io-wq run it */
+    if (issue_flags & IO_URING_F_NONBLOCK)
+        return -EAGAIN;
+
+    return uringblk_ctl_run(ioucmd->cmd_op, u64_to_user_ptr(READ_ONCE(ioucmd->sqe->addr)));
+}
+
+static const struct file_operations uringblk_ctl_fops = {
+    .owner = THIS_MODULE,
+    .open = nonseekable_open,
+    .unlocked_ioctl = uringblk_ctl_ioctl,
+    .compat_ioctl = uringblk_ctl_ioctl,
+    .uring_cmd = uringblk_ctl_uring_cmd,
+    .llseek = noop_llseek,
+};
+
+static struct miscdevice uringblk_ctl_misc = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = "uringblk-control",
+    .fops = &uringblk_ctl_fops,
+};
+
+int uringblk_ctl_init(void)
+{
+    int ret;
+
+    ret = misc_register(&uringblk_ctl_misc);
+    if (ret)
+        pr_err("uringblk: failed to register /dev/uringblk-control: %d\n", ret);
+    return ret;
+}
+
+void uringblk_ctl_exit(void)
+{
+    misc_deregister(&uringblk_ctl_misc);
+}
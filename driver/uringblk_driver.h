@@ -11,9 +11,16 @@
 #include <linux/types.h>
 #include <linux/ioctl.h>
 #include <linux/version.h>
+#include <linux/bio.h>
 #include <linux/blk-mq.h>
 #include <linux/blkdev.h>
+#include <linux/fs.h>
 #include <linux/io_uring.h>
+#include <linux/kref.h>
+#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/seqlock.h>
 
 /* Device constants */
 #define URINGBLK_DEVICE_NAME    "uringblk"
@@ -46,8 +53,51 @@ enum uringblk_ucmd {
     URINGBLK_UCMD_GET_STATS     = 0x06,
     URINGBLK_UCMD_ZONE_MGMT     = 0x10,
     URINGBLK_UCMD_FIRMWARE_OP   = 0x20,
+    /* Data commands (ABI 1.3), sqe->cmd holds a struct uringblk_io_cmd */
+    URINGBLK_UCMD_READ          = 0x40,
+    URINGBLK_UCMD_WRITE         = 0x41,
+    URINGBLK_UCMD_WRITE_ZEROES  = 0x42,
+    URINGBLK_UCMD_FLUSH         = 0x43,
+    URINGBLK_UCMD_READV         = 0x44,
+    URINGBLK_UCMD_WRITEV        = 0x45,
 };
 
+/*
+ * Data command, the buffer is given in sqe->addr and sqe->len (an
+ * iovec array and its length for READV/WRITEV). Set
+ * IORING_URING_CMD_FIXED and sqe->buf_index to use a registered buffer.
+ */
+struct uringblk_io_cmd {
+    __u16 opcode;           /* URINGBLK_UCMD_READ .. URINGBLK_UCMD_WRITEV */
+    __u16 flags;            /* URINGBLK_IO_F_* */
+    __u32 rsvd;
+    __u64 sector;           /* Start in 512-byte sectors */
+} __packed;
+
+#define URINGBLK_IO_F_FUA       (1U << 0)   /* Writes: forced unit access */
+#define URINGBLK_IO_F_BULK      (1U << 1)   /* Writes: bulk class, see bulk_write_mbps */
+#define URINGBLK_IO_F_ATOMIC    (1U << 2)   /* Writes: fail unless all or nothing */
+
+/*
+ * Control device (/dev/uringblk-control): add, remove and resize devices
+ * at runtime. Each command is an ioctl, or a URING_CMD with cmd_op set
+ * to the ioctl number and sqe->addr pointing at the struct. Needs
+ * CAP_SYS_ADMIN. backend_type is 0=virtual, 1=device, 2=stripe,
+ * 3=mirror or 4=file.
+ */
+struct uringblk_ctl_dev {
+    __u32 minor;            /* ADD: set on return; DEL, RESIZE: the device */
+    __u32 backend_type;     /* ADD */
+    __u32 nr_hw_queues;     /* ADD: 0 for the module default */
+    __u32 queue_depth;      /* ADD: 0 for the module default */
+    __u64 capacity;         /* ADD: bytes, 0 for the default; RESIZE: new size */
+    char  backend_path[256]; /* ADD: device, members or file */
+} __packed;
+
+#define URINGBLK_CTL_ADD_DEV    _IOWR(URINGBLK_URING_CMD_IO, 0x80, struct uringblk_ctl_dev)
+#define URINGBLK_CTL_DEL_DEV    _IOW(URINGBLK_URING_CMD_IO, 0x81, struct uringblk_ctl_dev)
+#define URINGBLK_CTL_RESIZE_DEV _IOW(URINGBLK_URING_CMD_IO, 0x82, struct uringblk_ctl_dev)
+
 /* URING_CMD header structure */
 struct uringblk_ucmd_hdr {
     __u16 abi_major;
@@ -90,6 +140,40 @@ struct uringblk_limits {
     __u32 io_opt;
     __u32 discard_granularity;
     __u64 discard_max_bytes;
+    /* ABI 1.5 */
+    __u32 atomic_write_unit_min; /* Bytes, 0 without atomic writes */
+    __u32 atomic_write_unit_max;
+    __u32 atomic_write_max_bytes;
+    __u32 atomic_write_boundary; /* Writes crossing it are not atomic */
+} __packed;
+
+/* ZONE_MGMT actions */
+enum uringblk_zone_action {
+    URINGBLK_ZONE_REPORT        = 0,
+    URINGBLK_ZONE_RESET         = 1,
+    URINGBLK_ZONE_OPEN          = 2,
+    URINGBLK_ZONE_CLOSE         = 3,
+    URINGBLK_ZONE_FINISH        = 4,
+    URINGBLK_ZONE_RESET_ALL     = 5,
+};
+
+/* ZONE_MGMT request (ABI 1.2), a REPORT buffer continues with the descriptors */
+struct uringblk_zone_mgmt {
+    __u8  action;           /* enum uringblk_zone_action */
+    __u8  rsvd[3];
+    __u32 nr_zones;         /* REPORT: descriptors wanted */
+    __u64 sector;           /* Zone start, or where a REPORT begins */
+} __packed;
+
+/* ZONE_MGMT report entry, sectors are 512 bytes */
+struct uringblk_zone_desc {
+    __u64 start;
+    __u64 len;
+    __u64 capacity;
+    __u64 wp;
+    __u8  type;             /* BLK_ZONE_TYPE_* */
+    __u8  cond;             /* BLK_ZONE_COND_* */
+    __u8  rsvd[6];
 } __packed;
 
 /* Feature flags */
@@ -100,6 +184,8 @@ struct uringblk_limits {
 #define URINGBLK_FEAT_WRITE_ZEROES  (1ULL << 4)
 #define URINGBLK_FEAT_ZONED         (1ULL << 5)
 #define URINGBLK_FEAT_POLLING       (1ULL << 6)
+#define URINGBLK_FEAT_ATOMIC_WRITE  (1ULL << 7)
+#define URINGBLK_FEAT_INTEGRITY     (1ULL << 8)
 
 /* GET_GEOMETRY response */
 struct uringblk_geometry {
@@ -128,6 +214,17 @@ struct uringblk_stats {
     __u32 p99_read_latency_us;
     __u32 p50_write_latency_us;
     __u32 p99_write_latency_us;
+    /* ABI 1.1 */
+    __u32 p90_read_latency_us;
+    __u32 p999_read_latency_us;
+    __u32 max_read_latency_us;
+    __u32 p90_write_latency_us;
+    __u32 p999_write_latency_us;
+    __u32 max_write_latency_us;
+    /* ABI 1.4 */
+    __u64 cache_hits;
+    __u64 cache_misses;
+    __u64 cache_promotions;
 } __packed;
 
 #ifdef __KERNEL__
@@ -136,6 +233,10 @@ struct uringblk_stats {
 enum uringblk_backend_type {
     URINGBLK_BACKEND_VIRTUAL = 0,  /* In-memory virtual storage */
     URINGBLK_BACKEND_DEVICE = 1,   /* Real block device */
+    URINGBLK_BACKEND_STRIPE = 2,   /* RAID-0 over several block devices */
+    URINGBLK_BACKEND_MIRROR = 3,   /* RAID-1 over two or three block devices */
+    URINGBLK_BACKEND_FILE = 4,     /* Regular file on a filesystem */
+    URINGBLK_BACKEND_EMUL = 5,     /* In-memory storage with emulated timing */
 };
 
 /* Forward declaration */
@@ -149,6 +250,10 @@ struct uringblk_backend_ops {
     int (*write)(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len);
     int (*flush)(struct uringblk_backend *backend);
     int (*discard)(struct uringblk_backend *backend, loff_t pos, size_t len);
+    /* Optional: take over a started request and complete it asynchronously */
+    blk_status_t (*queue_rq)(struct uringblk_backend *backend, struct request *rq);
+    /* Optional: grow to @capacity bytes while I/O is running */
+    int (*resize)(struct uringblk_backend *backend, size_t capacity);
 };
 
 struct uringblk_backend {
@@ -156,12 +261,15 @@ struct uringblk_backend {
     const struct uringblk_backend_ops *ops;
     void *private_data;
     size_t capacity;
-    struct mutex io_mutex;
+    size_t reserved;               /* Bytes after capacity holding driver metadata */
+    unsigned int io_min;           /* Preferred I/O sizes in bytes, 0 for the defaults */
+    unsigned int io_opt;
 };
 
 /* Driver configuration */
 struct uringblk_config {
     unsigned int nr_hw_queues;
+    unsigned int nr_poll_queues;   /* Extra HCTX_TYPE_POLL queues */
     unsigned int queue_depth;
     bool enable_poll;
     bool enable_discard;
@@ -169,6 +277,7 @@ struct uringblk_config {
     bool zoned_mode;
     enum uringblk_backend_type backend_type;
     char backend_device[256];
+    size_t capacity;               /* Bytes, 0 for capacity_mb or the size of the backend */
 };
 
 /* Per-device structure */
@@ -176,15 +285,19 @@ struct uringblk_device {
     struct gendisk *disk;
     struct blk_mq_tag_set tag_set;
     struct uringblk_config config;
-    struct uringblk_stats stats;
-    spinlock_t stats_lock;
-    
-    /* Latency tracking */
-    u32 latency_buckets[32]; /* Simple histogram for latency tracking */
-    spinlock_t latency_lock;
+    struct uringblk_stats stats;   /* Rare event counters, I/O counters are per hctx */
+    struct uringblk_stats stats_base; /* Per-hctx totals at the last reset */
+    seqlock_t stats_seq;           /* Readers of stats and stats_base do not lock */
     
     /* Storage backend */
     struct uringblk_backend backend;
+    struct bio_set bio_set;        /* Clones issued to lower devices */
+    struct uringblk_zoned *zoned;  /* Zone state when zoned_mode is set */
+    struct uringblk_wbcache *wbcache; /* Write-back cache when wb_cache_mb is set */
+    struct uringblk_flashcache *flashcache; /* Read cache tier when flash_cache_* is set */
+    struct uringblk_sched *sched;  /* Bulk I/O token bucket when bulk_write_mbps is set */
+    struct uringblk_atomic *atomic; /* Atomic write journal when atomic_write_kb is set */
+    struct uringblk_integrity *integrity; /* Block tags when integrity_tags is set */
     
     /* Features */
     u64 features;
@@ -193,12 +306,92 @@ struct uringblk_device {
     char model[40];
     char firmware[16];
     
-    struct mutex admin_mutex;
+    struct mutex admin_mutex;      /* Serialises commands that change the device */
+    seqcount_mutex_t admin_seq;    /* Lets readers of what they change go lockless */
     int major;
     int minor;
     
     /* Admin interface */
     struct device *admin_device;   /* Admin char device node */
+
+    struct kref ref;               /* Device table and open admin nodes */
+    bool deleting;                 /* Being removed, under admin_mutex */
+};
+
+/* Feature bitmap as last set by SET_FEATURES, without taking admin_mutex */
+static inline u64 uringblk_features(struct uringblk_device *dev)
+{
+    unsigned int seq;
+    u64 features;
+
+    do {
+        seq = read_seqcount_begin(&dev->admin_seq);
+        features = dev->features;
+    } while (read_seqcount_retry(&dev->admin_seq, seq));
+    return features;
+}
+
+/* Per-request driver data (tag_set.cmd_size) */
+struct uringblk_cmd {
+    atomic_t pending;              /* Lower bios in flight, +1 while submitting */
+    blk_status_t status;           /* First lower error */
+    u64 start_ns;                  /* Dispatch time for the latency histograms */
+    struct bio *poll_bio;          /* Referenced lower bio polled for REQ_POLLED requests */
+    struct list_head poll_node;    /* On uringblk_queue.poll_list */
+    struct kiocb iocb;             /* File backend I/O */
+    struct bio_vec *bvec;          /* Joined bvec table of a multi-bio file request */
+    struct hrtimer timer;          /* Completion of an emulated request */
+};
+
+/*
+ * Latency histograms are log-linear over nanoseconds: values below
+ * URINGBLK_LAT_SUB get a bucket each, then every power of two is split
+ * into URINGBLK_LAT_SUB buckets (12.5% resolution). Anything above
+ * 2^(URINGBLK_LAT_MAX_SHIFT + 1) ns lands in the last bucket.
+ */
+#define URINGBLK_LAT_SUB_BITS   3
+#define URINGBLK_LAT_SUB        (1 << URINGBLK_LAT_SUB_BITS)
+#define URINGBLK_LAT_MAX_SHIFT  36
+#define URINGBLK_LAT_BUCKETS    ((URINGBLK_LAT_MAX_SHIFT - URINGBLK_LAT_SUB_BITS + 2) * URINGBLK_LAT_SUB)
+
+enum uringblk_lat_op {
+    URINGBLK_LAT_READ,
+    URINGBLK_LAT_WRITE,
+    URINGBLK_LAT_FLUSH,
+    URINGBLK_LAT_DISCARD,
+    URINGBLK_LAT_NR,
+};
+
+/*
+ * Latency histograms of one hardware queue. A queue's completions run
+ * on few CPUs, so one copy under a lock beats one per possible CPU.
+ */
+struct uringblk_lat_hist {
+    spinlock_t lock;               /* Serializes the writers of syncp */
+    struct u64_stats_sync syncp;
+    u64_stats_t buckets[URINGBLK_LAT_NR][URINGBLK_LAT_BUCKETS];
+    u64_stats_t max_ns[URINGBLK_LAT_NR];
+};
+
+/* Percentiles of one histogram, in nanoseconds */
+struct uringblk_lat_summary {
+    u64 count;
+    u64 p50;
+    u64 p90;
+    u64 p99;
+    u64 p999;
+    u64 max;
+};
+
+/* Per-CPU request counters of one hardware queue */
+struct uringblk_qstats {
+    u64_stats_t read_ops;
+    u64_stats_t write_ops;
+    u64_stats_t flush_ops;
+    u64_stats_t discard_ops;
+    u64_stats_t read_bytes;
+    u64_stats_t write_bytes;
+    struct u64_stats_sync syncp;
 };
 
 /* Per-queue context */
@@ -206,13 +399,26 @@ struct uringblk_queue {
     struct uringblk_device *dev;
     struct blk_mq_hw_ctx *hctx;
     unsigned int queue_num;
-    spinlock_t lock;
+    spinlock_t lock;               /* Protects poll_list and deferred */
+    struct list_head poll_list;    /* Polled requests waiting on lower bios */
+    struct bio_list deferred;      /* Lower bios waiting for the end of the batch */
+    unsigned int nr_deferred;
+    struct list_head bulk_list;    /* Bulk requests waiting for tokens, under lock */
+    struct delayed_work bulk_work; /* Dispatches them once the bucket has refilled */
+    struct uringblk_qstats __percpu *stats;
+    struct uringblk_lat_hist *lat;
 };
 
 /* Function declarations */
 int uringblk_init_device(struct uringblk_device *dev, int minor);
 void uringblk_cleanup_device(struct uringblk_device *dev);
+struct uringblk_device *uringblk_device_get(unsigned int minor);
+void uringblk_device_put(struct uringblk_device *dev);
+int uringblk_add_device(const struct uringblk_ctl_dev *info);
+int uringblk_remove_device(unsigned int minor);
+int uringblk_resize_device(struct uringblk_device *dev, u64 capacity);
 int uringblk_handle_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags);
+blk_status_t uringblk_run_rq(struct uringblk_queue *uq, struct request *rq);
 blk_status_t uringblk_handle_uring_cmd_request(struct request *rq, struct uringblk_device *dev);
 int uringblk_poll(struct blk_mq_hw_ctx *hctx, struct io_uring_cmd *ioucmd);
 
@@ -223,6 +429,109 @@ int uringblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
                        unsigned int hctx_idx);
 void uringblk_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx);
 int uringblk_poll_fn(struct blk_mq_hw_ctx *hctx, struct io_comp_batch *iob);
+void uringblk_complete_rq(struct request *rq, blk_status_t status);
+
+/* Lower device remapping (uringblk_bio.c) */
+int uringblk_bio_init(struct uringblk_device *dev);
+void uringblk_bio_exit(struct uringblk_device *dev);
+void uringblk_cmd_start(struct request *rq);
+void uringblk_cmd_set_error(struct request *rq, blk_status_t status);
+void uringblk_cmd_put(struct request *rq);
+void uringblk_bio_submit(struct request *rq, struct bio *bio);
+struct blk_plug *uringblk_plug_begin(struct blk_plug *plug);
+void uringblk_plug_end(struct blk_plug *plug, struct blk_plug *outer);
+void uringblk_bio_commit(struct uringblk_queue *uq);
+void uringblk_bio_endio(struct bio *bio);
+struct bio *uringblk_bio_clone(struct uringblk_device *dev, struct bio *src,
+                               struct block_device *bdev, sector_t sector);
+blk_status_t uringblk_bio_remap_rq(struct uringblk_device *dev,
+                                   struct request *rq,
+                                   struct block_device *bdev);
+int uringblk_bio_rw_kern(struct block_device *bdev, blk_opf_t opf, sector_t sector,
+                         void *buf, size_t len);
+int uringblk_bio_open_members(const char *paths, struct bdev_handle **members,
+                              unsigned int max);
+void uringblk_bio_release_members(struct bdev_handle **members, unsigned int nr);
+void uringblk_bio_poll_track(struct request *rq, struct bio *bio);
+void uringblk_bio_poll_done(struct request *rq);
+int uringblk_bio_poll(struct uringblk_queue *uq, struct io_comp_batch *iob);
+struct io_comp_batch *uringblk_bio_poll_batch(void);
+
+/* Zoned emulation (uringblk_zoned.c) */
+bool uringblk_zoned_enabled(void);
+int uringblk_zoned_init(struct uringblk_device *dev);
+void uringblk_zoned_exit(struct uringblk_device *dev);
+int uringblk_zoned_setup_queue(struct uringblk_device *dev);
+blk_status_t uringblk_zoned_prep_rq(struct uringblk_device *dev, struct request *rq);
+blk_status_t uringblk_zoned_mgmt(struct uringblk_device *dev, enum req_op op, sector_t sector);
+int uringblk_report_zones(struct gendisk *disk, sector_t sector,
+                          unsigned int nr_zones, report_zones_cb cb, void *data);
+
+/* Write-back cache (uringblk_wbcache.c) */
+bool uringblk_wbcache_enabled(void);
+int uringblk_wbcache_init(struct uringblk_device *dev);
+void uringblk_wbcache_exit(struct uringblk_device *dev);
+bool uringblk_wbcache_queue_rq(struct uringblk_device *dev, struct request *rq,
+                              blk_status_t *status);
+
+/* Read cache tier (uringblk_flashcache.c) */
+bool uringblk_flashcache_enabled(void);
+int uringblk_flashcache_init(struct uringblk_device *dev);
+void uringblk_flashcache_exit(struct uringblk_device *dev);
+bool uringblk_flashcache_queue_rq(struct uringblk_device *dev, struct request *rq);
+void uringblk_flashcache_write_done(struct uringblk_device *dev, struct request *rq);
+void uringblk_flashcache_stats(struct uringblk_device *dev, struct uringblk_stats *out);
+void uringblk_flashcache_stats_reset(struct uringblk_device *dev);
+
+/* Latency and bulk I/O classes (uringblk_sched.c) */
+bool uringblk_sched_enabled(void);
+int uringblk_sched_init(struct uringblk_device *dev);
+void uringblk_sched_exit(struct uringblk_device *dev);
+void uringblk_sched_init_queue(struct uringblk_queue *uq);
+void uringblk_sched_exit_queue(struct uringblk_queue *uq);
+bool uringblk_sched_hold(struct uringblk_queue *uq, struct request *rq);
+
+/* Atomic writes (uringblk_atomic.c) */
+bool uringblk_atomic_enabled(void);
+int uringblk_atomic_init(struct uringblk_device *dev);
+void uringblk_atomic_exit(struct uringblk_device *dev);
+void uringblk_atomic_setup_queue(struct uringblk_device *dev);
+void uringblk_atomic_limits(struct uringblk_device *dev, struct uringblk_limits *limits);
+bool uringblk_atomic_fits(struct uringblk_device *dev, sector_t sector, u32 len);
+bool uringblk_atomic_queue_rq(struct uringblk_device *dev, struct request *rq);
+
+/* Integrity tags (uringblk_integrity.c) */
+bool uringblk_integrity_enabled(void);
+int uringblk_integrity_init(struct uringblk_device *dev);
+void uringblk_integrity_exit(struct uringblk_device *dev);
+void uringblk_integrity_setup_queue(struct uringblk_device *dev);
+bool uringblk_integrity_queue_rq(struct uringblk_device *dev, struct request *rq,
+                                blk_status_t *status);
+
+/* Striped backend (uringblk_stripe.c) */
+extern const struct uringblk_backend_ops uringblk_stripe_ops;
+int uringblk_stripe_init(struct uringblk_backend *backend, const char *paths, size_t capacity);
+
+/* Mirrored backend (uringblk_mirror.c) */
+extern const struct uringblk_backend_ops uringblk_mirror_ops;
+int uringblk_mirror_init(struct uringblk_backend *backend, const char *paths, size_t capacity);
+
+/* File backend (uringblk_file.c) */
+extern const struct uringblk_backend_ops uringblk_file_ops;
+int uringblk_file_init(struct uringblk_backend *backend, const char *path, size_t capacity);
+
+/* Emulated backend (uringblk_emul.c) */
+extern const struct uringblk_backend_ops uringblk_emul_ops;
+int uringblk_emul_init(struct uringblk_backend *backend, const char *path, size_t capacity);
+int uringblk_virtual_init(struct uringblk_backend *backend, size_t capacity);
+
+/* Control device (uringblk_ctl.c) */
+int uringblk_ctl_init(void);
+void uringblk_ctl_exit(void);
+
+/* Data commands over URING_CMD (uringblk_passthru.c) */
+int uringblk_pt_cmd(struct uringblk_device *dev, struct io_uring_cmd *ioucmd,
+                    unsigned int issue_flags);
 
 /* Block device file operations */
 int uringblk_open(struct gendisk *disk, blk_mode_t mode);
@@ -236,9 +545,11 @@ int uringblk_cmd_get_features(struct uringblk_device *dev, void __user *argp, u3
 int uringblk_cmd_set_features(struct uringblk_device *dev, void __user *argp, u32 len);
 int uringblk_cmd_get_geometry(struct uringblk_device *dev, void __user *argp, u32 len);
 int uringblk_cmd_get_stats(struct uringblk_device *dev, void __user *argp, u32 len);
+int uringblk_cmd_zone_mgmt(struct uringblk_device *dev, void __user *argp, u32 len);
 
 /* Module parameters */
 extern unsigned int uringblk_nr_hw_queues;
+extern unsigned int uringblk_poll_queues;
 extern unsigned int uringblk_queue_depth;
 extern bool uringblk_enable_poll;
 extern bool uringblk_enable_discard;
@@ -251,13 +562,31 @@ extern bool uringblk_auto_detect_size;
 extern int uringblk_max_devices;
 extern char *uringblk_devices;
 
+/* Statistics (uringblk_stats.c) */
+int uringblk_queue_stats_alloc(struct uringblk_queue *uq);
+void uringblk_queue_stats_free(struct uringblk_queue *uq);
+void uringblk_stats_account(struct uringblk_queue *uq, struct request *rq);
+void uringblk_queue_stats_sum(struct uringblk_queue *uq, struct uringblk_stats *out);
+void uringblk_stats_snapshot(struct uringblk_device *dev, struct uringblk_stats *out);
+void uringblk_stats_reset(struct uringblk_device *dev);
+void uringblk_stats_media_error(struct uringblk_device *dev, unsigned int nr);
+void uringblk_lat_record(struct uringblk_queue *uq, struct request *rq, u64 lat_ns);
+int uringblk_lat_summary(struct uringblk_device *dev, struct uringblk_queue *uq,
+                         enum uringblk_lat_op op, struct uringblk_lat_summary *out);
+
 /* Sysfs functions */
 int uringblk_sysfs_create(struct gendisk *disk);
 void uringblk_sysfs_remove(struct gendisk *disk);
 
 /* ABI version */
 #define URINGBLK_ABI_MAJOR  1
-#define URINGBLK_ABI_MINOR  0
+#define URINGBLK_ABI_MINOR  5
+
+/* GET_STATS replies are truncated to the caller's length, down to ABI 1.0 */
+#define URINGBLK_STATS_SIZE_V1_0 offsetofend(struct uringblk_stats, p99_write_latency_us)
+
+/* So are GET_LIMITS replies */
+#define URINGBLK_LIMITS_SIZE_V1_0 offsetofend(struct uringblk_limits, discard_max_bytes)
 
 #endif /* __KERNEL__ */
 
@@ -0,0 +1,318 @@
+/*
+ * uringblk_emul.c - Emulated device backend
+ *
+ * backend_type=5 keeps its data in RAM like the virtual backend, but
+ * completes requests from an hrtimer at the time a device with the
+ * configured behaviour would have:
+ *
+ *  - a service time per operation (emul_read_us, emul_write_us,
+ *    emul_flush_us), spread uniformly by emul_jitter_pct and replaced
+ *    by emul_tail_us for emul_tail_ppm of the requests,
+ *  - IOPS and bandwidth caps (emul_iops, emul_mbps), which queue
+ *    requests behind each other once they are reached,
+ *  - a garbage collection pause of emul_gc_pause_ms every
+ *    emul_gc_interval_ms, completions falling into it wait for its end,
+ *  - media errors on emul_error_ppm of the reads and writes, which
+ *    leave the data untouched and count in media_errors.
+ *
+ * Random choices come from a per-device generator seeded with
+ * emul_seed, so a benchmark issuing the same requests in the same order
+ * sees the same latencies. The parameters can be changed at runtime and
+ * apply to requests queued afterwards. The synchronous ops used by the
+ * caches and tags are not delayed.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/prandom.h>
+#include <linux/slab.h>
+
+#include "uringblk_driver.h"
+
+static unsigned int emul_read_us = 80;
+module_param(emul_read_us, uint, 0644);
+MODULE_PARM_DESC(emul_read_us, "Emulated read service time in us (default: 80)");
+
+static unsigned int emul_write_us = 20;
+module_param(emul_write_us, uint, 0644);
+MODULE_PARM_DESC(emul_write_us, "Emulated write, discard and write zeroes service time in us (default: 20)");
+
+static unsigned int emul_flush_us = 500;
+module_param(emul_flush_us, uint, 0644);
+MODULE_PARM_DESC(emul_flush_us, "Emulated flush service time in us (default: 500)");
+
+static unsigned int emul_jitter_pct = 10;
+module_param(emul_jitter_pct, uint, 0644);
+MODULE_PARM_DESC(emul_jitter_pct, "Service times vary uniformly by this percentage either way (default: 10)");
+
+static unsigned int emul_tail_ppm;
+module_param(emul_tail_ppm, uint, 0644);
+MODULE_PARM_DESC(emul_tail_ppm, "Requests per million taking emul_tail_us instead (default: 0)");
+
+static unsigned int emul_tail_us = 5000;
+module_param(emul_tail_us, uint, 0644);
+MODULE_PARM_DESC(emul_tail_us, "Service time of tail requests in us (default: 5000)");
+
+static unsigned int emul_iops;
+module_param(emul_iops, uint, 0644);
+MODULE_PARM_DESC(emul_iops, "Emulated IOPS cap, 0 for none (default: 0)");
+
+static unsigned int emul_mbps;
+module_param(emul_mbps, uint, 0644);
+MODULE_PARM_DESC(emul_mbps, "Emulated bandwidth cap in MB/s, 0 for none (default: 0)");
+
+static unsigned int emul_gc_interval_ms;
+module_param(emul_gc_interval_ms, uint, 0644);
+MODULE_PARM_DESC(emul_gc_interval_ms, "Period of emulated garbage collection pauses in ms, 0 for none (default: 0)");
+
+static unsigned int emul_gc_pause_ms = 10;
+module_param(emul_gc_pause_ms, uint, 0644);
+MODULE_PARM_DESC(emul_gc_pause_ms, "Length of an emulated garbage collection pause in ms (default: 10)");
+
+static unsigned int emul_error_ppm;
+module_param(emul_error_ppm, uint, 0644);
+MODULE_PARM_DESC(emul_error_ppm, "Reads and writes per million failing with a media error (default: 0)");
+
+static unsigned int emul_seed = 1;
+module_param(emul_seed, uint, 0444);
+MODULE_PARM_DESC(emul_seed, "Seed of the emulation's random choices (default: 1)");
+
+struct uringblk_emul {
+    struct uringblk_backend store; /* Virtual backend holding the data */
+    spinlock_t lock;               /* Protects the fields below */
+    struct rnd_state rnd;
+    u64 iops_next;                 /* When the IOPS cap admits the next request */
+    u64 bw_next;                   /* When the bandwidth cap admits the next byte */
+    u64 origin;                    /* Start of the first GC period */
+};
+
+/* A uniformly distributed value below @range */
+static u32 emul_rand(struct uringblk_emul *e, u32 range)
+{
+    return range ? prandom_u32_state(&e->rnd) % range : 0;
+}
+
+static u64 emul_service_ns(struct uringblk_emul *e, struct request *rq)
+{
+    unsigned int pct = min(READ_ONCE(emul_jitter_pct), 100U);
+    u64 us;
+
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+        us = READ_ONCE(emul_read_us);
+        break;
+    case REQ_OP_FLUSH:
+        us = READ_ONCE(emul_flush_us);
+        break;
+    default:
+        us = READ_ONCE(emul_write_us);
+        break;
+    }
+
+    if (emul_rand(e, 1000000) < READ_ONCE(emul_tail_ppm))
+        return (u64)READ_ONCE(emul_tail_us) * NSEC_PER_USEC;
+    return div_u64(us * NSEC_PER_USEC * (100 - pct + emul_rand(e, 2 * pct + 1)), 100);
+}
+
+/*
+ * When @rq completes. Requests are admitted by the caps in the order
+ * they are queued, then take their service time, then wait out a GC
+ * pause they end up in.
+ */
+static u64 emul_schedule(struct uringblk_emul *e, struct request *rq, bool *fail)
+{
+    unsigned int iops = READ_ONCE(emul_iops);
+    unsigned int mbps = READ_ONCE(emul_mbps);
+    unsigned int gc_interval = READ_ONCE(emul_gc_interval_ms);
+    unsigned int bytes = req_op(rq) == REQ_OP_READ || req_op(rq) == REQ_OP_WRITE ?
+                         blk_rq_bytes(rq) : 0;
+    u64 now = ktime_get_ns();
+    unsigned long flags;
+    u64 start, done;
+
+    spin_lock_irqsave(&e->lock, flags);
+    start = now;
+    if (iops) {
+        start = max(start, e->iops_next);
+        e->iops_next = start + div_u64(NSEC_PER_SEC, iops);
+    }
+    if (mbps && bytes) {
+        start = max(start, e->bw_next);
+        e->bw_next = start + div64_u64((u64)bytes * NSEC_PER_SEC, (u64)mbps << 20);
+        start = e->bw_next;
+    }
+    done = start + emul_service_ns(e, rq);
+
+    if (gc_interval) {
+        u64 period = (u64)gc_interval * NSEC_PER_MSEC;
+        u64 pause = min_t(u64, (u64)READ_ONCE(emul_gc_pause_ms) * NSEC_PER_MSEC, period);
+        u64 phase;
+
+        div64_u64_rem(done - e->origin, period, &phase);
+        if (phase < pause)
+            done += pause - phase;
+    }
+
+    *fail = bytes && emul_rand(e, 1000000) < READ_ONCE(emul_error_ppm);
+    spin_unlock_irqrestore(&e->lock, flags);
+    return done;
+}
+
+static enum hrtimer_restart emul_timer_done(struct hrtimer *timer)
+{
+    struct uringblk_cmd *cmd = container_of(timer, struct uringblk_cmd, timer);
+
+    uringblk_complete_rq(blk_mq_rq_from_pdu(cmd), cmd->status);
+    return HRTIMER_NORESTART;
+}
+
+static int emul_copy(struct uringblk_backend *store, struct request *rq)
+{
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    int ret;
+
+    rq_for_each_segment(bvec, rq, iter) {
+        void *buffer = page_address(bvec.bv_page) + bvec.bv_offset;
+
+        if (req_op(rq) == REQ_OP_READ)
+            ret = store->ops->read(store, pos, buffer, bvec.bv_len);
+        else
+            ret = store->ops->write(store, pos, buffer, bvec.bv_len);
+        if (ret < 0)
+            return ret;
+        pos += bvec.bv_len;
+    }
+    return 0;
+}
+
+/* The data moves at once, the completion waits for the emulated device */
+static blk_status_t emul_queue_rq(struct uringblk_backend *backend, struct request *rq)
+{
+    struct uringblk_device *dev = container_of(backend, struct uringblk_device, backend);
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct uringblk_emul *e = backend->private_data;
+    bool fail;
+    u64 done;
+    int ret = 0;
+
+    done = emul_schedule(e, rq, &fail);
+
+    if (fail) {
+        uringblk_stats_media_error(dev, 1);
+        cmd->status = BLK_STS_MEDIUM;
+    } else {
+        switch (req_op(rq)) {
+        case REQ_OP_READ:
+        case REQ_OP_WRITE:
+            ret = emul_copy(&e->store, rq);
+            break;
+        case REQ_OP_DISCARD:
+        case REQ_OP_WRITE_ZEROES:
+            ret = e->store.ops->discard(&e->store, (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT,
+                                        blk_rq_bytes(rq));
+            break;
+        default:
+            break;
+        }
+        cmd->status = ret < 0 ? BLK_STS_IOERR : BLK_STS_OK;
+    }
+
+    hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    cmd->timer.function = emul_timer_done;
+    hrtimer_start(&cmd->timer, ns_to_ktime(done), HRTIMER_MODE_ABS);
+    return BLK_STS_OK;
+}
+
+int uringblk_emul_init(struct uringblk_backend *backend, const char *path, size_t capacity)
+{
+    struct uringblk_emul *e;
+    int ret;
+
+    e = kzalloc(sizeof(*e), GFP_KERNEL);
+    if (!e)
+        return -ENOMEM;
+
+    ret = uringblk_virtual_init(&e->store, capacity);
+    if (ret) {
+        kfree(e);
+        return ret;
+    }
+
+    spin_lock_init(&e->lock);
+    prandom_seed_state(&e->rnd, emul_seed);
+    e->origin = ktime_get_ns();
+
+    backend->private_data = e;
+    backend->capacity = e->store.capacity;
+    backend->type = URINGBLK_BACKEND_EMUL;
+    backend->ops = &uringblk_emul_ops;
+
+    pr_info("uringblk: emulated device, %zu MB, read %u us, write %u us, %u IOPS, %u MB/s\n",
+            backend->capacity >> 20, emul_read_us, emul_write_us, emul_iops, emul_mbps);
+    return 0;
+}
+
+static void emul_cleanup(struct uringblk_backend *backend)
+{
+    struct uringblk_emul *e = backend->private_data;
+
+    if (!e)
+        return;
+
+    e->store.ops->cleanup(&e->store);
+    kfree(e);
+    backend->private_data = NULL;
+}
+
+static int emul_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len)
+{
+    struct uringblk_emul *e = backend->private_data;
+
+    return e->store.ops->read(&e->store, pos, buf, len);
+}
+
+static int emul_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len)
+{
+    struct uringblk_emul *e = backend->private_data;
+
+    return e->store.ops->write(&e->store, pos, buf, len);
+}
+
+static int emul_flush(struct uringblk_backend *backend)
+{
+    return 0;
+}
+
+static int emul_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
+{
+    struct uringblk_emul *e = backend->private_data;
+
+    return e->store.ops->discard(&e->store, pos, len);
+}
+
+static int emul_resize(struct uringblk_backend *backend, size_t capacity)
+{
+    struct uringblk_emul *e = backend->private_data;
+    int ret;
+
+    ret = e->store.ops->resize(&e->store, capacity);
+    if (!ret)
+        WRITE_ONCE(backend->capacity, capacity);
+    return ret;
+}
+
+const struct uringblk_backend_ops uringblk_emul_ops = {
+    .init = uringblk_emul_init,
+    .cleanup = emul_cleanup,
+    .read = emul_read,
+    .write = emul_write,
+    .flush = emul_flush,
+    .discard = emul_discard,
+    .queue_rq = emul_queue_rq,
+    .resize = emul_resize,
+};
@@ -0,0 +1,380 @@
+/*
+ * uringblk_file.c - Backend on a regular file
+ *
+ * backend_type=4 serves the device from a file on an existing
+ * filesystem, so test and staging devices persist on hosts without a
+ * spare disk. The file is created if missing. With auto_detect_size the
+ * device takes the size of the file, otherwise the file is extended
+ * (sparsely) to capacity_mb.
+ *
+ * Reads and writes are issued as asynchronous kiocbs straight on the
+ * request pages, the way loop does it. When the filesystem can do
+ * direct I/O at the device logical block size the kiocbs carry
+ * IOCB_DIRECT: the page cache is bypassed and the request completes
+ * from the filesystem's own bio completion. Other files fall back to
+ * buffered I/O, which completes inline.
+ *
+ * FUA writes are issued with IOCB_DSYNC and flushes are an fsync.
+ * Discards punch holes; write zeroes punch holes too unless the caller
+ * asked to keep the blocks allocated, then they zero the range.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/bvec.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+#include "uringblk_driver.h"
+
+static bool file_direct_io = true;
+module_param(file_direct_io, bool, 0444);
+MODULE_PARM_DESC(file_direct_io, "Bypass the page cache for backend_type=4 when the filesystem allows it (default: true)");
+
+struct uringblk_file {
+    struct file *file;
+    bool dio;                      /* Issue kiocbs with IOCB_DIRECT */
+};
+
+/* Direct I/O needs requests aligned to the block size of the filesystem */
+static bool file_can_dio(struct file *file)
+{
+    struct block_device *bdev = file_inode(file)->i_sb->s_bdev;
+
+    if (!file_direct_io || !(file->f_mode & FMODE_CAN_ODIRECT))
+        return false;
+    return !bdev || bdev_logical_block_size(bdev) <= uringblk_logical_block_size;
+}
+
+/**
+ * uringblk_file_init - Open the file behind a file backend
+ * @backend: Backend to set up
+ * @path: Path of the file, created if missing
+ * @capacity: Size in bytes the file is extended to, 0 to use its size
+ */
+int uringblk_file_init(struct uringblk_backend *backend, const char *path, size_t capacity)
+{
+    struct uringblk_file *f;
+    struct inode *inode;
+    loff_t size;
+    int ret;
+
+    f = kzalloc(sizeof(*f), GFP_KERNEL);
+    if (!f)
+        return -ENOMEM;
+
+    f->file = filp_open(path, O_RDWR | O_CREAT | O_LARGEFILE, 0600);
+    if (IS_ERR(f->file)) {
+        ret = PTR_ERR(f->file);
+        pr_err("uringblk: cannot open backing file %s: %d\n", path, ret);
+        kfree(f);
+        return ret;
+    }
+
+    inode = file_inode(f->file);
+    if (!S_ISREG(inode->i_mode) || !f->file->f_op->read_iter || !f->file->f_op->write_iter) {
+        pr_err("uringblk: %s is not a regular file\n", path);
+        ret = -EINVAL;
+        goto err_close;
+    }
+
+    size = i_size_read(inode);
+    if (capacity) {
+        if (size < capacity) {
+            ret = vfs_truncate(&f->file->f_path, capacity);
+            if (ret) {
+                pr_err("uringblk: cannot extend %s to %zu bytes: %d\n", path, capacity, ret);
+                goto err_close;
+            }
+        }
+        size = capacity;
+    }
+    size = round_down(size, uringblk_logical_block_size);
+    if (!size) {
+        pr_err("uringblk: %s is empty, give it a size with auto_detect_size=0 capacity_mb=N\n",
+               path);
+        ret = -EINVAL;
+        goto err_close;
+    }
+
+    f->dio = file_can_dio(f->file);
+
+    backend->private_data = f;
+    backend->capacity = size;
+    backend->type = URINGBLK_BACKEND_FILE;
+    backend->ops = &uringblk_file_ops;
+
+    pr_info("uringblk: backing file %s, capacity %zu MB, %s I/O\n", path,
+            backend->capacity >> 20, f->dio ? "direct" : "buffered");
+    return 0;
+
+err_close:
+    filp_close(f->file, NULL);
+    kfree(f);
+    return ret;
+}
+
+static void file_cleanup(struct uringblk_backend *backend)
+{
+    struct uringblk_file *f = backend->private_data;
+
+    if (f) {
+        vfs_fsync(f->file, 0);
+        filp_close(f->file, NULL);
+        kfree(f);
+        backend->private_data = NULL;
+    }
+}
+
+/* A read that ran into the end of a file shrunk underneath returns zeroes */
+static void file_zero_tail(struct request *rq, size_t done)
+{
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    size_t off = 0;
+
+    rq_for_each_segment(bvec, rq, iter) {
+        if (off + bvec.bv_len > done) {
+            size_t skip = done > off ? done - off : 0;
+
+            memzero_page(bvec.bv_page, bvec.bv_offset + skip, bvec.bv_len - skip);
+        }
+        off += bvec.bv_len;
+    }
+}
+
+/*
+ * The submitter and the kiocb completion each hold a reference on the
+ * request: the bvec table has to outlive both, and the request must not
+ * end while the filesystem is still looking at the iterator.
+ */
+static void file_aio_put(struct request *rq)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+    if (!atomic_dec_and_test(&cmd->pending))
+        return;
+
+    kfree(cmd->bvec);
+    cmd->bvec = NULL;
+    uringblk_complete_rq(rq, READ_ONCE(cmd->status));
+}
+
+static void file_aio_complete(struct kiocb *iocb, long ret)
+{
+    struct uringblk_cmd *cmd = container_of(iocb, struct uringblk_cmd, iocb);
+    struct request *rq = blk_mq_rq_from_pdu(cmd);
+
+    if (iocb->ki_flags & IOCB_WRITE)
+        kiocb_end_write(iocb);
+
+    if (ret < 0) {
+        uringblk_cmd_set_error(rq, errno_to_blk_status(ret));
+    } else if (ret < blk_rq_bytes(rq)) {
+        if (req_op(rq) == REQ_OP_READ)
+            file_zero_tail(rq, ret);
+        else
+            uringblk_cmd_set_error(rq, BLK_STS_IOERR);
+    }
+
+    file_aio_put(rq);
+}
+
+static blk_status_t file_rw_aio(struct uringblk_file *f, struct request *rq, loff_t pos)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    unsigned int dir = op_is_write(req_op(rq)) ? ITER_SOURCE : ITER_DEST;
+    struct kiocb *iocb = &cmd->iocb;
+    struct req_iterator rq_iter;
+    unsigned int nr_bvec = 0;
+    struct bio_vec *bvec;
+    struct bio_vec tmp;
+    struct iov_iter iter;
+    unsigned int offset;
+    ssize_t ret;
+
+    rq_for_each_bvec(tmp, rq, rq_iter)
+        nr_bvec++;
+
+    if (rq->bio != rq->biotail) {
+        /* The bvec tables of several bios have to be joined */
+        bvec = kmalloc_array(nr_bvec, sizeof(*bvec), GFP_NOIO);
+        if (!bvec)
+            return BLK_STS_RESOURCE;
+        cmd->bvec = bvec;
+        rq_for_each_bvec(tmp, rq, rq_iter)
+            *bvec++ = tmp;
+        bvec = cmd->bvec;
+        offset = 0;
+    } else {
+        /* A single bio is used in place */
+        cmd->bvec = NULL;
+        bvec = __bvec_iter_bvec(rq->bio->bi_io_vec, rq->bio->bi_iter);
+        offset = rq->bio->bi_iter.bi_bvec_done;
+    }
+
+    iov_iter_bvec(&iter, dir, bvec, nr_bvec, blk_rq_bytes(rq));
+    iter.iov_offset = offset;
+
+    uringblk_cmd_start(rq);
+    atomic_inc(&cmd->pending);
+
+    iocb->ki_filp = f->file;
+    iocb->ki_pos = pos;
+    iocb->ki_complete = file_aio_complete;
+    iocb->ki_flags = f->dio ? IOCB_DIRECT : 0;
+    iocb->ki_ioprio = req_get_ioprio(rq);
+
+    if (dir == ITER_SOURCE) {
+        iocb->ki_flags |= IOCB_WRITE;
+        if (rq->cmd_flags & REQ_FUA)
+            iocb->ki_flags |= IOCB_DSYNC;
+        kiocb_start_write(iocb);
+        ret = f->file->f_op->write_iter(iocb, &iter);
+    } else {
+        ret = f->file->f_op->read_iter(iocb, &iter);
+    }
+
+    /* Buffered I/O and early errors complete inline */
+    if (ret != -EIOCBQUEUED)
+        file_aio_complete(iocb, ret);
+    file_aio_put(rq);
+    return BLK_STS_OK;
+}
+
+static int file_fallocate(struct uringblk_file *f, int mode, loff_t pos, u64 len)
+{
+    return vfs_fallocate(f->file, mode | FALLOC_FL_KEEP_SIZE, pos, len);
+}
+
+static blk_status_t file_queue_rq(struct uringblk_backend *backend, struct request *rq)
+{
+    struct uringblk_file *f = backend->private_data;
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    int ret;
+
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+    case REQ_OP_WRITE:
+        return file_rw_aio(f, rq, pos);
+    case REQ_OP_FLUSH:
+        ret = vfs_fsync(f->file, 0);
+        break;
+    case REQ_OP_DISCARD:
+        ret = file_fallocate(f, FALLOC_FL_PUNCH_HOLE, pos, blk_rq_bytes(rq));
+        /* Discard is advisory */
+        if (ret == -EOPNOTSUPP)
+            ret = 0;
+        break;
+    case REQ_OP_WRITE_ZEROES:
+        ret = file_fallocate(f, rq->cmd_flags & REQ_NOUNMAP ? FALLOC_FL_ZERO_RANGE :
+                             FALLOC_FL_PUNCH_HOLE, pos, blk_rq_bytes(rq));
+        break;
+    default:
+        ret = -EOPNOTSUPP;
+        break;
+    }
+
+    if (ret)
+        pr_err_ratelimited("uringblk: file op %d failed at pos %lld: %d\n",
+                           req_op(rq), pos, ret);
+    uringblk_complete_rq(rq, errno_to_blk_status(ret));
+    return BLK_STS_OK;
+}
+
+/* Synchronous I/O through the page cache, for the caches and zoned mode */
+static int file_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len)
+{
+    struct uringblk_file *f = backend->private_data;
+    ssize_t ret;
+
+    if (!f || pos + len > backend->capacity + backend->reserved)
+        return -EINVAL;
+
+    while (len) {
+        ret = kernel_read(f->file, buf, len, &pos);
+        if (ret < 0)
+            return ret;
+        if (!ret) {
+            memset(buf, 0, len);
+            break;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static int file_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len)
+{
+    struct uringblk_file *f = backend->private_data;
+    ssize_t ret;
+
+    if (!f || pos + len > backend->capacity + backend->reserved)
+        return -EINVAL;
+
+    while (len) {
+        ret = kernel_write(f->file, buf, len, &pos);
+        if (ret < 0)
+            return ret;
+        if (!ret)
+            return -EIO;
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static int file_flush(struct uringblk_backend *backend)
+{
+    struct uringblk_file *f = backend->private_data;
+
+    if (!f)
+        return -EINVAL;
+    return vfs_fsync(f->file, 0);
+}
+
+static int file_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
+{
+    struct uringblk_file *f = backend->private_data;
+    int ret;
+
+    if (!f || pos + len > backend->capacity + backend->reserved)
+        return -EINVAL;
+
+    ret = file_fallocate(f, FALLOC_FL_PUNCH_HOLE, pos, len);
+    return ret == -EOPNOTSUPP ? 0 : ret;
+}
+
+/* The file is extended sparsely, like at init */
+static int file_resize(struct uringblk_backend *backend, size_t capacity)
+{
+    struct uringblk_file *f = backend->private_data;
+    int ret;
+
+    if (!f)
+        return -EINVAL;
+
+    if (i_size_read(file_inode(f->file)) < capacity) {
+        ret = vfs_truncate(&f->file->f_path, capacity);
+        if (ret)
+            return ret;
+    }
+    WRITE_ONCE(backend->capacity, capacity);
+    return 0;
+}
+
+const struct uringblk_backend_ops uringblk_file_ops = {
+    .init = uringblk_file_init,
+    .cleanup = file_cleanup,
+    .read = file_read,
+    .write = file_write,
+    .flush = file_flush,
+    .discard = file_discard,
+    .queue_rq = file_queue_rq,
+    .resize = file_resize,
+};
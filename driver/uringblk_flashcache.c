@@ -0,0 +1,625 @@
+/*
+ * uringblk_flashcache.c - Read cache tier over a slower backend
+ *
+ * With flash_cache_mb or flash_cache_device set, a fast tier (a RAM
+ * region, or a whole fast block device) caches page sized blocks of the
+ * backend for reading:
+ *
+ *  - Admission is block granular and happens on the second miss. The
+ *    first miss only records the block on a history list (H).
+ *  - Resident blocks are managed as ARC: T1 holds blocks hit once since
+ *    admission, T2 blocks hit more often, and the ghost lists B1/B2
+ *    remember recent evictions from each and steer the target size of
+ *    T1. A ghost hit is admitted straight into T2.
+ *  - Writes are never cached. A write drops the cached copies of the
+ *    blocks it covers, once when it is queued and again when it
+ *    completes, so a promotion that raced with it cannot leave stale
+ *    data behind. Small writes keep the blocks on a ghost list so their
+ *    next read brings them back at once; large or sequential writes
+ *    (write-around) forget them.
+ *
+ * A read served entirely from resident blocks never reaches the
+ * backend. A read that admits blocks is done synchronously so the data
+ * can be copied into the fast tier; all other reads take the normal
+ * path. The slots it assigned belong to that read until it has filled
+ * them: a block invalidated meanwhile leaves its slot to the read, which
+ * frees it instead of marking it valid. All metadata is under one irq-safe spinlock since completions
+ * invalidate too.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/xarray.h>
+
+#include "uringblk_driver.h"
+
+static unsigned int flash_cache_mb;
+module_param(flash_cache_mb, uint, 0444);
+MODULE_PARM_DESC(flash_cache_mb, "Read cache size in MB, RAM unless flash_cache_device is set (default: 0, off)");
+
+static char *flash_cache_device = "";
+module_param(flash_cache_device, charp, 0444);
+MODULE_PARM_DESC(flash_cache_device, "Fast block device holding the read cache (default: none)");
+
+static unsigned int flash_cache_seq_kb = 256;
+module_param(flash_cache_seq_kb, uint, 0644);
+MODULE_PARM_DESC(flash_cache_seq_kb, "Writes of at least this size bypass the read cache entirely (default: 256)");
+
+enum fc_list {
+    FC_T1,                         /* Resident, hit once since admission */
+    FC_T2,                         /* Resident, hit more often */
+    FC_B1,                         /* Evicted from T1 */
+    FC_B2,                         /* Evicted from T2 */
+    FC_H,                          /* Missed once, not admitted */
+    FC_NR_LISTS,
+};
+
+struct fc_entry {
+    struct list_head lru;          /* MRU at the head of its list */
+    pgoff_t blk;
+    u32 slot;
+    u8 list;                       /* enum fc_list */
+    bool valid;                    /* Slot holds the data, not still being filled */
+};
+
+/* A slot a read assigned and still has to fill */
+struct fc_fill {
+    struct fc_entry *e;            /* Owner, only while the slot's gen is unchanged */
+    pgoff_t blk;
+    u32 slot;
+    u32 gen;
+};
+
+struct uringblk_flashcache {
+    spinlock_t lock;               /* Protects everything below */
+    struct xarray map;             /* Block -> struct fc_entry */
+    struct list_head lists[FC_NR_LISTS];
+    unsigned int len[FC_NR_LISTS];
+    unsigned int nr_slots;
+    unsigned int p;                /* ARC target size of T1 */
+    unsigned int nr_free;
+    u32 *free_slots;
+    u32 *slot_gen;                 /* Bumped when a slot changes owner */
+    struct page **pages;           /* RAM tier */
+    struct bdev_handle *fast;      /* Device tier */
+    sector_t next_write;           /* Where the last write ended */
+    u64 hits, misses, promotions;
+};
+
+bool uringblk_flashcache_enabled(void)
+{
+    return flash_cache_mb || *flash_cache_device;
+}
+
+static bool fc_resident(struct fc_entry *e)
+{
+    return e->list == FC_T1 || e->list == FC_T2;
+}
+
+static void fc_move(struct uringblk_flashcache *fc, struct fc_entry *e, enum fc_list list)
+{
+    fc->len[e->list]--;
+    fc->len[list]++;
+    e->list = list;
+    list_move(&e->lru, &fc->lists[list]);
+}
+
+static void fc_drop(struct uringblk_flashcache *fc, struct fc_entry *e)
+{
+    fc->len[e->list]--;
+    list_del(&e->lru);
+    xa_erase(&fc->map, e->blk);
+    kfree(e);
+}
+
+static struct fc_entry *fc_lru(struct uringblk_flashcache *fc, enum fc_list list)
+{
+    return list_last_entry(&fc->lists[list], struct fc_entry, lru);
+}
+
+static void fc_release_slot(struct uringblk_flashcache *fc, struct fc_entry *e)
+{
+    fc->slot_gen[e->slot]++;
+    /* A slot still being filled is freed by the read filling it */
+    if (e->valid)
+        fc->free_slots[fc->nr_free++] = e->slot;
+    e->valid = false;
+}
+
+/* ARC REPLACE: turn the LRU block of T1 or T2 into a ghost */
+static void fc_replace(struct uringblk_flashcache *fc, bool ghost_b2)
+{
+    struct fc_entry *e;
+
+    if (fc->len[FC_T1] &&
+        (fc->len[FC_T1] > fc->p || (ghost_b2 && fc->len[FC_T1] == fc->p) || !fc->len[FC_T2])) {
+        e = fc_lru(fc, FC_T1);
+        fc_release_slot(fc, e);
+        fc_move(fc, e, FC_B1);
+    } else {
+        e = fc_lru(fc, FC_T2);
+        fc_release_slot(fc, e);
+        fc_move(fc, e, FC_B2);
+    }
+
+    while (fc->len[FC_B1] + fc->len[FC_B2] > fc->nr_slots)
+        fc_drop(fc, fc_lru(fc, fc->len[FC_B1] > fc->len[FC_B2] ? FC_B1 : FC_B2));
+}
+
+/*
+ * Give @e a slot and make it resident on @list, its data still to come.
+ * Returns false if every slot is being filled.
+ */
+static bool fc_admit(struct uringblk_flashcache *fc, struct fc_entry *e, enum fc_list list)
+{
+    bool ghost_b2 = e->list == FC_B2;
+
+    /* Off its list while REPLACE trims the ghosts */
+    fc->len[e->list]--;
+    list_del(&e->lru);
+    /* Replacing a block still being filled frees no slot */
+    while (!fc->nr_free && (fc->len[FC_T1] || fc->len[FC_T2]))
+        fc_replace(fc, ghost_b2);
+    if (!fc->nr_free) {
+        list_add(&e->lru, &fc->lists[e->list]);
+        fc->len[e->list]++;
+        return false;
+    }
+
+    e->slot = fc->free_slots[--fc->nr_free];
+    e->valid = false;
+    e->list = list;
+    list_add(&e->lru, &fc->lists[list]);
+    fc->len[list]++;
+    fc->promotions++;
+    return true;
+}
+
+/* A block missed for the first time goes on the history list */
+static void fc_note_miss(struct uringblk_flashcache *fc, pgoff_t blk)
+{
+    struct fc_entry *e;
+
+    if (fc->len[FC_H] >= fc->nr_slots)
+        fc_drop(fc, fc_lru(fc, FC_H));
+
+    e = kmalloc(sizeof(*e), GFP_ATOMIC | __GFP_NOWARN);
+    if (!e)
+        return;
+    e->blk = blk;
+    e->list = FC_H;
+    e->valid = false;
+    if (xa_err(xa_store(&fc->map, blk, e, GFP_ATOMIC | __GFP_NOWARN))) {
+        kfree(e);
+        return;
+    }
+    list_add(&e->lru, &fc->lists[FC_H]);
+    fc->len[FC_H]++;
+}
+
+/*
+ * Drop the cached copies of a range. Resident blocks and their ghosts
+ * turn into B2 ghosts if @keep, otherwise they are forgotten.
+ */
+static void fc_invalidate(struct uringblk_flashcache *fc, loff_t pos, u64 len, bool keep)
+{
+    struct fc_entry *e;
+    unsigned long idx, flags;
+
+    spin_lock_irqsave(&fc->lock, flags);
+    xa_for_each_range(&fc->map, idx, e, pos >> PAGE_SHIFT, (pos + len - 1) >> PAGE_SHIFT) {
+        if (fc_resident(e))
+            fc_release_slot(fc, e);
+        if (keep && e->list != FC_H)
+            fc_move(fc, e, FC_B2);
+        else
+            fc_drop(fc, e);
+    }
+    spin_unlock_irqrestore(&fc->lock, flags);
+}
+
+static int fc_slot_rw(struct uringblk_flashcache *fc, u32 slot, size_t off, void *buf,
+                      size_t len, bool write)
+{
+    if (fc->pages) {
+        void *addr = page_address(fc->pages[slot]) + off;
+
+        if (write)
+            memcpy(addr, buf, len);
+        else
+            memcpy(buf, addr, len);
+        return 0;
+    }
+    return uringblk_bio_rw_kern(fc->fast->bdev, write ? REQ_OP_WRITE : REQ_OP_READ,
+                                ((sector_t)slot << (PAGE_SHIFT - SECTOR_SHIFT)) +
+                                (off >> SECTOR_SHIFT), buf, len);
+}
+
+/*
+ * Copy a range of resident blocks out of the fast tier. Returns false if
+ * a block left the cache meanwhile, in which case @buf is garbage.
+ */
+static bool fc_read_cached(struct uringblk_flashcache *fc, loff_t pos, void *buf, size_t len)
+{
+    while (len) {
+        size_t off = offset_in_page(pos);
+        size_t n = min_t(size_t, len, PAGE_SIZE - off);
+        struct fc_entry *e;
+        unsigned long flags;
+        u32 slot, gen;
+        int ret;
+
+        spin_lock_irqsave(&fc->lock, flags);
+        e = xa_load(&fc->map, pos >> PAGE_SHIFT);
+        if (!e || !fc_resident(e) || !e->valid) {
+            spin_unlock_irqrestore(&fc->lock, flags);
+            return false;
+        }
+        slot = e->slot;
+        gen = fc->slot_gen[slot];
+        /* RAM slots are copied under the lock, nobody can take them away */
+        if (fc->pages) {
+            fc_slot_rw(fc, slot, off, buf, n, false);
+            spin_unlock_irqrestore(&fc->lock, flags);
+        } else {
+            spin_unlock_irqrestore(&fc->lock, flags);
+            ret = fc_slot_rw(fc, slot, off, buf, n, false);
+            if (ret || READ_ONCE(fc->slot_gen[slot]) != gen)
+                return false;
+        }
+
+        buf += n;
+        pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Fill the slots fc_lookup() assigned from data read off the backend at
+ * @pos, or give them up if @buf is NULL. The slots are not reused before
+ * this returns, so the data can be written outside the lock.
+ */
+static void fc_fill(struct uringblk_flashcache *fc, loff_t pos, void *buf,
+                    struct fc_fill *fills, unsigned int nr)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr; i++) {
+        struct fc_fill *f = &fills[i];
+        unsigned long flags;
+        bool ok = false;
+
+        if (buf && READ_ONCE(fc->slot_gen[f->slot]) == f->gen)
+            ok = !fc_slot_rw(fc, f->slot, 0, buf + (((loff_t)f->blk << PAGE_SHIFT) - pos),
+                             PAGE_SIZE, true);
+
+        spin_lock_irqsave(&fc->lock, flags);
+        if (fc->slot_gen[f->slot] != f->gen) {
+            /* Invalidated while being filled, the slot was left to us */
+            fc->free_slots[fc->nr_free++] = f->slot;
+        } else if (ok) {
+            f->e->valid = true;
+        } else {
+            fc->slot_gen[f->slot]++;
+            fc->free_slots[fc->nr_free++] = f->slot;
+            fc_move(fc, f->e, FC_B2);
+        }
+        spin_unlock_irqrestore(&fc->lock, flags);
+    }
+}
+
+/*
+ * Account a read and decide what to do with it. Returns true if every
+ * block is resident, otherwise runs the misses through admission and
+ * records the slots assigned in @fills, @nr_fills of them. Without
+ * @fills nothing is admitted.
+ */
+static bool fc_lookup(struct uringblk_flashcache *fc, loff_t pos, u64 len,
+                      struct fc_fill *fills, unsigned int *nr_fills)
+{
+    pgoff_t first = pos >> PAGE_SHIFT, last = (pos + len - 1) >> PAGE_SHIFT;
+    pgoff_t blk;
+    struct fc_entry *e;
+    unsigned long flags;
+    bool hit = true;
+
+    *nr_fills = 0;
+    spin_lock_irqsave(&fc->lock, flags);
+
+    for (blk = first; blk <= last && hit; blk++) {
+        e = xa_load(&fc->map, blk);
+        hit = e && fc_resident(e) && e->valid;
+    }
+
+    if (hit) {
+        for (blk = first; blk <= last; blk++)
+            fc_move(fc, xa_load(&fc->map, blk), FC_T2);
+        fc->hits += last - first + 1;
+        spin_unlock_irqrestore(&fc->lock, flags);
+        return true;
+    }
+
+    fc->misses += last - first + 1;
+    for (blk = first; blk <= last; blk++) {
+        /* Only blocks the read covers entirely can be filled from it */
+        if ((loff_t)blk << PAGE_SHIFT < pos ||
+            ((loff_t)blk + 1) << PAGE_SHIFT > pos + len)
+            continue;
+
+        e = xa_load(&fc->map, blk);
+        if (!e) {
+            fc_note_miss(fc, blk);
+            continue;
+        }
+        if (!fills)
+            continue;
+
+        switch (e->list) {
+        case FC_T1:
+        case FC_T2:
+            /* Resident and valid, or being filled by someone else */
+            continue;
+        case FC_B1:
+            fc->p = min(fc->nr_slots, fc->p + max(fc->len[FC_B2] / fc->len[FC_B1], 1U));
+            if (!fc_admit(fc, e, FC_T2))
+                continue;
+            break;
+        case FC_B2:
+            fc->p -= min(fc->p, max(fc->len[FC_B1] / fc->len[FC_B2], 1U));
+            if (!fc_admit(fc, e, FC_T2))
+                continue;
+            break;
+        case FC_H:
+            if (!fc_admit(fc, e, FC_T1))
+                continue;
+            break;
+        }
+        fills[*nr_fills] = (struct fc_fill) {
+            .e = e,
+            .blk = blk,
+            .slot = e->slot,
+            .gen = fc->slot_gen[e->slot],
+        };
+        (*nr_fills)++;
+    }
+
+    spin_unlock_irqrestore(&fc->lock, flags);
+    return false;
+}
+
+/**
+ * uringblk_flashcache_queue_rq - Run a request through the read cache
+ * @dev: uringblk device
+ * @rq: Started request inside the device
+ *
+ * Returns true if the request was completed here, false if it should
+ * continue down the normal path.
+ */
+bool uringblk_flashcache_queue_rq(struct uringblk_device *dev, struct request *rq)
+{
+    struct uringblk_flashcache *fc = dev->flashcache;
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    u64 len = blk_rq_bytes(rq);
+    blk_status_t status = BLK_STS_OK;
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    struct fc_fill *fills = NULL;
+    unsigned int nr_fills;
+    void *buf;
+
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+        break;
+    case REQ_OP_WRITE:
+    case REQ_OP_WRITE_ZEROES:
+    case REQ_OP_DISCARD: {
+        bool around = len >= (u64)flash_cache_seq_kb << 10 ||
+                      blk_rq_pos(rq) == READ_ONCE(fc->next_write);
+
+        WRITE_ONCE(fc->next_write, blk_rq_pos(rq) + blk_rq_sectors(rq));
+        fc_invalidate(fc, pos, len, !around);
+        return false;
+    }
+    default:
+        return false;
+    }
+
+    if (len >= PAGE_SIZE)
+        fills = kmalloc_array(len >> PAGE_SHIFT, sizeof(*fills), GFP_NOIO | __GFP_NOWARN);
+
+    if (fc_lookup(fc, pos, len, fills, &nr_fills)) {
+        kfree(fills);
+        rq_for_each_segment(bvec, rq, iter) {
+            void *addr = page_address(bvec.bv_page) + bvec.bv_offset;
+
+            if (!fc_read_cached(fc, pos, addr, bvec.bv_len) &&
+                dev->backend.ops->read(&dev->backend, pos, addr, bvec.bv_len)) {
+                status = BLK_STS_IOERR;
+                break;
+            }
+            pos += bvec.bv_len;
+        }
+        uringblk_complete_rq(rq, status);
+        return true;
+    }
+
+    if (!nr_fills) {
+        kfree(fills);
+        return false;
+    }
+
+    /* Promotion: read the backend here so the data can be kept */
+    buf = kvmalloc(len, GFP_NOIO);
+    if (!buf || dev->backend.ops->read(&dev->backend, pos, buf, len)) {
+        fc_fill(fc, pos, NULL, fills, nr_fills);
+        kfree(fills);
+        kvfree(buf);
+        /* Let the normal path retry, or report the error */
+        return false;
+    }
+
+    fc_fill(fc, pos, buf, fills, nr_fills);
+    kfree(fills);
+
+    len = 0;
+    rq_for_each_segment(bvec, rq, iter) {
+        memcpy(page_address(bvec.bv_page) + bvec.bv_offset, buf + len, bvec.bv_len);
+        len += bvec.bv_len;
+    }
+    kvfree(buf);
+    uringblk_complete_rq(rq, BLK_STS_OK);
+    return true;
+}
+
+/**
+ * uringblk_flashcache_write_done - Invalidate behind a completed write
+ * @dev: uringblk device
+ * @rq: Write, write zeroes or discard request about to complete
+ *
+ * May be called from interrupt context.
+ */
+void uringblk_flashcache_write_done(struct uringblk_device *dev, struct request *rq)
+{
+    u64 len = blk_rq_bytes(rq);
+
+    if (len)
+        fc_invalidate(dev->flashcache, (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT, len,
+                      len < (u64)flash_cache_seq_kb << 10);
+}
+
+/* Hit, miss and promotion counts for GET_STATS */
+void uringblk_flashcache_stats(struct uringblk_device *dev, struct uringblk_stats *out)
+{
+    struct uringblk_flashcache *fc = dev->flashcache;
+    unsigned long flags;
+
+    if (!fc)
+        return;
+    spin_lock_irqsave(&fc->lock, flags);
+    out->cache_hits = fc->hits;
+    out->cache_misses = fc->misses;
+    out->cache_promotions = fc->promotions;
+    spin_unlock_irqrestore(&fc->lock, flags);
+}
+
+void uringblk_flashcache_stats_reset(struct uringblk_device *dev)
+{
+    struct uringblk_flashcache *fc = dev->flashcache;
+    unsigned long flags;
+
+    if (!fc)
+        return;
+    spin_lock_irqsave(&fc->lock, flags);
+    fc->hits = fc->misses = fc->promotions = 0;
+    spin_unlock_irqrestore(&fc->lock, flags);
+}
+
+static void fc_free(struct uringblk_flashcache *fc)
+{
+    unsigned int i;
+
+    if (fc->pages) {
+        for (i = 0; i < fc->nr_slots; i++)
+            if (fc->pages[i])
+                __free_page(fc->pages[i]);
+        kvfree(fc->pages);
+    }
+    if (fc->fast)
+        bdev_release(fc->fast);
+    kvfree(fc->free_slots);
+    kvfree(fc->slot_gen);
+    kfree(fc);
+}
+
+/**
+ * uringblk_flashcache_init - Set up the read cache of a device
+ * @dev: Device whose backend is initialized
+ */
+int uringblk_flashcache_init(struct uringblk_device *dev)
+{
+    struct uringblk_flashcache *fc;
+    u64 bytes = (u64)flash_cache_mb << 20;
+    unsigned int i;
+    int ret;
+
+    if (dev->config.zoned_mode || dev->wbcache) {
+        pr_err("uringblk: the read cache cannot be combined with zoned mode or wb_cache_mb\n");
+        return -EINVAL;
+    }
+
+    fc = kzalloc(sizeof(*fc), GFP_KERNEL);
+    if (!fc)
+        return -ENOMEM;
+
+    spin_lock_init(&fc->lock);
+    xa_init(&fc->map);
+    for (i = 0; i < FC_NR_LISTS; i++)
+        INIT_LIST_HEAD(&fc->lists[i]);
+    fc->next_write = (sector_t)-1;
+
+    if (*flash_cache_device) {
+        ret = uringblk_bio_open_members(flash_cache_device, &fc->fast, 1);
+        if (ret < 0)
+            goto err_free;
+        if (!bytes || bytes > bdev_nr_bytes(fc->fast->bdev))
+            bytes = bdev_nr_bytes(fc->fast->bdev);
+    }
+
+    fc->nr_slots = min_t(u64, bytes >> PAGE_SHIFT, U32_MAX);
+    if (!fc->nr_slots) {
+        pr_err("uringblk: the read cache holds no block\n");
+        ret = -EINVAL;
+        goto err_free;
+    }
+
+    ret = -ENOMEM;
+    fc->free_slots = kvmalloc_array(fc->nr_slots, sizeof(u32), GFP_KERNEL);
+    fc->slot_gen = kvcalloc(fc->nr_slots, sizeof(u32), GFP_KERNEL);
+    if (!fc->free_slots || !fc->slot_gen)
+        goto err_free;
+
+    if (!fc->fast) {
+        fc->pages = kvcalloc(fc->nr_slots, sizeof(struct page *), GFP_KERNEL);
+        if (!fc->pages)
+            goto err_free;
+        for (i = 0; i < fc->nr_slots; i++) {
+            fc->pages[i] = alloc_page(GFP_KERNEL);
+            if (!fc->pages[i])
+                goto err_free;
+        }
+    }
+
+    /* Hand out low slots first */
+    for (i = 0; i < fc->nr_slots; i++)
+        fc->free_slots[i] = fc->nr_slots - 1 - i;
+    fc->nr_free = fc->nr_slots;
+
+    dev->flashcache = fc;
+    pr_info("uringblk: %llu MB read cache on %s\n", ((u64)fc->nr_slots << PAGE_SHIFT) >> 20,
+            fc->fast ? flash_cache_device : "RAM");
+    return 0;
+
+err_free:
+    fc_free(fc);
+    return ret;
+}
+
+void uringblk_flashcache_exit(struct uringblk_device *dev)
+{
+    struct uringblk_flashcache *fc = dev->flashcache;
+    struct fc_entry *e;
+    unsigned long idx;
+
+    if (!fc)
+        return;
+
+    xa_for_each(&fc->map, idx, e)
+        kfree(e);
+    xa_destroy(&fc->map);
+    fc_free(fc);
+    dev->flashcache = NULL;
+}
@@ -0,0 +1,676 @@
+/*
+ * uringblk_integrity.c - Per-block guard and reference tags
+ *
+ * With integrity_tags set, every logical block has an 8 byte tuple, a
+ * crc32c of its data and the low 32 bits of its LBA, kept in a metadata
+ * area at the end of the backend: one superblock, then the tuples in
+ * LBA order. The exported capacity shrinks to make room for it.
+ *
+ * Writes store the tuples the upper layer passed through the kernel
+ * integrity API after checking them against the data, or generate
+ * them. Reads check the data against the stored tuples and hand them
+ * up. A block whose tuple is all zeroes has not been written since it
+ * was formatted or discarded and is not checked. Mismatches fail the
+ * request with BLK_STS_PROTECTION and count as media errors.
+ *
+ * Tagged requests are carried out synchronously through the backend's
+ * read, write and discard ops. A request locks its range of blocks while
+ * it moves their data and tuples, shared for reads and exclusive
+ * otherwise, so overlapping requests see data and tuples that belong
+ * together. Tuples sharing a metadata block are updated under one of
+ * UI_LOCKS mutexes. Data and tuples are not written atomically,
+ * a crash in the middle of a write can leave blocks failing the check
+ * until they are rewritten.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/blk-integrity.h>
+#include <linux/crc32c.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+#include "uringblk_driver.h"
+
+#define UI_LOCKS            64
+#define UI_FORMAT_CHUNK     (1 << 20)
+#define UI_MAGIC            0x53474154424c4255ULL  /* "UBLBTAGS" */
+
+static bool integrity_tags;
+module_param(integrity_tags, bool, 0444);
+MODULE_PARM_DESC(integrity_tags, "Keep a crc32c guard and reference tag for every block (default: false)");
+
+struct ui_tuple {
+    __be32 guard;                  /* crc32c of the block */
+    __be32 ref_tag;                /* Low 32 bits of the LBA */
+};
+
+struct ui_super {
+    __le64 magic;
+    __le64 nr_blocks;
+    __le32 block_size;
+    __le32 crc;                    /* Over the fields above */
+};
+
+struct uringblk_integrity {
+    struct uringblk_backend *backend;
+    loff_t meta;                   /* Superblock, the tuples start one block later */
+    u64 nr_blocks;
+    unsigned int shift;            /* log2 of the logical block size */
+    struct mutex locks[UI_LOCKS];  /* Serialize updates of a metadata block */
+    spinlock_t range_lock;         /* Protects ranges */
+    struct list_head ranges;       /* Locked block ranges */
+    wait_queue_head_t range_wait;
+};
+
+/* Blocks a request is moving the data and tuples of */
+struct ui_range {
+    struct list_head node;
+    u64 start, end;
+    bool write;
+};
+
+bool uringblk_integrity_enabled(void)
+{
+    return integrity_tags;
+}
+
+static bool ui_tuple_empty(const struct ui_tuple *t)
+{
+    return !t->guard && !t->ref_tag;
+}
+
+/*
+ * Kernel integrity profile. The block layer numbers tuples from the
+ * bio's start sector; prepare and complete translate between that and
+ * the LBAs stored on the device, like T10 PI type 1 does.
+ */
+#ifdef CONFIG_BLK_DEV_INTEGRITY
+static blk_status_t ui_generate(struct blk_integrity_iter *iter)
+{
+    unsigned int i;
+
+    for (i = 0; i < iter->data_size; i += iter->interval) {
+        struct ui_tuple *t = iter->prot_buf;
+
+        t->guard = cpu_to_be32(crc32c(~0, iter->data_buf, iter->interval));
+        t->ref_tag = cpu_to_be32(lower_32_bits(iter->seed));
+
+        iter->data_buf += iter->interval;
+        iter->prot_buf += iter->tuple_size;
+        iter->seed++;
+    }
+    return BLK_STS_OK;
+}
+
+static blk_status_t ui_verify(struct blk_integrity_iter *iter)
+{
+    unsigned int i;
+
+    for (i = 0; i < iter->data_size; i += iter->interval) {
+        struct ui_tuple *t = iter->prot_buf;
+
+        if (!ui_tuple_empty(t) &&
+            (be32_to_cpu(t->ref_tag) != lower_32_bits(iter->seed) ||
+             be32_to_cpu(t->guard) != crc32c(~0, iter->data_buf, iter->interval))) {
+            pr_err_ratelimited("%s: integrity tag mismatch at sector %llu\n",
+                               iter->disk_name, (unsigned long long)iter->seed);
+            return BLK_STS_PROTECTION;
+        }
+
+        iter->data_buf += iter->interval;
+        iter->prot_buf += iter->tuple_size;
+        iter->seed++;
+    }
+    return BLK_STS_OK;
+}
+
+static void ui_prepare(struct request *rq)
+{
+    struct blk_integrity *bi = &rq->q->integrity;
+    u32 ref_tag = blk_rq_pos(rq) >> (bi->interval_exp - SECTOR_SHIFT);
+    struct bio *bio;
+
+    __rq_for_each_bio(bio, rq) {
+        struct bio_integrity_payload *bip = bio_integrity(bio);
+        u32 virt = bip_get_seed(bip) & 0xffffffff;
+        struct bvec_iter iter;
+        struct bio_vec iv;
+
+        /* Already remapped, the request is being retried */
+        if (bip->bip_flags & BIP_MAPPED_INTEGRITY)
+            break;
+
+        bip_for_each_vec(iv, bip, iter) {
+            void *p = bvec_kmap_local(&iv);
+            unsigned int j;
+
+            for (j = 0; j < iv.bv_len; j += bi->tuple_size) {
+                struct ui_tuple *t = p + j;
+
+                if (be32_to_cpu(t->ref_tag) == virt)
+                    t->ref_tag = cpu_to_be32(ref_tag);
+                virt++;
+                ref_tag++;
+            }
+            kunmap_local(p);
+        }
+        bip->bip_flags |= BIP_MAPPED_INTEGRITY;
+    }
+}
+
+static void ui_complete(struct request *rq, unsigned int nr_bytes)
+{
+    struct blk_integrity *bi = &rq->q->integrity;
+    unsigned int intervals = nr_bytes >> bi->interval_exp;
+    u32 ref_tag = blk_rq_pos(rq) >> (bi->interval_exp - SECTOR_SHIFT);
+    struct bio *bio;
+
+    __rq_for_each_bio(bio, rq) {
+        struct bio_integrity_payload *bip = bio_integrity(bio);
+        u32 virt = bip_get_seed(bip) & 0xffffffff;
+        struct bvec_iter iter;
+        struct bio_vec iv;
+
+        bip_for_each_vec(iv, bip, iter) {
+            void *p = bvec_kmap_local(&iv);
+            unsigned int j;
+
+            for (j = 0; j < iv.bv_len && intervals; j += bi->tuple_size) {
+                struct ui_tuple *t = p + j;
+
+                if (!ui_tuple_empty(t) && be32_to_cpu(t->ref_tag) == ref_tag)
+                    t->ref_tag = cpu_to_be32(virt);
+                virt++;
+                ref_tag++;
+                intervals--;
+            }
+            kunmap_local(p);
+        }
+    }
+}
+
+static const struct blk_integrity_profile ui_profile = {
+    .name = "UBLK-CRC32C",
+    .generate_fn = ui_generate,
+    .verify_fn = ui_verify,
+    .prepare_fn = ui_prepare,
+    .complete_fn = ui_complete,
+};
+
+/* Copy the request's integrity tuples to or from @tags */
+static void ui_rq_tuples(struct request *rq, struct ui_tuple *tags, bool to_rq)
+{
+    void *p = tags;
+    struct bio *bio;
+
+    __rq_for_each_bio(bio, rq) {
+        struct bio_integrity_payload *bip = bio_integrity(bio);
+        struct bvec_iter iter;
+        struct bio_vec bv;
+
+        bip_for_each_vec(bv, bip, iter) {
+            if (to_rq)
+                memcpy_to_bvec(&bv, p);
+            else
+                memcpy_from_bvec(p, &bv);
+            p += bv.bv_len;
+        }
+    }
+}
+#else
+static void ui_rq_tuples(struct request *rq, struct ui_tuple *tags, bool to_rq)
+{
+}
+#endif /* CONFIG_BLK_DEV_INTEGRITY */
+
+/*
+ * Metadata area
+ */
+static loff_t ui_tuple_pos(struct uringblk_integrity *ui, u64 blk)
+{
+    return ui->meta + (1 << ui->shift) + blk * sizeof(struct ui_tuple);
+}
+
+static u32 ui_super_crc(const struct ui_super *sb)
+{
+    return crc32c(~0, sb, offsetof(struct ui_super, crc));
+}
+
+static int ui_read_tuples(struct uringblk_integrity *ui, u64 blk, unsigned int n,
+                          struct ui_tuple *tags)
+{
+    unsigned int bs = 1 << ui->shift;
+    loff_t pos = ui_tuple_pos(ui, blk);
+    loff_t start = round_down(pos, bs);
+    size_t len = round_up(pos + n * sizeof(*tags), bs) - start;
+    void *buf;
+    int ret;
+
+    buf = kvmalloc(len, GFP_NOIO);
+    if (!buf)
+        return -ENOMEM;
+
+    ret = ui->backend->ops->read(ui->backend, start, buf, len);
+    if (!ret)
+        memcpy(tags, buf + (pos - start), n * sizeof(*tags));
+    kvfree(buf);
+    return ret;
+}
+
+/* Read-modify-write of every metadata block the tuples touch */
+static int ui_write_tuples(struct uringblk_integrity *ui, u64 blk, unsigned int n,
+                           const struct ui_tuple *tags)
+{
+    unsigned int bs = 1 << ui->shift;
+    loff_t pos = ui_tuple_pos(ui, blk);
+    size_t left = n * sizeof(*tags);
+    const void *src = tags;
+    void *buf;
+    int ret = 0;
+
+    buf = kmalloc(bs, GFP_NOIO);
+    if (!buf)
+        return -ENOMEM;
+
+    while (left) {
+        loff_t bpos = round_down(pos, bs);
+        unsigned int off = pos - bpos;
+        size_t len = min_t(size_t, left, bs - off);
+        struct mutex *lock = &ui->locks[(bpos >> ui->shift) % UI_LOCKS];
+
+        mutex_lock(lock);
+        if (len < bs)
+            ret = ui->backend->ops->read(ui->backend, bpos, buf, bs);
+        if (!ret) {
+            memcpy(buf + off, src, len);
+            ret = ui->backend->ops->write(ui->backend, bpos, buf, bs);
+        }
+        mutex_unlock(lock);
+        if (ret)
+            break;
+
+        pos += len;
+        src += len;
+        left -= len;
+    }
+
+    kfree(buf);
+    return ret;
+}
+
+static bool ui_range_add(struct uringblk_integrity *ui, struct ui_range *r)
+{
+    struct ui_range *o;
+
+    spin_lock(&ui->range_lock);
+    list_for_each_entry(o, &ui->ranges, node) {
+        if (o->start < r->end && r->start < o->end && (o->write || r->write)) {
+            spin_unlock(&ui->range_lock);
+            return false;
+        }
+    }
+    list_add_tail(&r->node, &ui->ranges);
+    spin_unlock(&ui->range_lock);
+    return true;
+}
+
+static void ui_lock_range(struct uringblk_integrity *ui, struct ui_range *r,
+                          u64 blk, u64 n, bool write)
+{
+    r->start = blk;
+    r->end = blk + n;
+    r->write = write;
+    wait_event(ui->range_wait, ui_range_add(ui, r));
+}
+
+static void ui_unlock_range(struct uringblk_integrity *ui, struct ui_range *r)
+{
+    spin_lock(&ui->range_lock);
+    list_del(&r->node);
+    spin_unlock(&ui->range_lock);
+    wake_up_all(&ui->range_wait);
+}
+
+/* Zero the tuples of @n blocks, they read as never written */
+static int ui_clear_tuples(struct uringblk_integrity *ui, u64 blk, u64 n)
+{
+    unsigned int chunk = UI_FORMAT_CHUNK / sizeof(struct ui_tuple);
+    struct ui_tuple *zero;
+    int ret = 0;
+
+    zero = kvzalloc(UI_FORMAT_CHUNK, GFP_NOIO);
+    if (!zero)
+        return -ENOMEM;
+
+    while (n && !ret) {
+        unsigned int len = min_t(u64, n, chunk);
+
+        ret = ui_write_tuples(ui, blk, len, zero);
+        blk += len;
+        n -= len;
+    }
+
+    kvfree(zero);
+    return ret;
+}
+
+/* Zero every tuple, then write the superblock that says so */
+static int ui_format(struct uringblk_integrity *ui)
+{
+    loff_t pos = ui_tuple_pos(ui, 0);
+    loff_t end = round_up(ui_tuple_pos(ui, ui->nr_blocks), 1 << ui->shift);
+    struct ui_super *sb;
+    void *buf;
+    int ret = 0;
+
+    buf = kvzalloc(UI_FORMAT_CHUNK, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    while (pos < end && !ret) {
+        size_t len = min_t(loff_t, end - pos, UI_FORMAT_CHUNK);
+
+        ret = ui->backend->ops->write(ui->backend, pos, buf, len);
+        pos += len;
+    }
+    if (!ret) {
+        sb = buf;
+        sb->magic = cpu_to_le64(UI_MAGIC);
+        sb->nr_blocks = cpu_to_le64(ui->nr_blocks);
+        sb->block_size = cpu_to_le32(1 << ui->shift);
+        sb->crc = cpu_to_le32(ui_super_crc(sb));
+        ret = ui->backend->ops->write(ui->backend, ui->meta, buf, 1 << ui->shift);
+    }
+    if (!ret)
+        ret = ui->backend->ops->flush(ui->backend);
+
+    kvfree(buf);
+    return ret;
+}
+
+static bool ui_super_valid(struct uringblk_integrity *ui, const struct ui_super *sb)
+{
+    return le64_to_cpu(sb->magic) == UI_MAGIC &&
+           le64_to_cpu(sb->nr_blocks) == ui->nr_blocks &&
+           le32_to_cpu(sb->block_size) == 1 << ui->shift &&
+           le32_to_cpu(sb->crc) == ui_super_crc(sb);
+}
+
+/**
+ * uringblk_integrity_init - Set up the metadata area of a device
+ * @dev: Device whose backend has been initialized
+ *
+ * The area takes the end of the backend, which must not change size.
+ * It is formatted unless its superblock matches the device.
+ */
+int uringblk_integrity_init(struct uringblk_device *dev)
+{
+    unsigned int bs = uringblk_logical_block_size;
+    struct uringblk_integrity *ui;
+    u64 total = dev->backend.capacity >> ilog2(bs);
+    u64 meta_blocks;
+    void *buf;
+    int ret, i;
+
+    if (dev->config.zoned_mode || dev->wbcache || dev->flashcache || dev->atomic) {
+        pr_err("uringblk: integrity tags cannot be used in zoned mode or with a cache or atomic writes\n");
+        return -EINVAL;
+    }
+
+    ui = kzalloc(sizeof(*ui), GFP_KERNEL);
+    if (!ui)
+        return -ENOMEM;
+
+    ui->backend = &dev->backend;
+    ui->shift = ilog2(bs);
+    for (i = 0; i < UI_LOCKS; i++)
+        mutex_init(&ui->locks[i]);
+    spin_lock_init(&ui->range_lock);
+    INIT_LIST_HEAD(&ui->ranges);
+    init_waitqueue_head(&ui->range_wait);
+
+    /* Data blocks, then the superblock and as many blocks of tuples as they need */
+    ui->nr_blocks = div_u64(total * bs, bs + sizeof(struct ui_tuple));
+    while (ui->nr_blocks &&
+           ui->nr_blocks + 1 + DIV_ROUND_UP(ui->nr_blocks * sizeof(struct ui_tuple), bs) > total)
+        ui->nr_blocks--;
+    if (!ui->nr_blocks) {
+        ret = -ENOSPC;
+        goto err_free;
+    }
+    meta_blocks = total - ui->nr_blocks;
+    ui->meta = ui->nr_blocks << ui->shift;
+
+    buf = kmalloc(bs, GFP_KERNEL);
+    if (!buf) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
+    ret = dev->backend.ops->read(&dev->backend, ui->meta, buf, bs);
+    if (!ret && !ui_super_valid(ui, buf)) {
+        pr_info("uringblk: formatting integrity tags for %llu blocks\n", ui->nr_blocks);
+        ret = ui_format(ui);
+    }
+    kfree(buf);
+    if (ret) {
+        pr_err("uringblk: failed to set up integrity tags: %d\n", ret);
+        goto err_free;
+    }
+
+    dev->backend.reserved += dev->backend.capacity - ui->meta;
+    dev->backend.capacity = ui->meta;
+    dev->integrity = ui;
+    dev->features |= URINGBLK_FEAT_INTEGRITY;
+    pr_info("uringblk: integrity tags in %llu KB after the data\n",
+            (meta_blocks << ui->shift) >> 10);
+    return 0;
+
+err_free:
+    kfree(ui);
+    return ret;
+}
+
+void uringblk_integrity_exit(struct uringblk_device *dev)
+{
+    kfree(dev->integrity);
+    dev->integrity = NULL;
+}
+
+/* Register the profile so upper layers can pass and receive tuples */
+void uringblk_integrity_setup_queue(struct uringblk_device *dev)
+{
+#ifdef CONFIG_BLK_DEV_INTEGRITY
+    struct blk_integrity bi = {
+        .profile = &ui_profile,
+        .flags = BLK_INTEGRITY_DEVICE_CAPABLE,
+        .tuple_size = sizeof(struct ui_tuple),
+        .interval_exp = ilog2(uringblk_logical_block_size),
+    };
+
+    if (dev->integrity)
+        blk_integrity_register(dev->disk, &bi);
+#endif
+}
+
+/*
+ * Check the request's data against @tags, or fill in @tags if @generate.
+ * Returns the number of blocks whose tuple does not match.
+ */
+static unsigned int ui_check(struct uringblk_integrity *ui, struct request *rq,
+                             struct ui_tuple *tags, bool generate)
+{
+    u32 ref_tag = blk_rq_pos(rq) >> (ui->shift - SECTOR_SHIFT);
+    unsigned int bs = 1 << ui->shift;
+    unsigned int done = 0, bad = 0, i = 0;
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    u32 crc = ~0;
+
+    rq_for_each_segment(bvec, rq, iter) {
+        void *p = bvec_kmap_local(&bvec);
+        unsigned int off = 0;
+
+        while (off < bvec.bv_len) {
+            unsigned int n = min(bvec.bv_len - off, bs - done);
+
+            crc = crc32c(crc, p + off, n);
+            off += n;
+            done += n;
+            if (done < bs)
+                continue;
+
+            if (generate) {
+                tags[i].guard = cpu_to_be32(crc);
+                tags[i].ref_tag = cpu_to_be32(ref_tag + i);
+            } else if (!ui_tuple_empty(&tags[i]) &&
+                       (be32_to_cpu(tags[i].guard) != crc ||
+                        be32_to_cpu(tags[i].ref_tag) != ref_tag + i)) {
+                pr_err_ratelimited("uringblk: integrity tag mismatch at block %llu\n",
+                                   (blk_rq_pos(rq) >> (ui->shift - SECTOR_SHIFT)) + i);
+                bad++;
+            }
+            crc = ~0;
+            done = 0;
+            i++;
+        }
+        kunmap_local(p);
+    }
+    return bad;
+}
+
+/* Write zeroes goes down as zeroes, the backends' discard may leave data */
+static int ui_zero_data(struct uringblk_backend *backend, loff_t pos, u64 len)
+{
+    void *zero;
+    int ret = 0;
+
+    zero = kvzalloc(UI_FORMAT_CHUNK, GFP_NOIO);
+    if (!zero)
+        return -ENOMEM;
+
+    while (len && !ret) {
+        size_t n = min_t(u64, len, UI_FORMAT_CHUNK);
+
+        ret = backend->ops->write(backend, pos, zero, n);
+        pos += n;
+        len -= n;
+    }
+
+    kvfree(zero);
+    return ret;
+}
+
+static int ui_rw_data(struct uringblk_backend *backend, struct request *rq)
+{
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    int ret;
+
+    rq_for_each_segment(bvec, rq, iter) {
+        void *buffer = page_address(bvec.bv_page) + bvec.bv_offset;
+
+        if (req_op(rq) == REQ_OP_READ)
+            ret = backend->ops->read(backend, pos, buffer, bvec.bv_len);
+        else
+            ret = backend->ops->write(backend, pos, buffer, bvec.bv_len);
+        if (ret < 0)
+            return ret;
+        pos += bvec.bv_len;
+    }
+    return 0;
+}
+
+/**
+ * uringblk_integrity_queue_rq - Carry out a request with its tags
+ * @dev: Device with integrity tags
+ * @rq: Started request
+ * @status: Set to what ->queue_rq should return when the request is taken
+ *
+ * Returns true if the request has been completed, or left for blk-mq to
+ * retry with *@status BLK_STS_RESOURCE when the tags could not be
+ * allocated; nothing has been touched then. Flushes are left to the
+ * normal path.
+ */
+bool uringblk_integrity_queue_rq(struct uringblk_device *dev, struct request *rq,
+                                 blk_status_t *status)
+{
+    struct uringblk_integrity *ui = dev->integrity;
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    u64 blk = blk_rq_pos(rq) >> (ui->shift - SECTOR_SHIFT);
+    unsigned int n = blk_rq_bytes(rq) >> ui->shift;
+    struct ui_tuple *tags;
+    struct ui_range range;
+    unsigned int bad = 0;
+    int ret = 0;
+
+    *status = BLK_STS_OK;
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+    case REQ_OP_WRITE:
+        break;
+    case REQ_OP_DISCARD:
+    case REQ_OP_WRITE_ZEROES:
+        /* Tuples first, the range is never checked against stale ones */
+        ui_lock_range(ui, &range, blk, n, true);
+        ret = ui_clear_tuples(ui, blk, n);
+        if (!ret && req_op(rq) == REQ_OP_DISCARD)
+            ret = ui->backend->ops->discard(ui->backend, pos, blk_rq_bytes(rq));
+        else if (!ret)
+            ret = ui_zero_data(ui->backend, pos, blk_rq_bytes(rq));
+        ui_unlock_range(ui, &range);
+        uringblk_complete_rq(rq, ret ? BLK_STS_IOERR : BLK_STS_OK);
+        return true;
+    default:
+        return false;
+    }
+
+    tags = kvcalloc(n, sizeof(*tags), GFP_NOIO);
+    if (!tags) {
+        *status = BLK_STS_RESOURCE;
+        return true;
+    }
+
+    ui_lock_range(ui, &range, blk, n, req_op(rq) != REQ_OP_READ);
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+        ret = ui_rw_data(ui->backend, rq);
+        if (!ret)
+            ret = ui_read_tuples(ui, blk, n, tags);
+        if (ret)
+            break;
+        bad = ui_check(ui, rq, tags, false);
+        if (!bad && blk_integrity_rq(rq))
+            ui_rq_tuples(rq, tags, true);
+        break;
+    default:
+        /* Tuples from above must match the data they came with */
+        if (blk_integrity_rq(rq)) {
+            ui_rq_tuples(rq, tags, false);
+            bad = ui_check(ui, rq, tags, false);
+        } else {
+            ui_check(ui, rq, tags, true);
+        }
+        if (bad)
+            break;
+        ret = ui_rw_data(ui->backend, rq);
+        if (!ret)
+            ret = ui_write_tuples(ui, blk, n, tags);
+        break;
+    }
+    ui_unlock_range(ui, &range);
+    kvfree(tags);
+
+    if (bad) {
+        uringblk_stats_media_error(dev, bad);
+        uringblk_complete_rq(rq, BLK_STS_PROTECTION);
+    } else {
+        uringblk_complete_rq(rq, ret ? BLK_STS_IOERR : BLK_STS_OK);
+    }
+    return true;
+}
@@ -17,6 +17,8 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/xarray.h>
+#include <linux/rcupdate.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/uaccess.h>
@@ -47,6 +49,10 @@ unsigned int uringblk_nr_hw_queues = URINGBLK_DEFAULT_NR_HW_QUEUES;
 module_param_named(nr_hw_queues, uringblk_nr_hw_queues, uint, 0644);
 MODULE_PARM_DESC(nr_hw_queues, "Number of hardware queues (default: 4)");
 
+unsigned int uringblk_poll_queues = 1;
+module_param_named(poll_queues, uringblk_poll_queues, uint, 0444);
+MODULE_PARM_DESC(poll_queues, "Number of IOPOLL queues in addition to nr_hw_queues when enable_poll is set (default: 1)");
+
 unsigned int uringblk_queue_depth = URINGBLK_DEFAULT_QUEUE_DEPTH;
 module_param_named(queue_depth, uringblk_queue_depth, uint, 0644);
 MODULE_PARM_DESC(queue_depth, "Queue depth per hardware queue (default: 1024)");
@@ -73,11 +79,11 @@ MODULE_PARM_DESC(capacity_mb, "Device capacity in MB (default: 1024)");
 
 int uringblk_backend_type = URINGBLK_BACKEND_VIRTUAL;
 module_param_named(backend_type, uringblk_backend_type, int, 0644);
-MODULE_PARM_DESC(backend_type, "Backend type: 0=virtual, 1=device (default: 0)");
+MODULE_PARM_DESC(backend_type, "Backend type: 0=virtual, 1=device, 2=stripe, 3=mirror, 4=file, 5=emulated (default: 0)");
 
 char *uringblk_backend_device = "";
 module_param_named(backend_device, uringblk_backend_device, charp, 0644);
-MODULE_PARM_DESC(backend_device, "Backend device path (e.g., /dev/sda1) when backend_type=1");
+MODULE_PARM_DESC(backend_device, "Backend device path (e.g., /dev/sda1) when backend_type=1, comma-separated members when backend_type=2 or 3, a file path when backend_type=4");
 
 bool uringblk_auto_detect_size = true;
 module_param_named(auto_detect_size, uringblk_auto_detect_size, bool, 0644);
@@ -85,7 +91,7 @@ MODULE_PARM_DESC(auto_detect_size, "Auto-detect device size for real block devic
 
 int uringblk_max_devices = 1;
 module_param_named(max_devices, uringblk_max_devices, int, 0444);
-MODULE_PARM_DESC(max_devices, "Maximum number of uringblk devices to create (default: 1)");
+MODULE_PARM_DESC(max_devices, "Maximum number of uringblk devices to create at load time (default: 1)");
 
 char *uringblk_devices = "";
 module_param_named(devices, uringblk_devices, charp, 0644);
@@ -93,7 +99,9 @@ MODULE_PARM_DESC(devices, "Comma-separated list of device paths (overrides backe
 
 /* Global state */
 static int uringblk_major = 0;
-static struct uringblk_device **uringblk_device_array = NULL;
+/* Devices by minor, added at load time or through the control device */
+static struct uringblk_device *uringblk_device_array[URINGBLK_MINORS];
+static DEFINE_MUTEX(uringblk_devices_mutex);
 static int num_devices = 0;
 
 /* Forward declarations */
@@ -110,193 +118,239 @@ static int virtual_backend_read(struct uringblk_backend *backend, loff_t pos, vo
 static int virtual_backend_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len);
 static int virtual_backend_flush(struct uringblk_backend *backend);
 static int virtual_backend_discard(struct uringblk_backend *backend, loff_t pos, size_t len);
+static int virtual_backend_resize(struct uringblk_backend *backend, size_t capacity);
 
 static int device_backend_init(struct uringblk_backend *backend, const char *device_path, size_t capacity);
 static void device_backend_cleanup(struct uringblk_backend *backend);
-/* Structure to hold async I/O context */
-struct uringblk_io_context {
-    struct request *rq;
-    struct uringblk_backend *backend;
-    void *buffer;
-    loff_t pos;
-    size_t len;
-    struct page *page;
-    void *kaddr;
-};
-
-/* Bio completion callback for async I/O */
-static void device_backend_bio_complete(struct bio *bio);
-static int device_backend_read_async(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len, struct request *rq);
-static int device_backend_write_async(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len, struct request *rq);
-static int device_backend_flush_async(struct uringblk_backend *backend, struct request *rq);
-
+static blk_status_t device_backend_queue_rq(struct uringblk_backend *backend, struct request *rq);
 static int device_backend_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len);
 static int device_backend_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len);
 static int device_backend_flush(struct uringblk_backend *backend);
 static int device_backend_discard(struct uringblk_backend *backend, loff_t pos, size_t len);
+static int device_backend_resize(struct uringblk_backend *backend, size_t capacity);
 
 /*
  * Block device request queue operations
  */
-blk_status_t uringblk_queue_rq(struct blk_mq_hw_ctx *hctx,
-                               const struct blk_mq_queue_data *bd)
+
+/* Carry out a started request, also for requests the scheduler held back */
+blk_status_t uringblk_run_rq(struct uringblk_queue *uq, struct request *rq)
 {
-    struct request *rq = bd->rq;
-    struct uringblk_queue *uq = hctx->driver_data;
     struct uringblk_device *dev = uq->dev;
     struct bio_vec bvec;
     struct req_iterator iter;
-    loff_t pos = blk_rq_pos(rq) * uringblk_logical_block_size;
-    loff_t dev_size = dev->backend.capacity;
-    unsigned long flags;
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    loff_t dev_size = READ_ONCE(dev->backend.capacity);
     blk_status_t status = BLK_STS_OK;
 
-    /* NOWAIT handling for this kernel version - simplified */
-
-    blk_mq_start_request(rq);
-
     /* Bounds checking */
     if (pos >= dev_size || pos + blk_rq_bytes(rq) > dev_size) {
         blk_mq_end_request(rq, BLK_STS_IOERR);
         return BLK_STS_OK;
     }
 
-    /* Update statistics */
-    spin_lock_irqsave(&dev->stats_lock, flags);
     switch (req_op(rq)) {
     case REQ_OP_READ:
-        dev->stats.read_ops++;
-        dev->stats.read_sectors += blk_rq_sectors(rq);
-        dev->stats.read_bytes += blk_rq_bytes(rq);
-        break;
     case REQ_OP_WRITE:
-        dev->stats.write_ops++;
-        dev->stats.write_sectors += blk_rq_sectors(rq);
-        dev->stats.write_bytes += blk_rq_bytes(rq);
-        break;
     case REQ_OP_FLUSH:
-        dev->stats.flush_ops++;
-        break;
     case REQ_OP_DISCARD:
-        dev->stats.discard_ops++;
+    case REQ_OP_WRITE_ZEROES:
+    case REQ_OP_ZONE_APPEND:
+        uringblk_stats_account(uq, rq);
         break;
+    case REQ_OP_ZONE_RESET:
+    case REQ_OP_ZONE_RESET_ALL:
+    case REQ_OP_ZONE_OPEN:
+    case REQ_OP_ZONE_CLOSE:
+    case REQ_OP_ZONE_FINISH:
+        if (!dev->zoned)
+            goto notsupp;
+        blk_mq_end_request(rq, uringblk_zoned_mgmt(dev, req_op(rq), blk_rq_pos(rq)));
+        return BLK_STS_OK;
     case REQ_OP_DRV_IN:
     case REQ_OP_DRV_OUT:
         /* Handle URING_CMD operations */
-        pr_info("uringblk: URING_CMD request detected, op=%u\n", req_op(rq));
-        spin_unlock_irqrestore(&dev->stats_lock, flags);
         return uringblk_handle_uring_cmd_request(rq, dev);
     default:
-        status = BLK_STS_NOTSUPP;
-        break;
+    notsupp:
+        blk_mq_end_request(rq, BLK_STS_NOTSUPP);
+        return BLK_STS_OK;
     }
-    spin_unlock_irqrestore(&dev->stats_lock, flags);
 
-    if (status != BLK_STS_OK) {
-        blk_mq_end_request(rq, status);
-        return BLK_STS_OK;
+    if (dev->zoned) {
+        status = uringblk_zoned_prep_rq(dev, rq);
+        if (status) {
+            blk_mq_end_request(rq, status);
+            return BLK_STS_OK;
+        }
+        /* Zone append has been moved to the write pointer */
+        pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
     }
 
-    /* For device backend, use async I/O to avoid RCU critical section violations */
-    if (dev->backend.type == URINGBLK_BACKEND_DEVICE) {
-        int ret = 0;
-        
-        /* Handle single-segment requests asynchronously */
-        /* Note: For simplicity, we'll handle the first segment only. 
-         * Multi-segment support would require more complex async handling */
-        rq_for_each_segment(bvec, rq, iter) {
-            void *buffer = page_address(bvec.bv_page) + bvec.bv_offset;
-            size_t len = bvec.bv_len;
+    /* The write-back cache hands on whatever it does not complete itself */
+    if (dev->wbcache && uringblk_wbcache_queue_rq(dev, rq, &status))
+        return status;
 
-            if (pos + len > dev_size) {
-                len = dev_size - pos;
-            }
+    /* So does the read cache */
+    if (dev->flashcache && uringblk_flashcache_queue_rq(dev, rq))
+        return BLK_STS_OK;
 
-            switch (req_op(rq)) {
-            case REQ_OP_READ:
-                ret = device_backend_read_async(&dev->backend, pos, buffer, len, rq);
-                break;
-            case REQ_OP_WRITE:
-                ret = device_backend_write_async(&dev->backend, pos, buffer, len, rq);
-                break;
-            case REQ_OP_FLUSH:
-                ret = device_backend_flush_async(&dev->backend, rq);
-                break;
-            case REQ_OP_DISCARD:
-                /* For now, treat discard as successful without actual implementation */
-                ret = 0;
-                blk_mq_end_request(rq, BLK_STS_OK);
-                break;
-            default:
-                blk_mq_end_request(rq, BLK_STS_NOTSUPP);
-                return BLK_STS_OK;
-            }
-            
-            if (ret < 0) {
-                blk_mq_end_request(rq, BLK_STS_IOERR);
-                return BLK_STS_OK;
-            }
-            
-            /* For async operations, the completion callback will call blk_mq_end_request */
-            /* Only handle the first segment for now */
-            if (req_op(rq) != REQ_OP_DISCARD) {
-                return BLK_STS_OK;
-            }
-            break;
-        }
-        
+    /* Multi-block writes that must not tear go through the journal */
+    if (dev->atomic && uringblk_atomic_queue_rq(dev, rq))
         return BLK_STS_OK;
-    } else {
-        /* For virtual backend, use synchronous I/O (no RCU issues) */
+
+    /* Tagged devices check and store the tags along with the data */
+    if (dev->integrity && uringblk_integrity_queue_rq(dev, rq, &status))
+        return status;
+
+    /* Backends that complete asynchronously take the request over */
+    if (dev->backend.ops->queue_rq)
+        return dev->backend.ops->queue_rq(&dev->backend, rq);
+
+    switch (req_op(rq)) {
+    case REQ_OP_FLUSH:
+        if (dev->backend.ops->flush(&dev->backend) < 0)
+            status = BLK_STS_IOERR;
+        break;
+    case REQ_OP_DISCARD:
+    case REQ_OP_WRITE_ZEROES:
+        /* Synchronous backends read discarded ranges back as zeroes */
+        if (dev->backend.ops->discard(&dev->backend, pos, blk_rq_bytes(rq)) < 0)
+            status = BLK_STS_IOERR;
+        break;
+    default:
+        /* Synchronous backends copy segment by segment */
         rq_for_each_segment(bvec, rq, iter) {
             void *buffer = page_address(bvec.bv_page) + bvec.bv_offset;
             size_t len = bvec.bv_len;
-            int ret = 0;
+            int ret;
 
-            if (pos + len > dev_size) {
-                len = dev_size - pos;
-            }
-
-            switch (req_op(rq)) {
-            case REQ_OP_READ:
+            if (req_op(rq) == REQ_OP_READ)
                 ret = dev->backend.ops->read(&dev->backend, pos, buffer, len);
-                if (ret < 0) {
-                    status = BLK_STS_IOERR;
-                }
-                break;
-            case REQ_OP_WRITE:
+            else
                 ret = dev->backend.ops->write(&dev->backend, pos, buffer, len);
-                if (ret < 0) {
-                    status = BLK_STS_IOERR;
-                }
-                break;
-            case REQ_OP_FLUSH:
-                ret = dev->backend.ops->flush(&dev->backend);
-                if (ret < 0) {
-                    status = BLK_STS_IOERR;
-                }
-                break;
-            case REQ_OP_DISCARD:
-                ret = dev->backend.ops->discard(&dev->backend, pos, len);
-                if (ret < 0) {
-                    status = BLK_STS_IOERR;
-                }
-                break;
-            default:
-                status = BLK_STS_NOTSUPP;
-                break;
-            }
-
-            if (status != BLK_STS_OK) {
+            if (ret < 0) {
+                status = BLK_STS_IOERR;
                 break;
             }
 
             pos += len;
         }
+        break;
+    }
+
+    uringblk_complete_rq(rq, status);
+    return BLK_STS_OK;
+}
+
+static blk_status_t uringblk_dispatch_rq(struct uringblk_queue *uq, struct request *rq)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+    /* NOWAIT handling for this kernel version - simplified */
 
-        blk_mq_end_request(rq, status);
+    blk_mq_start_request(rq);
+    cmd->start_ns = ktime_get_ns();
+    cmd->poll_bio = NULL;
+
+    /* Bulk writes out of tokens wait on the hw queue's bulk list */
+    if (uringblk_sched_hold(uq, rq))
         return BLK_STS_OK;
+
+    return uringblk_run_rq(uq, rq);
+}
+
+blk_status_t uringblk_queue_rq(struct blk_mq_hw_ctx *hctx,
+                               const struct blk_mq_queue_data *bd)
+{
+    struct uringblk_queue *uq = hctx->driver_data;
+    struct blk_plug plug, *outer;
+    blk_status_t status;
+
+    /* Backends issuing bios directly must not reach the plug being flushed */
+    outer = uringblk_plug_begin(&plug);
+    status = uringblk_dispatch_rq(uq, bd->rq);
+
+    /* More requests follow, their lower bios go out with this one's */
+    if (bd->last)
+        uringblk_bio_commit(uq);
+    uringblk_plug_end(&plug, outer);
+    return status;
+}
+
+/* blk-mq stopped short of the request it announced as last */
+static void uringblk_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+    uringblk_bio_commit(hctx->driver_data);
+}
+
+#define URINGBLK_REQUEUE_DELAY_MS 3
+
+/*
+ * A whole plug batch, typically one io_uring submission. @rqlist is
+ * the list of the plug blk-mq is flushing, so the walk runs under a
+ * plug of our own and the lower bios of every request are issued
+ * through it once the list has been walked. When the backend runs short of resources the walk stops
+ * and the requests not yet issued stay on @rqlist, blk-mq hands them to
+ * ->queue_rq one by one and handles the shortage there. The request
+ * that hit it has already been started and can only be requeued.
+ */
+static void uringblk_queue_rqs(struct request **rqlist)
+{
+    struct uringblk_queue *uq, *prev = NULL;
+    struct blk_plug plug, *outer;
+    struct request *rq;
+
+    outer = uringblk_plug_begin(&plug);
+    while ((rq = rq_list_pop(rqlist))) {
+        blk_status_t status;
+
+        uq = rq->mq_hctx->driver_data;
+        if (prev && prev != uq)
+            uringblk_bio_commit(prev);
+        prev = uq;
+
+        status = uringblk_dispatch_rq(uq, rq);
+        if (status == BLK_STS_RESOURCE || status == BLK_STS_DEV_RESOURCE) {
+            blk_mq_requeue_request(rq, false);
+            blk_mq_delay_kick_requeue_list(rq->q, URINGBLK_REQUEUE_DELAY_MS);
+            break;
+        }
+        if (status != BLK_STS_OK)
+            blk_mq_end_request(rq, status);
     }
+    if (prev)
+        uringblk_bio_commit(prev);
+    uringblk_plug_end(&plug, outer);
+}
+
+static void uringblk_complete_batch(struct io_comp_batch *iob)
+{
+    blk_mq_end_request_batch(iob);
+}
+
+void uringblk_complete_rq(struct request *rq, blk_status_t status)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct uringblk_queue *uq = rq->mq_hctx->driver_data;
+    struct io_comp_batch *iob = NULL;
+
+    uringblk_lat_record(uq, rq, ktime_get_ns() - cmd->start_ns);
+
+    /* Promotions that raced with a write must not outlive it */
+    if (uq->dev->flashcache && op_is_write(req_op(rq)))
+        uringblk_flashcache_write_done(uq->dev, rq);
+
+    if (rq->cmd_flags & REQ_POLLED) {
+        uringblk_bio_poll_done(rq);
+        iob = uringblk_bio_poll_batch();
+    }
+
+    /* Polled completions are finished in a batch by the poller */
+    if (blk_mq_add_to_batch(rq, iob, status != BLK_STS_OK, uringblk_complete_batch))
+        return;
+
+    blk_mq_end_request(rq, status);
 }
 
 int uringblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
@@ -313,6 +367,14 @@ int uringblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
     uq->hctx = hctx;
     uq->queue_num = hctx_idx;
     spin_lock_init(&uq->lock);
+    INIT_LIST_HEAD(&uq->poll_list);
+    bio_list_init(&uq->deferred);
+    uringblk_sched_init_queue(uq);
+
+    if (uringblk_queue_stats_alloc(uq)) {
+        kfree(uq);
+        return -ENOMEM;
+    }
 
     hctx->driver_data = uq;
     return 0;
@@ -320,39 +382,57 @@ int uringblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 
 void uringblk_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
 {
-    kfree(hctx->driver_data);
+    struct uringblk_queue *uq = hctx->driver_data;
+
+    uringblk_sched_exit_queue(uq);
+    uringblk_queue_stats_free(uq);
+    kfree(uq);
     hctx->driver_data = NULL;
 }
 
 int uringblk_poll_fn(struct blk_mq_hw_ctx *hctx, struct io_comp_batch *iob)
 {
     struct uringblk_queue *uq = hctx->driver_data;
-    struct uringblk_device *dev = uq->dev;
-    int completed = 0;
-    
-    /* Check if polling is enabled */
-    if (!dev->config.enable_poll) {
-        return 0;
-    }
-    
-    /* For virtual backend, operations complete immediately so no polling needed */
-    if (dev->backend.type == URINGBLK_BACKEND_VIRTUAL) {
-        return 0;
+
+    /* Synchronous backends complete in queue_rq, only lower bios need polling */
+    return uringblk_bio_poll(uq, iob);
+}
+
+/* Default queues first, then the HCTX_TYPE_POLL queues */
+static void uringblk_map_queues(struct blk_mq_tag_set *set)
+{
+    struct uringblk_device *dev = set->driver_data;
+    unsigned int i, qoff;
+
+    for (i = 0, qoff = 0; i < set->nr_maps; i++) {
+        struct blk_mq_queue_map *map = &set->map[i];
+
+        switch (i) {
+        case HCTX_TYPE_DEFAULT:
+            map->nr_queues = dev->config.nr_hw_queues;
+            break;
+        case HCTX_TYPE_POLL:
+            map->nr_queues = dev->config.nr_poll_queues;
+            break;
+        default:
+            map->nr_queues = 0;
+            continue;
+        }
+
+        map->queue_offset = qoff;
+        qoff += map->nr_queues;
+        blk_mq_map_queues(map);
     }
-    
-    /* For device backends, polling is more complex and would require tracking
-     * pending async operations. For now, just return 0 completed operations.
-     * In a full implementation, we'd track pending async I/O and poll their status.
-     */
-    
-    return completed;
 }
 
 static const struct blk_mq_ops uringblk_mq_ops = {
     .queue_rq = uringblk_queue_rq,
+    .queue_rqs = uringblk_queue_rqs,
+    .commit_rqs = uringblk_commit_rqs,
     .init_hctx = uringblk_init_hctx,
     .exit_hctx = uringblk_exit_hctx,
     .poll = uringblk_poll_fn,
+    .map_queues = uringblk_map_queues,
 };
 
 /*
@@ -365,10 +445,14 @@ static int validate_backend_config(int backend_type, const char *device_path)
             
     switch (backend_type) {
     case URINGBLK_BACKEND_VIRTUAL:
+    case URINGBLK_BACKEND_EMUL:
         /* Virtual backend doesn't need device path */
         pr_info("uringblk: DEBUG - Virtual backend validation passed\n");
         return 0;
     case URINGBLK_BACKEND_DEVICE:
+    case URINGBLK_BACKEND_STRIPE:
+    case URINGBLK_BACKEND_MIRROR:
+    case URINGBLK_BACKEND_FILE:
         if (!device_path || strlen(device_path) == 0) {
             pr_err("uringblk: DEBUG - device backend requires a valid device path\n");
             return -EINVAL;
@@ -385,6 +469,21 @@ static int validate_backend_config(int backend_type, const char *device_path)
     }
 }
 
+/* Backends that build one device out of several lower devices */
+static bool uringblk_backend_multi(void)
+{
+    return uringblk_backend_type == URINGBLK_BACKEND_STRIPE ||
+           uringblk_backend_type == URINGBLK_BACKEND_MIRROR;
+}
+
+/* Path(s) handed to the backend, a stripe or mirror takes its members from devices= */
+static const char *uringblk_backend_path(void)
+{
+    if (uringblk_backend_multi() && strlen(uringblk_devices) > 0)
+        return uringblk_devices;
+    return uringblk_backend_device;
+}
+
 static int parse_device_list(const char *device_str, char ***device_paths, int *count)
 {
     char *str_copy, *start, *end;
@@ -499,11 +598,17 @@ static void free_device_list(char **device_paths, int count)
 int uringblk_open(struct gendisk *disk, blk_mode_t mode)
 {
     struct uringblk_device *dev = disk->private_data;
+    int ret = 0;
     
     if (!dev)
         return -ENODEV;
 
-    return 0;
+    /* Removal checks for openers under the same lock */
+    mutex_lock(&dev->admin_mutex);
+    if (dev->deleting)
+        ret = -ENXIO;
+    mutex_unlock(&dev->admin_mutex);
+    return ret;
 }
 
 void uringblk_release(struct gendisk *disk)
@@ -536,113 +641,73 @@ struct uringblk_uring_cmd {
     __u64 addr;          /* User response buffer address */
 } __packed;
 
-/* PDU structure for our URING_CMD operations */
-struct uringblk_cmd_pdu {
-    struct uringblk_device *dev;
-    int result;
-};
-
-static inline struct uringblk_cmd_pdu *uringblk_cmd_pdu(struct io_uring_cmd *cmd)
-{
-    return (struct uringblk_cmd_pdu *)cmd->pdu;
-}
-
-/* Task work completion for async URING_CMD operations */
-static void uringblk_uring_cmd_complete_async(struct io_uring_cmd *cmd, unsigned int issue_flags)
-{
-    struct uringblk_cmd_pdu *pdu = uringblk_cmd_pdu(cmd);
-    io_uring_cmd_done(cmd, pdu->result, 0, issue_flags);
-}
-
+/*
+ * Every admin command runs to completion in the issuing context and its
+ * result is returned inline. Read-only commands work on seqcount
+ * protected state and never take admin_mutex, so monitoring can poll
+ * them from any context at any rate. Commands that change the device
+ * are serialised on admin_mutex; a nonblocking issue that finds it held
+ * returns -EAGAIN and io_uring retries from a worker.
+ */
 int uringblk_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
 {
-    const struct io_uring_sqe *sqe = ioucmd->sqe;
-    const struct uringblk_uring_cmd *ucmd = (const struct uringblk_uring_cmd *)io_uring_sqe_cmd(sqe);
-    struct uringblk_cmd_pdu *pdu = uringblk_cmd_pdu(ioucmd);
-    struct uringblk_device *dev;
-    void __user *user_addr;
+    const struct uringblk_uring_cmd *ucmd = io_uring_sqe_cmd(ioucmd->sqe);
+    struct uringblk_device *dev = ioucmd->file->private_data;
+    u16 opcode = READ_ONCE(ucmd->opcode);
+    u32 len = READ_ONCE(ucmd->len);
+    void __user *argp = u64_to_user_ptr(READ_ONCE(ucmd->addr));
     int ret;
 
-    pr_info("uringblk: uring_cmd called with sqe->opcode=%u, issue_flags=0x%x\n", sqe->opcode, issue_flags);
-    
-    /* Handle cancellation */
-    if (issue_flags & IO_URING_F_CANCEL) {
+    if (issue_flags & IO_URING_F_CANCEL)
         return -ECANCELED;
-    }
 
-    pr_info("uringblk: URING_CMD ucmd->opcode=%u, ucmd->len=%u, ucmd->flags=0x%x\n", 
-            ucmd->opcode, ucmd->len, ucmd->flags);
-    
-    /* Get device from file's private data (set during open) */
-    dev = (struct uringblk_device *)ioucmd->file->private_data;
-    if (!dev) {
+    if (!dev)
         return -ENODEV;
-    }
 
-    /* Store device in PDU for async completion */
-    pdu->dev = dev;
+    /* Data commands bypass the admin path entirely */
+    if (opcode >= URINGBLK_UCMD_READ && opcode <= URINGBLK_UCMD_WRITEV)
+        return uringblk_pt_cmd(dev, ioucmd, issue_flags);
 
-    /* Validate command parameters */
-    if (ucmd->len > 4096) { /* Reasonable max response size */
+    if (len > 4096) /* Reasonable max response size */
         return -EINVAL;
-    }
-
-    user_addr = (void __user *)(unsigned long)ucmd->addr;
-
-    /* For nonblocking operations, check if we need to sleep */
-    if (issue_flags & IO_URING_F_NONBLOCK) {
-        if (mutex_is_locked(&dev->admin_mutex)) {
-            return -EAGAIN; /* Retry from blocking context */
-        }
-    }
-
-    /* Take admin mutex */
-    if (mutex_lock_interruptible(&dev->admin_mutex)) {
-        return -ERESTARTSYS;
-    }
 
-    /* Mark as cancelable after taking mutex */
-    io_uring_cmd_mark_cancelable(ioucmd, issue_flags);
-
-    /* Dispatch command synchronously */
-    switch (ucmd->opcode) {
+    switch (opcode) {
     case URINGBLK_UCMD_IDENTIFY:
-        ret = uringblk_cmd_identify(dev, user_addr, ucmd->len);
-        break;
+        return uringblk_cmd_identify(dev, argp, len);
     case URINGBLK_UCMD_GET_LIMITS:
-        ret = uringblk_cmd_get_limits(dev, user_addr, ucmd->len);
-        break;
+        return uringblk_cmd_get_limits(dev, argp, len);
     case URINGBLK_UCMD_GET_FEATURES:
-        ret = uringblk_cmd_get_features(dev, user_addr, ucmd->len);
-        break;
-    case URINGBLK_UCMD_SET_FEATURES:
-        ret = uringblk_cmd_set_features(dev, user_addr, ucmd->len);
-        break;
+        return uringblk_cmd_get_features(dev, argp, len);
     case URINGBLK_UCMD_GET_GEOMETRY:
-        ret = uringblk_cmd_get_geometry(dev, user_addr, ucmd->len);
-        break;
+        return uringblk_cmd_get_geometry(dev, argp, len);
     case URINGBLK_UCMD_GET_STATS:
-        ret = uringblk_cmd_get_stats(dev, user_addr, ucmd->len);
+        return uringblk_cmd_get_stats(dev, argp, len);
+    case URINGBLK_UCMD_SET_FEATURES:
+    case URINGBLK_UCMD_ZONE_MGMT:
         break;
     default:
-        ret = -EOPNOTSUPP;
-        break;
+        return -EOPNOTSUPP;
     }
 
+    if (issue_flags & IO_URING_F_NONBLOCK) {
+        if (!mutex_trylock(&dev->admin_mutex))
+            return -EAGAIN;
+    } else if (mutex_lock_interruptible(&dev->admin_mutex)) {
+        return -ERESTARTSYS;
+    }
+
+    if (opcode == URINGBLK_UCMD_SET_FEATURES)
+        ret = uringblk_cmd_set_features(dev, argp, len);
+    else
+        ret = uringblk_cmd_zone_mgmt(dev, argp, len);
+
     mutex_unlock(&dev->admin_mutex);
-    
-    /* Store result in PDU and complete asynchronously */
-    pdu->result = ret;
-    __io_uring_cmd_do_in_task(ioucmd, uringblk_uring_cmd_complete_async, IO_URING_F_COMPLETE_DEFER);
-    
-    return -EIOCBQUEUED; /* Tell io_uring we'll call io_uring_cmd_done() later */
+    return ret;
 }
 
 /* Handle URING_CMD operations that come through blk-mq as REQ_OP_DRV_IN/OUT */
 blk_status_t uringblk_handle_uring_cmd_request(struct request *rq, struct uringblk_device *dev)
 {
-    pr_info("uringblk: handling URING_CMD via blk-mq, request op=%u\n", req_op(rq));
-    
     /* For now, return success - this proves the path is working */
     blk_mq_end_request(rq, BLK_STS_OK);
     return BLK_STS_OK;
@@ -650,7 +715,6 @@ blk_status_t uringblk_handle_uring_cmd_request(struct request *rq, struct uringb
 
 int uringblk_handle_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags)
 {
-    pr_info("uringblk: uringblk_handle_uring_cmd called\n");
     return uringblk_uring_cmd(cmd, issue_flags);
 }
 
@@ -659,6 +723,7 @@ static const struct block_device_operations uringblk_fops = {
     .open = uringblk_open,
     .release = uringblk_release,
     .getgeo = uringblk_getgeo,
+    .report_zones = uringblk_report_zones,
 };
 
 /*
@@ -671,6 +736,7 @@ static const struct uringblk_backend_ops virtual_backend_ops = {
     .write = virtual_backend_write,
     .flush = virtual_backend_flush,
     .discard = virtual_backend_discard,
+    .resize = virtual_backend_resize,
 };
 
 static const struct uringblk_backend_ops device_backend_ops = {
@@ -680,6 +746,8 @@ static const struct uringblk_backend_ops device_backend_ops = {
     .write = device_backend_write,
     .flush = device_backend_flush,
     .discard = device_backend_discard,
+    .queue_rq = device_backend_queue_rq,
+    .resize = device_backend_resize,
 };
 
 /*
@@ -698,14 +766,14 @@ int uringblk_cmd_identify(struct uringblk_device *dev, void __user *argp, u32 le
     id.logical_block_size = uringblk_logical_block_size;
     id.physical_block_size = uringblk_logical_block_size;
     id.capacity_sectors = dev->backend.capacity / uringblk_logical_block_size;
-    id.features_bitmap = dev->features;
+    id.features_bitmap = uringblk_features(dev);
     id.queue_count = dev->config.nr_hw_queues;
     id.queue_depth = dev->config.queue_depth;
     id.max_segments = URINGBLK_MAX_SEGMENTS;
     id.max_segment_size = URINGBLK_MAX_SEGMENT_SIZE;
     id.dma_alignment = 4096;
-    id.io_min = uringblk_logical_block_size;
-    id.io_opt = 64 * 1024;
+    id.io_min = queue_io_min(dev->disk->queue);
+    id.io_opt = queue_io_opt(dev->disk->queue);
 
     if (copy_to_user(argp, &id, sizeof(id)))
         return -EFAULT;
@@ -717,8 +785,10 @@ int uringblk_cmd_get_limits(struct uringblk_device *dev, void __user *argp, u32
 {
     struct uringblk_limits limits;
 
-    if (len < sizeof(limits))
+    /* Callers built against ABI 1.0 get the fields they know about */
+    if (len < URINGBLK_LIMITS_SIZE_V1_0)
         return -EINVAL;
+    len = min_t(u32, len, sizeof(limits));
 
     memset(&limits, 0, sizeof(limits));
     limits.max_hw_sectors_kb = 4096;
@@ -728,24 +798,27 @@ int uringblk_cmd_get_limits(struct uringblk_device *dev, void __user *argp, u32
     limits.max_segments = URINGBLK_MAX_SEGMENTS;
     limits.max_segment_size = URINGBLK_MAX_SEGMENT_SIZE;
     limits.dma_alignment = 4096;
-    limits.io_min = uringblk_logical_block_size;
-    limits.io_opt = 64 * 1024;
+    limits.io_min = queue_io_min(dev->disk->queue);
+    limits.io_opt = queue_io_opt(dev->disk->queue);
+    uringblk_atomic_limits(dev, &limits);
 
-    if (copy_to_user(argp, &limits, sizeof(limits)))
+    if (copy_to_user(argp, &limits, len))
         return -EFAULT;
 
-    return sizeof(limits);
+    return len;
 }
 
 int uringblk_cmd_get_features(struct uringblk_device *dev, void __user *argp, u32 len)
 {
-    if (len < sizeof(dev->features))
+    u64 features = uringblk_features(dev);
+
+    if (len < sizeof(features))
         return -EINVAL;
 
-    if (copy_to_user(argp, &dev->features, sizeof(dev->features)))
+    if (copy_to_user(argp, &features, sizeof(features)))
         return -EFAULT;
 
-    return sizeof(dev->features);
+    return sizeof(features);
 }
 
 int uringblk_cmd_get_geometry(struct uringblk_device *dev, void __user *argp, u32 len)
@@ -769,65 +842,42 @@ int uringblk_cmd_get_geometry(struct uringblk_device *dev, void __user *argp, u3
     return sizeof(geo);
 }
 
-static u32 calculate_latency_percentile(u32 *buckets, int bucket_count, int percentile)
+static u32 uringblk_ns_to_us(u64 ns)
 {
-    u64 total_ops = 0;
-    u64 target_ops;
-    u64 running_total = 0;
-    int i;
-    
-    /* Calculate total operations */
-    for (i = 0; i < bucket_count; i++) {
-        total_ops += buckets[i];
-    }
-    
-    if (total_ops == 0) {
-        return 0;
-    }
-    
-    /* Use integer arithmetic to avoid floating point in kernel */
-    target_ops = (total_ops * percentile) / 100;
-    
-    /* Find the bucket where we reach the target */
-    for (i = 0; i < bucket_count; i++) {
-        running_total += buckets[i];
-        if (running_total >= target_ops) {
-            /* Return latency for this bucket (simple approximation) */
-            return i * 10; /* Each bucket represents 10μs */
-        }
-    }
-    
-    return (bucket_count - 1) * 10;
+    return min_t(u64, DIV_ROUND_UP_ULL(ns, NSEC_PER_USEC), U32_MAX);
 }
 
 int uringblk_cmd_get_stats(struct uringblk_device *dev, void __user *argp, u32 len)
 {
+    struct uringblk_lat_summary rd, wr;
     struct uringblk_stats stats;
-    unsigned long flags;
-    u32 latency_buckets[32];
 
-    if (len < sizeof(stats))
+    /* Callers built against ABI 1.0 get the fields they know about */
+    if (len < URINGBLK_STATS_SIZE_V1_0)
         return -EINVAL;
+    len = min_t(u32, len, sizeof(stats));
 
-    spin_lock_irqsave(&dev->stats_lock, flags);
-    memcpy(&stats, &dev->stats, sizeof(stats));
-    spin_unlock_irqrestore(&dev->stats_lock, flags);
-    
-    /* Get latency data for percentile calculation */
-    spin_lock_irqsave(&dev->latency_lock, flags);
-    memcpy(latency_buckets, dev->latency_buckets, sizeof(latency_buckets));
-    spin_unlock_irqrestore(&dev->latency_lock, flags);
-    
-    /* Calculate latency percentiles */
-    stats.p50_read_latency_us = calculate_latency_percentile(latency_buckets, 32, 50);
-    stats.p99_read_latency_us = calculate_latency_percentile(latency_buckets, 32, 99);
-    stats.p50_write_latency_us = calculate_latency_percentile(latency_buckets, 32, 50);
-    stats.p99_write_latency_us = calculate_latency_percentile(latency_buckets, 32, 99);
+    uringblk_stats_snapshot(dev, &stats);
+
+    if (uringblk_lat_summary(dev, NULL, URINGBLK_LAT_READ, &rd) ||
+        uringblk_lat_summary(dev, NULL, URINGBLK_LAT_WRITE, &wr))
+        return -ENOMEM;
 
-    if (copy_to_user(argp, &stats, sizeof(stats)))
+    stats.p50_read_latency_us = uringblk_ns_to_us(rd.p50);
+    stats.p90_read_latency_us = uringblk_ns_to_us(rd.p90);
+    stats.p99_read_latency_us = uringblk_ns_to_us(rd.p99);
+    stats.p999_read_latency_us = uringblk_ns_to_us(rd.p999);
+    stats.max_read_latency_us = uringblk_ns_to_us(rd.max);
+    stats.p50_write_latency_us = uringblk_ns_to_us(wr.p50);
+    stats.p90_write_latency_us = uringblk_ns_to_us(wr.p90);
+    stats.p99_write_latency_us = uringblk_ns_to_us(wr.p99);
+    stats.p999_write_latency_us = uringblk_ns_to_us(wr.p999);
+    stats.max_write_latency_us = uringblk_ns_to_us(wr.max);
+
+    if (copy_to_user(argp, &stats, len))
         return -EFAULT;
 
-    return sizeof(stats);
+    return len;
 }
 
 int uringblk_cmd_set_features(struct uringblk_device *dev, void __user *argp, u32 len)
@@ -845,11 +895,18 @@ int uringblk_cmd_set_features(struct uringblk_device *dev, void __user *argp, u3
                            URINGBLK_FEAT_FLUSH | URINGBLK_FEAT_DISCARD |
                            URINGBLK_FEAT_WRITE_ZEROES | URINGBLK_FEAT_POLLING;
     
-    if (features & ~supported_features) {
+    /*
+     * Called with admin_mutex held. The other bits (zoned, atomic write,
+     * integrity) describe how the device was set up and stay as they are;
+     * the caller may pass them back unchanged from GET_FEATURES.
+     */
+    if ((features ^ dev->features) & ~supported_features) {
         return -EINVAL;
     }
     
-    dev->features = features;
+    write_seqcount_begin(&dev->admin_seq);
+    dev->features = (dev->features & ~supported_features) | (features & supported_features);
+    write_seqcount_end(&dev->admin_seq);
     
     return 0;
 }
@@ -857,9 +914,21 @@ int uringblk_cmd_set_features(struct uringblk_device *dev, void __user *argp, u3
 /*
  * Virtual backend implementation
  */
+/*
+ * The virtual backend is thin provisioned: pages are allocated on first
+ * write and indexed by page offset in an xarray. Holes read as zeroes.
+ * Readers and writers copy under rcu_read_lock() and discarded pages
+ * are freed after a grace period, so a discard never pulls a page out
+ * from under a concurrent copy.
+ */
+struct virtual_store {
+    struct xarray pages;
+    atomic_long_t nr_pages;
+};
+
 static int virtual_backend_init(struct uringblk_backend *backend, const char *device_path, size_t capacity)
 {
-    void *data;
+    struct virtual_store *store;
 
     pr_info("uringblk: DEBUG - virtual_backend_init called with capacity=%zu bytes", capacity);
     
@@ -868,55 +937,123 @@ static int virtual_backend_init(struct uringblk_backend *backend, const char *de
         return -EINVAL;
     }
     
-    if (capacity > SIZE_MAX) {
-        pr_err("uringblk: DEBUG - virtual backend capacity too large: %zu", capacity);
-        return -EINVAL;
-    }
-    
-    pr_info("uringblk: DEBUG - allocating %zu bytes of virtual memory", capacity);
-    data = vzalloc(capacity);
-    if (!data) {
-        pr_err("uringblk: DEBUG - failed to allocate %zu bytes for virtual backend", capacity);
+    store = kzalloc(sizeof(*store), GFP_KERNEL);
+    if (!store)
         return -ENOMEM;
-    }
-    pr_info("uringblk: DEBUG - virtual memory allocation successful");
 
-    backend->private_data = data;
+    xa_init(&store->pages);
+    atomic_long_set(&store->nr_pages, 0);
+
+    backend->private_data = store;
     backend->capacity = capacity;
     backend->type = URINGBLK_BACKEND_VIRTUAL;
     backend->ops = &virtual_backend_ops;
-    mutex_init(&backend->io_mutex);
 
     return 0;
 }
 
+/* In-memory store for backends that keep their data in RAM */
+int uringblk_virtual_init(struct uringblk_backend *backend, size_t capacity)
+{
+    return virtual_backend_init(backend, NULL, capacity);
+}
+
+static void virtual_free_page_rcu(struct rcu_head *head)
+{
+    __free_page(container_of(head, struct page, rcu_head));
+}
+
 static void virtual_backend_cleanup(struct uringblk_backend *backend)
 {
-    if (backend->private_data) {
-        vfree(backend->private_data);
-        backend->private_data = NULL;
-    }
+    struct virtual_store *store = backend->private_data;
+    struct page *page;
+    unsigned long idx;
+
+    if (!store)
+        return;
+
+    xa_for_each(&store->pages, idx, page)
+        __free_page(page);
+    xa_destroy(&store->pages);
+
+    /* Discards may still have pages waiting for a grace period */
+    rcu_barrier();
+
+    pr_info("uringblk: virtual backend released %ld pages\n",
+            atomic_long_read(&store->nr_pages));
+    kfree(store);
+    backend->private_data = NULL;
 }
 
 static int virtual_backend_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len)
 {
-    void *data = backend->private_data;
+    struct virtual_store *store = backend->private_data;
 
-    if (!data || pos + len > backend->capacity)
+    if (!store || pos + len > backend->capacity + backend->reserved)
         return -EINVAL;
 
-    memcpy(buf, data + pos, len);
+    rcu_read_lock();
+    while (len) {
+        size_t off = offset_in_page(pos);
+        size_t n = min_t(size_t, len, PAGE_SIZE - off);
+        struct page *page = xa_load(&store->pages, pos >> PAGE_SHIFT);
+
+        if (page)
+            memcpy(buf, page_address(page) + off, n);
+        else
+            memset(buf, 0, n);
+
+        buf += n;
+        pos += n;
+        len -= n;
+    }
+    rcu_read_unlock();
+
     return 0;
 }
 
 static int virtual_backend_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len)
 {
-    void *data = backend->private_data;
+    struct virtual_store *store = backend->private_data;
+    struct page *page, *old;
 
-    if (!data || pos + len > backend->capacity)
+    if (!store || pos + len > backend->capacity + backend->reserved)
         return -EINVAL;
 
-    memcpy(data + pos, buf, len);
+    while (len) {
+        size_t off = offset_in_page(pos);
+        size_t n = min_t(size_t, len, PAGE_SIZE - off);
+        pgoff_t idx = pos >> PAGE_SHIFT;
+
+        rcu_read_lock();
+        page = xa_load(&store->pages, idx);
+        if (page) {
+            memcpy(page_address(page) + off, buf, n);
+            rcu_read_unlock();
+            buf += n;
+            pos += n;
+            len -= n;
+            continue;
+        }
+        rcu_read_unlock();
+
+        /* First write to this page, a racing writer may beat us to it */
+        page = alloc_page(GFP_NOIO | __GFP_ZERO);
+        if (!page)
+            return -ENOMEM;
+
+        old = xa_cmpxchg(&store->pages, idx, NULL, page, GFP_NOIO);
+        if (xa_is_err(old)) {
+            __free_page(page);
+            return xa_err(old);
+        }
+        if (old)
+            __free_page(page);
+        else
+            atomic_long_inc(&store->nr_pages);
+        /* Copy on the next pass under rcu_read_lock() */
+    }
+
     return 0;
 }
 
@@ -926,14 +1063,61 @@ static int virtual_backend_flush(struct uringblk_backend *backend)
     return 0;
 }
 
+/* Zero the resident parts of a byte range */
+static void virtual_zero_range(struct virtual_store *store, loff_t pos, loff_t end)
+{
+    struct page *page;
+
+    rcu_read_lock();
+    while (pos < end) {
+        size_t off = offset_in_page(pos);
+        size_t n = min_t(loff_t, end - pos, PAGE_SIZE - off);
+
+        page = xa_load(&store->pages, pos >> PAGE_SHIFT);
+        if (page)
+            memset(page_address(page) + off, 0, n);
+        pos += n;
+    }
+    rcu_read_unlock();
+}
+
+/* Discard and write zeroes: whole pages are freed, partial ones zeroed */
 static int virtual_backend_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
 {
-    void *data = backend->private_data;
+    struct virtual_store *store = backend->private_data;
+    loff_t end = pos + len;
+    loff_t head = round_up(pos, PAGE_SIZE);
+    loff_t tail = round_down(end, PAGE_SIZE);
+    struct page *page;
+    unsigned long idx;
 
-    if (!data || pos + len > backend->capacity)
+    if (!store || end > backend->capacity + backend->reserved)
         return -EINVAL;
 
-    memset(data + pos, 0, len);
+    if (head >= tail) {
+        virtual_zero_range(store, pos, end);
+        return 0;
+    }
+
+    virtual_zero_range(store, pos, head);
+    virtual_zero_range(store, tail, end);
+
+    /* Only resident pages are visited */
+    xa_for_each_range(&store->pages, idx, page, head >> PAGE_SHIFT,
+                      (tail >> PAGE_SHIFT) - 1) {
+        if (xa_cmpxchg(&store->pages, idx, page, NULL, 0) != page)
+            continue;
+        atomic_long_dec(&store->nr_pages);
+        call_rcu(&page->rcu_head, virtual_free_page_rcu);
+    }
+
+    return 0;
+}
+
+/* Pages are allocated on first write, growing only moves the limit */
+static int virtual_backend_resize(struct uringblk_backend *backend, size_t capacity)
+{
+    WRITE_ONCE(backend->capacity, capacity);
     return 0;
 }
 
@@ -1021,7 +1205,7 @@ static int device_backend_init(struct uringblk_backend *backend, const char *dev
     }
 
     /* Auto-detect size or validate requested capacity */
-    if (uringblk_auto_detect_size || capacity == 0) {
+    if (capacity == 0) {
         capacity = device_size;
         pr_info("uringblk: auto-detected device size: %lld bytes (%lld MB)\n", 
                 device_size, device_size / (1024 * 1024));
@@ -1035,7 +1219,6 @@ static int device_backend_init(struct uringblk_backend *backend, const char *dev
     backend->capacity = capacity;
     backend->type = URINGBLK_BACKEND_DEVICE;
     backend->ops = &device_backend_ops;
-    mutex_init(&backend->io_mutex);
 
     pr_info("uringblk: using device backend %s (capacity: %zu bytes, %zu MB)\n", 
             device_path, capacity, capacity / (1024 * 1024));
@@ -1052,262 +1235,48 @@ static void device_backend_cleanup(struct uringblk_backend *backend)
     }
 }
 
-/* Bio completion callback for async I/O */
-static void device_backend_bio_complete(struct bio *bio)
-{
-    struct uringblk_io_context *ctx = bio->bi_private;
-    blk_status_t status = BLK_STS_OK;
-    
-    if (bio->bi_status != BLK_STS_OK) {
-        pr_err("uringblk: I/O failed: %d\n", bio->bi_status);
-        status = bio->bi_status;
-    } else if (bio_op(bio) == REQ_OP_READ && ctx->buffer) {
-        /* Copy data from page to buffer for read operations */
-        memcpy(ctx->buffer, ctx->kaddr, min_t(size_t, ctx->len, PAGE_SIZE));
-    }
-    
-    /* Clean up */
-    if (ctx->kaddr && ctx->page) {
-        kunmap(ctx->page);
-    }
-    if (ctx->page) {
-        __free_page(ctx->page);
-    }
-    
-    /* Complete the request */
-    blk_mq_end_request(ctx->rq, status);
-    
-    /* Free context */
-    kfree(ctx);
-    
-    /* Free bio */
-    bio_put(bio);
-}
-
-static int device_backend_read_async(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len, struct request *rq)
+static blk_status_t device_backend_queue_rq(struct uringblk_backend *backend, struct request *rq)
 {
+    struct uringblk_device *dev = container_of(backend, struct uringblk_device, backend);
     struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    struct bio *bio;
-    struct bio_vec bvec;
-    struct uringblk_io_context *ctx;
-    
-    if (!bdev_handle || pos + len > backend->capacity)
-        return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
-        return -EINVAL;
 
-    /* Allocate I/O context */
-    ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
-    if (!ctx)
-        return -ENOMEM;
-    
-    /* Allocate a page for the buffer */
-    ctx->page = alloc_page(GFP_KERNEL);
-    if (!ctx->page) {
-        kfree(ctx);
-        return -ENOMEM;
-    }
-    
-    ctx->rq = rq;
-    ctx->backend = backend;
-    ctx->buffer = buf;
-    ctx->pos = pos;
-    ctx->len = len;
-    ctx->kaddr = kmap(ctx->page);
-    
-    /* Create a bio for the read operation */
-    bio = bio_alloc(bdev, 1, REQ_OP_READ, GFP_KERNEL);
-    bio->bi_iter.bi_sector = pos >> 9; /* Convert to sectors */
-    bio->bi_private = ctx;
-    bio->bi_end_io = device_backend_bio_complete;
-    
-    bvec.bv_page = ctx->page;
-    bvec.bv_len = min_t(size_t, len, PAGE_SIZE);
-    bvec.bv_offset = 0;
-    if (!bio_add_page(bio, ctx->page, bvec.bv_len, 0)) {
-        pr_err("uringblk: failed to add page to bio\n");
-        kunmap(ctx->page);
-        __free_page(ctx->page);
-        kfree(ctx);
-        bio_put(bio);
-        return -EIO;
-    }
-
-    /* Submit async I/O - no waiting */
-    submit_bio(bio);
-    return 0;
+    /* Sectors map 1:1 onto the lower device */
+    return uringblk_bio_remap_rq(dev, rq, bdev_handle->bdev);
 }
 
+/*
+ * Synchronous device backend I/O. Each call carries its own bio chain
+ * and on-stack completion, so concurrent callers from different hardware
+ * queues do not serialize on anything but the lower device.
+ */
 static int device_backend_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len)
 {
     struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    struct bio *bio;
-    struct bio_vec bvec;
-    struct page *page;
-    void *kaddr;
-    int ret = 0;
+    int ret;
 
-    if (!bdev_handle || pos + len > backend->capacity)
-        return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
+    if (!bdev_handle || pos + len > backend->capacity + backend->reserved)
         return -EINVAL;
 
-    /* Allocate a page for the buffer */
-    page = alloc_page(GFP_KERNEL);
-    if (!page)
-        return -ENOMEM;
-
-    kaddr = kmap(page);
-    
-    /* Create a bio for the read operation */
-    bio = bio_alloc(bdev, 1, REQ_OP_READ, GFP_KERNEL);
-    bio->bi_iter.bi_sector = pos >> 9; /* Convert to sectors */
-    
-    bvec.bv_page = page;
-    bvec.bv_len = min_t(size_t, len, PAGE_SIZE);
-    bvec.bv_offset = 0;
-    if (!bio_add_page(bio, page, bvec.bv_len, 0)) {
-        pr_err("uringblk: failed to add page to bio\n");
-        kunmap(page);
-        __free_page(page);
-        bio_put(bio);
-        return -EIO;
-    }
-
-    mutex_lock(&backend->io_mutex);
-    ret = submit_bio_wait(bio);
-    mutex_unlock(&backend->io_mutex);
-
-    if (ret == 0) {
-        memcpy(buf, kaddr, min_t(size_t, len, PAGE_SIZE));
-    } else {
-        pr_err("uringblk: read failed at pos %lld, len %zu: %d\n", pos, len, ret);
-    }
-
-    kunmap(page);
-    __free_page(page);
-    bio_put(bio);
+    ret = uringblk_bio_rw_kern(bdev_handle->bdev, REQ_OP_READ, pos >> SECTOR_SHIFT,
+                               buf, len);
+    if (ret)
+        pr_err_ratelimited("uringblk: read failed at pos %lld, len %zu: %d\n", pos, len, ret);
 
     return ret;
 }
 
-static int device_backend_write_async(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len, struct request *rq)
-{
-    struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    struct bio *bio;
-    struct bio_vec bvec;
-    struct uringblk_io_context *ctx;
-    
-    if (!bdev_handle || pos + len > backend->capacity)
-        return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
-        return -EINVAL;
-
-    /* Allocate I/O context */
-    ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
-    if (!ctx)
-        return -ENOMEM;
-    
-    /* Allocate a page for the buffer */
-    ctx->page = alloc_page(GFP_KERNEL);
-    if (!ctx->page) {
-        kfree(ctx);
-        return -ENOMEM;
-    }
-    
-    ctx->rq = rq;
-    ctx->backend = backend;
-    ctx->buffer = NULL; /* No need to copy data back for writes */
-    ctx->pos = pos;
-    ctx->len = len;
-    ctx->kaddr = kmap(ctx->page);
-    
-    /* Copy data from input buffer to page */
-    memcpy(ctx->kaddr, buf, min_t(size_t, len, PAGE_SIZE));
-    
-    /* Create a bio for the write operation */
-    bio = bio_alloc(bdev, 1, REQ_OP_WRITE, GFP_KERNEL);
-    bio->bi_iter.bi_sector = pos >> 9; /* Convert to sectors */
-    bio->bi_private = ctx;
-    bio->bi_end_io = device_backend_bio_complete;
-    
-    bvec.bv_page = ctx->page;
-    bvec.bv_len = min_t(size_t, len, PAGE_SIZE);
-    bvec.bv_offset = 0;
-    if (!bio_add_page(bio, ctx->page, bvec.bv_len, 0)) {
-        pr_err("uringblk: failed to add page to bio\n");
-        kunmap(ctx->page);
-        __free_page(ctx->page);
-        kfree(ctx);
-        bio_put(bio);
-        return -EIO;
-    }
-
-    /* Submit async I/O - no waiting */
-    submit_bio(bio);
-    return 0;
-}
-
 static int device_backend_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len)
 {
     struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    struct bio *bio;
-    struct bio_vec bvec;
-    struct page *page;
-    void *kaddr;
-    int ret = 0;
+    int ret;
 
-    if (!bdev_handle || pos + len > backend->capacity)
-        return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
+    if (!bdev_handle || pos + len > backend->capacity + backend->reserved)
         return -EINVAL;
 
-    /* Allocate a page for the buffer */
-    page = alloc_page(GFP_KERNEL);
-    if (!page)
-        return -ENOMEM;
-
-    kaddr = kmap(page);
-    memcpy(kaddr, buf, min_t(size_t, len, PAGE_SIZE));
-    
-    /* Create a bio for the write operation */
-    bio = bio_alloc(bdev, 1, REQ_OP_WRITE, GFP_KERNEL);
-    bio->bi_iter.bi_sector = pos >> 9; /* Convert to sectors */
-    
-    bvec.bv_page = page;
-    bvec.bv_len = min_t(size_t, len, PAGE_SIZE);
-    bvec.bv_offset = 0;
-    if (!bio_add_page(bio, page, bvec.bv_len, 0)) {
-        pr_err("uringblk: failed to add page to bio\n");
-        kunmap(page);
-        __free_page(page);
-        bio_put(bio);
-        return -EIO;
-    }
-
-    mutex_lock(&backend->io_mutex);
-    ret = submit_bio_wait(bio);
-    mutex_unlock(&backend->io_mutex);
-
-    if (ret != 0) {
-        pr_err("uringblk: write failed at pos %lld, len %zu: %d\n", pos, len, ret);
-    }
-
-    kunmap(page);
-    __free_page(page);
-    bio_put(bio);
+    ret = uringblk_bio_rw_kern(bdev_handle->bdev, REQ_OP_WRITE | REQ_SYNC,
+                               pos >> SECTOR_SHIFT, (void *)buf, len);
+    if (ret)
+        pr_err_ratelimited("uringblk: write failed at pos %lld, len %zu: %d\n", pos, len, ret);
 
     return ret;
 }
@@ -1315,91 +1284,46 @@ static int device_backend_write(struct uringblk_backend *backend, loff_t pos, co
 static int device_backend_flush(struct uringblk_backend *backend)
 {
     struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    struct bio *bio;
     int ret;
 
     if (!bdev_handle)
         return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
-        return -EINVAL;
 
-    /* Create a bio for flush operation */
-    bio = bio_alloc(bdev, 0, REQ_OP_FLUSH, GFP_KERNEL);
-
-    mutex_lock(&backend->io_mutex);
-    ret = submit_bio_wait(bio);
-    mutex_unlock(&backend->io_mutex);
-
-    if (ret) {
-        pr_err("uringblk: flush failed: %d\n", ret);
-    }
+    ret = blkdev_issue_flush(bdev_handle->bdev);
+    if (ret)
+        pr_err_ratelimited("uringblk: flush failed: %d\n", ret);
 
-    bio_put(bio);
     return ret;
 }
 
-static int device_backend_flush_async(struct uringblk_backend *backend, struct request *rq)
+static int device_backend_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
 {
     struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    struct bio *bio;
-    struct uringblk_io_context *ctx;
+    int ret;
 
-    if (!bdev_handle)
-        return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
+    if (!bdev_handle || pos + len > backend->capacity + backend->reserved)
         return -EINVAL;
 
-    /* Allocate I/O context */
-    ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
-    if (!ctx)
-        return -ENOMEM;
-    
-    ctx->rq = rq;
-    ctx->backend = backend;
-    ctx->buffer = NULL;
-    ctx->pos = 0;
-    ctx->len = 0;
-    ctx->page = NULL;
-    ctx->kaddr = NULL;
-
-    /* Create a bio for flush operation */
-    bio = bio_alloc(bdev, 0, REQ_OP_FLUSH, GFP_KERNEL);
-    bio->bi_private = ctx;
-    bio->bi_end_io = device_backend_bio_complete;
-
-    /* Submit async I/O - no waiting */
-    submit_bio(bio);
-    return 0;
+    ret = blkdev_issue_discard(bdev_handle->bdev, pos >> SECTOR_SHIFT,
+                               len >> SECTOR_SHIFT, GFP_NOIO);
+    if (ret)
+        pr_err_ratelimited("uringblk: discard failed at pos %lld, len %zu: %d\n", pos, len, ret);
+
+    return ret;
 }
 
-static int device_backend_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
+/* A device opened below its size, or grown underneath, can take more */
+static int device_backend_resize(struct uringblk_backend *backend, size_t capacity)
 {
     struct bdev_handle *bdev_handle = backend->private_data;
-    struct block_device *bdev;
-    int ret;
 
-    if (!bdev_handle || pos + len > backend->capacity)
-        return -EINVAL;
-        
-    bdev = bdev_handle->bdev;
-    if (!bdev)
+    if (!bdev_handle)
         return -EINVAL;
-    
-    mutex_lock(&backend->io_mutex);
-    ret = blkdev_issue_discard(bdev, pos / 512, len / 512, GFP_KERNEL);
-    mutex_unlock(&backend->io_mutex);
-
-    if (ret) {
-        pr_err("uringblk: discard failed at pos %lld, len %zu: %d\n", pos, len, ret);
-    }
+    if (capacity > bdev_nr_bytes(bdev_handle->bdev))
+        return -ENOSPC;
 
-    return ret;
+    WRITE_ONCE(backend->capacity, capacity);
+    return 0;
 }
 
 /*
@@ -1409,21 +1333,31 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
 {
     int ret;
 
-    /* Initialize device structure */
-    memset(dev, 0, sizeof(*dev));
+    /*
+     * The caller hands in a zeroed device with config.backend_type and
+     * config.backend_device already chosen, keep them. Queue count,
+     * depth and capacity left at zero take the module defaults.
+     */
     dev->minor = minor;
-    spin_lock_init(&dev->stats_lock);
-    spin_lock_init(&dev->latency_lock);
+    kref_init(&dev->ref);
+    seqlock_init(&dev->stats_seq);
     mutex_init(&dev->admin_mutex);
+    seqcount_mutex_init(&dev->admin_seq, &dev->admin_mutex);
 
     /* Set up configuration */
-    dev->config.nr_hw_queues = uringblk_nr_hw_queues;
-    dev->config.queue_depth = uringblk_queue_depth;
+    if (!dev->config.nr_hw_queues)
+        dev->config.nr_hw_queues = uringblk_nr_hw_queues;
+    if (!dev->config.queue_depth)
+        dev->config.queue_depth = uringblk_queue_depth;
+    if (!dev->config.capacity && (dev->config.backend_type == URINGBLK_BACKEND_VIRTUAL ||
+                                  dev->config.backend_type == URINGBLK_BACKEND_EMUL ||
+                                  !uringblk_auto_detect_size))
+        dev->config.capacity = (size_t)uringblk_capacity_mb * 1024 * 1024;
     dev->config.enable_poll = uringblk_enable_poll;
+    dev->config.nr_poll_queues = uringblk_enable_poll ? uringblk_poll_queues : 0;
     dev->config.enable_discard = uringblk_enable_discard;
     dev->config.write_cache = uringblk_write_cache;
-    dev->config.backend_type = uringblk_backend_type;
-    strncpy(dev->config.backend_device, uringblk_backend_device, sizeof(dev->config.backend_device) - 1);
+    dev->config.zoned_mode = uringblk_zoned_enabled();
 
     /* Set up features */
     dev->features = URINGBLK_FEAT_FLUSH;
@@ -1431,7 +1365,7 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
         dev->features |= URINGBLK_FEAT_WRITE_CACHE;
     if (dev->config.enable_discard)
         dev->features |= URINGBLK_FEAT_DISCARD | URINGBLK_FEAT_WRITE_ZEROES;
-    if (dev->config.enable_poll)
+    if (dev->config.nr_poll_queues)
         dev->features |= URINGBLK_FEAT_POLLING;
     
     dev->features |= URINGBLK_FEAT_FUA;
@@ -1439,6 +1373,14 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
     /* Set device info */
     if (dev->config.backend_type == URINGBLK_BACKEND_VIRTUAL) {
         snprintf(dev->model, sizeof(dev->model), "uringblk Virtual Device");
+    } else if (dev->config.backend_type == URINGBLK_BACKEND_STRIPE) {
+        snprintf(dev->model, sizeof(dev->model), "uringblk Striped Device");
+    } else if (dev->config.backend_type == URINGBLK_BACKEND_MIRROR) {
+        snprintf(dev->model, sizeof(dev->model), "uringblk Mirrored Device");
+    } else if (dev->config.backend_type == URINGBLK_BACKEND_FILE) {
+        snprintf(dev->model, sizeof(dev->model), "uringblk File Backend");
+    } else if (dev->config.backend_type == URINGBLK_BACKEND_EMUL) {
+        snprintf(dev->model, sizeof(dev->model), "uringblk Emulated Device");
     } else {
         snprintf(dev->model, sizeof(dev->model), "uringblk Device Backend");
     }
@@ -1461,15 +1403,26 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
     switch (dev->config.backend_type) {
     case URINGBLK_BACKEND_VIRTUAL:
         pr_info("uringblk: DEBUG - Initializing virtual backend with capacity %zu MB\n", 
-                (size_t)uringblk_capacity_mb);
-        ret = virtual_backend_init(&dev->backend, NULL, (size_t)uringblk_capacity_mb * 1024 * 1024);
+                dev->config.capacity >> 20);
+        ret = virtual_backend_init(&dev->backend, NULL, dev->config.capacity);
         break;
     case URINGBLK_BACKEND_DEVICE:
         /* For device backend, use auto-detected size or fallback to capacity_mb */
-        pr_info("uringblk: DEBUG - Initializing device backend with path '%s', auto_detect=%d, capacity=%zu MB\n",
-                dev->config.backend_device, uringblk_auto_detect_size, (size_t)uringblk_capacity_mb);
-        ret = device_backend_init(&dev->backend, dev->config.backend_device, 
-                                uringblk_auto_detect_size ? 0 : (size_t)uringblk_capacity_mb * 1024 * 1024);
+        pr_info("uringblk: DEBUG - Initializing device backend with path '%s', capacity=%zu MB\n",
+                dev->config.backend_device, dev->config.capacity >> 20);
+        ret = device_backend_init(&dev->backend, dev->config.backend_device, dev->config.capacity);
+        break;
+    case URINGBLK_BACKEND_STRIPE:
+        ret = uringblk_stripe_init(&dev->backend, dev->config.backend_device, dev->config.capacity);
+        break;
+    case URINGBLK_BACKEND_MIRROR:
+        ret = uringblk_mirror_init(&dev->backend, dev->config.backend_device, dev->config.capacity);
+        break;
+    case URINGBLK_BACKEND_FILE:
+        ret = uringblk_file_init(&dev->backend, dev->config.backend_device, dev->config.capacity);
+        break;
+    case URINGBLK_BACKEND_EMUL:
+        ret = uringblk_emul_init(&dev->backend, NULL, dev->config.capacity);
         break;
     default:
         pr_err("uringblk: DEBUG - Invalid backend type: %d\n", dev->config.backend_type);
@@ -1482,15 +1435,59 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
     }
     pr_info("uringblk: DEBUG - Backend initialization succeeded\n");
 
+    if (dev->config.zoned_mode) {
+        ret = uringblk_zoned_init(dev);
+        if (ret)
+            goto err_cleanup_backend;
+    }
+
+    if (uringblk_wbcache_enabled()) {
+        ret = uringblk_wbcache_init(dev);
+        if (ret)
+            goto err_zoned_exit;
+    }
+
+    if (uringblk_flashcache_enabled()) {
+        ret = uringblk_flashcache_init(dev);
+        if (ret)
+            goto err_wbcache_exit;
+    }
+
+    if (uringblk_atomic_enabled()) {
+        ret = uringblk_atomic_init(dev);
+        if (ret)
+            goto err_flashcache_exit;
+    }
+
+    if (uringblk_integrity_enabled()) {
+        ret = uringblk_integrity_init(dev);
+        if (ret)
+            goto err_atomic_exit;
+    }
+
+    if (uringblk_sched_enabled()) {
+        ret = uringblk_sched_init(dev);
+        if (ret)
+            goto err_integrity_exit;
+    }
+
+    ret = uringblk_bio_init(dev);
+    if (ret) {
+        pr_err("uringblk: failed to allocate bio set: %d\n", ret);
+        goto err_sched_exit;
+    }
+
     /* Initialize tag set */
     memset(&dev->tag_set, 0, sizeof(dev->tag_set));
     dev->tag_set.ops = &uringblk_mq_ops;
-    dev->tag_set.nr_hw_queues = dev->config.nr_hw_queues;
+    dev->tag_set.nr_hw_queues = dev->config.nr_hw_queues + dev->config.nr_poll_queues;
+    dev->tag_set.nr_maps = dev->config.nr_poll_queues ? HCTX_MAX_TYPES : 1;
     dev->tag_set.queue_depth = dev->config.queue_depth;
     dev->tag_set.numa_node = NUMA_NO_NODE;
-    dev->tag_set.cmd_size = 0;
+    dev->tag_set.cmd_size = sizeof(struct uringblk_cmd);
     dev->tag_set.flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_BLOCKING;
-    if (dev->config.enable_poll) {
+    /* Zoned writes are kept in order by the zone aware elevator */
+    if (dev->config.enable_poll && !dev->config.zoned_mode) {
         dev->tag_set.flags |= BLK_MQ_F_NO_SCHED;
     }
     dev->tag_set.driver_data = dev;
@@ -1498,7 +1495,7 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
     ret = blk_mq_alloc_tag_set(&dev->tag_set);
     if (ret) {
         pr_err("uringblk: failed to allocate tag set: %d\n", ret);
-        goto err_cleanup_backend;
+        goto err_free_bio_set;
     }
 
     /* Allocate disk */
@@ -1524,15 +1521,18 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
     blk_queue_max_segments(dev->disk->queue, URINGBLK_MAX_SEGMENTS);
     blk_queue_max_segment_size(dev->disk->queue, URINGBLK_MAX_SEGMENT_SIZE);
     
-    /* Set optimal and minimum I/O sizes */
-    blk_queue_io_min(dev->disk->queue, uringblk_logical_block_size);
-    blk_queue_io_opt(dev->disk->queue, 64 * 1024); /* 64KB optimal */
+    /* Set optimal and minimum I/O sizes, a stripe asks for whole units and rows */
+    blk_queue_io_min(dev->disk->queue, dev->backend.io_min ?: uringblk_logical_block_size);
+    blk_queue_io_opt(dev->disk->queue, dev->backend.io_opt ?: 64 * 1024); /* 64KB optimal */
     
     /* Set DMA alignment */
     blk_queue_dma_alignment(dev->disk->queue, 4095); /* 4KB alignment */
+    uringblk_atomic_setup_queue(dev);
+    uringblk_integrity_setup_queue(dev);
 
     if (dev->config.enable_discard) {
-        blk_queue_max_discard_sectors(dev->disk->queue, UINT_MAX);
+        if (!dev->zoned)
+            blk_queue_max_discard_sectors(dev->disk->queue, UINT_MAX);
         blk_queue_max_write_zeroes_sectors(dev->disk->queue, UINT_MAX);
         /* Use limits to set discard granularity for this kernel version */
         blk_queue_logical_block_size(dev->disk->queue, uringblk_logical_block_size);
@@ -1549,8 +1549,16 @@ int uringblk_init_device(struct uringblk_device *dev, int minor)
     /* Set nonrot flag for SSDs */
     blk_queue_flag_set(QUEUE_FLAG_NONROT, dev->disk->queue);
 
-    /* Set capacity */
-    set_capacity(dev->disk, dev->backend.capacity / uringblk_logical_block_size);
+    /* Set capacity, always in 512-byte sectors */
+    set_capacity(dev->disk, dev->backend.capacity >> SECTOR_SHIFT);
+
+    if (dev->zoned) {
+        ret = uringblk_zoned_setup_queue(dev);
+        if (ret) {
+            pr_err("uringblk: failed to set up zones: %d\n", ret);
+            goto err_put_disk;
+        }
+    }
     
     /* Add disk without scanning partitions to avoid deadlock during initialization */
     ret = device_add_disk(NULL, dev->disk, NULL);
@@ -1587,6 +1595,20 @@ err_put_disk:
     put_disk(dev->disk);
 err_free_tag_set:
     blk_mq_free_tag_set(&dev->tag_set);
+err_free_bio_set:
+    uringblk_bio_exit(dev);
+err_sched_exit:
+    uringblk_sched_exit(dev);
+err_integrity_exit:
+    uringblk_integrity_exit(dev);
+err_atomic_exit:
+    uringblk_atomic_exit(dev);
+err_flashcache_exit:
+    uringblk_flashcache_exit(dev);
+err_wbcache_exit:
+    uringblk_wbcache_exit(dev);
+err_zoned_exit:
+    uringblk_zoned_exit(dev);
 err_cleanup_backend:
     dev->backend.ops->cleanup(&dev->backend);
     return ret;
@@ -1605,14 +1627,181 @@ void uringblk_cleanup_device(struct uringblk_device *dev)
         del_gendisk(dev->disk);
         put_disk(dev->disk);
     }
+
+    /* Dirty cache blocks still go to the backend */
+    uringblk_wbcache_exit(dev);
+    uringblk_flashcache_exit(dev);
     
     blk_mq_free_tag_set(&dev->tag_set);
+    uringblk_sched_exit(dev);
+    uringblk_integrity_exit(dev);
+    uringblk_atomic_exit(dev);
+    uringblk_bio_exit(dev);
+    uringblk_zoned_exit(dev);
     
     if (dev->backend.ops) {
         dev->backend.ops->cleanup(&dev->backend);
     }
 }
 
+/*
+ * Device table
+ */
+static void uringblk_device_free(struct kref *ref)
+{
+    kfree(container_of(ref, struct uringblk_device, ref));
+}
+
+struct uringblk_device *uringblk_device_get(unsigned int minor)
+{
+    struct uringblk_device *dev;
+
+    if (minor >= URINGBLK_MINORS)
+        return NULL;
+
+    mutex_lock(&uringblk_devices_mutex);
+    dev = uringblk_device_array[minor];
+    if (dev)
+        kref_get(&dev->ref);
+    mutex_unlock(&uringblk_devices_mutex);
+    return dev;
+}
+
+void uringblk_device_put(struct uringblk_device *dev)
+{
+    if (dev)
+        kref_put(&dev->ref, uringblk_device_free);
+}
+
+/**
+ * uringblk_add_device - Create a device at runtime
+ * @info: Backend, queue count, depth and capacity, zero for the defaults
+ *
+ * The device takes the lowest free minor, which is returned. The
+ * global feature parameters (zoned mode, caches) apply as at load time.
+ */
+int uringblk_add_device(const struct uringblk_ctl_dev *info)
+{
+    struct uringblk_device *dev;
+    int minor, ret;
+
+    if (strnlen(info->backend_path, sizeof(info->backend_path)) == sizeof(info->backend_path))
+        return -ENAMETOOLONG;
+    ret = validate_backend_config(info->backend_type, info->backend_path);
+    if (ret)
+        return ret;
+    if (info->nr_hw_queues > nr_cpu_ids || info->queue_depth > BLK_MQ_MAX_DEPTH)
+        return -EINVAL;
+
+    dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+    if (!dev)
+        return -ENOMEM;
+    dev->config.backend_type = info->backend_type;
+    strscpy(dev->config.backend_device, info->backend_path, sizeof(dev->config.backend_device));
+    dev->config.nr_hw_queues = info->nr_hw_queues;
+    dev->config.queue_depth = info->queue_depth;
+    dev->config.capacity = info->capacity;
+
+    mutex_lock(&uringblk_devices_mutex);
+    for (minor = 0; minor < URINGBLK_MINORS; minor++) {
+        if (!uringblk_device_array[minor])
+            break;
+    }
+    ret = minor < URINGBLK_MINORS ? uringblk_init_device(dev, minor) : -ENOSPC;
+    if (ret) {
+        mutex_unlock(&uringblk_devices_mutex);
+        kfree(dev);
+        return ret;
+    }
+    uringblk_device_array[minor] = dev;
+    num_devices++;
+    mutex_unlock(&uringblk_devices_mutex);
+
+    return minor;
+}
+
+/**
+ * uringblk_remove_device - Tear down a device
+ * @minor: Device to remove
+ *
+ * Fails with -EBUSY while the block device or its admin node is open.
+ * del_gendisk() drains the requests still in flight and the write-back
+ * cache reaches the backend before it is released. Other devices keep
+ * running throughout.
+ */
+int uringblk_remove_device(unsigned int minor)
+{
+    struct uringblk_device *dev;
+    int ret = 0;
+
+    if (minor >= URINGBLK_MINORS)
+        return -ENODEV;
+
+    mutex_lock(&uringblk_devices_mutex);
+    dev = uringblk_device_array[minor];
+    if (!dev) {
+        mutex_unlock(&uringblk_devices_mutex);
+        return -ENODEV;
+    }
+
+    /* uringblk_open() runs under open_mutex and refuses once deleting is set */
+    mutex_lock(&dev->disk->open_mutex);
+    mutex_lock(&dev->admin_mutex);
+    if (disk_openers(dev->disk) || kref_read(&dev->ref) > 1)
+        ret = -EBUSY;
+    else
+        dev->deleting = true;
+    mutex_unlock(&dev->admin_mutex);
+    mutex_unlock(&dev->disk->open_mutex);
+    if (ret) {
+        mutex_unlock(&uringblk_devices_mutex);
+        return ret;
+    }
+
+    uringblk_device_array[minor] = NULL;
+    num_devices--;
+    mutex_unlock(&uringblk_devices_mutex);
+
+    uringblk_cleanup_device(dev);
+    uringblk_device_put(dev);
+    pr_info("uringblk: removed device %s%u\n", URINGBLK_DEVICE_NAME, minor);
+    return 0;
+}
+
+/**
+ * uringblk_resize_device - Grow a device while it is in use
+ * @dev: uringblk device
+ * @capacity: New capacity in bytes
+ *
+ * Only upwards, shrinking would cut off data that may be in use, and
+ * only on backends that can grow in place. Zoned devices keep their
+ * zone layout.
+ */
+int uringblk_resize_device(struct uringblk_device *dev, u64 capacity)
+{
+    unsigned int align = dev->wbcache ? PAGE_SIZE : uringblk_logical_block_size;
+    int ret = 0;
+
+    /* The atomic write journal and the tags sit right after the capacity */
+    if (!dev->backend.ops->resize || dev->zoned || dev->atomic || dev->integrity)
+        return -EOPNOTSUPP;
+    if (!IS_ALIGNED(capacity, align) || capacity > SIZE_MAX)
+        return -EINVAL;
+
+    mutex_lock(&dev->admin_mutex);
+    if (capacity < dev->backend.capacity) {
+        ret = -EINVAL;
+    } else if (capacity > dev->backend.capacity) {
+        ret = dev->backend.ops->resize(&dev->backend, capacity);
+        if (!ret) {
+            set_capacity_and_notify(dev->disk, capacity >> SECTOR_SHIFT);
+            pr_info("uringblk: %s grown to %llu MB\n", dev->disk->disk_name, capacity >> 20);
+        }
+    }
+    mutex_unlock(&dev->admin_mutex);
+    return ret;
+}
+
 /*
  * Module initialization and cleanup
  */
@@ -1622,14 +1811,10 @@ static int uringblk_admin_open(struct inode *inode, struct file *file)
     int minor = iminor(inode);
     struct uringblk_device *dev;
     
-    pr_info("uringblk: admin device open called for minor %d\n", minor);
-    
-    /* Find device by minor number */
-    if (minor >= URINGBLK_MINORS) {
-        return -ENODEV;
-    }
+    pr_debug("uringblk: admin device open called for minor %d\n", minor);
     
-    dev = uringblk_device_array[minor];
+    /* Find device by minor number, the reference keeps it until release */
+    dev = uringblk_device_get(minor);
     if (!dev) {
         pr_err("uringblk: no device found for minor %d\n", minor);
         return -ENODEV;
@@ -1638,20 +1823,29 @@ static int uringblk_admin_open(struct inode *inode, struct file *file)
     /* Store device in file private data for uring_cmd handler */
     file->private_data = dev;
     
-    pr_info("uringblk: admin device opened successfully for device %s\n", dev->disk->disk_name);
+    pr_debug("uringblk: admin device opened successfully for device %s\n", dev->disk->disk_name);
     return 0;
 }
 
 static int uringblk_admin_release(struct inode *inode, struct file *file)
 {
+    uringblk_device_put(file->private_data);
     file->private_data = NULL;
     return 0;
 }
 
+/* Admin commands are URING_CMDs, the only ioctl grows this device */
 static long uringblk_admin_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
-    /* We primarily use URING_CMD, but can add ioctl support here if needed */
-    return -ENOTTY;
+    struct uringblk_ctl_dev info;
+
+    if (cmd != URINGBLK_CTL_RESIZE_DEV)
+        return -ENOTTY;
+    if (!capable(CAP_SYS_ADMIN))
+        return -EPERM;
+    if (copy_from_user(&info, (void __user *)arg, sizeof(info)))
+        return -EFAULT;
+    return uringblk_resize_device(file->private_data, info.capacity);
 }
 
 static const struct file_operations uringblk_admin_fops = {
@@ -1734,9 +1928,9 @@ static int __init uringblk_init(void)
     /* Early validation of backend configuration */
     pr_info("uringblk: DEBUG - Early validation of backend configuration\n");
     pr_info("uringblk: DEBUG - backend_type=%d, backend_device='%s'\n", 
-            uringblk_backend_type, uringblk_backend_device);
+            uringblk_backend_type, uringblk_backend_path());
     
-    ret = validate_backend_config(uringblk_backend_type, uringblk_backend_device);
+    ret = validate_backend_config(uringblk_backend_type, uringblk_backend_path());
     if (ret) {
         pr_err("uringblk: DEBUG - Early backend validation failed: %d\n", ret);
         return ret;
@@ -1751,7 +1945,10 @@ static int __init uringblk_init(void)
     }
 
     /* Parse device list if provided */
-    if (strlen(uringblk_devices) > 0) {
+    if (uringblk_backend_multi()) {
+        /* The listed devices are the members of a single device */
+        device_count = 1;
+    } else if (strlen(uringblk_devices) > 0) {
         ret = parse_device_list(uringblk_devices, &device_paths, &device_count);
         if (ret) {
             pr_err("uringblk: failed to parse device list: %d\n", ret);
@@ -1794,12 +1991,8 @@ static int __init uringblk_init(void)
     if (device_count > uringblk_max_devices) {
         device_count = uringblk_max_devices;
     }
-
-    /* Allocate device array */
-    uringblk_device_array = kmalloc_array(device_count, sizeof(struct uringblk_device *), GFP_KERNEL);
-    if (!uringblk_device_array) {
-        ret = -ENOMEM;
-        goto err_free_paths;
+    if (device_count > URINGBLK_MINORS) {
+        device_count = URINGBLK_MINORS;
     }
 
     /* Initialize devices */
@@ -1817,7 +2010,7 @@ static int __init uringblk_init(void)
                    sizeof(uringblk_device_array[i]->config.backend_device) - 1);
         } else {
             uringblk_device_array[i]->config.backend_type = uringblk_backend_type;
-            strncpy(uringblk_device_array[i]->config.backend_device, uringblk_backend_device, 
+            strncpy(uringblk_device_array[i]->config.backend_device, uringblk_backend_path(), 
                    sizeof(uringblk_device_array[i]->config.backend_device) - 1);
         }
 
@@ -1832,24 +2025,26 @@ static int __init uringblk_init(void)
     }
 
     free_device_list(device_paths, device_count);
+    device_paths = NULL;
+
+    ret = uringblk_ctl_init();
+    if (ret)
+        goto err_cleanup_devices;
     
     pr_info("uringblk: driver loaded successfully (major=%d, %d devices)\n", 
             uringblk_major, num_devices);
     return 0;
 
 err_cleanup_devices:
-    for (i = 0; i < device_count; i++) {
+    for (i = 0; i < URINGBLK_MINORS; i++) {
         if (uringblk_device_array[i]) {
-            if (i < num_devices) {
-                uringblk_cleanup_device(uringblk_device_array[i]);
-            }
-            kfree(uringblk_device_array[i]);
+            uringblk_cleanup_device(uringblk_device_array[i]);
+            uringblk_device_put(uringblk_device_array[i]);
+            uringblk_device_array[i] = NULL;
         }
     }
-    kfree(uringblk_device_array);
-    uringblk_device_array = NULL;
     num_devices = 0;
-err_free_paths:
+    /* NULL once the devices are up, freed here when one failed to init */
     free_device_list(device_paths, device_count);
 err_unregister:
     unregister_blkdev(uringblk_major, URINGBLK_DEVICE_NAME);
@@ -1862,15 +2057,15 @@ static void __exit uringblk_exit(void)
     
     pr_info("uringblk: Unloading driver\n");
 
-    if (uringblk_device_array) {
-        for (i = 0; i < num_devices; i++) {
-            if (uringblk_device_array[i]) {
-                uringblk_cleanup_device(uringblk_device_array[i]);
-                kfree(uringblk_device_array[i]);
-            }
+    /* No new devices, and none is open: every open holds the module */
+    uringblk_ctl_exit();
+
+    for (i = 0; i < URINGBLK_MINORS; i++) {
+        if (uringblk_device_array[i]) {
+            uringblk_cleanup_device(uringblk_device_array[i]);
+            uringblk_device_put(uringblk_device_array[i]);
+            uringblk_device_array[i] = NULL;
         }
-        kfree(uringblk_device_array);
-        uringblk_device_array = NULL;
     }
 
     unregister_blkdev(uringblk_major, URINGBLK_DEVICE_NAME);
@@ -0,0 +1,869 @@
+/*
+ * uringblk_mirror.c - Mirrored (RAID-1) backend
+ *
+ * Every write goes to all two or three members. With the default
+ * quorum the request completes when all of them have acked and the
+ * clones share the request pages. A smaller mirror_write_quorum
+ * completes the request early, so the data is first copied into pages
+ * owned by the mirror that the stragglers can still write from. Until a
+ * straggler has finished, reads of its range avoid that member and
+ * flushes wait for it.
+ *
+ * A member that fails a write or flush is degraded: reads go to the
+ * others as long as one of them is not.
+ *
+ * Reads go to the member with the lowest smoothed latency times its
+ * reads in flight. With mirror_hedge_reads set, a read that has not
+ * completed within the member's running p95 latency is sent to a second
+ * member as well and the first good copy wins. Both legs of a hedged
+ * read land in private pages, the loser may still be in flight after
+ * the request has completed. When the first leg fails, the second one
+ * is sent at once instead of at the deadline.
+ *
+ * Members are not resynchronized: a member that missed a write stays
+ * degraded until it is replaced and the mirror rebuilt from user space.
+ */
+
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/highmem.h>
+#include <linux/hrtimer.h>
+#include <linux/refcount.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/wait_bit.h>
+#include <linux/workqueue.h>
+
+#include "uringblk_driver.h"
+
+#define URINGBLK_MIRROR_MAX        3
+#define URINGBLK_MIRROR_HEDGE_MAX  (256 * 1024)   /* Larger reads are never hedged */
+#define URINGBLK_MIRROR_HEDGE_MIN  (20 * NSEC_PER_USEC)
+
+static unsigned int mirror_write_quorum;
+module_param(mirror_write_quorum, uint, 0444);
+MODULE_PARM_DESC(mirror_write_quorum, "Member acks that complete a mirrored write, 0 for all (default: 0)");
+
+static bool mirror_hedge_reads;
+module_param(mirror_hedge_reads, bool, 0644);
+MODULE_PARM_DESC(mirror_hedge_reads, "Send a second read to another member after the first one's p95 latency (default: false)");
+
+struct mirror_member {
+    struct bdev_handle *handle;
+    atomic_t inflight;             /* Reads in flight */
+    u64 ewma_ns;                   /* Smoothed read latency */
+    u64 p95_ns;                    /* Running p95 estimate of the read latency */
+};
+
+struct uringblk_mirror {
+    unsigned int nr_members;
+    unsigned int quorum;
+    struct workqueue_struct *wq;   /* Issues hedged reads */
+    atomic_t nr_hedged;            /* Hedged reads not yet freed */
+    atomic_t nr_writes;            /* Quorum writes not yet freed */
+    unsigned long degraded;        /* Members that failed a write */
+    spinlock_t lock;               /* Protects writes and write_seq */
+    struct list_head writes;       /* Quorum writes in flight, oldest first */
+    u64 write_seq;
+    wait_queue_head_t write_wait;  /* Flushes waiting for stragglers */
+    struct mirror_member members[URINGBLK_MIRROR_MAX];
+};
+
+/* Data pages private to the mirror */
+struct mirror_buf {
+    size_t len;
+    unsigned int nr_pages;
+    struct page *pages[];
+};
+
+/* A write completing at quorum */
+struct mirror_write {
+    struct request *rq;
+    struct uringblk_mirror *m;
+    struct list_head node;         /* On uringblk_mirror.writes */
+    u64 seq;
+    sector_t sector;
+    unsigned int nr_sectors;
+    unsigned long done;            /* Members that finished writing */
+    atomic_t pending;              /* Members still writing */
+    atomic_t acks;
+    unsigned int quorum;
+    struct mirror_buf *buf;
+};
+
+/* A read that may be hedged, one leg per member asked */
+struct mirror_leg {
+    struct mirror_read *rd;
+    unsigned int member;
+    u64 start_ns;
+    struct mirror_buf *buf;
+};
+
+struct mirror_read {
+    struct request *rq;
+    struct uringblk_mirror *m;
+    refcount_t ref;                /* One per leg in flight, one for the timer */
+    spinlock_t lock;               /* Protects the state below */
+    unsigned int inflight;
+    bool hedged;
+    bool done;
+    struct hrtimer timer;
+    struct work_struct hedge_work;
+    unsigned long avoid;           /* Members not to read from */
+    struct mirror_leg legs[2];
+};
+
+/*
+ * Latency tracking. Updates race between CPUs and may lose samples,
+ * which only makes the estimates slightly noisier.
+ */
+static void mirror_sample(struct mirror_member *mm, u64 ns)
+{
+    u64 ewma = READ_ONCE(mm->ewma_ns);
+    u64 p95 = READ_ONCE(mm->p95_ns);
+    u64 step;
+
+    WRITE_ONCE(mm->ewma_ns, ewma ? ewma - (ewma >> 3) + (ns >> 3) : ns);
+
+    /*
+     * Moving 19 steps up for every sample above the estimate and one
+     * down for every sample below settles where 5% of samples are above.
+     */
+    if (!p95) {
+        p95 = ns;
+    } else {
+        step = max_t(u64, p95 >> 8, 1);
+        if (ns > p95)
+            p95 += 19 * step;
+        else if (p95 > step)
+            p95 -= step;
+    }
+    WRITE_ONCE(mm->p95_ns, p95);
+}
+
+static int mirror_pick_from(struct uringblk_mirror *m, unsigned long avoid)
+{
+    unsigned int i;
+    int best = -1;
+    u64 score, best_score = U64_MAX;
+
+    for (i = 0; i < m->nr_members; i++) {
+        if (avoid & BIT(i))
+            continue;
+        score = READ_ONCE(m->members[i].ewma_ns) *
+                (atomic_read(&m->members[i].inflight) + 1);
+        if (best < 0 || score < best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+ * Member with the lowest expected wait outside @avoid. Degraded members
+ * are only read once every member is degraded. -1 if there is none.
+ */
+static int mirror_pick(struct uringblk_mirror *m, unsigned long avoid)
+{
+    unsigned long degraded = READ_ONCE(m->degraded);
+
+    if (degraded != BIT(m->nr_members) - 1)
+        avoid |= degraded;
+    return mirror_pick_from(m, avoid);
+}
+
+static void mirror_degrade(struct uringblk_mirror *m, int i)
+{
+    if (i >= 0 && !test_and_set_bit(i, &m->degraded))
+        pr_err("uringblk: mirror member %pg degraded, reads avoid it until it is rebuilt\n",
+               m->members[i].handle->bdev);
+}
+
+/*
+ * Members still writing to a range: stragglers of acked quorum writes,
+ * and members of writes racing with the read.
+ */
+static unsigned long mirror_stale(struct uringblk_mirror *m, sector_t sector,
+                                  unsigned int nr_sectors)
+{
+    struct mirror_write *wr;
+    unsigned long stale = 0, flags;
+
+    /* A write queued meanwhile races with the read anyway */
+    if (list_empty(&m->writes))
+        return 0;
+
+    spin_lock_irqsave(&m->lock, flags);
+    list_for_each_entry(wr, &m->writes, node) {
+        if (wr->sector < sector + nr_sectors && sector < wr->sector + wr->nr_sectors)
+            stale |= ~READ_ONCE(wr->done);
+    }
+    spin_unlock_irqrestore(&m->lock, flags);
+    /* Pairs with mirror_write_endio(), a member done after a failure is degraded */
+    smp_rmb();
+    return stale & (BIT(m->nr_members) - 1);
+}
+
+static u64 mirror_oldest_write(struct uringblk_mirror *m)
+{
+    struct mirror_write *wr;
+    u64 seq;
+
+    spin_lock_irq(&m->lock);
+    wr = list_first_entry_or_null(&m->writes, struct mirror_write, node);
+    seq = wr ? wr->seq : U64_MAX;
+    spin_unlock_irq(&m->lock);
+    return seq;
+}
+
+/* A flush covers the stragglers of every write submitted before it */
+static void mirror_wait_writes(struct uringblk_mirror *m)
+{
+    u64 seq;
+
+    spin_lock_irq(&m->lock);
+    seq = m->write_seq;
+    spin_unlock_irq(&m->lock);
+    wait_event(m->write_wait, mirror_oldest_write(m) > seq);
+}
+
+static int mirror_member_of(struct uringblk_mirror *m, struct block_device *bdev)
+{
+    unsigned int i;
+
+    for (i = 0; i < m->nr_members; i++)
+        if (m->members[i].handle->bdev == bdev)
+            return i;
+    return -1;
+}
+
+/*
+ * Private data pages
+ */
+static void mirror_buf_free(struct mirror_buf *buf)
+{
+    unsigned int i;
+
+    if (!buf)
+        return;
+    for (i = 0; i < buf->nr_pages; i++)
+        if (buf->pages[i])
+            __free_page(buf->pages[i]);
+    kfree(buf);
+}
+
+static struct mirror_buf *mirror_buf_alloc(size_t len)
+{
+    unsigned int i, nr = DIV_ROUND_UP(len, PAGE_SIZE);
+    struct mirror_buf *buf;
+
+    buf = kzalloc(struct_size(buf, pages, nr), GFP_NOIO);
+    if (!buf)
+        return NULL;
+    buf->len = len;
+    buf->nr_pages = nr;
+
+    for (i = 0; i < nr; i++) {
+        buf->pages[i] = alloc_page(GFP_NOIO);
+        if (!buf->pages[i]) {
+            mirror_buf_free(buf);
+            return NULL;
+        }
+    }
+    return buf;
+}
+
+/* Copy between the request pages and @buf */
+static void mirror_buf_copy(struct mirror_buf *buf, struct request *rq, bool to_rq)
+{
+    struct req_iterator iter;
+    struct bio_vec bv;
+    size_t off = 0;
+
+    rq_for_each_segment(bv, rq, iter) {
+        unsigned int done = 0;
+
+        while (done < bv.bv_len) {
+            void *p = page_address(buf->pages[off >> PAGE_SHIFT]) + offset_in_page(off);
+            unsigned int n = min_t(size_t, bv.bv_len - done, PAGE_SIZE - offset_in_page(off));
+
+            if (to_rq)
+                memcpy_to_page(bv.bv_page, bv.bv_offset + done, p, n);
+            else
+                memcpy_from_page(p, bv.bv_page, bv.bv_offset + done, n);
+            done += n;
+            off += n;
+        }
+    }
+}
+
+/* Issue @buf as one chain of bios that completes through @end_io */
+static void mirror_buf_submit(struct mirror_buf *buf, struct block_device *bdev,
+                              blk_opf_t opf, sector_t sector,
+                              bio_end_io_t *end_io, void *private)
+{
+    struct bio *bio = NULL;
+    size_t left = buf->len;
+    unsigned int i = 0;
+
+    while (left) {
+        bio = blk_next_bio(bio, bdev, bio_max_segs(buf->nr_pages - i), opf, GFP_NOIO);
+        bio->bi_iter.bi_sector = sector;
+
+        while (left) {
+            unsigned int n = min_t(size_t, left, PAGE_SIZE);
+
+            if (bio_add_page(bio, buf->pages[i], n, 0) != n)
+                break;
+            i++;
+            left -= n;
+            sector += n >> SECTOR_SHIFT;
+        }
+    }
+
+    bio->bi_end_io = end_io;
+    bio->bi_private = private;
+    submit_bio(bio);
+}
+
+/*
+ * Writes
+ */
+static void mirror_write_endio(struct bio *bio)
+{
+    struct mirror_write *wr = bio->bi_private;
+    struct uringblk_mirror *m = wr->m;
+    int i = mirror_member_of(m, bio->bi_bdev);
+    unsigned long flags;
+
+    if (bio->bi_status) {
+        pr_err_ratelimited("uringblk: mirror write failed on %pg: %d\n",
+                           bio->bi_bdev, blk_status_to_errno(bio->bi_status));
+        mirror_degrade(m, i);
+    } else if (atomic_inc_return(&wr->acks) == wr->quorum) {
+        uringblk_complete_rq(wr->rq, BLK_STS_OK);
+    }
+    /* Reads may use the member again, it is degraded if it failed */
+    if (i >= 0) {
+        smp_mb__before_atomic();
+        set_bit(i, &wr->done);
+    }
+    bio_put(bio);
+
+    if (atomic_dec_and_test(&wr->pending)) {
+        if (atomic_read(&wr->acks) < wr->quorum)
+            uringblk_complete_rq(wr->rq, BLK_STS_IOERR);
+
+        spin_lock_irqsave(&m->lock, flags);
+        list_del(&wr->node);
+        spin_unlock_irqrestore(&m->lock, flags);
+        if (wq_has_sleeper(&m->write_wait))
+            wake_up(&m->write_wait);
+
+        mirror_buf_free(wr->buf);
+        kfree(wr);
+        if (atomic_dec_and_test(&m->nr_writes))
+            wake_up_var(&m->nr_writes);
+    }
+}
+
+static blk_status_t mirror_write_quorum_rq(struct uringblk_mirror *m, struct request *rq)
+{
+    blk_opf_t opf = REQ_OP_WRITE | (rq->cmd_flags & (REQ_FUA | REQ_SYNC));
+    struct mirror_write *wr;
+    struct blk_plug plug;
+    unsigned int i;
+
+    wr = kzalloc(sizeof(*wr), GFP_NOIO);
+    if (!wr)
+        return BLK_STS_RESOURCE;
+    wr->buf = mirror_buf_alloc(blk_rq_bytes(rq));
+    if (!wr->buf) {
+        kfree(wr);
+        return BLK_STS_RESOURCE;
+    }
+    mirror_buf_copy(wr->buf, rq, false);
+    wr->rq = rq;
+    wr->m = m;
+    wr->sector = blk_rq_pos(rq);
+    wr->nr_sectors = blk_rq_sectors(rq);
+    wr->quorum = m->quorum;
+    atomic_set(&wr->pending, m->nr_members);
+
+    atomic_inc(&m->nr_writes);
+    spin_lock_irq(&m->lock);
+    wr->seq = ++m->write_seq;
+    list_add_tail(&wr->node, &m->writes);
+    spin_unlock_irq(&m->lock);
+
+    blk_start_plug(&plug);
+    for (i = 0; i < m->nr_members; i++)
+        mirror_buf_submit(wr->buf, m->members[i].handle->bdev, opf, blk_rq_pos(rq),
+                          mirror_write_endio, wr);
+    blk_finish_plug(&plug);
+    return BLK_STS_OK;
+}
+
+static void mirror_all_endio(struct bio *bio)
+{
+    struct request *rq = bio->bi_private;
+    struct uringblk_queue *uq = rq->mq_hctx->driver_data;
+    struct uringblk_mirror *m = uq->dev->backend.private_data;
+
+    /* A member that missed a discard still returns data that was there */
+    if (bio->bi_status && bio_op(bio) != REQ_OP_DISCARD)
+        mirror_degrade(m, mirror_member_of(m, bio->bi_bdev));
+    uringblk_bio_endio(bio);
+}
+
+/* Writes acked by every member, discards and flushes share the request pages */
+static blk_status_t mirror_all_rq(struct uringblk_device *dev, struct uringblk_mirror *m,
+                                  struct request *rq)
+{
+    struct blk_plug plug;
+    struct bio *bio, *clone;
+    unsigned int i;
+
+    if (req_op(rq) == REQ_OP_FLUSH)
+        mirror_wait_writes(m);
+
+    uringblk_cmd_start(rq);
+
+    blk_start_plug(&plug);
+    for (i = 0; i < m->nr_members; i++) {
+        struct block_device *bdev = m->members[i].handle->bdev;
+
+        if (req_op(rq) == REQ_OP_FLUSH) {
+            clone = bio_alloc_bioset(bdev, 0, REQ_OP_WRITE | REQ_PREFLUSH,
+                                     GFP_NOIO, &dev->bio_set);
+            if (!clone) {
+                uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+                goto out;
+            }
+            clone->bi_end_io = mirror_all_endio;
+            uringblk_bio_submit(rq, clone);
+            continue;
+        }
+
+        __rq_for_each_bio(bio, rq) {
+            clone = uringblk_bio_clone(dev, bio, bdev, bio->bi_iter.bi_sector);
+            if (!clone) {
+                uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+                goto out;
+            }
+            clone->bi_opf &= ~REQ_POLLED;
+            clone->bi_end_io = mirror_all_endio;
+            uringblk_bio_submit(rq, clone);
+        }
+    }
+out:
+    blk_finish_plug(&plug);
+
+    uringblk_cmd_put(rq);
+    return BLK_STS_OK;
+}
+
+/*
+ * Plain reads are cloned onto one member
+ */
+static void mirror_read_endio(struct bio *bio)
+{
+    struct request *rq = bio->bi_private;
+    struct uringblk_queue *uq = rq->mq_hctx->driver_data;
+    struct uringblk_mirror *m = uq->dev->backend.private_data;
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    int i = mirror_member_of(m, bio->bi_bdev);
+
+    if (i >= 0) {
+        if (!bio->bi_status)
+            mirror_sample(&m->members[i], ktime_get_ns() - cmd->start_ns);
+        atomic_dec(&m->members[i].inflight);
+    }
+    uringblk_bio_endio(bio);
+}
+
+static blk_status_t mirror_read_rq(struct uringblk_device *dev, struct uringblk_mirror *m,
+                                   struct request *rq, unsigned int member)
+{
+    struct uringblk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+    struct mirror_member *mm = &m->members[member];
+    struct blk_plug plug;
+    struct bio *bio, *clone;
+
+    uringblk_cmd_start(rq);
+
+    blk_start_plug(&plug);
+    __rq_for_each_bio(bio, rq) {
+        clone = uringblk_bio_clone(dev, bio, mm->handle->bdev, bio->bi_iter.bi_sector);
+        if (!clone) {
+            uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+            break;
+        }
+        if ((rq->cmd_flags & REQ_POLLED) && !cmd->poll_bio)
+            uringblk_bio_poll_track(rq, clone);
+        clone->bi_end_io = mirror_read_endio;
+        atomic_inc(&mm->inflight);
+        uringblk_bio_submit(rq, clone);
+    }
+    blk_finish_plug(&plug);
+
+    uringblk_cmd_put(rq);
+    return BLK_STS_OK;
+}
+
+/*
+ * Hedged reads
+ */
+static void mirror_read_put(struct mirror_read *rd)
+{
+    struct uringblk_mirror *m = rd->m;
+
+    if (refcount_dec_and_test(&rd->ref)) {
+        mirror_buf_free(rd->legs[0].buf);
+        mirror_buf_free(rd->legs[1].buf);
+        kfree(rd);
+        if (atomic_dec_and_test(&m->nr_hedged))
+            wake_up_var(&m->nr_hedged);
+    }
+}
+
+static void mirror_hedge_endio(struct bio *bio)
+{
+    struct mirror_leg *leg = bio->bi_private;
+    struct mirror_read *rd = leg->rd;
+    struct mirror_member *mm = &rd->m->members[leg->member];
+    blk_status_t status = bio->bi_status;
+    bool complete = false, failover = false;
+    unsigned long flags;
+
+    if (!status)
+        mirror_sample(mm, ktime_get_ns() - leg->start_ns);
+    else
+        pr_err_ratelimited("uringblk: mirror read failed on %pg: %d\n",
+                           bio->bi_bdev, blk_status_to_errno(status));
+    atomic_dec(&mm->inflight);
+    bio_put(bio);
+
+    spin_lock_irqsave(&rd->lock, flags);
+    rd->inflight--;
+    if (!rd->done) {
+        if (!status || (rd->hedged && !rd->inflight)) {
+            rd->done = true;
+            complete = true;
+        } else if (!rd->hedged) {
+            failover = true;
+        }
+    }
+    spin_unlock_irqrestore(&rd->lock, flags);
+
+    if (complete) {
+        if (!status)
+            mirror_buf_copy(leg->buf, rd->rq, true);
+        uringblk_complete_rq(rd->rq, status);
+        /* Nothing left to hedge, drop the timer's reference early */
+        if (hrtimer_try_to_cancel(&rd->timer) == 1)
+            mirror_read_put(rd);
+    }
+
+    /* Retry on another member now rather than at the hedge deadline */
+    if (failover && hrtimer_try_to_cancel(&rd->timer) == 1)
+        queue_work(rd->m->wq, &rd->hedge_work);
+
+    mirror_read_put(rd);
+}
+
+static int mirror_leg_submit(struct mirror_read *rd, unsigned int idx, unsigned int member)
+{
+    struct mirror_leg *leg = &rd->legs[idx];
+    struct request *rq = rd->rq;
+
+    leg->buf = mirror_buf_alloc(blk_rq_bytes(rq));
+    if (!leg->buf)
+        return -ENOMEM;
+    leg->rd = rd;
+    leg->member = member;
+    leg->start_ns = ktime_get_ns();
+
+    refcount_inc(&rd->ref);
+    atomic_inc(&rd->m->members[member].inflight);
+    mirror_buf_submit(leg->buf, rd->m->members[member].handle->bdev, REQ_OP_READ,
+                      blk_rq_pos(rq), mirror_hedge_endio, leg);
+    return 0;
+}
+
+static void mirror_hedge_work(struct work_struct *work)
+{
+    struct mirror_read *rd = container_of(work, struct mirror_read, hedge_work);
+    bool launch = false, fail = false;
+    int member = mirror_pick(rd->m, rd->avoid | BIT(rd->legs[0].member));
+
+    spin_lock_irq(&rd->lock);
+    if (!rd->done && !rd->hedged) {
+        rd->hedged = true;
+        rd->inflight++;
+        launch = true;
+    }
+    spin_unlock_irq(&rd->lock);
+
+    if (launch && (member < 0 || mirror_leg_submit(rd, 1, member))) {
+        spin_lock_irq(&rd->lock);
+        rd->inflight--;
+        if (!rd->done && !rd->inflight) {
+            /* The first leg already failed and there is no second one */
+            rd->done = true;
+            fail = true;
+        }
+        spin_unlock_irq(&rd->lock);
+        if (fail)
+            uringblk_complete_rq(rd->rq, BLK_STS_IOERR);
+    }
+
+    /* Drop the timer's reference */
+    mirror_read_put(rd);
+}
+
+static enum hrtimer_restart mirror_hedge_timer(struct hrtimer *timer)
+{
+    struct mirror_read *rd = container_of(timer, struct mirror_read, timer);
+
+    /* Bios cannot be allocated here, issue the hedge from process context */
+    queue_work(rd->m->wq, &rd->hedge_work);
+    return HRTIMER_NORESTART;
+}
+
+static blk_status_t mirror_hedged_read_rq(struct uringblk_mirror *m, struct request *rq,
+                                          unsigned int member, unsigned long avoid,
+                                          u64 delay_ns)
+{
+    struct mirror_read *rd;
+
+    rd = kzalloc(sizeof(*rd), GFP_NOIO);
+    if (!rd)
+        return BLK_STS_RESOURCE;
+
+    rd->rq = rq;
+    rd->m = m;
+    refcount_set(&rd->ref, 1);     /* The timer's, handed on to the work */
+    spin_lock_init(&rd->lock);
+    rd->inflight = 1;
+    rd->avoid = avoid;
+    hrtimer_init(&rd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    rd->timer.function = mirror_hedge_timer;
+    INIT_WORK(&rd->hedge_work, mirror_hedge_work);
+
+    atomic_inc(&m->nr_hedged);
+    if (mirror_leg_submit(rd, 0, member)) {
+        mirror_read_put(rd);
+        return BLK_STS_RESOURCE;
+    }
+
+    hrtimer_start(&rd->timer, ns_to_ktime(delay_ns), HRTIMER_MODE_REL);
+    return BLK_STS_OK;
+}
+
+static blk_status_t mirror_queue_rq(struct uringblk_backend *backend, struct request *rq)
+{
+    struct uringblk_device *dev = container_of(backend, struct uringblk_device, backend);
+    struct uringblk_mirror *m = backend->private_data;
+    unsigned long avoid;
+    int member;
+    u64 p95;
+
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+        avoid = mirror_stale(m, blk_rq_pos(rq), blk_rq_sectors(rq));
+        member = mirror_pick(m, avoid);
+        /* Only when the read races with a write to every member */
+        if (member < 0) {
+            avoid = 0;
+            member = mirror_pick(m, 0);
+        }
+        p95 = READ_ONCE(m->members[member].p95_ns);
+        /* Until the member has a latency estimate there is nothing to hedge on */
+        if (READ_ONCE(mirror_hedge_reads) && p95 &&
+            blk_rq_bytes(rq) <= URINGBLK_MIRROR_HEDGE_MAX)
+            return mirror_hedged_read_rq(m, rq, member, avoid,
+                                         max_t(u64, p95, URINGBLK_MIRROR_HEDGE_MIN));
+        return mirror_read_rq(dev, m, rq, member);
+    case REQ_OP_WRITE:
+        if (m->quorum < m->nr_members)
+            return mirror_write_quorum_rq(m, rq);
+        fallthrough;
+    default:
+        return mirror_all_rq(dev, m, rq);
+    }
+}
+
+/**
+ * uringblk_mirror_init - Open the members of a mirrored backend
+ * @backend: Backend to set up
+ * @paths: Comma-separated member device paths, two or three of them
+ * @capacity: Requested capacity in bytes, 0 for the smallest member
+ */
+int uringblk_mirror_init(struct uringblk_backend *backend, const char *paths, size_t capacity)
+{
+    struct bdev_handle *handles[URINGBLK_MIRROR_MAX];
+    struct uringblk_mirror *m;
+    sector_t sectors = 0;
+    unsigned int i;
+    int ret;
+
+    ret = uringblk_bio_open_members(paths, handles, URINGBLK_MIRROR_MAX);
+    if (ret < 0)
+        return ret;
+    if (ret < 2) {
+        pr_err("uringblk: a mirror needs two or three members\n");
+        uringblk_bio_release_members(handles, ret);
+        return -EINVAL;
+    }
+
+    m = kzalloc(sizeof(*m), GFP_KERNEL);
+    if (!m) {
+        uringblk_bio_release_members(handles, ret);
+        return -ENOMEM;
+    }
+    m->wq = alloc_workqueue("uringblk_mirror", WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+    if (!m->wq) {
+        uringblk_bio_release_members(handles, ret);
+        kfree(m);
+        return -ENOMEM;
+    }
+    atomic_set(&m->nr_hedged, 0);
+    atomic_set(&m->nr_writes, 0);
+    spin_lock_init(&m->lock);
+    INIT_LIST_HEAD(&m->writes);
+    init_waitqueue_head(&m->write_wait);
+    m->nr_members = ret;
+    m->quorum = mirror_write_quorum ? min(mirror_write_quorum, m->nr_members) : m->nr_members;
+
+    for (i = 0; i < m->nr_members; i++) {
+        sector_t n = bdev_nr_sectors(handles[i]->bdev);
+
+        m->members[i].handle = handles[i];
+        atomic_set(&m->members[i].inflight, 0);
+        if (!i || n < sectors)
+            sectors = n;
+    }
+    if (capacity)
+        sectors = min_t(sector_t, sectors, capacity >> SECTOR_SHIFT);
+
+    backend->private_data = m;
+    backend->capacity = (size_t)sectors << SECTOR_SHIFT;
+    backend->type = URINGBLK_BACKEND_MIRROR;
+    backend->ops = &uringblk_mirror_ops;
+
+    pr_info("uringblk: mirroring over %u devices, write quorum %u, capacity %zu MB\n",
+            m->nr_members, m->quorum, backend->capacity >> 20);
+    return 0;
+}
+
+static void mirror_cleanup(struct uringblk_backend *backend)
+{
+    struct uringblk_mirror *m = backend->private_data;
+    unsigned int i;
+
+    if (!m)
+        return;
+
+    /* Hedge timers and work, and quorum stragglers, may outlive their requests */
+    wait_var_event(&m->nr_hedged, !atomic_read(&m->nr_hedged));
+    wait_var_event(&m->nr_writes, !atomic_read(&m->nr_writes));
+    destroy_workqueue(m->wq);
+    for (i = 0; i < m->nr_members; i++)
+        bdev_release(m->members[i].handle);
+    kfree(m);
+    backend->private_data = NULL;
+}
+
+/*
+ * Synchronous I/O reads from the preferred member and writes to all
+ */
+static int mirror_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len)
+{
+    struct uringblk_mirror *m = backend->private_data;
+    unsigned long avoid;
+    int i, ret;
+
+    if (pos + len > backend->capacity + backend->reserved)
+        return -EINVAL;
+
+    avoid = mirror_stale(m, pos >> SECTOR_SHIFT, len >> SECTOR_SHIFT);
+    i = mirror_pick(m, avoid);
+    if (i < 0) {
+        avoid = 0;
+        i = mirror_pick(m, 0);
+    }
+    ret = uringblk_bio_rw_kern(m->members[i].handle->bdev, REQ_OP_READ,
+                               pos >> SECTOR_SHIFT, buf, len);
+    if (ret) {
+        i = mirror_pick(m, avoid | BIT(i));
+        if (i >= 0)
+            ret = uringblk_bio_rw_kern(m->members[i].handle->bdev, REQ_OP_READ,
+                                       pos >> SECTOR_SHIFT, buf, len);
+    }
+    return ret;
+}
+
+static int mirror_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len)
+{
+    struct uringblk_mirror *m = backend->private_data;
+    unsigned int i, acks = 0;
+
+    if (pos + len > backend->capacity + backend->reserved)
+        return -EINVAL;
+
+    for (i = 0; i < m->nr_members; i++) {
+        if (!uringblk_bio_rw_kern(m->members[i].handle->bdev, REQ_OP_WRITE | REQ_SYNC,
+                                  pos >> SECTOR_SHIFT, (void *)buf, len))
+            acks++;
+        else
+            mirror_degrade(m, i);
+    }
+    return acks >= m->quorum ? 0 : -EIO;
+}
+
+static int mirror_flush(struct uringblk_backend *backend)
+{
+    struct uringblk_mirror *m = backend->private_data;
+    unsigned int i;
+    int ret = 0, err;
+
+    mirror_wait_writes(m);
+    for (i = 0; i < m->nr_members; i++) {
+        err = blkdev_issue_flush(m->members[i].handle->bdev);
+        if (err) {
+            mirror_degrade(m, i);
+            if (!ret)
+                ret = err;
+        }
+    }
+    return ret;
+}
+
+static int mirror_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
+{
+    struct uringblk_mirror *m = backend->private_data;
+    unsigned int i;
+    int ret = 0, err;
+
+    for (i = 0; i < m->nr_members; i++) {
+        err = blkdev_issue_discard(m->members[i].handle->bdev, pos >> SECTOR_SHIFT,
+                                   len >> SECTOR_SHIFT, GFP_NOIO);
+        if (err && err != -EOPNOTSUPP && !ret)
+            ret = err;
+    }
+    return ret;
+}
+
+const struct uringblk_backend_ops uringblk_mirror_ops = {
+    .init = uringblk_mirror_init,
+    .cleanup = mirror_cleanup,
+    .read = mirror_read,
+    .write = mirror_write,
+    .flush = mirror_flush,
+    .discard = mirror_discard,
+    .queue_rq = mirror_queue_rq,
+};
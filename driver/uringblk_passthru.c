@@ -0,0 +1,289 @@
+/*
+ * uringblk_passthru.c - Data commands over URING_CMD
+ *
+ * READ, WRITE, WRITE_ZEROES and FLUSH can be sent as URING_CMDs on the
+ * admin device, the way NVMe passthrough and ublk do it. The user
+ * buffer (a registered io_uring buffer with IORING_URING_CMD_FIXED, a
+ * plain buffer or an iovec array for the vectored opcodes) is pinned
+ * and submitted as bios straight to the disk, with the same alignment
+ * rules as O_DIRECT. There is no VFS on the way, and the CQE is posted
+ * from task work once the last bio ends.
+ *
+ * The bios go through the block layer like any other I/O, so flushes
+ * and FUA take the blk-mq flush machinery and every backend, zoned mode
+ * and the statistics see them as ordinary requests.
+ *
+ * The admin device bypasses the permissions of the disk node, so the
+ * commands that write need the admin device opened for writing and
+ * CAP_SYS_ADMIN, and fail with -EBUSY while the disk or one of its
+ * partitions is held exclusively, by a mounted filesystem for one.
+ */
+
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/uio.h>
+#include <linux/ioprio.h>
+#include <linux/capability.h>
+#include <linux/io_uring.h>
+#include <linux/io_uring/cmd.h>
+
+#include "uringblk_driver.h"
+
+/* Per-command state, lives in io_uring_cmd->pdu */
+struct uringblk_pt_pdu {
+    atomic_t pending;              /* Bios in flight, +1 while submitting */
+    int result;                    /* Bytes submitted */
+    int error;                     /* First bio error */
+    bool dirty;                    /* Read into user pages, dirty them on completion */
+};
+
+static inline struct uringblk_pt_pdu *uringblk_pt_pdu(struct io_uring_cmd *ioucmd)
+{
+    return (struct uringblk_pt_pdu *)ioucmd->pdu;
+}
+
+static void uringblk_pt_done(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+    struct uringblk_pt_pdu *pdu = uringblk_pt_pdu(ioucmd);
+
+    io_uring_cmd_done(ioucmd, pdu->error ?: pdu->result, 0, issue_flags);
+}
+
+static void uringblk_pt_put(struct io_uring_cmd *ioucmd)
+{
+    if (atomic_dec_and_test(&uringblk_pt_pdu(ioucmd)->pending))
+        io_uring_cmd_do_in_task_lazy(ioucmd, uringblk_pt_done);
+}
+
+static void uringblk_pt_end_bio(struct bio *bio)
+{
+    struct io_uring_cmd *ioucmd = bio->bi_private;
+    struct uringblk_pt_pdu *pdu = uringblk_pt_pdu(ioucmd);
+
+    if (bio->bi_status)
+        cmpxchg(&pdu->error, 0, blk_status_to_errno(bio->bi_status));
+
+    /* Same as block device direct I/O */
+    if (pdu->dirty) {
+        bio_check_pages_dirty(bio);
+    } else {
+        bio_release_pages(bio, false);
+        bio_put(bio);
+    }
+    uringblk_pt_put(ioucmd);
+}
+
+static struct bio *uringblk_pt_alloc_bio(struct uringblk_device *dev, struct io_uring_cmd *ioucmd,
+                                         unsigned short nr_vecs, blk_opf_t opf,
+                                         sector_t sector, u16 ioprio)
+{
+    struct bio *bio;
+
+    bio = bio_alloc(dev->disk->part0, nr_vecs, opf, GFP_KERNEL);
+    bio->bi_iter.bi_sector = sector;
+    if (ioprio_valid(ioprio))
+        bio->bi_ioprio = ioprio;
+    bio->bi_private = ioucmd;
+    bio->bi_end_io = uringblk_pt_end_bio;
+    atomic_inc(&uringblk_pt_pdu(ioucmd)->pending);
+    return bio;
+}
+
+static int uringblk_pt_import(struct io_uring_cmd *ioucmd, int rw, bool vec,
+                              struct iov_iter *iter, struct iovec **iov)
+{
+    const struct io_uring_sqe *sqe = ioucmd->sqe;
+    u64 ubuf = READ_ONCE(sqe->addr);
+    u32 len = READ_ONCE(sqe->len);
+    ssize_t ret;
+
+    *iov = NULL;
+    if (ioucmd->flags & IORING_URING_CMD_FIXED) {
+        /* A registered buffer is already pinned, vectors are not supported on it */
+        if (vec)
+            return -EINVAL;
+        return io_uring_cmd_import_fixed(ubuf, len, rw, iter, ioucmd);
+    }
+    if (!vec)
+        return import_ubuf(rw, u64_to_user_ptr(ubuf), len, iter);
+
+    ret = import_iovec(rw, u64_to_user_ptr(ubuf), len, 0, iov, iter);
+    return ret < 0 ? ret : 0;
+}
+
+/* Someone holds the disk or one of its partitions exclusively */
+static bool uringblk_pt_claimed(struct gendisk *disk)
+{
+    struct block_device *part;
+    unsigned long idx;
+    bool claimed = false;
+
+    rcu_read_lock();
+    xa_for_each(&disk->part_tbl, idx, part) {
+        if (READ_ONCE(part->bd_holder)) {
+            claimed = true;
+            break;
+        }
+    }
+    rcu_read_unlock();
+    return claimed;
+}
+
+/**
+ * uringblk_pt_cmd - Run a data URING_CMD
+ * @dev: uringblk device
+ * @ioucmd: io_uring command, sqe->cmd holds a struct uringblk_io_cmd
+ * @issue_flags: io_uring issue flags
+ *
+ * sqe->addr and sqe->len describe the buffer, or the iovec array and
+ * its length for the vectored opcodes. The CQE result is the number of
+ * bytes transferred or a negative errno.
+ */
+int uringblk_pt_cmd(struct uringblk_device *dev, struct io_uring_cmd *ioucmd,
+                    unsigned int issue_flags)
+{
+    const struct uringblk_io_cmd *io = io_uring_sqe_cmd(ioucmd->sqe);
+    struct uringblk_pt_pdu *pdu = uringblk_pt_pdu(ioucmd);
+    u16 opcode = READ_ONCE(io->opcode);
+    u16 flags = READ_ONCE(io->flags);
+    sector_t sector = READ_ONCE(io->sector);
+    u32 len = READ_ONCE(ioucmd->sqe->len);
+    u16 ioprio = READ_ONCE(ioucmd->sqe->ioprio);
+    unsigned int lbs = uringblk_logical_block_size;
+    bool vec = opcode == URINGBLK_UCMD_READV || opcode == URINGBLK_UCMD_WRITEV;
+    struct iovec *iov;
+    struct iov_iter iter;
+    struct blk_plug plug;
+    struct bio *bio;
+    blk_opf_t opf;
+    int ret;
+
+    BUILD_BUG_ON(sizeof(struct uringblk_pt_pdu) > sizeof(ioucmd->pdu));
+
+    if (flags & ~(URINGBLK_IO_F_FUA | URINGBLK_IO_F_BULK | URINGBLK_IO_F_ATOMIC))
+        return -EINVAL;
+    /* Same rules as ioprio_set() */
+    if (IOPRIO_PRIO_CLASS(ioprio) == IOPRIO_CLASS_RT &&
+        !capable(CAP_SYS_ADMIN) && !capable(CAP_SYS_NICE))
+        return -EPERM;
+
+    switch (opcode) {
+    case URINGBLK_UCMD_READ:
+    case URINGBLK_UCMD_READV:
+        opf = REQ_OP_READ;
+        break;
+    case URINGBLK_UCMD_WRITE:
+    case URINGBLK_UCMD_WRITEV:
+        /* Bulk writes go down like writeback does */
+        opf = REQ_OP_WRITE;
+        if (!(flags & URINGBLK_IO_F_BULK))
+            opf |= REQ_SYNC | REQ_IDLE;
+        break;
+    case URINGBLK_UCMD_WRITE_ZEROES:
+        opf = REQ_OP_WRITE_ZEROES;
+        break;
+    case URINGBLK_UCMD_FLUSH:
+        /* An empty preflush, the block layer drops it without a write cache */
+        opf = REQ_OP_WRITE | REQ_PREFLUSH;
+        break;
+    default:
+        return -EOPNOTSUPP;
+    }
+    if (flags & URINGBLK_IO_F_FUA) {
+        if (!op_is_write(opf) || opcode == URINGBLK_UCMD_FLUSH)
+            return -EINVAL;
+        opf |= REQ_FUA;
+    }
+    if ((flags & (URINGBLK_IO_F_BULK | URINGBLK_IO_F_ATOMIC)) &&
+        (req_op(opf) != REQ_OP_WRITE || opcode == URINGBLK_UCMD_FLUSH))
+        return -EINVAL;
+    /* One bio the block layer never splits, it only has to fit one atomic unit */
+    if (flags & URINGBLK_IO_F_ATOMIC) {
+        if (!dev->atomic)
+            return -EOPNOTSUPP;
+        if (opcode != URINGBLK_UCMD_WRITE || !uringblk_atomic_fits(dev, sector, len))
+            return -EINVAL;
+    }
+
+    if (op_is_write(opf)) {
+        if (!(ioucmd->file->f_mode & FMODE_WRITE))
+            return -EBADF;
+        if (!capable(CAP_SYS_ADMIN))
+            return -EPERM;
+        if (uringblk_pt_claimed(dev->disk))
+            return -EBUSY;
+    }
+
+    if (opcode == URINGBLK_UCMD_READ || opcode == URINGBLK_UCMD_WRITE ||
+        opcode == URINGBLK_UCMD_WRITE_ZEROES) {
+        if (!len || !IS_ALIGNED(len, lbs) ||
+            sector + (len >> SECTOR_SHIFT) > get_capacity(dev->disk))
+            return -EINVAL;
+    }
+
+    atomic_set(&pdu->pending, 1);
+    pdu->error = 0;
+    pdu->dirty = false;
+
+    if (opcode == URINGBLK_UCMD_FLUSH || opcode == URINGBLK_UCMD_WRITE_ZEROES) {
+        pdu->result = opcode == URINGBLK_UCMD_FLUSH ? 0 : len;
+        bio = uringblk_pt_alloc_bio(dev, ioucmd, 0, opf, 0, ioprio);
+        if (opcode == URINGBLK_UCMD_WRITE_ZEROES) {
+            bio->bi_iter.bi_sector = sector;
+            bio->bi_iter.bi_size = len;
+        }
+        submit_bio(bio);
+        uringblk_pt_put(ioucmd);
+        return -EIOCBQUEUED;
+    }
+
+    ret = uringblk_pt_import(ioucmd, op_is_write(opf) ? ITER_SOURCE : ITER_DEST, vec,
+                             &iter, &iov);
+    if (ret)
+        return ret;
+
+    /* Vector lengths are only known now */
+    len = iov_iter_count(&iter);
+    if (vec && (!len || !IS_ALIGNED(len, lbs) ||
+                sector + (len >> SECTOR_SHIFT) > get_capacity(dev->disk))) {
+        ret = -EINVAL;
+        goto out;
+    }
+    if (!iov_iter_is_aligned(&iter, queue_dma_alignment(dev->disk->queue), lbs - 1)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    pdu->result = len;
+    pdu->dirty = !op_is_write(opf) && user_backed_iter(&iter);
+
+    blk_start_plug(&plug);
+    do {
+        bio = uringblk_pt_alloc_bio(dev, ioucmd, bio_iov_vecs_to_alloc(&iter, BIO_MAX_VECS),
+                                    opf, sector, ioprio);
+        ret = bio_iov_iter_get_pages(bio, &iter);
+        /* An atomic write must go down as one bio */
+        if (!ret && (flags & URINGBLK_IO_F_ATOMIC) && iov_iter_count(&iter))
+            ret = -EINVAL;
+        if (ret) {
+            bio->bi_status = errno_to_blk_status(ret);
+            bio_endio(bio);
+            break;
+        }
+        if (pdu->dirty)
+            bio_set_pages_dirty(bio);
+        sector += bio_sectors(bio);
+        submit_bio(bio);
+    } while (iov_iter_count(&iter));
+    blk_finish_plug(&plug);
+
+    kfree(iov);
+    uringblk_pt_put(ioucmd);
+    return -EIOCBQUEUED;
+
+out:
+    kfree(iov);
+    return ret;
+}
@@ -0,0 +1,207 @@
+/*
+ * uringblk_sched.c - Latency and bulk I/O classes
+ *
+ * With bulk_write_mbps set, every hw queue keeps bulk writes apart
+ * from the rest of its requests. A request is bulk when its ioprio
+ * class is IDLE, or when it is a write without REQ_SYNC, REQ_FUA or
+ * REQ_PREFLUSH and its class is not RT: page cache writeback and
+ * checkpoints. A WAL append written with O_DSYNC, fdatasync or a FUA
+ * URING_CMD is latency critical, as is anything in the RT class.
+ *
+ * Latency critical requests are dispatched as soon as blk-mq hands
+ * them over and never wait behind bulk ones. Bulk requests draw on a
+ * token bucket shared by the hw queues of the device, filled at
+ * bulk_write_mbps and holding up to bulk_burst_kb. A bulk request
+ * finding the bucket empty is parked on its hw queue's bulk list,
+ * and so is every bulk request behind it, until the bucket has
+ * refilled. Requests are started before they are parked, their
+ * latency includes the wait.
+ *
+ * Zoned devices are not supported, holding back part of the writes
+ * to a zone would move them off the write pointer.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/ioprio.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "uringblk_driver.h"
+
+static unsigned int bulk_write_mbps;
+module_param(bulk_write_mbps, uint, 0444);
+MODULE_PARM_DESC(bulk_write_mbps, "Bandwidth of the bulk I/O class in MB/s, 0 to not tell the classes apart (default: 0)");
+
+static unsigned int bulk_burst_kb = 1024;
+module_param(bulk_burst_kb, uint, 0644);
+MODULE_PARM_DESC(bulk_burst_kb, "Bulk I/O the token bucket lets through at once in KB (default: 1024)");
+
+struct uringblk_sched {
+    spinlock_t lock;               /* Protects tokens and last_ns */
+    s64 tokens;                    /* Bytes, negative after a large request */
+    u64 last_ns;                   /* Last refill */
+    u64 rate;                      /* Bytes per second */
+};
+
+bool uringblk_sched_enabled(void)
+{
+    return bulk_write_mbps != 0;
+}
+
+int uringblk_sched_init(struct uringblk_device *dev)
+{
+    struct uringblk_sched *s;
+
+    if (dev->config.zoned_mode) {
+        pr_err("uringblk: bulk_write_mbps is not supported in zoned mode\n");
+        return -EINVAL;
+    }
+
+    s = kzalloc(sizeof(*s), GFP_KERNEL);
+    if (!s)
+        return -ENOMEM;
+
+    spin_lock_init(&s->lock);
+    s->rate = (u64)bulk_write_mbps << 20;
+    s->tokens = (s64)READ_ONCE(bulk_burst_kb) << 10;
+    s->last_ns = ktime_get_ns();
+    dev->sched = s;
+    return 0;
+}
+
+void uringblk_sched_exit(struct uringblk_device *dev)
+{
+    kfree(dev->sched);
+    dev->sched = NULL;
+}
+
+static bool usched_bulk(struct request *rq)
+{
+    switch (IOPRIO_PRIO_CLASS(req_get_ioprio(rq))) {
+    case IOPRIO_CLASS_RT:
+        return false;
+    case IOPRIO_CLASS_IDLE:
+        return true;
+    default:
+        return req_op(rq) == REQ_OP_WRITE &&
+               !(rq->cmd_flags & (REQ_SYNC | REQ_FUA | REQ_PREFLUSH));
+    }
+}
+
+/*
+ * Take @bytes from the bucket. A request is let through as long as the
+ * bucket is not in debt, so requests larger than the burst still go.
+ * Otherwise *delay is set to the time until the debt is paid off.
+ */
+static bool usched_take(struct uringblk_sched *s, unsigned int bytes,
+                        unsigned long *delay)
+{
+    s64 burst = (s64)READ_ONCE(bulk_burst_kb) << 10;
+    u64 now = ktime_get_ns();
+    u64 elapsed;
+    bool ok;
+
+    spin_lock(&s->lock);
+    /* Long idle periods only need to fill the bucket */
+    elapsed = min_t(u64, now - s->last_ns, 10 * NSEC_PER_SEC);
+    s->tokens = min_t(s64, burst,
+                      s->tokens + mul_u64_u64_div_u64(elapsed, s->rate, NSEC_PER_SEC));
+    s->last_ns = now;
+
+    ok = s->tokens >= 0;
+    if (ok)
+        s->tokens -= bytes;
+    else
+        *delay = nsecs_to_jiffies(div64_u64((u64)-s->tokens * NSEC_PER_SEC,
+                                            s->rate)) + 1;
+    spin_unlock(&s->lock);
+    return ok;
+}
+
+/**
+ * uringblk_sched_hold - Park a bulk request the bucket has no room for
+ * @uq: hw queue the request was dispatched to
+ * @rq: started request
+ *
+ * Returns true if the request was parked, the bulk work of @uq
+ * dispatches it later. False if it is to be dispatched now.
+ */
+bool uringblk_sched_hold(struct uringblk_queue *uq, struct request *rq)
+{
+    struct uringblk_sched *s = uq->dev->sched;
+    unsigned long delay = 0;
+
+    if (!s || !usched_bulk(rq))
+        return false;
+
+    spin_lock_irq(&uq->lock);
+    /* Bulk requests keep their order among themselves */
+    if (list_empty(&uq->bulk_list) && usched_take(s, blk_rq_bytes(rq), &delay)) {
+        spin_unlock_irq(&uq->lock);
+        return false;
+    }
+    list_add_tail(&rq->queuelist, &uq->bulk_list);
+    spin_unlock_irq(&uq->lock);
+
+    /* Already pending when the list was not empty */
+    queue_delayed_work(system_unbound_wq, &uq->bulk_work, delay);
+    return true;
+}
+
+static void usched_bulk_work(struct work_struct *work)
+{
+    struct uringblk_queue *uq = container_of(to_delayed_work(work),
+                                             struct uringblk_queue, bulk_work);
+    struct uringblk_sched *s = uq->dev->sched;
+    struct blk_plug plug;
+    struct request *rq;
+    unsigned long delay;
+    bool requeue = false;
+
+    blk_start_plug(&plug);
+    for (;;) {
+        blk_status_t status;
+
+        spin_lock_irq(&uq->lock);
+        rq = list_first_entry_or_null(&uq->bulk_list, struct request, queuelist);
+        if (rq && !usched_take(s, blk_rq_bytes(rq), &delay)) {
+            spin_unlock_irq(&uq->lock);
+            queue_delayed_work(system_unbound_wq, &uq->bulk_work, delay);
+            break;
+        }
+        if (rq)
+            list_del_init(&rq->queuelist);
+        spin_unlock_irq(&uq->lock);
+        if (!rq)
+            break;
+
+        status = uringblk_run_rq(uq, rq);
+        if (status == BLK_STS_RESOURCE || status == BLK_STS_DEV_RESOURCE) {
+            blk_mq_requeue_request(rq, false);
+            requeue = true;
+        } else if (status != BLK_STS_OK) {
+            blk_mq_end_request(rq, status);
+        }
+    }
+    uringblk_bio_commit(uq);
+    blk_finish_plug(&plug);
+
+    if (requeue)
+        blk_mq_kick_requeue_list(uq->dev->disk->queue);
+}
+
+void uringblk_sched_init_queue(struct uringblk_queue *uq)
+{
+    INIT_LIST_HEAD(&uq->bulk_list);
+    INIT_DELAYED_WORK(&uq->bulk_work, usched_bulk_work);
+}
+
+void uringblk_sched_exit_queue(struct uringblk_queue *uq)
+{
+    /* The queue is frozen, every parked request has been dispatched */
+    cancel_delayed_work_sync(&uq->bulk_work);
+    WARN_ON_ONCE(!list_empty(&uq->bulk_list));
+}
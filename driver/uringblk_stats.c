@@ -0,0 +1,347 @@
+/*
+ * uringblk_stats.c - Request statistics for the uringblk driver
+ *
+ * Each hardware queue keeps per-CPU counters that the submission path
+ * bumps without any shared lock or cache line. They are only summed
+ * when GET_STATS or sysfs asks for them. Completion latencies go into
+ * log-linear histograms of the same hardware queue, one per operation
+ * type. They are a few KB each and not worth replicating per CPU.
+ */
+
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/blk-mq.h>
+#include <linux/u64_stats_sync.h>
+
+#include "uringblk_driver.h"
+
+int uringblk_queue_stats_alloc(struct uringblk_queue *uq)
+{
+    int cpu;
+
+    uq->stats = alloc_percpu(struct uringblk_qstats);
+    if (!uq->stats)
+        return -ENOMEM;
+
+    uq->lat = kzalloc(sizeof(*uq->lat), GFP_KERNEL);
+    if (!uq->lat) {
+        free_percpu(uq->stats);
+        uq->stats = NULL;
+        return -ENOMEM;
+    }
+    spin_lock_init(&uq->lat->lock);
+    u64_stats_init(&uq->lat->syncp);
+
+    for_each_possible_cpu(cpu)
+        u64_stats_init(&per_cpu_ptr(uq->stats, cpu)->syncp);
+    return 0;
+}
+
+void uringblk_queue_stats_free(struct uringblk_queue *uq)
+{
+    kfree(uq->lat);
+    uq->lat = NULL;
+    free_percpu(uq->stats);
+    uq->stats = NULL;
+}
+
+void uringblk_stats_account(struct uringblk_queue *uq, struct request *rq)
+{
+    struct uringblk_qstats *qs;
+
+    qs = get_cpu_ptr(uq->stats);
+    u64_stats_update_begin(&qs->syncp);
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+        u64_stats_inc(&qs->read_ops);
+        u64_stats_add(&qs->read_bytes, blk_rq_bytes(rq));
+        break;
+    case REQ_OP_WRITE:
+    case REQ_OP_ZONE_APPEND:
+        u64_stats_inc(&qs->write_ops);
+        u64_stats_add(&qs->write_bytes, blk_rq_bytes(rq));
+        break;
+    case REQ_OP_FLUSH:
+        u64_stats_inc(&qs->flush_ops);
+        break;
+    case REQ_OP_DISCARD:
+    case REQ_OP_WRITE_ZEROES:
+        u64_stats_inc(&qs->discard_ops);
+        break;
+    default:
+        break;
+    }
+    u64_stats_update_end(&qs->syncp);
+    put_cpu_ptr(uq->stats);
+}
+
+/**
+ * uringblk_queue_stats_sum - Sum the per-CPU counters of one hw queue
+ * @uq: Hardware queue context
+ * @out: Counters to add to
+ */
+void uringblk_queue_stats_sum(struct uringblk_queue *uq, struct uringblk_stats *out)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        struct uringblk_qstats *qs = per_cpu_ptr(uq->stats, cpu);
+        u64 rops, wops, fops, dops, rbytes, wbytes;
+        unsigned int start;
+
+        do {
+            start = u64_stats_fetch_begin(&qs->syncp);
+            rops = u64_stats_read(&qs->read_ops);
+            wops = u64_stats_read(&qs->write_ops);
+            fops = u64_stats_read(&qs->flush_ops);
+            dops = u64_stats_read(&qs->discard_ops);
+            rbytes = u64_stats_read(&qs->read_bytes);
+            wbytes = u64_stats_read(&qs->write_bytes);
+        } while (u64_stats_fetch_retry(&qs->syncp, start));
+
+        out->read_ops += rops;
+        out->write_ops += wops;
+        out->flush_ops += fops;
+        out->discard_ops += dops;
+        out->read_bytes += rbytes;
+        out->write_bytes += wbytes;
+    }
+    out->read_sectors = out->read_bytes >> SECTOR_SHIFT;
+    out->write_sectors = out->write_bytes >> SECTOR_SHIFT;
+}
+
+static void uringblk_stats_sum(struct uringblk_device *dev, struct uringblk_stats *out)
+{
+    struct blk_mq_hw_ctx *hctx;
+    unsigned long i;
+
+    memset(out, 0, sizeof(*out));
+    if (!dev->disk)
+        return;
+
+    queue_for_each_hw_ctx(dev->disk->queue, hctx, i) {
+        if (hctx->driver_data)
+            uringblk_queue_stats_sum(hctx->driver_data, out);
+    }
+}
+
+/**
+ * uringblk_stats_snapshot - Aggregate device statistics
+ * @dev: uringblk device
+ * @out: Filled with the counters accumulated since the last reset
+ *
+ * Rare event counters (queue full, media errors, retries) stay in
+ * dev->stats, written under stats_seq. The I/O counters never reset in
+ * place; a reset records a baseline that is subtracted here. Nothing
+ * is locked on the read side.
+ */
+void uringblk_stats_snapshot(struct uringblk_device *dev, struct uringblk_stats *out)
+{
+    struct uringblk_stats sum;
+    unsigned int seq;
+
+    uringblk_stats_sum(dev, &sum);
+
+    do {
+        seq = read_seqbegin(&dev->stats_seq);
+        *out = dev->stats;
+        out->read_ops = sum.read_ops - dev->stats_base.read_ops;
+        out->write_ops = sum.write_ops - dev->stats_base.write_ops;
+        out->flush_ops = sum.flush_ops - dev->stats_base.flush_ops;
+        out->discard_ops = sum.discard_ops - dev->stats_base.discard_ops;
+        out->read_bytes = sum.read_bytes - dev->stats_base.read_bytes;
+        out->write_bytes = sum.write_bytes - dev->stats_base.write_bytes;
+    } while (read_seqretry(&dev->stats_seq, seq));
+    out->read_sectors = out->read_bytes >> SECTOR_SHIFT;
+    out->write_sectors = out->write_bytes >> SECTOR_SHIFT;
+    uringblk_flashcache_stats(dev, out);
+}
+
+/* Blocks the driver itself found corrupted */
+void uringblk_stats_media_error(struct uringblk_device *dev, unsigned int nr)
+{
+    unsigned long flags;
+
+    write_seqlock_irqsave(&dev->stats_seq, flags);
+    dev->stats.media_errors += nr;
+    write_sequnlock_irqrestore(&dev->stats_seq, flags);
+}
+
+static void uringblk_lat_reset(struct uringblk_queue *uq);
+
+void uringblk_stats_reset(struct uringblk_device *dev)
+{
+    struct uringblk_stats sum;
+    struct blk_mq_hw_ctx *hctx;
+    unsigned long flags, i;
+
+    uringblk_stats_sum(dev, &sum);
+
+    write_seqlock_irqsave(&dev->stats_seq, flags);
+    memset(&dev->stats, 0, sizeof(dev->stats));
+    dev->stats_base = sum;
+    write_sequnlock_irqrestore(&dev->stats_seq, flags);
+    uringblk_flashcache_stats_reset(dev);
+
+    if (!dev->disk)
+        return;
+    queue_for_each_hw_ctx(dev->disk->queue, hctx, i) {
+        if (hctx->driver_data)
+            uringblk_lat_reset(hctx->driver_data);
+    }
+}
+
+/*
+ * Latency histograms
+ */
+static enum uringblk_lat_op uringblk_lat_op(struct request *rq)
+{
+    switch (req_op(rq)) {
+    case REQ_OP_READ:
+        return URINGBLK_LAT_READ;
+    case REQ_OP_WRITE:
+    case REQ_OP_ZONE_APPEND:
+        return URINGBLK_LAT_WRITE;
+    case REQ_OP_FLUSH:
+        return URINGBLK_LAT_FLUSH;
+    case REQ_OP_DISCARD:
+    case REQ_OP_WRITE_ZEROES:
+        return URINGBLK_LAT_DISCARD;
+    default:
+        return URINGBLK_LAT_NR;
+    }
+}
+
+static unsigned int uringblk_lat_bucket(u64 ns)
+{
+    unsigned int shift;
+
+    if (ns < URINGBLK_LAT_SUB)
+        return ns;
+
+    ns = min_t(u64, ns, (1ULL << (URINGBLK_LAT_MAX_SHIFT + 1)) - 1);
+    shift = fls64(ns) - 1 - URINGBLK_LAT_SUB_BITS;
+    return (shift + 1) * URINGBLK_LAT_SUB + ((ns >> shift) & (URINGBLK_LAT_SUB - 1));
+}
+
+/* Largest value that maps to @bucket */
+static u64 uringblk_lat_bucket_max(unsigned int bucket)
+{
+    unsigned int shift;
+
+    if (bucket < URINGBLK_LAT_SUB)
+        return bucket;
+
+    shift = bucket / URINGBLK_LAT_SUB - 1;
+    return ((u64)(URINGBLK_LAT_SUB + bucket % URINGBLK_LAT_SUB + 1) << shift) - 1;
+}
+
+/*
+ * Completions may run in interrupt context on any CPU of the queue, so
+ * the update takes the histogram lock with interrupts off.
+ */
+void uringblk_lat_record(struct uringblk_queue *uq, struct request *rq, u64 lat_ns)
+{
+    enum uringblk_lat_op op = uringblk_lat_op(rq);
+    struct uringblk_lat_hist *h = uq->lat;
+    unsigned long flags;
+
+    if (op == URINGBLK_LAT_NR)
+        return;
+
+    spin_lock_irqsave(&h->lock, flags);
+    u64_stats_update_begin(&h->syncp);
+    u64_stats_inc(&h->buckets[op][uringblk_lat_bucket(lat_ns)]);
+    if (lat_ns > u64_stats_read(&h->max_ns[op]))
+        u64_stats_set(&h->max_ns[op], lat_ns);
+    u64_stats_update_end(&h->syncp);
+    spin_unlock_irqrestore(&h->lock, flags);
+}
+
+static void uringblk_lat_sum(struct uringblk_queue *uq, enum uringblk_lat_op op,
+                             u64 *buckets, u64 *max_ns)
+{
+    struct uringblk_lat_hist *h = uq->lat;
+    int i;
+
+    for (i = 0; i < URINGBLK_LAT_BUCKETS; i++)
+        buckets[i] += u64_stats_read(&h->buckets[op][i]);
+    *max_ns = max(*max_ns, u64_stats_read(&h->max_ns[op]));
+}
+
+static void uringblk_lat_reset(struct uringblk_queue *uq)
+{
+    struct uringblk_lat_hist *h = uq->lat;
+    unsigned long flags;
+    int op, i;
+
+    spin_lock_irqsave(&h->lock, flags);
+    u64_stats_update_begin(&h->syncp);
+    for (op = 0; op < URINGBLK_LAT_NR; op++) {
+        for (i = 0; i < URINGBLK_LAT_BUCKETS; i++)
+            u64_stats_set(&h->buckets[op][i], 0);
+        u64_stats_set(&h->max_ns[op], 0);
+    }
+    u64_stats_update_end(&h->syncp);
+    spin_unlock_irqrestore(&h->lock, flags);
+}
+
+static u64 uringblk_lat_percentile(const u64 *buckets, u64 count, u64 max_ns,
+                                   unsigned int permille)
+{
+    u64 target = DIV_ROUND_UP_ULL(count * permille, 1000);
+    u64 seen = 0;
+    int i;
+
+    for (i = 0; i < URINGBLK_LAT_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= target)
+            return min(uringblk_lat_bucket_max(i), max_ns);
+    }
+    return max_ns;
+}
+
+/**
+ * uringblk_lat_summary - Percentiles of one operation type
+ * @dev: uringblk device
+ * @uq: Single hardware queue, or NULL for the whole device
+ * @op: Operation type
+ * @out: Filled with the sample count and percentiles in ns
+ */
+int uringblk_lat_summary(struct uringblk_device *dev, struct uringblk_queue *uq,
+                         enum uringblk_lat_op op, struct uringblk_lat_summary *out)
+{
+    struct blk_mq_hw_ctx *hctx;
+    u64 *buckets, max_ns = 0;
+    unsigned long i;
+
+    memset(out, 0, sizeof(*out));
+
+    buckets = kcalloc(URINGBLK_LAT_BUCKETS, sizeof(*buckets), GFP_KERNEL);
+    if (!buckets)
+        return -ENOMEM;
+
+    if (uq) {
+        uringblk_lat_sum(uq, op, buckets, &max_ns);
+    } else if (dev->disk) {
+        queue_for_each_hw_ctx(dev->disk->queue, hctx, i) {
+            if (hctx->driver_data)
+                uringblk_lat_sum(hctx->driver_data, op, buckets, &max_ns);
+        }
+    }
+
+    for (i = 0; i < URINGBLK_LAT_BUCKETS; i++)
+        out->count += buckets[i];
+
+    if (out->count) {
+        out->p50 = uringblk_lat_percentile(buckets, out->count, max_ns, 500);
+        out->p90 = uringblk_lat_percentile(buckets, out->count, max_ns, 900);
+        out->p99 = uringblk_lat_percentile(buckets, out->count, max_ns, 990);
+        out->p999 = uringblk_lat_percentile(buckets, out->count, max_ns, 999);
+        out->max = max_ns;
+    }
+
+    kfree(buckets);
+    return 0;
+}
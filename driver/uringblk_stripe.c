@@ -0,0 +1,293 @@
+/*
+ * uringblk_stripe.c - Striped (RAID-0) backend
+ *
+ * The device is laid out round-robin over several lower block devices
+ * in units of stripe_unit_kb. Every request bio is cut at unit
+ * boundaries and the pieces are cloned onto their members, so a large
+ * request is carried by all members in parallel. There is no
+ * redundancy: losing a member loses the device.
+ *
+ * Members are given as a comma-separated list of device paths, either
+ * in backend_device or in devices= when backend_type=2.
+ */
+
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+
+#include "uringblk_driver.h"
+
+#define URINGBLK_STRIPE_MAX_MEMBERS 16
+
+static unsigned int stripe_unit_kb = 128;
+module_param(stripe_unit_kb, uint, 0444);
+MODULE_PARM_DESC(stripe_unit_kb, "Stripe unit in KB for backend_type=2, a power of two >= 4 (default: 128)");
+
+struct uringblk_stripe {
+    unsigned int nr_members;
+    unsigned int unit_shift;       /* log2 of the stripe unit in sectors */
+    sector_t member_sectors;       /* Sectors used on each member */
+    struct bdev_handle *members[URINGBLK_STRIPE_MAX_MEMBERS];
+};
+
+/*
+ * Map a device sector onto its member. Returns the member and sets
+ * @lower to the sector on it and @left to the sectors remaining in the
+ * stripe unit.
+ */
+static struct block_device *stripe_map(struct uringblk_stripe *s, sector_t sector,
+                                       sector_t *lower, sector_t *left)
+{
+    sector_t unit_sectors = (sector_t)1 << s->unit_shift;
+    sector_t offset = sector & (unit_sectors - 1);
+    sector_t chunk = sector >> s->unit_shift;
+    u32 member = sector_div(chunk, s->nr_members);
+
+    *lower = (chunk << s->unit_shift) + offset;
+    *left = unit_sectors - offset;
+    return s->members[member]->bdev;
+}
+
+static void stripe_release(struct uringblk_stripe *s)
+{
+    uringblk_bio_release_members(s->members, s->nr_members);
+    kfree(s);
+}
+
+/**
+ * uringblk_stripe_init - Open the members of a striped backend
+ * @backend: Backend to set up
+ * @paths: Comma-separated member device paths
+ * @capacity: Requested capacity in bytes, 0 to use all of the members
+ *
+ * Every member contributes as many whole stripe units as the smallest
+ * one holds.
+ */
+int uringblk_stripe_init(struct uringblk_backend *backend, const char *paths, size_t capacity)
+{
+    unsigned int unit_sectors = stripe_unit_kb << (10 - SECTOR_SHIFT);
+    struct uringblk_stripe *s;
+    sector_t min_sectors = 0;
+    unsigned int i;
+    int ret;
+
+    if (stripe_unit_kb < 4 || !is_power_of_2(stripe_unit_kb)) {
+        pr_err("uringblk: stripe_unit_kb must be a power of two >= 4, got %u\n",
+               stripe_unit_kb);
+        return -EINVAL;
+    }
+
+    s = kzalloc(sizeof(*s), GFP_KERNEL);
+    if (!s)
+        return -ENOMEM;
+    s->unit_shift = ilog2(unit_sectors);
+
+    ret = uringblk_bio_open_members(paths, s->members, URINGBLK_STRIPE_MAX_MEMBERS);
+    if (ret < 0) {
+        kfree(s);
+        return ret;
+    }
+    s->nr_members = ret;
+
+    if (s->nr_members < 2) {
+        pr_err("uringblk: a stripe needs at least two members\n");
+        stripe_release(s);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < s->nr_members; i++) {
+        sector_t n = bdev_nr_sectors(s->members[i]->bdev);
+
+        if (!i || n < min_sectors)
+            min_sectors = n;
+    }
+    s->member_sectors = round_down(min_sectors, unit_sectors);
+    if (capacity) {
+        sector_t want = DIV_ROUND_UP_ULL(capacity >> SECTOR_SHIFT,
+                                         (u64)unit_sectors * s->nr_members) * unit_sectors;
+
+        s->member_sectors = min(s->member_sectors, want);
+    }
+    if (!s->member_sectors) {
+        pr_err("uringblk: stripe members are smaller than one stripe unit\n");
+        stripe_release(s);
+        return -EINVAL;
+    }
+
+    backend->private_data = s;
+    backend->capacity = (size_t)(s->member_sectors * s->nr_members) << SECTOR_SHIFT;
+    backend->type = URINGBLK_BACKEND_STRIPE;
+    backend->ops = &uringblk_stripe_ops;
+    backend->io_min = unit_sectors << SECTOR_SHIFT;
+    backend->io_opt = backend->io_min * s->nr_members;
+
+    pr_info("uringblk: striping over %u devices, %u KB unit, capacity %zu MB\n",
+            s->nr_members, stripe_unit_kb, backend->capacity >> 20);
+    return 0;
+}
+
+static void stripe_cleanup(struct uringblk_backend *backend)
+{
+    struct uringblk_stripe *s = backend->private_data;
+
+    if (s) {
+        stripe_release(s);
+        backend->private_data = NULL;
+    }
+}
+
+/*
+ * Clone one request bio onto its members, one clone per stripe unit it
+ * touches. Completions of different members may arrive on different
+ * lower queues, so the clones complete by interrupt rather than being
+ * polled.
+ */
+static int stripe_split_bio(struct uringblk_device *dev, struct uringblk_stripe *s,
+                            struct request *rq, struct bio *bio)
+{
+    sector_t sector = bio->bi_iter.bi_sector;
+    sector_t total = bio_sectors(bio);
+    sector_t done = 0;
+
+    while (done < total) {
+        struct block_device *bdev;
+        sector_t lower, left, n;
+        struct bio *clone;
+
+        bdev = stripe_map(s, sector + done, &lower, &left);
+        n = min(left, total - done);
+
+        clone = uringblk_bio_clone(dev, bio, bdev, 0);
+        if (!clone)
+            return -ENOMEM;
+        bio_trim(clone, done, n);
+        clone->bi_iter.bi_sector = lower;
+        clone->bi_opf &= ~REQ_POLLED;
+        uringblk_bio_submit(rq, clone);
+
+        done += n;
+    }
+    return 0;
+}
+
+static blk_status_t stripe_queue_rq(struct uringblk_backend *backend, struct request *rq)
+{
+    struct uringblk_device *dev = container_of(backend, struct uringblk_device, backend);
+    struct uringblk_stripe *s = backend->private_data;
+    struct blk_plug plug;
+    struct bio *bio;
+    unsigned int i;
+
+    uringblk_cmd_start(rq);
+
+    blk_start_plug(&plug);
+    if (req_op(rq) == REQ_OP_FLUSH) {
+        /* Every member may hold part of the cached data */
+        for (i = 0; i < s->nr_members; i++) {
+            bio = bio_alloc_bioset(s->members[i]->bdev, 0, REQ_OP_WRITE | REQ_PREFLUSH,
+                                   GFP_NOIO, &dev->bio_set);
+            if (!bio) {
+                uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+                break;
+            }
+            uringblk_bio_submit(rq, bio);
+        }
+    } else {
+        __rq_for_each_bio(bio, rq) {
+            if (stripe_split_bio(dev, s, rq, bio)) {
+                uringblk_cmd_set_error(rq, BLK_STS_RESOURCE);
+                break;
+            }
+        }
+    }
+    blk_finish_plug(&plug);
+
+    uringblk_cmd_put(rq);
+    return BLK_STS_OK;
+}
+
+/*
+ * Synchronous I/O on a kernel buffer, split at stripe unit boundaries.
+ * @buf is NULL for discards.
+ */
+static int stripe_rw_kern(struct uringblk_backend *backend, blk_opf_t opf,
+                          loff_t pos, void *buf, size_t len)
+{
+    struct uringblk_stripe *s = backend->private_data;
+    sector_t sector = pos >> SECTOR_SHIFT;
+    sector_t left = len >> SECTOR_SHIFT;
+    int ret = 0;
+
+    if (!s || pos + len > backend->capacity + backend->reserved)
+        return -EINVAL;
+
+    while (left && !ret) {
+        struct block_device *bdev;
+        sector_t lower, n;
+
+        bdev = stripe_map(s, sector, &lower, &n);
+        n = min(n, left);
+
+        if (buf) {
+            ret = uringblk_bio_rw_kern(bdev, opf, lower, buf, n << SECTOR_SHIFT);
+            buf += n << SECTOR_SHIFT;
+        } else {
+            ret = blkdev_issue_discard(bdev, lower, n, GFP_NOIO);
+            if (ret == -EOPNOTSUPP)
+                ret = 0;
+        }
+
+        sector += n;
+        left -= n;
+    }
+
+    if (ret)
+        pr_err_ratelimited("uringblk: stripe I/O failed at pos %lld, len %zu: %d\n",
+                           pos, len, ret);
+    return ret;
+}
+
+static int stripe_read(struct uringblk_backend *backend, loff_t pos, void *buf, size_t len)
+{
+    return stripe_rw_kern(backend, REQ_OP_READ, pos, buf, len);
+}
+
+static int stripe_write(struct uringblk_backend *backend, loff_t pos, const void *buf, size_t len)
+{
+    return stripe_rw_kern(backend, REQ_OP_WRITE | REQ_SYNC, pos, (void *)buf, len);
+}
+
+static int stripe_flush(struct uringblk_backend *backend)
+{
+    struct uringblk_stripe *s = backend->private_data;
+    unsigned int i;
+    int ret = 0, err;
+
+    if (!s)
+        return -EINVAL;
+
+    for (i = 0; i < s->nr_members; i++) {
+        err = blkdev_issue_flush(s->members[i]->bdev);
+        if (err && !ret)
+            ret = err;
+    }
+    return ret;
+}
+
+static int stripe_discard(struct uringblk_backend *backend, loff_t pos, size_t len)
+{
+    return stripe_rw_kern(backend, REQ_OP_DISCARD, pos, NULL, len);
+}
+
+const struct uringblk_backend_ops uringblk_stripe_ops = {
+    .init = uringblk_stripe_init,
+    .cleanup = stripe_cleanup,
+    .read = stripe_read,
+    .write = stripe_write,
+    .flush = stripe_flush,
+    .discard = stripe_discard,
+    .queue_rq = stripe_queue_rq,
+};
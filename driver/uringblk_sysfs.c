@@ -21,7 +21,7 @@ static ssize_t features_show(struct device *dev, struct device_attribute *attr,
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
     
-    return sprintf(buf, "0x%llx\n", udev->features);
+    return sprintf(buf, "0x%llx\n", uringblk_features(udev));
 }
 
 static ssize_t firmware_rev_show(struct device *dev, struct device_attribute *attr,
@@ -101,14 +101,10 @@ static ssize_t read_ops_show(struct device *dev, struct device_attribute *attr,
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 read_ops;
+    struct uringblk_stats stats;
     
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    read_ops = udev->stats.read_ops;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
-    
-    return sprintf(buf, "%llu\n", read_ops);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.read_ops);
 }
 
 static ssize_t write_ops_show(struct device *dev, struct device_attribute *attr,
@@ -116,14 +112,10 @@ static ssize_t write_ops_show(struct device *dev, struct device_attribute *attr,
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 write_ops;
-    
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    write_ops = udev->stats.write_ops;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
+    struct uringblk_stats stats;
     
-    return sprintf(buf, "%llu\n", write_ops);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.write_ops);
 }
 
 static ssize_t read_bytes_show(struct device *dev, struct device_attribute *attr,
@@ -131,14 +123,10 @@ static ssize_t read_bytes_show(struct device *dev, struct device_attribute *attr
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 read_bytes;
-    
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    read_bytes = udev->stats.read_bytes;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
+    struct uringblk_stats stats;
     
-    return sprintf(buf, "%llu\n", read_bytes);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.read_bytes);
 }
 
 static ssize_t write_bytes_show(struct device *dev, struct device_attribute *attr,
@@ -146,14 +134,10 @@ static ssize_t write_bytes_show(struct device *dev, struct device_attribute *att
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 write_bytes;
+    struct uringblk_stats stats;
     
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    write_bytes = udev->stats.write_bytes;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
-    
-    return sprintf(buf, "%llu\n", write_bytes);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.write_bytes);
 }
 
 static ssize_t flush_ops_show(struct device *dev, struct device_attribute *attr,
@@ -161,14 +145,10 @@ static ssize_t flush_ops_show(struct device *dev, struct device_attribute *attr,
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 flush_ops;
-    
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    flush_ops = udev->stats.flush_ops;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
+    struct uringblk_stats stats;
     
-    return sprintf(buf, "%llu\n", flush_ops);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.flush_ops);
 }
 
 static ssize_t discard_ops_show(struct device *dev, struct device_attribute *attr,
@@ -176,14 +156,10 @@ static ssize_t discard_ops_show(struct device *dev, struct device_attribute *att
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 discard_ops;
-    
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    discard_ops = udev->stats.discard_ops;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
+    struct uringblk_stats stats;
     
-    return sprintf(buf, "%llu\n", discard_ops);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.discard_ops);
 }
 
 static ssize_t queue_full_events_show(struct device *dev, struct device_attribute *attr,
@@ -191,14 +167,10 @@ static ssize_t queue_full_events_show(struct device *dev, struct device_attribut
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 queue_full_events;
+    struct uringblk_stats stats;
     
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    queue_full_events = udev->stats.queue_full_events;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
-    
-    return sprintf(buf, "%llu\n", queue_full_events);
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.queue_full_events);
 }
 
 static ssize_t media_errors_show(struct device *dev, struct device_attribute *attr,
@@ -206,14 +178,112 @@ static ssize_t media_errors_show(struct device *dev, struct device_attribute *at
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
-    u64 media_errors;
+    struct uringblk_stats stats;
+    
+    uringblk_stats_snapshot(udev, &stats);
+    return sprintf(buf, "%llu\n", stats.media_errors);
+}
+
+/* One line per hardware queue, totals since module load */
+static ssize_t hctx_stats_show(struct device *dev, struct device_attribute *attr,
+                               char *buf)
+{
+    struct gendisk *disk = dev_to_disk(dev);
+    struct blk_mq_hw_ctx *hctx;
+    unsigned long i;
+    int len = 0;
+    
+    queue_for_each_hw_ctx(disk->queue, hctx, i) {
+        struct uringblk_queue *uq = hctx->driver_data;
+        struct uringblk_stats stats = {};
+        
+        if (!uq)
+            continue;
+        uringblk_queue_stats_sum(uq, &stats);
+        len += sysfs_emit_at(buf, len, "%u read_ops=%llu write_ops=%llu read_bytes=%llu write_bytes=%llu\n",
+                             uq->queue_num, stats.read_ops, stats.write_ops,
+                             stats.read_bytes, stats.write_bytes);
+    }
+    
+    return len;
+}
+
+/*
+ * Latency attributes read "count p50 p90 p99 p99.9 max", times in ns,
+ * since the last stats reset.
+ */
+static ssize_t uringblk_latency_show(struct device *dev, char *buf,
+                                     enum uringblk_lat_op op)
+{
+    struct gendisk *disk = dev_to_disk(dev);
+    struct uringblk_device *udev = disk->private_data;
+    struct uringblk_lat_summary lat;
+    int ret;
+    
+    ret = uringblk_lat_summary(udev, NULL, op, &lat);
+    if (ret)
+        return ret;
+    
+    return sysfs_emit(buf, "%llu %llu %llu %llu %llu %llu\n", lat.count,
+                      lat.p50, lat.p90, lat.p99, lat.p999, lat.max);
+}
+
+static ssize_t read_latency_show(struct device *dev, struct device_attribute *attr,
+                                 char *buf)
+{
+    return uringblk_latency_show(dev, buf, URINGBLK_LAT_READ);
+}
+
+static ssize_t write_latency_show(struct device *dev, struct device_attribute *attr,
+                                  char *buf)
+{
+    return uringblk_latency_show(dev, buf, URINGBLK_LAT_WRITE);
+}
+
+static ssize_t flush_latency_show(struct device *dev, struct device_attribute *attr,
+                                  char *buf)
+{
+    return uringblk_latency_show(dev, buf, URINGBLK_LAT_FLUSH);
+}
+
+static ssize_t discard_latency_show(struct device *dev, struct device_attribute *attr,
+                                    char *buf)
+{
+    return uringblk_latency_show(dev, buf, URINGBLK_LAT_DISCARD);
+}
+
+/* One line per hardware queue and operation: "hctx op count p50 p90 p99 p99.9 max" */
+static ssize_t hctx_latency_show(struct device *dev, struct device_attribute *attr,
+                                 char *buf)
+{
+    static const char * const op_names[URINGBLK_LAT_NR] = {
+        "read", "write", "flush", "discard",
+    };
+    struct gendisk *disk = dev_to_disk(dev);
+    struct uringblk_device *udev = disk->private_data;
+    struct uringblk_lat_summary lat;
+    struct blk_mq_hw_ctx *hctx;
+    unsigned long i;
+    int op, ret, len = 0;
     
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    media_errors = udev->stats.media_errors;
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
+    queue_for_each_hw_ctx(disk->queue, hctx, i) {
+        struct uringblk_queue *uq = hctx->driver_data;
+        
+        if (!uq)
+            continue;
+        for (op = 0; op < URINGBLK_LAT_NR; op++) {
+            ret = uringblk_lat_summary(udev, uq, op, &lat);
+            if (ret)
+                return ret;
+            if (!lat.count)
+                continue;
+            len += sysfs_emit_at(buf, len, "%u %s %llu %llu %llu %llu %llu %llu\n",
+                                 uq->queue_num, op_names[op], lat.count, lat.p50,
+                                 lat.p90, lat.p99, lat.p999, lat.max);
+        }
+    }
     
-    return sprintf(buf, "%llu\n", media_errors);
+    return len;
 }
 
 static ssize_t stats_reset_store(struct device *dev, struct device_attribute *attr,
@@ -221,15 +291,12 @@ static ssize_t stats_reset_store(struct device *dev, struct device_attribute *at
 {
     struct gendisk *disk = dev_to_disk(dev);
     struct uringblk_device *udev = disk->private_data;
-    unsigned long flags;
     int val;
     
     if (kstrtoint(buf, 10, &val) || val != 1)
         return -EINVAL;
     
-    spin_lock_irqsave(&udev->stats_lock, flags);
-    memset(&udev->stats, 0, sizeof(udev->stats));
-    spin_unlock_irqrestore(&udev->stats_lock, flags);
+    uringblk_stats_reset(udev);
     
     return count;
 }
@@ -252,6 +319,12 @@ static DEVICE_ATTR_RO(flush_ops);
 static DEVICE_ATTR_RO(discard_ops);
 static DEVICE_ATTR_RO(queue_full_events);
 static DEVICE_ATTR_RO(media_errors);
+static DEVICE_ATTR_RO(hctx_stats);
+static DEVICE_ATTR_RO(read_latency);
+static DEVICE_ATTR_RO(write_latency);
+static DEVICE_ATTR_RO(flush_latency);
+static DEVICE_ATTR_RO(discard_latency);
+static DEVICE_ATTR_RO(hctx_latency);
 static DEVICE_ATTR_WO(stats_reset);
 
 /* Array of device attributes */
@@ -273,6 +346,12 @@ static struct attribute *uringblk_attrs[] = {
     &dev_attr_discard_ops.attr,
     &dev_attr_queue_full_events.attr,
     &dev_attr_media_errors.attr,
+    &dev_attr_hctx_stats.attr,
+    &dev_attr_read_latency.attr,
+    &dev_attr_write_latency.attr,
+    &dev_attr_flush_latency.attr,
+    &dev_attr_discard_latency.attr,
+    &dev_attr_hctx_latency.attr,
     &dev_attr_stats_reset.attr,
     NULL,
 };
@@ -26,7 +26,7 @@
 
 /* Userspace definitions from uringblk_driver.h */
 #define URINGBLK_ABI_MAJOR  1
-#define URINGBLK_ABI_MINOR  0
+#define URINGBLK_ABI_MINOR  5
 
 enum uringblk_ucmd {
     URINGBLK_UCMD_IDENTIFY      = 0x01,
@@ -37,8 +37,35 @@ enum uringblk_ucmd {
     URINGBLK_UCMD_GET_STATS     = 0x06,
     URINGBLK_UCMD_ZONE_MGMT     = 0x10,
     URINGBLK_UCMD_FIRMWARE_OP   = 0x20,
+    URINGBLK_UCMD_READ          = 0x40,
+    URINGBLK_UCMD_WRITE         = 0x41,
+    URINGBLK_UCMD_WRITE_ZEROES  = 0x42,
+    URINGBLK_UCMD_FLUSH         = 0x43,
+    URINGBLK_UCMD_READV         = 0x44,
+    URINGBLK_UCMD_WRITEV        = 0x45,
 };
 
+struct uringblk_io_cmd {
+    uint16_t opcode;
+    uint16_t flags;
+    uint32_t rsvd;
+    uint64_t sector;
+} __attribute__((packed));
+
+struct uringblk_ctl_dev {
+    uint32_t minor;
+    uint32_t backend_type;
+    uint32_t nr_hw_queues;
+    uint32_t queue_depth;
+    uint64_t capacity;
+    char     backend_path[256];
+} __attribute__((packed));
+
+#define URINGBLK_CTL_ADD_DEV    _IOWR('U', 0x80, struct uringblk_ctl_dev)
+#define URINGBLK_CTL_DEL_DEV    _IOW('U', 0x81, struct uringblk_ctl_dev)
+#define URINGBLK_CTL_RESIZE_DEV _IOW('U', 0x82, struct uringblk_ctl_dev)
+#define URINGBLK_CONTROL        "/dev/uringblk-control"
+
 struct uringblk_ucmd_hdr {
     uint16_t abi_major;
     uint16_t abi_minor;
@@ -82,6 +109,43 @@ struct uringblk_stats {
     uint32_t p99_read_latency_us;
     uint32_t p50_write_latency_us;
     uint32_t p99_write_latency_us;
+    /* ABI 1.1 */
+    uint32_t p90_read_latency_us;
+    uint32_t p999_read_latency_us;
+    uint32_t max_read_latency_us;
+    uint32_t p90_write_latency_us;
+    uint32_t p999_write_latency_us;
+    uint32_t max_write_latency_us;
+    /* ABI 1.4 */
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_promotions;
+} __attribute__((packed));
+
+enum uringblk_zone_action {
+    URINGBLK_ZONE_REPORT        = 0,
+    URINGBLK_ZONE_RESET         = 1,
+    URINGBLK_ZONE_OPEN          = 2,
+    URINGBLK_ZONE_CLOSE         = 3,
+    URINGBLK_ZONE_FINISH        = 4,
+    URINGBLK_ZONE_RESET_ALL     = 5,
+};
+
+struct uringblk_zone_mgmt {
+    uint8_t  action;
+    uint8_t  rsvd[3];
+    uint32_t nr_zones;
+    uint64_t sector;
+} __attribute__((packed));
+
+struct uringblk_zone_desc {
+    uint64_t start;
+    uint64_t len;
+    uint64_t capacity;
+    uint64_t wp;
+    uint8_t  type;
+    uint8_t  cond;
+    uint8_t  rsvd[6];
 } __attribute__((packed));
 
 /* Fallback for io_uring_prep_cmd if not available */
@@ -106,6 +170,7 @@ static inline void io_uring_prep_cmd(struct io_uring_sqe *sqe, int fd,
 
 struct test_config {
     const char *device;
+    const char *lower;
     int queue_depth;
     int io_count;
     bool use_poll;
@@ -116,6 +181,7 @@ struct test_config {
 
 static struct test_config config = {
     .device = DEFAULT_DEVICE,
+    .lower = NULL,
     .queue_depth = TEST_QUEUE_DEPTH,
     .io_count = TEST_IO_COUNT,
     .use_poll = false,
@@ -304,11 +370,357 @@ static int test_uring_cmd_get_stats(int admin_fd, struct io_uring *ring)
     printf("  Write bytes: %" PRIu64 "\n", stats.write_bytes);
     printf("  Queue full events: %" PRIu64 "\n", stats.queue_full_events);
     printf("  Media errors: %" PRIu64 "\n", stats.media_errors);
+    printf("  Read latency (us): p50=%u p90=%u p99=%u p99.9=%u max=%u\n",
+           stats.p50_read_latency_us, stats.p90_read_latency_us,
+           stats.p99_read_latency_us, stats.p999_read_latency_us,
+           stats.max_read_latency_us);
+    printf("  Write latency (us): p50=%u p90=%u p99=%u p99.9=%u max=%u\n",
+           stats.p50_write_latency_us, stats.p90_write_latency_us,
+           stats.p99_write_latency_us, stats.p999_write_latency_us,
+           stats.max_write_latency_us);
+    if (stats.cache_hits || stats.cache_misses)
+        printf("  Read cache: hits=%" PRIu64 " misses=%" PRIu64 " promotions=%" PRIu64 "\n",
+               stats.cache_hits, stats.cache_misses, stats.cache_promotions);
+
+    io_uring_cqe_seen(ring, cqe);
+    return 0;
+}
+
+#define TEST_REPORT_ZONES 8
+
+static int test_uring_cmd_zone_report(int admin_fd, struct io_uring *ring)
+{
+    struct {
+        struct uringblk_zone_mgmt req;
+        struct uringblk_zone_desc zones[TEST_REPORT_ZONES];
+    } __attribute__((packed)) report;
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    struct uringblk_uring_cmd ucmd;
+    int ret, i;
+
+    printf("Testing URING_CMD ZONE_MGMT report...\n");
+
+    memset(&report, 0, sizeof(report));
+    report.req.action = URINGBLK_ZONE_REPORT;
+    report.req.nr_zones = TEST_REPORT_ZONES;
+    report.req.sector = 0;
+
+    ucmd.opcode = URINGBLK_UCMD_ZONE_MGMT;
+    ucmd.flags = 0;
+    ucmd.len = sizeof(report);
+    ucmd.addr = (uint64_t)&report;
+
+    sqe = io_uring_get_sqe(ring);
+    if (!sqe) {
+        fprintf(stderr, "Failed to get SQE\n");
+        return -1;
+    }
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = admin_fd;
+    memcpy(sqe->cmd, &ucmd, sizeof(ucmd));
+
+    ret = io_uring_submit(ring);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_submit failed: %s\n", strerror(-ret));
+        return ret;
+    }
+
+    ret = io_uring_wait_cqe(ring, &cqe);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring_wait_cqe failed: %s\n", strerror(-ret));
+        return ret;
+    }
 
+    ret = cqe->res;
     io_uring_cqe_seen(ring, cqe);
+
+    if (ret == -EOPNOTSUPP) {
+        printf("  Device is not zoned, skipped\n");
+        return 0;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "URING_CMD ZONE_MGMT failed: %s\n", strerror(-ret));
+        return ret;
+    }
+
+    printf("Zones (first %d):\n", ret);
+    for (i = 0; i < ret; i++)
+        printf("  start=%" PRIu64 " len=%" PRIu64 " wp=%" PRIu64 " type=%u cond=%u\n",
+               report.zones[i].start, report.zones[i].len, report.zones[i].wp,
+               report.zones[i].type, report.zones[i].cond);
     return 0;
 }
 
+/* One data URING_CMD on a plain buffer, returns the CQE result */
+static int uring_cmd_io(int admin_fd, struct io_uring *ring, uint16_t opcode,
+                        uint64_t sector, void *buf, uint32_t len)
+{
+    struct uringblk_io_cmd io = {
+        .opcode = opcode,
+        .sector = sector,
+    };
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    int ret;
+
+    sqe = io_uring_get_sqe(ring);
+    if (!sqe) {
+        fprintf(stderr, "Failed to get SQE\n");
+        return -1;
+    }
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = admin_fd;
+    sqe->addr = (uint64_t)buf;
+    sqe->len = len;
+    memcpy(sqe->cmd, &io, sizeof(io));
+
+    ret = io_uring_submit(ring);
+    if (ret < 0)
+        return ret;
+
+    ret = io_uring_wait_cqe(ring, &cqe);
+    if (ret < 0)
+        return ret;
+
+    ret = cqe->res;
+    io_uring_cqe_seen(ring, cqe);
+    return ret;
+}
+
+static int test_uring_cmd_passthru(int admin_fd, struct io_uring *ring)
+{
+    char *write_buf, *read_buf;
+    int ret;
+
+    printf("Testing URING_CMD data commands...\n");
+
+    write_buf = aligned_alloc(TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+    read_buf = aligned_alloc(TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+    if (!write_buf || !read_buf) {
+        perror("aligned_alloc");
+        ret = -ENOMEM;
+        goto cleanup;
+    }
+
+    memset(write_buf, 0x5a, TEST_BLOCK_SIZE);
+    memset(read_buf, 0, TEST_BLOCK_SIZE);
+
+    ret = uring_cmd_io(admin_fd, ring, URINGBLK_UCMD_WRITE, 8, write_buf, TEST_BLOCK_SIZE);
+    if (ret == -EOPNOTSUPP) {
+        printf("  Data commands not supported, skipped\n");
+        ret = 0;
+        goto cleanup;
+    }
+    if (ret != TEST_BLOCK_SIZE) {
+        fprintf(stderr, "URING_CMD WRITE failed: %d\n", ret);
+        ret = ret < 0 ? ret : -EIO;
+        goto cleanup;
+    }
+
+    ret = uring_cmd_io(admin_fd, ring, URINGBLK_UCMD_READ, 8, read_buf, TEST_BLOCK_SIZE);
+    if (ret != TEST_BLOCK_SIZE) {
+        fprintf(stderr, "URING_CMD READ failed: %d\n", ret);
+        ret = ret < 0 ? ret : -EIO;
+        goto cleanup;
+    }
+
+    if (memcmp(write_buf, read_buf, TEST_BLOCK_SIZE) != 0) {
+        fprintf(stderr, "URING_CMD data verification failed\n");
+        ret = -EIO;
+        goto cleanup;
+    }
+
+    ret = uring_cmd_io(admin_fd, ring, URINGBLK_UCMD_FLUSH, 0, NULL, 0);
+    if (ret < 0) {
+        fprintf(stderr, "URING_CMD FLUSH failed: %s\n", strerror(-ret));
+        goto cleanup;
+    }
+
+    printf("Data commands passed\n");
+    ret = 0;
+
+cleanup:
+    free(write_buf);
+    free(read_buf);
+    return ret;
+}
+
+/* Add a small virtual device, grow it and remove it again */
+static int test_control(void)
+{
+    struct uringblk_ctl_dev info;
+    int ctl_fd, ret;
+
+    printf("Testing runtime add/resize/remove...\n");
+
+    ctl_fd = open(URINGBLK_CONTROL, O_RDWR);
+    if (ctl_fd < 0) {
+        printf("  %s not available, skipped\n", URINGBLK_CONTROL);
+        return 0;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.backend_type = 0;
+    info.nr_hw_queues = 1;
+    info.queue_depth = 64;
+    info.capacity = 64ULL << 20;
+    if (ioctl(ctl_fd, URINGBLK_CTL_ADD_DEV, &info) < 0) {
+        ret = -errno;
+        fprintf(stderr, "ADD_DEV failed: %s\n", strerror(errno));
+        goto out;
+    }
+    printf("  Added /dev/uringblk%u (64 MB)\n", info.minor);
+
+    info.capacity = 128ULL << 20;
+    if (ioctl(ctl_fd, URINGBLK_CTL_RESIZE_DEV, &info) < 0) {
+        ret = -errno;
+        fprintf(stderr, "RESIZE_DEV failed: %s\n", strerror(errno));
+        ioctl(ctl_fd, URINGBLK_CTL_DEL_DEV, &info);
+        goto out;
+    }
+    printf("  Grown to 128 MB\n");
+
+    if (ioctl(ctl_fd, URINGBLK_CTL_DEL_DEV, &info) < 0) {
+        ret = -errno;
+        fprintf(stderr, "DEL_DEV failed: %s\n", strerror(errno));
+        goto out;
+    }
+    printf("Control commands passed\n");
+    ret = 0;
+
+out:
+    close(ctl_fd);
+    return ret;
+}
+
+/* Submit @nr requests of @write in a single io_uring_submit() and reap them */
+static int batch_rw(struct io_uring *ring, int fd, char *buf, int nr, bool write)
+{
+    struct io_uring_cqe *cqe;
+    int i, ret = 0;
+
+    for (i = 0; i < nr; i++) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+        char *p = buf + (size_t)i * TEST_BLOCK_SIZE;
+        off_t off = (off_t)i * 2 * TEST_BLOCK_SIZE;
+
+        if (!sqe)
+            return -EBUSY;
+        if (write)
+            io_uring_prep_write(sqe, fd, p, TEST_BLOCK_SIZE, off);
+        else
+            io_uring_prep_read(sqe, fd, p, TEST_BLOCK_SIZE, off);
+    }
+
+    ret = io_uring_submit(ring);
+    if (ret != nr)
+        return ret < 0 ? ret : -EIO;
+
+    ret = 0;
+    for (i = 0; i < nr; i++) {
+        if (io_uring_wait_cqe(ring, &cqe) < 0)
+            return -EIO;
+        if (cqe->res != TEST_BLOCK_SIZE && !ret)
+            ret = cqe->res < 0 ? cqe->res : -EIO;
+        io_uring_cqe_seen(ring, cqe);
+    }
+    return ret;
+}
+
+/*
+ * A uringblk device stacked on a blk-mq device. A multi-request
+ * io_uring submission is plugged and reaches ->queue_rqs, whose lower
+ * bios must end up on the lower device rather than on the list being
+ * walked. The requests skip every other block so none of them merge.
+ */
+static int test_stacked_batch(struct io_uring *ring)
+{
+    struct uringblk_ctl_dev info;
+    char path[64], *wbuf, *rbuf;
+    int ctl_fd, fd = -1, nr, i, ret;
+    size_t len;
+
+    printf("Testing batched I/O stacked on %s...\n", config.lower);
+
+    ctl_fd = open(URINGBLK_CONTROL, O_RDWR);
+    if (ctl_fd < 0) {
+        printf("  %s not available, skipped\n", URINGBLK_CONTROL);
+        return 0;
+    }
+
+    nr = config.queue_depth;
+    len = (size_t)nr * TEST_BLOCK_SIZE;
+    wbuf = aligned_alloc(TEST_BLOCK_SIZE, len);
+    rbuf = aligned_alloc(TEST_BLOCK_SIZE, len);
+    if (!wbuf || !rbuf) {
+        perror("aligned_alloc");
+        ret = -ENOMEM;
+        goto out_free;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.backend_type = 1;
+    info.nr_hw_queues = 2;
+    info.queue_depth = 64;
+    snprintf(info.backend_path, sizeof(info.backend_path), "%s", config.lower);
+    if (ioctl(ctl_fd, URINGBLK_CTL_ADD_DEV, &info) < 0) {
+        ret = -errno;
+        fprintf(stderr, "ADD_DEV on %s failed: %s\n", config.lower, strerror(errno));
+        goto out_free;
+    }
+
+    snprintf(path, sizeof(path), "/dev/uringblk%u", info.minor);
+    fd = open(path, O_RDWR | O_DIRECT);
+    if (fd < 0) {
+        ret = -errno;
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        goto out_del;
+    }
+
+    for (i = 0; i < nr; i++)
+        memset(wbuf + (size_t)i * TEST_BLOCK_SIZE, 0x10 + i, TEST_BLOCK_SIZE);
+    memset(rbuf, 0, len);
+
+    ret = batch_rw(ring, fd, wbuf, nr, true);
+    if (ret) {
+        fprintf(stderr, "Batched write failed: %s\n", strerror(-ret));
+        goto out_close;
+    }
+    ret = batch_rw(ring, fd, rbuf, nr, false);
+    if (ret) {
+        fprintf(stderr, "Batched read failed: %s\n", strerror(-ret));
+        goto out_close;
+    }
+
+    for (i = 0; i < nr; i++) {
+        if (memcmp(wbuf + (size_t)i * TEST_BLOCK_SIZE,
+                   rbuf + (size_t)i * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE)) {
+            fprintf(stderr, "Data mismatch in block %d of the batch\n", i);
+            ret = -EIO;
+            goto out_close;
+        }
+    }
+    printf("  %d writes and %d reads in one submission each passed\n", nr, nr);
+
+out_close:
+    close(fd);
+out_del:
+    if (ioctl(ctl_fd, URINGBLK_CTL_DEL_DEV, &info) < 0 && !ret) {
+        ret = -errno;
+        fprintf(stderr, "DEL_DEV failed: %s\n", strerror(errno));
+    }
+out_free:
+    free(wbuf);
+    free(rbuf);
+    close(ctl_fd);
+    return ret;
+}
+
 /* I/O test functions */
 static int test_basic_io(int fd, struct io_uring *ring)
 {
@@ -494,6 +906,8 @@ static void print_usage(const char *progname)
     printf("  -d, --device DEVICE    Device path (default: %s)\n", DEFAULT_DEVICE);
     printf("  -q, --queue-depth N    Queue depth (default: %d)\n", TEST_QUEUE_DEPTH);
     printf("  -c, --count N          Number of I/O operations (default: %d)\n", TEST_IO_COUNT);
+    printf("  -l, --lower DEVICE     Stack a new device on blk-mq DEVICE and test batched I/O\n");
+    printf("                         (overwrites DEVICE, e.g. /dev/nullb0 with memory_backed=1)\n");
     printf("  -p, --poll             Use polling mode\n");
     printf("  -f, --fixed-buffers    Use fixed buffers\n");
     printf("  -a, --admin            Test admin commands\n");
@@ -513,6 +927,7 @@ int main(int argc, char *argv[])
         {"device", required_argument, 0, 'd'},
         {"queue-depth", required_argument, 0, 'q'},
         {"count", required_argument, 0, 'c'},
+        {"lower", required_argument, 0, 'l'},
         {"poll", no_argument, 0, 'p'},
         {"fixed-buffers", no_argument, 0, 'f'},
         {"admin", no_argument, 0, 'a'},
@@ -522,7 +937,7 @@ int main(int argc, char *argv[])
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "d:q:c:pfavh", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:q:c:l:pfavh", long_options, NULL)) != -1) {
         switch (opt) {
         case 'd':
             config.device = optarg;
@@ -541,6 +956,9 @@ int main(int argc, char *argv[])
                 exit(1);
             }
             break;
+        case 'l':
+            config.lower = optarg;
+            break;
         case 'p':
             config.use_poll = true;
             break;
@@ -646,6 +1064,37 @@ int main(int argc, char *argv[])
             goto cleanup_ring;
         }
         printf("\n");
+
+        ret = test_uring_cmd_zone_report(admin_fd, &ring);
+        if (ret) {
+            fprintf(stderr, "ZONE_MGMT test failed\n");
+            goto cleanup_ring;
+        }
+        printf("\n");
+
+        ret = test_uring_cmd_passthru(admin_fd, &ring);
+        if (ret) {
+            fprintf(stderr, "Data command test failed\n");
+            goto cleanup_ring;
+        }
+        printf("\n");
+
+        ret = test_control();
+        if (ret) {
+            fprintf(stderr, "Control device test failed\n");
+            goto cleanup_ring;
+        }
+        printf("\n");
+    }
+
+    if (config.lower) {
+        printf("=== Stacked Batch Test ===\n");
+        ret = test_stacked_batch(&ring);
+        if (ret) {
+            fprintf(stderr, "Stacked batch test failed\n");
+            goto cleanup_ring;
+        }
+        printf("\n");
     }
 
     printf("=== Performance Test ===\n");
@@ -0,0 +1,458 @@
+/*
+ * uringblk_wbcache.c - Write-back RAM cache in front of the backend
+ *
+ * With wb_cache_mb set, writes are copied into page sized cache blocks
+ * and complete at once. The blocks are written back to the backend in
+ * LBA order, with runs of adjacent blocks merged into one backend write
+ * of up to WBC_BATCH_PAGES pages:
+ *
+ *  - on REQ_OP_FLUSH and on FUA writes, before the request completes,
+ *  - in the background every WBC_WRITEBACK_MS or once half the cache
+ *    is dirty,
+ *  - synchronously by the writer that finds the cache full, which is
+ *    the backpressure on a workload outrunning the backend.
+ *
+ * Written back blocks leave the cache, so every block in it is dirty.
+ * Writebacks and invalidations are serialized by flush_mutex; the block
+ * index and the block data are protected by the xarray lock. A block
+ * rewritten while its copy is on the way to the backend keeps its new
+ * generation and stays for the next writeback.
+ *
+ * Reads that touch no cached block go down the normal path. The others
+ * read the backend synchronously and overlay the cached blocks; evict
+ * lets them detect a block that left the cache in between.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/xarray.h>
+
+#include "uringblk_driver.h"
+
+#define WBC_BATCH_PAGES     256     /* Largest merged backend write */
+#define WBC_WRITEBACK_MS    1000
+
+static unsigned int wb_cache_mb;
+module_param(wb_cache_mb, uint, 0444);
+MODULE_PARM_DESC(wb_cache_mb, "Write-back RAM cache per device in MB, 0 to write through (default: 0)");
+
+struct wbc_block {
+    struct page *page;
+    u64 gen;                       /* Bumped by every write to the block */
+};
+
+struct uringblk_wbcache {
+    struct xarray blocks;          /* Page index -> struct wbc_block */
+    seqcount_spinlock_t evict;     /* Bumped when blocks leave the cache */
+    atomic_t nr_blocks;
+    unsigned int max_blocks;
+    struct mutex flush_mutex;      /* Serializes writeback and invalidation */
+    struct delayed_work work;
+    void *buf;                     /* Merged run being written back */
+    u64 gens[WBC_BATCH_PAGES];     /* Generations copied into buf */
+    struct uringblk_backend *backend;
+};
+
+bool uringblk_wbcache_enabled(void)
+{
+    return wb_cache_mb;
+}
+
+static void wbc_free_block(struct wbc_block *b)
+{
+    __free_page(b->page);
+    kfree(b);
+}
+
+/*
+ * Copy the run into buf block by block, each under the xarray lock so
+ * it cannot be torn by a concurrent write.
+ */
+static void wbc_copy_run(struct uringblk_wbcache *wb, pgoff_t start, unsigned int n)
+{
+    struct wbc_block *b;
+    unsigned int i;
+
+    xa_lock(&wb->blocks);
+    for (i = 0; i < n; i++) {
+        b = xa_load(&wb->blocks, start + i);
+        memcpy(wb->buf + ((size_t)i << PAGE_SHIFT), page_address(b->page), PAGE_SIZE);
+        wb->gens[i] = b->gen;
+    }
+    xa_unlock(&wb->blocks);
+}
+
+/* Drop the blocks of a written run that were not rewritten meanwhile */
+static void wbc_retire_run(struct uringblk_wbcache *wb, pgoff_t start, unsigned int n)
+{
+    struct wbc_block *b, *freed[16];
+    unsigned int i, nr_freed;
+
+    while (n) {
+        nr_freed = 0;
+        xa_lock(&wb->blocks);
+        write_seqcount_begin(&wb->evict);
+        for (i = 0; i < n && nr_freed < ARRAY_SIZE(freed); i++) {
+            b = xa_load(&wb->blocks, start + i);
+            if (b->gen != wb->gens[i])
+                continue;
+            __xa_erase(&wb->blocks, start + i);
+            freed[nr_freed++] = b;
+        }
+        write_seqcount_end(&wb->evict);
+        xa_unlock(&wb->blocks);
+
+        atomic_sub(nr_freed, &wb->nr_blocks);
+        while (nr_freed)
+            wbc_free_block(freed[--nr_freed]);
+
+        memmove(wb->gens, wb->gens + i, (n - i) * sizeof(wb->gens[0]));
+        start += i;
+        n -= i;
+    }
+}
+
+/* Write every cached block back, called with flush_mutex held */
+static int wbc_writeback_locked(struct uringblk_wbcache *wb)
+{
+    struct wbc_block *b;
+    unsigned long idx = 0;
+    int ret;
+
+    lockdep_assert_held(&wb->flush_mutex);
+
+    /* Nothing but flush_mutex holders removes blocks, so the walk is stable */
+    while ((b = xa_find(&wb->blocks, &idx, ULONG_MAX, XA_PRESENT))) {
+        pgoff_t start = idx;
+        unsigned int n = 1;
+
+        while (n < WBC_BATCH_PAGES && xa_load(&wb->blocks, start + n))
+            n++;
+
+        wbc_copy_run(wb, start, n);
+        ret = wb->backend->ops->write(wb->backend, (loff_t)start << PAGE_SHIFT,
+                                      wb->buf, (size_t)n << PAGE_SHIFT);
+        if (ret) {
+            pr_err_ratelimited("uringblk: cache writeback at %lld failed: %d\n",
+                               (loff_t)start << PAGE_SHIFT, ret);
+            return ret;
+        }
+        wbc_retire_run(wb, start, n);
+        idx = start + n;
+    }
+    return 0;
+}
+
+static int wbc_writeback(struct uringblk_wbcache *wb)
+{
+    int ret;
+
+    mutex_lock(&wb->flush_mutex);
+    ret = wbc_writeback_locked(wb);
+    mutex_unlock(&wb->flush_mutex);
+    return ret;
+}
+
+static void wbc_writeback_work(struct work_struct *work)
+{
+    struct uringblk_wbcache *wb = container_of(to_delayed_work(work),
+                                               struct uringblk_wbcache, work);
+
+    /* A failed block stays dirty and is retried on the next round */
+    wbc_writeback(wb);
+    if (atomic_read(&wb->nr_blocks))
+        queue_delayed_work(system_unbound_wq, &wb->work,
+                           msecs_to_jiffies(WBC_WRITEBACK_MS));
+}
+
+/**
+ * uringblk_wbcache_init - Set up the write-back cache of a device
+ * @dev: Device whose backend is initialized
+ */
+int uringblk_wbcache_init(struct uringblk_device *dev)
+{
+    struct uringblk_wbcache *wb;
+
+    if (dev->config.zoned_mode) {
+        pr_err("uringblk: the write-back cache cannot be used in zoned mode\n");
+        return -EINVAL;
+    }
+    if (!IS_ALIGNED(dev->backend.capacity, PAGE_SIZE)) {
+        pr_err("uringblk: the write-back cache needs a page aligned capacity\n");
+        return -EINVAL;
+    }
+
+    wb = kzalloc(sizeof(*wb), GFP_KERNEL);
+    if (!wb)
+        return -ENOMEM;
+
+    wb->buf = vmalloc(WBC_BATCH_PAGES << PAGE_SHIFT);
+    if (!wb->buf) {
+        kfree(wb);
+        return -ENOMEM;
+    }
+
+    xa_init(&wb->blocks);
+    seqcount_spinlock_init(&wb->evict, &wb->blocks.xa_lock);
+    atomic_set(&wb->nr_blocks, 0);
+    wb->max_blocks = max_t(unsigned int, ((size_t)wb_cache_mb << 20) >> PAGE_SHIFT,
+                           WBC_BATCH_PAGES);
+    mutex_init(&wb->flush_mutex);
+    INIT_DELAYED_WORK(&wb->work, wbc_writeback_work);
+    wb->backend = &dev->backend;
+
+    dev->wbcache = wb;
+    dev->config.write_cache = true;
+    dev->features |= URINGBLK_FEAT_WRITE_CACHE | URINGBLK_FEAT_FUA;
+
+    pr_info("uringblk: %u MB write-back cache\n", wb_cache_mb);
+    return 0;
+}
+
+/**
+ * uringblk_wbcache_exit - Write the cache back and free it
+ * @dev: Device with no I/O left
+ */
+void uringblk_wbcache_exit(struct uringblk_device *dev)
+{
+    struct uringblk_wbcache *wb = dev->wbcache;
+    struct wbc_block *b;
+    unsigned long idx;
+
+    if (!wb)
+        return;
+
+    cancel_delayed_work_sync(&wb->work);
+    if (wbc_writeback(wb) || wb->backend->ops->flush(wb->backend))
+        pr_err("uringblk: data left in the write-back cache is lost\n");
+
+    xa_for_each(&wb->blocks, idx, b)
+        wbc_free_block(b);
+    xa_destroy(&wb->blocks);
+    vfree(wb->buf);
+    kfree(wb);
+    dev->wbcache = NULL;
+}
+
+/* Allocate a block for the page at @idx, filled from the backend unless @full */
+static struct wbc_block *wbc_alloc_block(struct uringblk_wbcache *wb, pgoff_t idx, bool full)
+{
+    struct wbc_block *b;
+
+    b = kmalloc(sizeof(*b), GFP_NOIO);
+    if (!b)
+        return NULL;
+    b->page = alloc_page(GFP_NOIO);
+    if (!b->page) {
+        kfree(b);
+        return NULL;
+    }
+    b->gen = 0;
+
+    if (!full && wb->backend->ops->read(wb->backend, (loff_t)idx << PAGE_SHIFT,
+                                        page_address(b->page), PAGE_SIZE)) {
+        wbc_free_block(b);
+        return NULL;
+    }
+    return b;
+}
+
+static int wbc_write(struct uringblk_wbcache *wb, loff_t pos, const void *buf, size_t len)
+{
+    while (len) {
+        size_t off = offset_in_page(pos);
+        size_t n = min_t(size_t, len, PAGE_SIZE - off);
+        pgoff_t idx = pos >> PAGE_SHIFT;
+        struct wbc_block *b;
+        int ret;
+
+        xa_lock(&wb->blocks);
+        b = xa_load(&wb->blocks, idx);
+        if (b) {
+            memcpy(page_address(b->page) + off, buf, n);
+            b->gen++;
+            xa_unlock(&wb->blocks);
+            buf += n;
+            pos += n;
+            len -= n;
+            continue;
+        }
+        xa_unlock(&wb->blocks);
+
+        /* Backpressure: a full cache is written back by the writer */
+        if (atomic_read(&wb->nr_blocks) >= wb->max_blocks) {
+            ret = wbc_writeback(wb);
+            if (ret)
+                return ret;
+        } else if (atomic_read(&wb->nr_blocks) >= wb->max_blocks / 2) {
+            mod_delayed_work(system_unbound_wq, &wb->work, 0);
+        }
+
+        b = wbc_alloc_block(wb, idx, n == PAGE_SIZE);
+        if (!b)
+            return -ENOMEM;
+
+        /* A racing writer may have cached the block, copy on the next pass */
+        xa_lock(&wb->blocks);
+        ret = __xa_insert(&wb->blocks, idx, b, GFP_NOIO);
+        xa_unlock(&wb->blocks);
+        if (ret) {
+            wbc_free_block(b);
+            if (ret != -EBUSY)
+                return ret;
+            continue;
+        }
+        if (atomic_inc_return(&wb->nr_blocks) == 1)
+            queue_delayed_work(system_unbound_wq, &wb->work,
+                               msecs_to_jiffies(WBC_WRITEBACK_MS));
+    }
+    return 0;
+}
+
+/* Copy the cached parts of a range over data read from the backend */
+static void wbc_overlay(struct uringblk_wbcache *wb, loff_t pos, void *buf, size_t len)
+{
+    struct wbc_block *b;
+
+    xa_lock(&wb->blocks);
+    while (len) {
+        size_t off = offset_in_page(pos);
+        size_t n = min_t(size_t, len, PAGE_SIZE - off);
+
+        b = xa_load(&wb->blocks, pos >> PAGE_SHIFT);
+        if (b)
+            memcpy(buf, page_address(b->page) + off, n);
+        buf += n;
+        pos += n;
+        len -= n;
+    }
+    xa_unlock(&wb->blocks);
+}
+
+static bool wbc_cached(struct uringblk_wbcache *wb, loff_t pos, size_t len)
+{
+    unsigned long idx = pos >> PAGE_SHIFT;
+
+    return xa_find(&wb->blocks, &idx, (pos + len - 1) >> PAGE_SHIFT, XA_PRESENT);
+}
+
+static int wbc_read(struct uringblk_wbcache *wb, loff_t pos, void *buf, size_t len)
+{
+    unsigned int seq;
+    int ret;
+
+    do {
+        seq = read_seqcount_begin(&wb->evict);
+        ret = wb->backend->ops->read(wb->backend, pos, buf, len);
+        if (ret)
+            return ret;
+        wbc_overlay(wb, pos, buf, len);
+    } while (read_seqcount_retry(&wb->evict, seq));
+    return 0;
+}
+
+/*
+ * Discard and write zeroes: blocks entirely inside the range are dropped,
+ * partially covered ones are zeroed in place so their other data stays.
+ */
+static void wbc_invalidate(struct uringblk_wbcache *wb, loff_t pos, size_t len)
+{
+    loff_t end = pos + len;
+    struct wbc_block *b;
+    unsigned long idx;
+
+    mutex_lock(&wb->flush_mutex);
+    xa_lock(&wb->blocks);
+    write_seqcount_begin(&wb->evict);
+    xa_for_each_range(&wb->blocks, idx, b, pos >> PAGE_SHIFT, (end - 1) >> PAGE_SHIFT) {
+        loff_t bstart = (loff_t)idx << PAGE_SHIFT;
+        loff_t from = max(pos, bstart), to = min(end, bstart + (loff_t)PAGE_SIZE);
+
+        if (to - from < PAGE_SIZE) {
+            memset(page_address(b->page) + (from - bstart), 0, to - from);
+            b->gen++;
+            continue;
+        }
+        __xa_erase(&wb->blocks, idx);
+        atomic_dec(&wb->nr_blocks);
+        /* Freeing a page does not sleep, doing it under the lock is fine */
+        wbc_free_block(b);
+    }
+    write_seqcount_end(&wb->evict);
+    xa_unlock(&wb->blocks);
+    mutex_unlock(&wb->flush_mutex);
+}
+
+/**
+ * uringblk_wbcache_queue_rq - Run a request through the write-back cache
+ * @dev: uringblk device
+ * @rq: Started request inside the device
+ * @status: Set to what ->queue_rq should return when the request is taken
+ *
+ * Returns true if the request was completed here, or left for blk-mq to
+ * retry with *@status BLK_STS_RESOURCE when a cache block could not be
+ * allocated. Writing the blocks cached so far again is harmless. Returns
+ * false if the request should continue down the normal path.
+ */
+bool uringblk_wbcache_queue_rq(struct uringblk_device *dev, struct request *rq,
+                               blk_status_t *status)
+{
+    struct uringblk_wbcache *wb = dev->wbcache;
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    struct req_iterator iter;
+    struct bio_vec bvec;
+    int ret = 0;
+
+    switch (req_op(rq)) {
+    case REQ_OP_WRITE:
+        rq_for_each_segment(bvec, rq, iter) {
+            ret = wbc_write(wb, pos, page_address(bvec.bv_page) + bvec.bv_offset,
+                            bvec.bv_len);
+            if (ret)
+                break;
+            pos += bvec.bv_len;
+        }
+        /* FUA: the write and everything before it must be stable */
+        if (!ret && (rq->cmd_flags & REQ_FUA)) {
+            ret = wbc_writeback(wb);
+            if (!ret)
+                ret = dev->backend.ops->flush(&dev->backend);
+        }
+        break;
+    case REQ_OP_READ:
+        if (!wbc_cached(wb, pos, blk_rq_bytes(rq)))
+            return false;
+        rq_for_each_segment(bvec, rq, iter) {
+            ret = wbc_read(wb, pos, page_address(bvec.bv_page) + bvec.bv_offset,
+                           bvec.bv_len);
+            if (ret)
+                break;
+            pos += bvec.bv_len;
+        }
+        break;
+    case REQ_OP_FLUSH:
+        /* The backend flush itself follows on the normal path */
+        if (!wbc_writeback(wb))
+            return false;
+        ret = -EIO;
+        break;
+    case REQ_OP_DISCARD:
+    case REQ_OP_WRITE_ZEROES:
+        wbc_invalidate(wb, pos, blk_rq_bytes(rq));
+        return false;
+    default:
+        return false;
+    }
+
+    *status = BLK_STS_OK;
+    if (ret == -ENOMEM)
+        *status = BLK_STS_RESOURCE;
+    else
+        uringblk_complete_rq(rq, ret ? BLK_STS_IOERR : BLK_STS_OK);
+    return true;
+}
@@ -0,0 +1,471 @@
+/*
+ * uringblk_zoned.c - Host-managed zoned block device emulation
+ *
+ * With zoned=1 the device is split into zone_size_mb zones, the first
+ * zone_nr_conv of them conventional and the rest sequential write
+ * required. Write pointers and zone conditions live in memory only,
+ * the data goes to whatever backend the device uses. Zone append is
+ * turned into a write at the write pointer and reports where it landed
+ * through rq->__sector.
+ *
+ * All zone state is serialized by one spinlock. Every operation under
+ * it is O(1) except RESET_ALL and looking for an implicitly open zone
+ * to close, which is good enough for an emulator.
+ */
+
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+
+#include "uringblk_driver.h"
+
+static bool zoned;
+module_param(zoned, bool, 0444);
+MODULE_PARM_DESC(zoned, "Expose a host-managed zoned device (default: false)");
+
+static unsigned int zone_size_mb = 64;
+module_param(zone_size_mb, uint, 0444);
+MODULE_PARM_DESC(zone_size_mb, "Zone size in MB, a power of two (default: 64)");
+
+static unsigned int zone_nr_conv;
+module_param(zone_nr_conv, uint, 0444);
+MODULE_PARM_DESC(zone_nr_conv, "Number of conventional zones at the start of the device (default: 0)");
+
+static unsigned int zone_max_open;
+module_param(zone_max_open, uint, 0444);
+MODULE_PARM_DESC(zone_max_open, "Maximum number of open zones, 0 for no limit (default: 0)");
+
+struct uringblk_zone {
+    sector_t start;
+    sector_t wp;
+    enum blk_zone_type type;
+    enum blk_zone_cond cond;
+};
+
+struct uringblk_zoned {
+    spinlock_t lock;               /* Protects everything below */
+    unsigned int nr_zones;
+    unsigned int zone_shift;       /* log2 of the zone size in sectors */
+    unsigned int nr_open;          /* Implicitly and explicitly open zones */
+    unsigned int max_open;
+    unsigned int close_hint;       /* Where to look for a zone to close */
+    struct uringblk_zone zones[];
+};
+
+bool uringblk_zoned_enabled(void)
+{
+    return zoned;
+}
+
+static sector_t zone_sectors(struct uringblk_zoned *z)
+{
+    return (sector_t)1 << z->zone_shift;
+}
+
+static struct uringblk_zone *zone_of(struct uringblk_zoned *z, sector_t sector)
+{
+    return &z->zones[sector >> z->zone_shift];
+}
+
+/**
+ * uringblk_zoned_init - Lay the device out in zones
+ * @dev: Device whose backend is initialized
+ *
+ * The capacity is rounded down to whole zones.
+ */
+int uringblk_zoned_init(struct uringblk_device *dev)
+{
+    sector_t zsectors = (sector_t)zone_size_mb << (20 - SECTOR_SHIFT);
+    unsigned int i, nr_zones;
+    struct uringblk_zoned *z;
+
+    if (!IS_ENABLED(CONFIG_BLK_DEV_ZONED)) {
+        pr_err("uringblk: zoned=1 needs a kernel built with CONFIG_BLK_DEV_ZONED\n");
+        return -EOPNOTSUPP;
+    }
+
+    if (!zone_size_mb || !is_power_of_2(zone_size_mb)) {
+        pr_err("uringblk: zone_size_mb must be a power of two, got %u\n", zone_size_mb);
+        return -EINVAL;
+    }
+
+    nr_zones = (dev->backend.capacity >> SECTOR_SHIFT) / zsectors;
+    if (nr_zones <= zone_nr_conv) {
+        pr_err("uringblk: %zu MB hold no sequential zone of %u MB after %u conventional ones\n",
+               dev->backend.capacity >> 20, zone_size_mb, zone_nr_conv);
+        return -EINVAL;
+    }
+
+    z = kvzalloc(struct_size(z, zones, nr_zones), GFP_KERNEL);
+    if (!z)
+        return -ENOMEM;
+
+    spin_lock_init(&z->lock);
+    z->nr_zones = nr_zones;
+    z->zone_shift = ilog2(zsectors);
+    z->max_open = zone_max_open;
+
+    for (i = 0; i < nr_zones; i++) {
+        struct uringblk_zone *zone = &z->zones[i];
+
+        zone->start = (sector_t)i << z->zone_shift;
+        if (i < zone_nr_conv) {
+            zone->type = BLK_ZONE_TYPE_CONVENTIONAL;
+            zone->cond = BLK_ZONE_COND_NOT_WP;
+            zone->wp = zone->start + zsectors;
+        } else {
+            zone->type = BLK_ZONE_TYPE_SEQWRITE_REQ;
+            zone->cond = BLK_ZONE_COND_EMPTY;
+            zone->wp = zone->start;
+        }
+    }
+
+    dev->zoned = z;
+    dev->backend.capacity = (size_t)nr_zones * zsectors << SECTOR_SHIFT;
+    dev->features |= URINGBLK_FEAT_ZONED;
+    dev->features &= ~URINGBLK_FEAT_DISCARD;
+
+    pr_info("uringblk: zoned device with %u zones of %u MB (%u conventional)\n",
+            nr_zones, zone_size_mb, zone_nr_conv);
+    return 0;
+}
+
+void uringblk_zoned_exit(struct uringblk_device *dev)
+{
+    kvfree(dev->zoned);
+    dev->zoned = NULL;
+}
+
+/**
+ * uringblk_zoned_setup_queue - Zoned queue limits
+ * @dev: Device with an allocated disk
+ *
+ * Called after set_capacity() and before add_disk().
+ */
+int uringblk_zoned_setup_queue(struct uringblk_device *dev)
+{
+#ifdef CONFIG_BLK_DEV_ZONED
+    struct uringblk_zoned *z = dev->zoned;
+    struct request_queue *q = dev->disk->queue;
+
+    disk_set_zoned(dev->disk);
+    blk_queue_flag_set(QUEUE_FLAG_ZONE_RESETALL, q);
+    blk_queue_chunk_sectors(q, zone_sectors(z));
+    blk_queue_max_zone_append_sectors(q, min_t(sector_t, zone_sectors(z),
+                                               queue_max_hw_sectors(q)));
+    disk_set_max_open_zones(dev->disk, z->max_open);
+    disk_set_max_active_zones(dev->disk, 0);
+    /* Sequential writes must reach us in order */
+    blk_queue_required_elevator_features(q, ELEVATOR_F_ZBD_SEQ_WRITE);
+
+    return blk_revalidate_disk_zones(dev->disk, NULL);
+#else
+    return -EOPNOTSUPP;
+#endif
+}
+
+/*
+ * Open zone accounting, called with z->lock held
+ */
+static bool zone_close_imp_open(struct uringblk_zoned *z)
+{
+    unsigned int i, n;
+
+    for (n = 0; n < z->nr_zones; n++) {
+        struct uringblk_zone *zone;
+
+        i = (z->close_hint + n) % z->nr_zones;
+        zone = &z->zones[i];
+        if (zone->cond != BLK_ZONE_COND_IMP_OPEN)
+            continue;
+
+        zone->cond = zone->wp == zone->start ? BLK_ZONE_COND_EMPTY : BLK_ZONE_COND_CLOSED;
+        z->nr_open--;
+        z->close_hint = i + 1;
+        return true;
+    }
+    return false;
+}
+
+static blk_status_t zone_get_open(struct uringblk_zoned *z)
+{
+    if (z->max_open && z->nr_open >= z->max_open && !zone_close_imp_open(z))
+        return BLK_STS_ZONE_OPEN_RESOURCE;
+    z->nr_open++;
+    return BLK_STS_OK;
+}
+
+static bool zone_is_open(struct uringblk_zone *zone)
+{
+    return zone->cond == BLK_ZONE_COND_IMP_OPEN || zone->cond == BLK_ZONE_COND_EXP_OPEN;
+}
+
+/*
+ * Check a write against the write pointer and move the pointer past
+ * it. Zone append is redirected to the write pointer.
+ */
+static blk_status_t zone_write(struct uringblk_zoned *z, struct request *rq)
+{
+    sector_t sector = blk_rq_pos(rq);
+    sector_t nr = blk_rq_sectors(rq);
+    struct uringblk_zone *zone = zone_of(z, sector);
+    blk_status_t status = BLK_STS_OK;
+    struct bio *bio;
+    sector_t pos;
+
+    if (zone->type == BLK_ZONE_TYPE_CONVENTIONAL)
+        return req_op(rq) == REQ_OP_ZONE_APPEND ? BLK_STS_IOERR : BLK_STS_OK;
+
+    spin_lock(&z->lock);
+
+    if (req_op(rq) == REQ_OP_ZONE_APPEND)
+        sector = zone->wp;
+
+    if (zone->cond == BLK_ZONE_COND_FULL || sector != zone->wp ||
+        zone->wp + nr > zone->start + zone_sectors(z)) {
+        status = BLK_STS_IOERR;
+        goto out;
+    }
+
+    if (!zone_is_open(zone)) {
+        status = zone_get_open(z);
+        if (status)
+            goto out;
+        zone->cond = BLK_ZONE_COND_IMP_OPEN;
+    }
+
+    zone->wp += nr;
+    if (zone->wp == zone->start + zone_sectors(z)) {
+        zone->cond = BLK_ZONE_COND_FULL;
+        z->nr_open--;
+    }
+
+    if (req_op(rq) == REQ_OP_ZONE_APPEND) {
+        /* Reported back to the submitter on completion */
+        rq->__sector = sector;
+        pos = sector;
+        __rq_for_each_bio(bio, rq) {
+            bio->bi_iter.bi_sector = pos;
+            pos += bio_sectors(bio);
+        }
+    }
+out:
+    spin_unlock(&z->lock);
+    return status;
+}
+
+static blk_status_t zone_mgmt_one(struct uringblk_zoned *z, struct uringblk_zone *zone,
+                                  enum req_op op)
+{
+    blk_status_t status;
+
+    if (zone->type == BLK_ZONE_TYPE_CONVENTIONAL)
+        return BLK_STS_IOERR;
+
+    switch (op) {
+    case REQ_OP_ZONE_RESET:
+        if (zone_is_open(zone))
+            z->nr_open--;
+        zone->cond = BLK_ZONE_COND_EMPTY;
+        zone->wp = zone->start;
+        return BLK_STS_OK;
+    case REQ_OP_ZONE_OPEN:
+        if (zone->cond == BLK_ZONE_COND_EXP_OPEN || zone->cond == BLK_ZONE_COND_FULL)
+            return BLK_STS_OK;
+        if (zone->cond != BLK_ZONE_COND_IMP_OPEN) {
+            status = zone_get_open(z);
+            if (status)
+                return status;
+        }
+        zone->cond = BLK_ZONE_COND_EXP_OPEN;
+        return BLK_STS_OK;
+    case REQ_OP_ZONE_CLOSE:
+        if (zone->cond == BLK_ZONE_COND_CLOSED)
+            return BLK_STS_OK;
+        if (!zone_is_open(zone))
+            return BLK_STS_IOERR;
+        z->nr_open--;
+        zone->cond = zone->wp == zone->start ? BLK_ZONE_COND_EMPTY : BLK_ZONE_COND_CLOSED;
+        return BLK_STS_OK;
+    case REQ_OP_ZONE_FINISH:
+        if (zone_is_open(zone))
+            z->nr_open--;
+        zone->cond = BLK_ZONE_COND_FULL;
+        zone->wp = zone->start + zone_sectors(z);
+        return BLK_STS_OK;
+    default:
+        return BLK_STS_NOTSUPP;
+    }
+}
+
+/* Reset zones drop their data, the virtual backend gives the pages back */
+static void zone_discard(struct uringblk_device *dev, sector_t sector, sector_t nr)
+{
+    if (dev->backend.type == URINGBLK_BACKEND_VIRTUAL)
+        dev->backend.ops->discard(&dev->backend, (loff_t)sector << SECTOR_SHIFT,
+                                  (size_t)nr << SECTOR_SHIFT);
+}
+
+/**
+ * uringblk_zoned_mgmt - Apply a zone management operation
+ * @dev: Zoned device
+ * @op: REQ_OP_ZONE_RESET/OPEN/CLOSE/FINISH/RESET_ALL
+ * @sector: Start of the zone, ignored for RESET_ALL
+ */
+blk_status_t uringblk_zoned_mgmt(struct uringblk_device *dev, enum req_op op, sector_t sector)
+{
+    struct uringblk_zoned *z = dev->zoned;
+    blk_status_t status = BLK_STS_OK;
+    struct uringblk_zone *zone;
+    unsigned int i;
+
+    if (op == REQ_OP_ZONE_RESET_ALL) {
+        spin_lock(&z->lock);
+        for (i = zone_nr_conv; i < z->nr_zones; i++)
+            zone_mgmt_one(z, &z->zones[i], REQ_OP_ZONE_RESET);
+        spin_unlock(&z->lock);
+
+        i = min(zone_nr_conv, z->nr_zones);
+        zone_discard(dev, (sector_t)i << z->zone_shift,
+                     (sector_t)(z->nr_zones - i) << z->zone_shift);
+        return BLK_STS_OK;
+    }
+
+    if (sector >= ((sector_t)z->nr_zones << z->zone_shift) ||
+        sector & (zone_sectors(z) - 1))
+        return BLK_STS_IOERR;
+
+    zone = zone_of(z, sector);
+    spin_lock(&z->lock);
+    status = zone_mgmt_one(z, zone, op);
+    spin_unlock(&z->lock);
+
+    if (!status && op == REQ_OP_ZONE_RESET)
+        zone_discard(dev, sector, zone_sectors(z));
+    return status;
+}
+
+/**
+ * uringblk_zoned_prep_rq - Zone checks before a request reaches the backend
+ * @dev: Zoned device
+ * @rq: Started request
+ *
+ * Writes are checked against and advance the write pointer. Anything
+ * else passes through.
+ */
+blk_status_t uringblk_zoned_prep_rq(struct uringblk_device *dev, struct request *rq)
+{
+    switch (req_op(rq)) {
+    case REQ_OP_WRITE:
+    case REQ_OP_WRITE_ZEROES:
+    case REQ_OP_ZONE_APPEND:
+        return zone_write(dev->zoned, rq);
+    case REQ_OP_DISCARD:
+        return BLK_STS_NOTSUPP;
+    default:
+        return BLK_STS_OK;
+    }
+}
+
+static void zone_to_blk(struct uringblk_zoned *z, struct uringblk_zone *zone,
+                        struct blk_zone *blkz)
+{
+    memset(blkz, 0, sizeof(*blkz));
+    blkz->start = zone->start;
+    blkz->len = zone_sectors(z);
+    blkz->capacity = zone_sectors(z);
+    blkz->wp = zone->wp;
+    blkz->type = zone->type;
+    blkz->cond = zone->cond;
+}
+
+int uringblk_report_zones(struct gendisk *disk, sector_t sector,
+                          unsigned int nr_zones, report_zones_cb cb, void *data)
+{
+    struct uringblk_device *dev = disk->private_data;
+    struct uringblk_zoned *z = dev->zoned;
+    unsigned int i, n = 0;
+    struct blk_zone blkz;
+    int ret;
+
+    if (!z)
+        return -EOPNOTSUPP;
+
+    for (i = sector >> z->zone_shift; i < z->nr_zones && n < nr_zones; i++, n++) {
+        spin_lock(&z->lock);
+        zone_to_blk(z, &z->zones[i], &blkz);
+        spin_unlock(&z->lock);
+
+        ret = cb(&blkz, i, data);
+        if (ret)
+            return ret;
+    }
+    return n;
+}
+
+/**
+ * uringblk_cmd_zone_mgmt - URINGBLK_UCMD_ZONE_MGMT handler
+ * @dev: uringblk device
+ * @argp: struct uringblk_zone_mgmt, followed by the report for REPORT
+ * @len: Size of the user buffer
+ *
+ * REPORT returns the number of zone descriptors written, the other
+ * actions 0.
+ */
+int uringblk_cmd_zone_mgmt(struct uringblk_device *dev, void __user *argp, u32 len)
+{
+    struct uringblk_zoned *z = dev->zoned;
+    struct uringblk_zone_desc __user *out;
+    struct uringblk_zone_mgmt req;
+    struct uringblk_zone_desc desc;
+    static const enum req_op ops[] = {
+        [URINGBLK_ZONE_RESET] = REQ_OP_ZONE_RESET,
+        [URINGBLK_ZONE_OPEN] = REQ_OP_ZONE_OPEN,
+        [URINGBLK_ZONE_CLOSE] = REQ_OP_ZONE_CLOSE,
+        [URINGBLK_ZONE_FINISH] = REQ_OP_ZONE_FINISH,
+        [URINGBLK_ZONE_RESET_ALL] = REQ_OP_ZONE_RESET_ALL,
+    };
+    unsigned int i, n;
+
+    if (!z)
+        return -EOPNOTSUPP;
+    if (len < sizeof(req))
+        return -EINVAL;
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+
+    if (req.action != URINGBLK_ZONE_REPORT) {
+        if (req.action >= ARRAY_SIZE(ops) || !ops[req.action])
+            return -EINVAL;
+        return blk_status_to_errno(uringblk_zoned_mgmt(dev, ops[req.action], req.sector));
+    }
+
+    out = argp + sizeof(req);
+    n = min_t(u32, req.nr_zones, (len - sizeof(req)) / sizeof(desc));
+
+    for (i = 0; i < n; i++) {
+        struct uringblk_zone *zone;
+        unsigned int zno = (req.sector >> z->zone_shift) + i;
+
+        if (zno >= z->nr_zones)
+            break;
+        zone = &z->zones[zno];
+
+        memset(&desc, 0, sizeof(desc));
+        spin_lock(&z->lock);
+        desc.start = zone->start;
+        desc.len = zone_sectors(z);
+        desc.capacity = zone_sectors(z);
+        desc.wp = zone->wp;
+        desc.type = zone->type;
+        desc.cond = zone->cond;
+        spin_unlock(&z->lock);
+
+        if (copy_to_user(&out[i], &desc, sizeof(desc)))
+            return -EFAULT;
+    }
+    return i;
+}
@@ -22,17 +22,17 @@
 #define HAVE_KVM_IOCTLS 1
 
 /* Driver integration */
-#define HAVE_WAL_DRIVER 1
+#define HAVE_WAL_DRIVER 0
 #ifdef HAVE_WAL_DRIVER
-    #define WAL_DRIVER_BUILD_DIR "/home/sunny/dev/kvm_db/build/driver"
+    #define WAL_DRIVER_BUILD_DIR ""
     #define WAL_CHAR_DEVICE "/dev/rwal"
     #define WAL_BLOCK_DEVICE "/dev/wal"
     #define WAL_PROC_ENTRY "/proc/wal_driver"
 #endif
 
-#define HAVE_URINGBLK_DRIVER 1
+#define HAVE_URINGBLK_DRIVER 0
 #ifdef HAVE_URINGBLK_DRIVER
-    #define URINGBLK_DRIVER_BUILD_DIR "/home/sunny/dev/kvm_db/build/driver/uringblk"
+    #define URINGBLK_DRIVER_BUILD_DIR ""
     #define URINGBLK_DEVICE "/dev/uringblk0"
     #define URINGBLK_SYSFS_PATH "/sys/block/uringblk0/uringblk"
 #endif
@@ -47,14 +47,14 @@
 #define FILESYSTEM_NO_LINK_NEEDED 0
 
 /* Build configuration */
-#define BUILD_DRIVER_BY_DEFAULT 1
-#define BUILD_DRIVER_TESTS 1
+#define BUILD_DRIVER_BY_DEFAULT 0
+#define BUILD_DRIVER_TESTS 0
 
 /* System information */
 #define CMAKE_SYSTEM_NAME "Linux"
-#define CMAKE_BUILD_TYPE "Release"
+#define CMAKE_BUILD_TYPE ""
 #define CMAKE_CXX_COMPILER_ID "GNU"
-#define CMAKE_CXX_COMPILER_VERSION "14.2.0"
+#define CMAKE_CXX_COMPILER_VERSION "12.2.0"
 
 /* Helpful macros */
 #if HAVE_WAL_DRIVER
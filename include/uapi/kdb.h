@@ -25,11 +25,141 @@ struct kdb_stats {
 	__u64 allocated_lp;     /* Currently allocated logical pages */
 };
 
+/* Fault latency histograms */
+#define KDB_LAT_BUCKETS      32  /* Bucket i counts latencies in [2^i, 2^(i+1)) ns */
+
+#define KDB_LAT_MINOR_FAULT  0   /* Fault on an already resident CP */
+#define KDB_LAT_MAJOR_FAULT  1   /* Fault that had to fill a new CP */
+#define KDB_LAT_MKWRITE      2   /* First write to a resident CP */
+#define KDB_LAT_NR           3
+
+struct kdb_lat_hist {
+	__u64 addr;      /* In: address inside a mapping, 0 for all mappings */
+	__u64 nr_maps;   /* Out: number of mappings aggregated */
+	__u64 hist[KDB_LAT_NR][KDB_LAT_BUCKETS];
+};
+
+/* Namespace quotas; a namespace is one mapping of the cache */
+#define KDB_NS_WEIGHT_DEFAULT 100
+
+struct kdb_ns {
+	__u64 addr;      /* Address inside the mapping to configure */
+	__u64 ns_id;     /* Namespace (tablespace) id */
+	__u32 weight;    /* Relative share of the cache, 0 keeps the current one */
+	__u32 reserved;
+	__u64 max_cp;    /* Hard quota in canonical pages, 0 = none */
+};
+
+struct kdb_ns_stats {
+	__u64 addr;        /* In: address inside the mapping */
+	__u64 ns_id;
+	__u32 weight;
+	__u32 reserved;
+	__u64 max_cp;      /* Hard quota, 0 = none */
+	__u64 share_cp;    /* Weighted share of cache_cp, 0 if unlimited */
+	__u64 resident_cp; /* Canonical pages currently resident */
+	__u64 dirty_cp;    /* Resident canonical pages that are dirty */
+	__u64 evicted_cp;  /* Canonical pages reclaimed from this namespace */
+	__u64 cache_cp;    /* Global cache limit, 0 if unlimited */
+};
+
+/*
+ * Lease API (REQ-API-001..005)
+ *
+ * get_page pins a logical page of a namespace and returns its address in
+ * the caller's mapping of that namespace; put releases the pin. A lease
+ * keeps every CP of the logical page resident until it is put, and all
+ * leases of a file descriptor are dropped when it is closed.
+ */
+#define KDB_MODE_SHARED    0            /* Any number of shared holders */
+#define KDB_MODE_EXCL      1            /* Single holder, required for mark_dirty */
+
+#define KDB_REQ_NOWAIT     (1U << 0)    /* -EAGAIN instead of waiting or filling */
+#define KDB_REQ_PREFETCH   (1U << 1)    /* Make resident only, no lease returned */
+
+struct kdb_page_req {
+	/* Request */
+	__u64 file_id;     /* Namespace id set with KDB_SET_NS */
+	__u64 page_no;     /* Logical page number */
+	__u32 mode;        /* KDB_MODE_* */
+	__u32 flags;       /* KDB_REQ_* */
+	__u64 want_lsn;    /* Minimum page LSN, 0 = any */
+	__u64 ctx;         /* Opaque, untouched by the kernel */
+	/* Completion */
+	__s32 status;      /* 0, -EAGAIN (miss or busy), -ESTALE (older than want_lsn) */
+	__u32 len;         /* Bytes valid at ptr (the logical page size) */
+	__u64 ptr;         /* Address of the page in the caller's mapping */
+	__u64 lease;       /* Handle for KDB_MARK_DIRTY and KDB_PUT_PAGE */
+	__u64 gen;         /* Bumped whenever a CP of the page is evicted */
+	__u64 page_lsn;    /* Highest LSN passed to KDB_MARK_DIRTY */
+};
+
+struct kdb_lease_op {
+	__u64 lease;
+	__u64 lsn;         /* KDB_MARK_DIRTY only */
+	__s32 status;      /* Out: 0 or negative errno */
+	__u32 reserved;
+};
+
+/* Batched form: one syscall for an array of requests of the same kind */
+#define KDB_BATCH_GET_PAGE    0   /* entries is struct kdb_page_req[] */
+#define KDB_BATCH_MARK_DIRTY  1   /* entries is struct kdb_lease_op[] */
+#define KDB_BATCH_PUT_PAGE    2   /* entries is struct kdb_lease_op[] */
+
+struct kdb_batch {
+	__u64 entries;     /* User pointer to the entry array */
+	__u32 nr;          /* Number of entries */
+	__u32 op;          /* KDB_BATCH_* */
+};
+
+/*
+ * Warm restart
+ *
+ * KDB_GET_HOTSET exports the resident logical pages of a namespace,
+ * hottest first, so that they can be saved at shutdown or periodically.
+ * KDB_PREFETCH hands such a list back: if no mapping has the namespace
+ * id yet, the list is kept until KDB_SET_NS names one. Both only see
+ * namespaces mapped by the calling process. Prefetching runs
+ * in the background, in list order, with batched reads from the file set
+ * with KDB_SET_BACKING. Without a backing file CPs are zero-filled.
+ * A KDB_PREFETCH with no entries cancels a pending hot set.
+ */
+#define KDB_HOTSET_MAX     (1U << 20)   /* Entries per KDB_PREFETCH call */
+
+struct kdb_hot_entry {
+	__u64 lpn;         /* Logical page number */
+	__u32 hits;        /* Faults and leases since the LP was created */
+	__u32 nr_cp;       /* Resident CPs when exported */
+};
+
+struct kdb_hotset {
+	__u64 ns_id;       /* Namespace id set with KDB_SET_NS */
+	__u64 entries;     /* User pointer to struct kdb_hot_entry[] */
+	__u32 nr;          /* GET: capacity in (0 = query), count out; PREFETCH: count */
+	__u32 flags;       /* Must be 0 */
+};
+
+struct kdb_backing {
+	__s32 fd;          /* Fill source for new mappings, -1 to clear */
+	__u32 flags;       /* Must be 0 */
+	__u64 offset;      /* Byte offset of logical page 0 in the file */
+};
+
 /* IOCTL definitions */
 #define KDB_MAGIC 'k'
 #define KDB_SET_LAYOUT   _IOW(KDB_MAGIC, 1, struct kdb_layout)
 #define KDB_GET_LAYOUT   _IOR(KDB_MAGIC, 2, struct kdb_layout)
 #define KDB_GET_STATS    _IOR(KDB_MAGIC, 3, struct kdb_stats)
 #define KDB_RESET_STATS  _IO(KDB_MAGIC, 4)
+#define KDB_GET_LAT_HIST _IOWR(KDB_MAGIC, 5, struct kdb_lat_hist)
+#define KDB_SET_NS       _IOW(KDB_MAGIC, 6, struct kdb_ns)
+#define KDB_GET_NS_STATS _IOWR(KDB_MAGIC, 7, struct kdb_ns_stats)
+#define KDB_GET_PAGE     _IOWR(KDB_MAGIC, 8, struct kdb_page_req)
+#define KDB_MARK_DIRTY   _IOWR(KDB_MAGIC, 9, struct kdb_lease_op)
+#define KDB_PUT_PAGE     _IOWR(KDB_MAGIC, 10, struct kdb_lease_op)
+#define KDB_BATCH        _IOW(KDB_MAGIC, 11, struct kdb_batch)
+#define KDB_GET_HOTSET   _IOWR(KDB_MAGIC, 12, struct kdb_hotset)
+#define KDB_PREFETCH     _IOW(KDB_MAGIC, 13, struct kdb_hotset)
+#define KDB_SET_BACKING  _IOW(KDB_MAGIC, 14, struct kdb_backing)
 
 #endif /* _UAPI_KDB_H */
\ No newline at end of file
@@ -9,6 +9,7 @@
 #define URINGBLK_UAPI_H
 
 #include <stdint.h>
+#include <linux/ioctl.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,8 +41,51 @@ enum uringblk_ucmd {
     URINGBLK_UCMD_GET_STATS     = 0x06,
     URINGBLK_UCMD_ZONE_MGMT     = 0x10,
     URINGBLK_UCMD_FIRMWARE_OP   = 0x20,
+    /* Data commands (ABI 1.3), sqe->cmd holds a struct uringblk_io_cmd */
+    URINGBLK_UCMD_READ          = 0x40,
+    URINGBLK_UCMD_WRITE         = 0x41,
+    URINGBLK_UCMD_WRITE_ZEROES  = 0x42,
+    URINGBLK_UCMD_FLUSH         = 0x43,
+    URINGBLK_UCMD_READV         = 0x44,
+    URINGBLK_UCMD_WRITEV        = 0x45,
 };
 
+/*
+ * Data command, the buffer is given in sqe->addr and sqe->len (an
+ * iovec array and its length for READV/WRITEV). Set
+ * IORING_URING_CMD_FIXED and sqe->buf_index to use a registered buffer.
+ */
+struct uringblk_io_cmd {
+    uint16_t opcode;           /* URINGBLK_UCMD_READ .. URINGBLK_UCMD_WRITEV */
+    uint16_t flags;            /* URINGBLK_IO_F_* */
+    uint32_t rsvd;
+    uint64_t sector;           /* Start in 512-byte sectors */
+} __attribute__((packed));
+
+#define URINGBLK_IO_F_FUA       (1U << 0)   /* Writes: forced unit access */
+#define URINGBLK_IO_F_BULK      (1U << 1)   /* Writes: bulk class, see bulk_write_mbps */
+#define URINGBLK_IO_F_ATOMIC    (1U << 2)   /* Writes: fail unless all or nothing */
+
+/*
+ * Control device (/dev/uringblk-control): add, remove and resize devices
+ * at runtime. Each command is an ioctl, or a URING_CMD with cmd_op set
+ * to the ioctl number and sqe->addr pointing at the struct. Needs
+ * CAP_SYS_ADMIN. backend_type is 0=virtual, 1=device, 2=stripe,
+ * 3=mirror, 4=file or 5=emulated.
+ */
+struct uringblk_ctl_dev {
+    uint32_t minor;            /* ADD: set on return; DEL, RESIZE: the device */
+    uint32_t backend_type;     /* ADD */
+    uint32_t nr_hw_queues;     /* ADD: 0 for the module default */
+    uint32_t queue_depth;      /* ADD: 0 for the module default */
+    uint64_t capacity;         /* ADD: bytes, 0 for the default; RESIZE: new size */
+    char  backend_path[256];   /* ADD: device, members or file */
+} __attribute__((packed));
+
+#define URINGBLK_CTL_ADD_DEV    _IOWR(URINGBLK_URING_CMD_IO, 0x80, struct uringblk_ctl_dev)
+#define URINGBLK_CTL_DEL_DEV    _IOW(URINGBLK_URING_CMD_IO, 0x81, struct uringblk_ctl_dev)
+#define URINGBLK_CTL_RESIZE_DEV _IOW(URINGBLK_URING_CMD_IO, 0x82, struct uringblk_ctl_dev)
+
 /* URING_CMD header structure */
 struct uringblk_ucmd_hdr {
     uint16_t abi_major;
@@ -84,6 +128,40 @@ struct uringblk_limits {
     uint32_t io_opt;
     uint32_t discard_granularity;
     uint64_t discard_max_bytes;
+    /* ABI 1.5 */
+    uint32_t atomic_write_unit_min; /* Bytes, 0 without atomic writes */
+    uint32_t atomic_write_unit_max;
+    uint32_t atomic_write_max_bytes;
+    uint32_t atomic_write_boundary; /* Writes crossing it are not atomic */
+} __attribute__((packed));
+
+/* ZONE_MGMT actions */
+enum uringblk_zone_action {
+    URINGBLK_ZONE_REPORT        = 0,
+    URINGBLK_ZONE_RESET         = 1,
+    URINGBLK_ZONE_OPEN          = 2,
+    URINGBLK_ZONE_CLOSE         = 3,
+    URINGBLK_ZONE_FINISH        = 4,
+    URINGBLK_ZONE_RESET_ALL     = 5,
+};
+
+/* ZONE_MGMT request (ABI 1.2), a REPORT buffer continues with the descriptors */
+struct uringblk_zone_mgmt {
+    uint8_t  action;           /* enum uringblk_zone_action */
+    uint8_t  rsvd[3];
+    uint32_t nr_zones;         /* REPORT: descriptors wanted */
+    uint64_t sector;           /* Zone start, or where a REPORT begins */
+} __attribute__((packed));
+
+/* ZONE_MGMT report entry, sectors are 512 bytes */
+struct uringblk_zone_desc {
+    uint64_t start;
+    uint64_t len;
+    uint64_t capacity;
+    uint64_t wp;
+    uint8_t  type;             /* BLK_ZONE_TYPE_* */
+    uint8_t  cond;             /* BLK_ZONE_COND_* */
+    uint8_t  rsvd[6];
 } __attribute__((packed));
 
 /* Feature flags */
@@ -94,6 +172,8 @@ struct uringblk_limits {
 #define URINGBLK_FEAT_WRITE_ZEROES  (1ULL << 4)
 #define URINGBLK_FEAT_ZONED         (1ULL << 5)
 #define URINGBLK_FEAT_POLLING       (1ULL << 6)
+#define URINGBLK_FEAT_ATOMIC_WRITE  (1ULL << 7)
+#define URINGBLK_FEAT_INTEGRITY     (1ULL << 8)
 
 /* GET_GEOMETRY response */
 struct uringblk_geometry {
@@ -122,11 +202,22 @@ struct uringblk_stats {
     uint32_t p99_read_latency_us;
     uint32_t p50_write_latency_us;
     uint32_t p99_write_latency_us;
+    /* ABI 1.1 */
+    uint32_t p90_read_latency_us;
+    uint32_t p999_read_latency_us;
+    uint32_t max_read_latency_us;
+    uint32_t p90_write_latency_us;
+    uint32_t p999_write_latency_us;
+    uint32_t max_write_latency_us;
+    /* ABI 1.4 */
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_promotions;
 } __attribute__((packed));
 
 /* ABI version */
 #define URINGBLK_ABI_MAJOR  1
-#define URINGBLK_ABI_MINOR  0
+#define URINGBLK_ABI_MINOR  5
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,98 @@
+#include "backing.h"
+#include "lp_state.h"
+#include "../include/uapi/kdb.h"
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/bvec.h>
+#include <linux/uio.h>
+#include <linux/slab.h>
+
+/* File used by mappings created from now on */
+static struct {
+	struct file *file;
+	loff_t offset;
+	struct mutex lock;
+} kdb_backing = {
+	.lock = __MUTEX_INITIALIZER(kdb_backing.lock),
+};
+
+int backing_set(const struct kdb_backing *kb)
+{
+	struct file *file = NULL, *old;
+	
+	if (kb->flags || !PAGE_ALIGNED(kb->offset))
+		return -EINVAL;
+	
+	if (kb->fd >= 0) {
+		file = fget(kb->fd);
+		if (!file)
+			return -EBADF;
+		
+		/* vfs_iter_read() needs ->read_iter */
+		if (!(file->f_mode & FMODE_READ) || !file->f_op->read_iter) {
+			fput(file);
+			return -EINVAL;
+		}
+	}
+	
+	mutex_lock(&kdb_backing.lock);
+	old = kdb_backing.file;
+	kdb_backing.file = file;
+	kdb_backing.offset = kb->offset;
+	mutex_unlock(&kdb_backing.lock);
+	
+	if (old)
+		fput(old);
+	
+	pr_info("kdb: backing file %s\n", file ? "set" : "cleared");
+	return 0;
+}
+
+void backing_attach(struct vma_ctx *ctx)
+{
+	mutex_lock(&kdb_backing.lock);
+	if (kdb_backing.file) {
+		ctx->backing = get_file(kdb_backing.file);
+		ctx->backing_off = kdb_backing.offset;
+	}
+	mutex_unlock(&kdb_backing.lock);
+}
+
+int backing_fill(struct vma_ctx *ctx, u64 pgoff, struct page **pages, u32 nr)
+{
+	struct bio_vec bv_one, *bv = &bv_one;
+	struct iov_iter iter;
+	loff_t pos;
+	ssize_t ret;
+	u32 i;
+	
+	if (!ctx->backing || !nr)
+		return 0;
+	
+	if (nr > 1) {
+		bv = kmalloc_array(nr, sizeof(*bv), GFP_KERNEL);
+		if (!bv)
+			return -ENOMEM;
+	}
+	
+	for (i = 0; i < nr; i++)
+		bvec_set_page(&bv[i], pages[i], PAGE_SIZE, 0);
+	iov_iter_bvec(&iter, ITER_DEST, bv, nr, (size_t)nr << PAGE_SHIFT);
+	
+	pos = ctx->backing_off + ((loff_t)pgoff << PAGE_SHIFT);
+	ret = vfs_iter_read(ctx->backing, &iter, &pos, 0);
+	
+	if (bv != &bv_one)
+		kfree(bv);
+	
+	/* A short read leaves the tail zero, like a sparse file */
+	return ret < 0 ? ret : 0;
+}
+
+void backing_exit(void)
+{
+	if (kdb_backing.file)
+		fput(kdb_backing.file);
+	kdb_backing.file = NULL;
+}
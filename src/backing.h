@@ -0,0 +1,50 @@
+#ifndef _KDB_BACKING_H
+#define _KDB_BACKING_H
+
+#include <linux/types.h>
+
+struct page;
+struct vma_ctx;
+struct kdb_backing;
+
+/*
+ * Backing file
+ *
+ * An optional file that missing CPs are read from instead of being
+ * zero-filled. It is only a fill source: dirty CPs are never written
+ * back to it. Each mapping takes a reference on the file that is
+ * current when it is created, so changing it affects new mappings only.
+ */
+
+/**
+ * backing_set - KDB_SET_BACKING: set or clear the backing file
+ * @kb: File descriptor and offset
+ * Returns 0 or a negative errno
+ */
+int backing_set(const struct kdb_backing *kb);
+
+/**
+ * backing_attach - Give a new mapping the current backing file
+ * @ctx: VMA context, the reference is dropped when it is destroyed
+ */
+void backing_attach(struct vma_ctx *ctx);
+
+/**
+ * backing_fill - Read consecutive canonical pages from the backing file
+ * @ctx: VMA context
+ * @pgoff: Page offset of the first page in the mapping
+ * @pages: Zeroed pages, not yet visible to anyone else
+ * @nr: Number of pages
+ *
+ * Issues a single read for the whole run. Pages past the end of the
+ * file stay zero. A no-op without a backing file.
+ * Returns 0 or a negative errno
+ */
+int backing_fill(struct vma_ctx *ctx, u64 pgoff, struct page **pages, u32 nr);
+
+/**
+ * backing_exit - Drop the backing file on module unload
+ */
+void backing_exit(void);
+
+#endif /* _KDB_BACKING_H */
@@ -1,6 +1,10 @@
 #include "lp_state.h"
 #include "cp_pool.h"
 #include "kdb_module.h"
+#include "evict.h"
+#include "lease.h"
+#include "backing.h"
+#include "warm.h"
 #include "../include/uapi/kdb.h"
 #include <linux/module.h>
 #include <linux/fs.h>
@@ -27,6 +31,13 @@ static struct {
  */
 static int kdb_open(struct inode *inode, struct file *filp)
 {
+	struct kdb_file *kf;
+	
+	kf = kdb_file_alloc();
+	if (!kf)
+		return -ENOMEM;
+	filp->private_data = kf;
+	
 	pr_debug("kdb: device opened\n");
 	return 0;
 }
@@ -38,6 +49,9 @@ static int kdb_open(struct inode *inode, struct file *filp)
  */
 static int kdb_release(struct inode *inode, struct file *filp)
 {
+	/* Drop any leases the client did not put */
+	kdb_file_release(filp->private_data);
+	
 	pr_debug("kdb: device closed\n");
 	return 0;
 }
@@ -53,6 +67,10 @@ static int kdb_mmap(struct file *filp, struct vm_area_struct *vma)
 	unsigned long size;
 	u64 total_size;
 	
+	/* CPs are shared with the cache and written back, a private copy is neither */
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+	
 	mutex_lock(&kdb_dev.lock);
 	
 	/* Check if layout has been configured */
@@ -86,6 +104,11 @@ static int kdb_mmap(struct file *filp, struct vm_area_struct *vma)
 	
 	mutex_unlock(&kdb_dev.lock);
 	
+	ctx->mapping = filp->f_mapping;
+	ctx->mm = vma->vm_mm;
+	ctx->user_base = vma->vm_start - (vma->vm_pgoff << PAGE_SHIFT);
+	backing_attach(ctx);
+	
 	/* Configure VMA */
 	vma->vm_ops = &kdb_vm_ops;
 	vma->vm_private_data = ctx;
@@ -97,6 +120,142 @@ static int kdb_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 }
 
+static int kdb_stats_fn(struct vma_ctx *ctx, void *arg)
+{
+	vma_ctx_stats(ctx, arg);
+	return 0;
+}
+
+static int kdb_lat_hist_fn(struct vma_ctx *ctx, void *arg)
+{
+	vma_ctx_lat_hist(ctx, arg);
+	return 0;
+}
+
+static int kdb_reset_stats_fn(struct vma_ctx *ctx, void *arg)
+{
+	vma_ctx_reset_stats(ctx);
+	return 0;
+}
+
+/**
+ * kdb_find_ctx - Find the VMA context of a mapping in the current process
+ * @addr: Any address inside the mapping
+ *
+ * Must be called with the mmap lock held, which keeps the context alive.
+ */
+static struct vma_ctx *kdb_find_ctx(unsigned long addr)
+{
+	struct vm_area_struct *vma = vma_lookup(current->mm, addr);
+	
+	if (!vma || vma->vm_ops != &kdb_vm_ops)
+		return NULL;
+	return vma->vm_private_data;
+}
+
+/**
+ * kdb_get_lat_hist - KDB_GET_LAT_HIST for one mapping or all mappings
+ * @uarg: User pointer to struct kdb_lat_hist
+ */
+static int kdb_get_lat_hist(void __user *uarg)
+{
+	struct kdb_lat_hist *hist;
+	struct vma_ctx *ctx;
+	u64 addr;
+	int ret = 0;
+	
+	if (get_user(addr, (u64 __user *)uarg))
+		return -EFAULT;
+	
+	hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+	hist->addr = addr;
+	
+	if (addr) {
+		mmap_read_lock(current->mm);
+		ctx = kdb_find_ctx(addr);
+		if (ctx)
+			vma_ctx_lat_hist(ctx, hist);
+		else
+			ret = -EINVAL;
+		mmap_read_unlock(current->mm);
+	} else {
+		kdb_ctx_for_each(kdb_lat_hist_fn, hist);
+	}
+	
+	if (!ret && copy_to_user(uarg, hist, sizeof(*hist)))
+		ret = -EFAULT;
+	
+	kfree(hist);
+	return ret;
+}
+
+/**
+ * kdb_set_ns - KDB_SET_NS: set namespace id, weight and quota of a mapping
+ * @uarg: User pointer to struct kdb_ns
+ */
+static int kdb_set_ns(void __user *uarg)
+{
+	struct kdb_ns ns;
+	struct vma_ctx *ctx;
+	int ret = 0;
+	
+	if (copy_from_user(&ns, uarg, sizeof(ns)))
+		return -EFAULT;
+	
+	mmap_read_lock(current->mm);
+	ctx = kdb_find_ctx(ns.addr);
+	if (ctx) {
+		u64 resident;
+		
+		WRITE_ONCE(ctx->ns_id, ns.ns_id);
+		if (ns.weight)
+			WRITE_ONCE(ctx->weight, ns.weight);
+		WRITE_ONCE(ctx->max_cp, ns.max_cp);
+		
+		/* Bring the namespace under a lowered quota right away */
+		resident = atomic64_read(&ctx->resident_cp);
+		if (ns.max_cp && resident > ns.max_cp)
+			evict_ctx(ctx, resident - ns.max_cp, "quota");
+		
+		/* A hot set saved under this id can start warming now */
+		warm_attach(ctx);
+	} else {
+		ret = -EINVAL;
+	}
+	mmap_read_unlock(current->mm);
+	
+	return ret;
+}
+
+/**
+ * kdb_get_ns_stats - KDB_GET_NS_STATS: quota usage of a mapping
+ * @uarg: User pointer to struct kdb_ns_stats
+ */
+static int kdb_get_ns_stats(void __user *uarg)
+{
+	struct kdb_ns_stats stats;
+	struct vma_ctx *ctx;
+	int ret = 0;
+	
+	if (copy_from_user(&stats, uarg, sizeof(stats)))
+		return -EFAULT;
+	
+	mmap_read_lock(current->mm);
+	ctx = kdb_find_ctx(stats.addr);
+	if (ctx)
+		evict_ns_stats(ctx, &stats);
+	else
+		ret = -EINVAL;
+	mmap_read_unlock(current->mm);
+	
+	if (!ret && copy_to_user(uarg, &stats, sizeof(stats)))
+		ret = -EFAULT;
+	
+	return ret;
+}
+
 /**
  * kdb_ioctl - Handle ioctl commands
  * @filp: File pointer
@@ -105,8 +264,13 @@ static int kdb_mmap(struct file *filp, struct vm_area_struct *vma)
  */
 static long kdb_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
+	struct kdb_file *kf = filp->private_data;
 	struct kdb_layout layout;
 	struct kdb_stats stats;
+	struct kdb_page_req req;
+	struct kdb_lease_op op;
+	struct kdb_batch batch;
+	struct kdb_backing backing;
 	int ret = 0;
 	
 	switch (cmd) {
@@ -154,22 +318,76 @@ static long kdb_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		break;
 		
 	case KDB_GET_STATS:
-		/* For now, just return zeroed stats - full implementation would
-		 * aggregate from all active VMAs */
+		/* Aggregate over all live mappings */
 		memset(&stats, 0, sizeof(stats));
+		kdb_ctx_for_each(kdb_stats_fn, &stats);
 		
 		/* Add basic CP pool stats */
-		cp_pool_stats(&stats.allocated_cp, NULL, NULL);
+		cp_pool_stats(&stats.allocated_cp, &stats.total_cp_alloc, NULL);
 		
 		if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
 			return -EFAULT;
 		break;
 		
 	case KDB_RESET_STATS:
-		/* Reset global statistics - for now just a no-op */
+		kdb_ctx_for_each(kdb_reset_stats_fn, NULL);
 		pr_info("kdb: statistics reset\n");
 		break;
 		
+	case KDB_GET_LAT_HIST:
+		ret = kdb_get_lat_hist((void __user *)arg);
+		break;
+		
+	case KDB_SET_NS:
+		ret = kdb_set_ns((void __user *)arg);
+		break;
+		
+	case KDB_GET_NS_STATS:
+		ret = kdb_get_ns_stats((void __user *)arg);
+		break;
+		
+	case KDB_GET_PAGE:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		ret = kdb_lease_get(kf, &req);
+		req.status = ret;
+		if (copy_to_user((void __user *)arg, &req, sizeof(req)))
+			return -EFAULT;
+		break;
+		
+	case KDB_MARK_DIRTY:
+	case KDB_PUT_PAGE:
+		if (copy_from_user(&op, (void __user *)arg, sizeof(op)))
+			return -EFAULT;
+		if (cmd == KDB_MARK_DIRTY)
+			ret = kdb_lease_mark_dirty(kf, &op);
+		else
+			ret = kdb_lease_put(kf, &op);
+		op.status = ret;
+		if (copy_to_user((void __user *)arg, &op, sizeof(op)))
+			return -EFAULT;
+		break;
+		
+	case KDB_BATCH:
+		if (copy_from_user(&batch, (void __user *)arg, sizeof(batch)))
+			return -EFAULT;
+		ret = kdb_lease_batch(kf, &batch);
+		break;
+		
+	case KDB_GET_HOTSET:
+		ret = warm_get_hotset((void __user *)arg);
+		break;
+		
+	case KDB_PREFETCH:
+		ret = warm_prefetch((void __user *)arg);
+		break;
+		
+	case KDB_SET_BACKING:
+		if (copy_from_user(&backing, (void __user *)arg, sizeof(backing)))
+			return -EFAULT;
+		ret = backing_set(&backing);
+		break;
+		
 	default:
 		ret = -ENOTTY;
 	}
@@ -0,0 +1,260 @@
+#include "evict.h"
+#include "lp_state.h"
+#include "cp_pool.h"
+#include "kdb_trace.h"
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/math64.h>
+
+/* Global cache limit shared by all mappings */
+static unsigned long cache_mb;
+module_param(cache_mb, ulong, 0644);
+MODULE_PARM_DESC(cache_mb, "Cache capacity in MB shared by all mappings (0 = unlimited)");
+
+#define EVICT_BATCH     32   /* CPs reclaimed per allocation over the limit */
+#define EVICT_SCAN_MAX  256  /* lp_states visited per evict_ctx() call */
+
+static u64 evict_cache_cp(void)
+{
+	return (u64)READ_ONCE(cache_mb) << (20 - PAGE_SHIFT);
+}
+
+static u64 evict_share(struct vma_ctx *ctx, u64 cache_cp, u64 total_weight)
+{
+	if (!cache_cp || !total_weight)
+		return 0;
+	return div64_u64(cache_cp * READ_ONCE(ctx->weight), total_weight);
+}
+
+/**
+ * evict_lp - Drop the clean canonical pages of one logical page
+ * @ctx: VMA context
+ * @lp: Logical page, pinned by the caller
+ * @nr: Maximum number of pages to drop
+ * @reason: Tracepoint reason
+ *
+ * The page lock serializes against kdb_fault(), which installs a CP with
+ * the page locked and rechecks lp->cp[] afterwards, and against
+ * kdb_page_mkwrite(), which sets the dirty bit under the page lock.
+ * Logical pages held by a lease are skipped.
+ */
+static unsigned long evict_lp(struct vma_ctx *ctx, struct lp_state *lp,
+			      unsigned long nr, const char *reason)
+{
+	unsigned long freed = 0;
+	u32 cpi;
+
+	for (cpi = 0; cpi < lp->cp_per_lp && freed < nr; cpi++) {
+		struct page *pg;
+		loff_t pos;
+
+		spin_lock(&lp->lock);
+		if (lp->lease_shared || lp->lease_excl) {
+			/* Leased logical pages are pinned */
+			spin_unlock(&lp->lock);
+			break;
+		}
+		pg = lp->cp[cpi];
+		if (!pg || test_bit(cpi, lp->dirty_bitmap)) {
+			spin_unlock(&lp->lock);
+			continue;
+		}
+		get_page(pg);
+		spin_unlock(&lp->lock);
+
+		/* Busy pages are being faulted in, try the next one */
+		if (!trylock_page(pg)) {
+			put_page(pg);
+			continue;
+		}
+
+		spin_lock(&lp->lock);
+		if (lp->cp[cpi] != pg || test_bit(cpi, lp->dirty_bitmap) ||
+		    lp->lease_shared || lp->lease_excl) {
+			spin_unlock(&lp->lock);
+			unlock_page(pg);
+			put_page(pg);
+			continue;
+		}
+		lp->cp[cpi] = NULL;
+		lp->nr_resident--;
+		lp->gen++;
+		spin_unlock(&lp->lock);
+
+		/*
+		 * Zap the PTEs; other mappings of the same offset simply refault.
+		 * Only shared mappings exist, there are no private COW copies.
+		 */
+		pos = (loff_t)(lp->lpn * ctx->cp_per_lp + cpi) << PAGE_SHIFT;
+		unmap_mapping_range(ctx->mapping, pos, PAGE_SIZE, 0);
+
+		unlock_page(pg);
+		put_page(pg);
+		cp_pool_free(pg);
+
+		atomic64_dec(&ctx->resident_cp);
+		atomic64_inc(&ctx->evicted_cp);
+		freed++;
+	}
+
+	if (freed)
+		trace_kdb_evict(ctx, lp->lpn, freed, reason);
+
+	return freed;
+}
+
+unsigned long evict_ctx(struct vma_ctx *ctx, unsigned long nr,
+			const char *reason)
+{
+	unsigned long freed = 0;
+	unsigned int scanned = 0;
+	struct lp_state *lp;
+
+	spin_lock(&ctx->lru_lock);
+	while (freed < nr && scanned++ < EVICT_SCAN_MAX &&
+	       !list_empty(&ctx->lru)) {
+		lp = list_first_entry(&ctx->lru, struct lp_state, lru_node);
+		list_move_tail(&lp->lru_node, &ctx->lru);
+
+		/* Clock: recently faulted logical pages get a second chance */
+		if (READ_ONCE(lp->referenced)) {
+			WRITE_ONCE(lp->referenced, false);
+			continue;
+		}
+		if (!READ_ONCE(lp->nr_resident))
+			continue;
+
+		/* lp_states live until the context is destroyed */
+		atomic_inc(&lp->refcount);
+		spin_unlock(&ctx->lru_lock);
+
+		freed += evict_lp(ctx, lp, nr - freed, reason);
+		lp_put(lp);
+
+		spin_lock(&ctx->lru_lock);
+	}
+	spin_unlock(&ctx->lru_lock);
+
+	return freed;
+}
+
+/**
+ * evict_reclaim - Reclaim from the namespaces furthest over their share
+ * @nr: Number of pages to reclaim
+ *
+ * Each round picks the context whose resident set exceeds its weighted
+ * share by the most. Contexts under their share are only touched once
+ * every over-share context has nothing clean left.
+ */
+static unsigned long evict_reclaim(unsigned long nr)
+{
+	u64 cache_cp = evict_cache_cp();
+	u64 total_weight = 0;
+	unsigned long freed = 0;
+	struct vma_ctx *ctx, *victim;
+
+	mutex_lock(&kdb_ctx_lock);
+
+	/* Unmapped contexts only linger for their leases, leave them be */
+	list_for_each_entry(ctx, &kdb_ctx_list, ctx_node) {
+		ctx->reclaim_skip = ctx->dead;
+		if (!ctx->dead)
+			total_weight += READ_ONCE(ctx->weight);
+	}
+
+	while (freed < nr) {
+		s64 excess, best = S64_MIN;
+		unsigned long n;
+
+		victim = NULL;
+		list_for_each_entry(ctx, &kdb_ctx_list, ctx_node) {
+			if (ctx->reclaim_skip)
+				continue;
+			excess = atomic64_read(&ctx->resident_cp) -
+				 (s64)evict_share(ctx, cache_cp, total_weight);
+			if (excess > best) {
+				best = excess;
+				victim = ctx;
+			}
+		}
+		if (!victim)
+			break;
+
+		n = evict_ctx(victim, nr - freed,
+			      best > 0 ? "over_share" : "reclaim");
+		if (!n)
+			victim->reclaim_skip = true;
+		freed += n;
+	}
+
+	mutex_unlock(&kdb_ctx_lock);
+
+	return freed;
+}
+
+struct page *evict_alloc_cp(struct vma_ctx *ctx)
+{
+	u64 cache_cp = evict_cache_cp();
+	u64 max_cp = READ_ONCE(ctx->max_cp);
+	u64 allocated;
+
+	/* A namespace at its hard quota recycles its own pages first */
+	if (max_cp && atomic64_read(&ctx->resident_cp) >= max_cp)
+		evict_ctx(ctx, EVICT_BATCH, "quota");
+
+	if (cache_cp) {
+		cp_pool_stats(&allocated, NULL, NULL);
+		if (allocated >= cache_cp)
+			evict_reclaim(EVICT_BATCH);
+	}
+
+	/*
+	 * Limits are soft: when everything resident is dirty there is
+	 * nothing to reclaim and the allocation goes ahead anyway.
+	 */
+	return cp_pool_alloc();
+}
+
+bool evict_has_room(struct vma_ctx *ctx)
+{
+	u64 cache_cp = evict_cache_cp();
+	u64 max_cp = READ_ONCE(ctx->max_cp);
+	u64 allocated;
+	
+	if (max_cp && atomic64_read(&ctx->resident_cp) >= max_cp)
+		return false;
+	
+	if (cache_cp) {
+		cp_pool_stats(&allocated, NULL, NULL);
+		if (allocated >= cache_cp)
+			return false;
+	}
+	
+	return true;
+}
+
+void evict_ns_stats(struct vma_ctx *ctx, struct kdb_ns_stats *stats)
+{
+	struct kdb_stats counters = {};
+	u64 cache_cp = evict_cache_cp();
+	u64 total_weight = 0;
+	struct vma_ctx *pos;
+
+	mutex_lock(&kdb_ctx_lock);
+	list_for_each_entry(pos, &kdb_ctx_list, ctx_node)
+		if (!pos->dead)
+			total_weight += READ_ONCE(pos->weight);
+	mutex_unlock(&kdb_ctx_lock);
+
+	vma_ctx_stats(ctx, &counters);
+
+	stats->ns_id = READ_ONCE(ctx->ns_id);
+	stats->weight = READ_ONCE(ctx->weight);
+	stats->max_cp = READ_ONCE(ctx->max_cp);
+	stats->share_cp = evict_share(ctx, cache_cp, total_weight);
+	stats->resident_cp = atomic64_read(&ctx->resident_cp);
+	stats->dirty_cp = counters.dirty_pages;
+	stats->evicted_cp = atomic64_read(&ctx->evicted_cp);
+	stats->cache_cp = cache_cp;
+}
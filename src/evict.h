@@ -0,0 +1,57 @@
+#ifndef _KDB_EVICT_H
+#define _KDB_EVICT_H
+
+#include <linux/types.h>
+
+struct page;
+struct vma_ctx;
+struct kdb_ns_stats;
+
+/*
+ * Cache capacity and weighted reclaim
+ *
+ * Every mapping is a namespace with a weight and an optional hard quota.
+ * When the cache is over its global limit, reclaim takes clean CPs from
+ * the namespace furthest above its weighted share first. Dirty CPs have
+ * no other copy and are never evicted.
+ */
+
+/**
+ * evict_alloc_cp - Allocate a canonical page on behalf of a mapping
+ * @ctx: VMA context the page will be charged to
+ *
+ * Reclaims from @ctx when it is at its hard quota and from the most
+ * over-share namespaces when the cache is full. Must be called without
+ * any lp_state lock held.
+ * Returns a zeroed page or NULL on failure
+ */
+struct page *evict_alloc_cp(struct vma_ctx *ctx);
+
+/**
+ * evict_ctx - Reclaim clean canonical pages from one mapping
+ * @ctx: VMA context, must be kept alive by the caller
+ * @nr: Number of pages to reclaim
+ * @reason: Reason string for the kdb_evict tracepoint
+ * Returns the number of pages reclaimed
+ */
+unsigned long evict_ctx(struct vma_ctx *ctx, unsigned long nr,
+			const char *reason);
+
+/**
+ * evict_has_room - Check whether a mapping can grow without reclaim
+ * @ctx: VMA context
+ *
+ * Used by speculative fills, which must not push out pages that are
+ * already in use.
+ * Returns false when @ctx is at its quota or the cache is full
+ */
+bool evict_has_room(struct vma_ctx *ctx);
+
+/**
+ * evict_ns_stats - Fill quota usage for one mapping
+ * @ctx: VMA context, must be kept alive by the caller
+ * @stats: Output, addr is left untouched
+ */
+void evict_ns_stats(struct vma_ctx *ctx, struct kdb_ns_stats *stats);
+
+#endif /* _KDB_EVICT_H */
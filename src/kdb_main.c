@@ -1,6 +1,8 @@
 #include "lp_state.h"
 #include "cp_pool.h"
 #include "kdb_module.h"
+#include "backing.h"
+#include "warm.h"
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
@@ -28,6 +30,13 @@ static int __init kdb_init(void)
 		goto err_lp_state;
 	}
 	
+	/* Initialize warm restart prefetching */
+	ret = warm_init();
+	if (ret) {
+		pr_err("kdb: failed to initialize prefetch: %d\n", ret);
+		goto err_warm;
+	}
+	
 	/* Initialize character device */
 	ret = kdb_chrdev_init();
 	if (ret) {
@@ -39,6 +48,8 @@ static int __init kdb_init(void)
 	return 0;
 	
 err_chrdev:
+	warm_exit();
+err_warm:
 	lp_state_exit();
 err_lp_state:
 	cp_pool_exit();
@@ -55,6 +66,8 @@ static void __exit kdb_exit(void)
 	
 	/* Cleanup in reverse order */
 	kdb_chrdev_exit();
+	warm_exit();
+	backing_exit();
 	lp_state_exit();
 	cp_pool_exit();
 	
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * KDB cache tracepoints
+ *
+ * Events cover the fault path (entry/exit), CP fills, mkwrite and
+ * eviction. They are cheap when disabled and can be enabled with:
+ *
+ *   echo 1 > /sys/kernel/tracing/events/kdb/enable
+ *
+ * The object including this header with CREATE_TRACE_POINTS (vma.c)
+ * must be built with -I$(src) so that define_trace.h can find it.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM kdb
+
+#if !defined(_KDB_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _KDB_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(kdb_fault_enter,
+	TP_PROTO(const void *ctx, u64 pgoff, bool write),
+	TP_ARGS(ctx, pgoff, write),
+
+	TP_STRUCT__entry(
+		__field(const void *, ctx)
+		__field(u64, pgoff)
+		__field(bool, write)
+	),
+
+	TP_fast_assign(
+		__entry->ctx = ctx;
+		__entry->pgoff = pgoff;
+		__entry->write = write;
+	),
+
+	TP_printk("ctx=%p pgoff=%llu %s",
+		  __entry->ctx, __entry->pgoff,
+		  __entry->write ? "write" : "read")
+);
+
+TRACE_EVENT(kdb_fault_exit,
+	TP_PROTO(const void *ctx, u64 pgoff, bool major, unsigned int ret,
+		 u64 lat_ns),
+	TP_ARGS(ctx, pgoff, major, ret, lat_ns),
+
+	TP_STRUCT__entry(
+		__field(const void *, ctx)
+		__field(u64, pgoff)
+		__field(bool, major)
+		__field(unsigned int, ret)
+		__field(u64, lat_ns)
+	),
+
+	TP_fast_assign(
+		__entry->ctx = ctx;
+		__entry->pgoff = pgoff;
+		__entry->major = major;
+		__entry->ret = ret;
+		__entry->lat_ns = lat_ns;
+	),
+
+	TP_printk("ctx=%p pgoff=%llu %s ret=0x%x lat=%lluns",
+		  __entry->ctx, __entry->pgoff,
+		  __entry->major ? "major" : "minor",
+		  __entry->ret, __entry->lat_ns)
+);
+
+DECLARE_EVENT_CLASS(kdb_cp_class,
+	TP_PROTO(const void *ctx, u64 lpn, u32 cpi),
+	TP_ARGS(ctx, lpn, cpi),
+
+	TP_STRUCT__entry(
+		__field(const void *, ctx)
+		__field(u64, lpn)
+		__field(u32, cpi)
+	),
+
+	TP_fast_assign(
+		__entry->ctx = ctx;
+		__entry->lpn = lpn;
+		__entry->cpi = cpi;
+	),
+
+	TP_printk("ctx=%p lpn=%llu cpi=%u",
+		  __entry->ctx, __entry->lpn, __entry->cpi)
+);
+
+DEFINE_EVENT(kdb_cp_class, kdb_fill_start,
+	TP_PROTO(const void *ctx, u64 lpn, u32 cpi),
+	TP_ARGS(ctx, lpn, cpi)
+);
+
+TRACE_EVENT(kdb_fill_done,
+	TP_PROTO(const void *ctx, u64 lpn, u32 cpi, int err, u64 lat_ns),
+	TP_ARGS(ctx, lpn, cpi, err, lat_ns),
+
+	TP_STRUCT__entry(
+		__field(const void *, ctx)
+		__field(u64, lpn)
+		__field(u32, cpi)
+		__field(int, err)
+		__field(u64, lat_ns)
+	),
+
+	TP_fast_assign(
+		__entry->ctx = ctx;
+		__entry->lpn = lpn;
+		__entry->cpi = cpi;
+		__entry->err = err;
+		__entry->lat_ns = lat_ns;
+	),
+
+	TP_printk("ctx=%p lpn=%llu cpi=%u err=%d lat=%lluns",
+		  __entry->ctx, __entry->lpn, __entry->cpi,
+		  __entry->err, __entry->lat_ns)
+);
+
+TRACE_EVENT(kdb_mkwrite,
+	TP_PROTO(const void *ctx, u64 lpn, u32 cpi, u64 lat_ns),
+	TP_ARGS(ctx, lpn, cpi, lat_ns),
+
+	TP_STRUCT__entry(
+		__field(const void *, ctx)
+		__field(u64, lpn)
+		__field(u32, cpi)
+		__field(u64, lat_ns)
+	),
+
+	TP_fast_assign(
+		__entry->ctx = ctx;
+		__entry->lpn = lpn;
+		__entry->cpi = cpi;
+		__entry->lat_ns = lat_ns;
+	),
+
+	TP_printk("ctx=%p lpn=%llu cpi=%u lat=%lluns",
+		  __entry->ctx, __entry->lpn, __entry->cpi, __entry->lat_ns)
+);
+
+TRACE_EVENT(kdb_evict,
+	TP_PROTO(const void *ctx, u64 lpn, u32 nr_cp, const char *reason),
+	TP_ARGS(ctx, lpn, nr_cp, reason),
+
+	TP_STRUCT__entry(
+		__field(const void *, ctx)
+		__field(u64, lpn)
+		__field(u32, nr_cp)
+		__string(reason, reason)
+	),
+
+	TP_fast_assign(
+		__entry->ctx = ctx;
+		__entry->lpn = lpn;
+		__entry->nr_cp = nr_cp;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("ctx=%p lpn=%llu nr_cp=%u reason=%s",
+		  __entry->ctx, __entry->lpn, __entry->nr_cp,
+		  __get_str(reason))
+);
+
+#endif /* _KDB_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE kdb_trace
+#include <trace/define_trace.h>
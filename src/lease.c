@@ -0,0 +1,366 @@
+#include "lease.h"
+#include "lp_state.h"
+#include "cp_pool.h"
+#include "evict.h"
+#include "backing.h"
+#include "../include/uapi/kdb.h"
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/uaccess.h>
+
+#define KDB_BATCH_MAX 1024  /* Entries per KDB_BATCH call */
+#define KDB_FILL_RUN  16    /* CPs per backing read when filling a lease */
+
+struct kdb_lease {
+	struct vma_ctx *ctx;     /* Referenced */
+	struct lp_state *lp;     /* Referenced */
+	u32 mode;                /* KDB_MODE_* */
+};
+
+/* Waiters for a conflicting lease to go away */
+static DECLARE_WAIT_QUEUE_HEAD(kdb_lease_wq);
+
+static bool kdb_lease_compatible(struct lp_state *lp, u32 mode)
+{
+	if (mode == KDB_MODE_EXCL)
+		return !READ_ONCE(lp->lease_excl) && !READ_ONCE(lp->lease_shared);
+	return !READ_ONCE(lp->lease_excl);
+}
+
+static int kdb_lease_acquire(struct lp_state *lp, u32 mode, bool nowait)
+{
+	int ret;
+
+	for (;;) {
+		spin_lock(&lp->lock);
+		if (kdb_lease_compatible(lp, mode)) {
+			if (mode == KDB_MODE_EXCL)
+				lp->lease_excl = true;
+			else
+				lp->lease_shared++;
+			spin_unlock(&lp->lock);
+			return 0;
+		}
+		spin_unlock(&lp->lock);
+
+		if (nowait)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(kdb_lease_wq,
+					       kdb_lease_compatible(lp, mode));
+		if (ret)
+			return ret;
+	}
+}
+
+static void kdb_lease_release(struct lp_state *lp, u32 mode)
+{
+	spin_lock(&lp->lock);
+	if (mode == KDB_MODE_EXCL)
+		lp->lease_excl = false;
+	else
+		lp->lease_shared--;
+	spin_unlock(&lp->lock);
+
+	if (wq_has_sleeper(&kdb_lease_wq))
+		wake_up_all(&kdb_lease_wq);
+}
+
+/**
+ * kdb_lease_fill - Make every CP of a logical page resident
+ * @ctx: VMA context
+ * @lp: Logical page
+ * @nowait: Fail with -EAGAIN instead of filling
+ *
+ * Each run of missing CPs is read with one backing_fill() call, up to
+ * KDB_FILL_RUN pages at a time. CPs filled by a racing fault keep
+ * their page and the one read here is dropped.
+ */
+static int kdb_lease_fill(struct vma_ctx *ctx, struct lp_state *lp, bool nowait)
+{
+	struct page *pages[KDB_FILL_RUN];
+	u32 cpi = 0, start, n, i;
+	int ret = 0;
+
+	while (cpi < lp->cp_per_lp) {
+		while (cpi < lp->cp_per_lp && READ_ONCE(lp->cp[cpi]))
+			cpi++;
+		start = cpi;
+		while (cpi < lp->cp_per_lp && cpi - start < KDB_FILL_RUN &&
+		       !READ_ONCE(lp->cp[cpi]))
+			cpi++;
+		if (cpi == start)
+			break;
+		if (nowait)
+			return -EAGAIN;
+
+		for (n = 0; n < cpi - start; n++) {
+			pages[n] = evict_alloc_cp(ctx);
+			if (!pages[n]) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+
+		/* A page never read from the backing file must not be installed */
+		if (!ret)
+			ret = backing_fill(ctx, lp->lpn * ctx->cp_per_lp + start,
+					   pages, n);
+
+		spin_lock(&lp->lock);
+		for (i = 0; i < n && !ret; i++) {
+			if (lp->cp[start + i])
+				continue;
+			lp->cp[start + i] = pages[i];
+			lp->nr_resident++;
+			atomic64_inc(&ctx->resident_cp);
+			pages[i] = NULL;
+		}
+		spin_unlock(&lp->lock);
+
+		for (i = 0; i < n; i++)
+			if (pages[i])
+				cp_pool_free(pages[i]);
+
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void kdb_lease_drop(struct kdb_lease *lease)
+{
+	kdb_lease_release(lease->lp, lease->mode);
+	lp_put(lease->lp);
+	vma_ctx_put(lease->ctx);
+	kfree(lease);
+}
+
+struct kdb_file *kdb_file_alloc(void)
+{
+	struct kdb_file *kf;
+
+	kf = kzalloc(sizeof(*kf), GFP_KERNEL);
+	if (!kf)
+		return NULL;
+
+	/* Handle 0 means "no lease" */
+	xa_init_flags(&kf->leases, XA_FLAGS_ALLOC1);
+	return kf;
+}
+
+void kdb_file_release(struct kdb_file *kf)
+{
+	struct kdb_lease *lease;
+	unsigned long id;
+
+	if (!kf)
+		return;
+
+	xa_for_each(&kf->leases, id, lease) {
+		xa_erase(&kf->leases, id);
+		kdb_lease_drop(lease);
+	}
+	xa_destroy(&kf->leases);
+	kfree(kf);
+}
+
+int kdb_lease_get(struct kdb_file *kf, struct kdb_page_req *req)
+{
+	bool nowait = req->flags & KDB_REQ_NOWAIT;
+	struct kdb_lease *lease = NULL;
+	struct vma_ctx *ctx;
+	struct lp_state *lp;
+	u32 id;
+	int ret;
+
+	req->ptr = 0;
+	req->len = 0;
+	req->lease = 0;
+
+	if (req->mode != KDB_MODE_SHARED && req->mode != KDB_MODE_EXCL)
+		return -EINVAL;
+
+	/* file_id names a namespace mapped by the calling process */
+	ctx = kdb_ctx_find_ns(req->file_id, current->mm);
+	if (!ctx)
+		return -ENOENT;
+
+	if (req->page_no >= ctx->n_lpn) {
+		ret = -EINVAL;
+		goto out_ctx;
+	}
+
+	lp = nowait ? lp_lookup(ctx, req->page_no) :
+		      lp_get_or_create(ctx, req->page_no);
+	if (!lp) {
+		ret = nowait ? -EAGAIN : -ENOMEM;
+		goto out_ctx;
+	}
+
+	if (req->flags & KDB_REQ_PREFETCH) {
+		ret = kdb_lease_fill(ctx, lp, nowait);
+		WRITE_ONCE(lp->referenced, true);
+		goto out_lp;
+	}
+
+	lease = kzalloc(sizeof(*lease), GFP_KERNEL);
+	if (!lease) {
+		ret = -ENOMEM;
+		goto out_lp;
+	}
+
+	/* Pin first so that nothing we fill can be evicted under us */
+	ret = kdb_lease_acquire(lp, req->mode, nowait);
+	if (ret)
+		goto out_free;
+
+	ret = kdb_lease_fill(ctx, lp, nowait);
+	if (ret)
+		goto out_release;
+
+	spin_lock(&lp->lock);
+	lp->referenced = true;
+	if (lp->hits != U32_MAX)
+		lp->hits++;
+	req->gen = lp->gen;
+	req->page_lsn = lp->page_lsn;
+	spin_unlock(&lp->lock);
+
+	/* Nothing newer can be produced without a backing store */
+	if (req->want_lsn && req->page_lsn < req->want_lsn) {
+		ret = -ESTALE;
+		goto out_release;
+	}
+
+	lease->ctx = ctx;
+	lease->lp = lp;
+	lease->mode = req->mode;
+
+	ret = xa_alloc(&kf->leases, &id, lease, xa_limit_31b, GFP_KERNEL);
+	if (ret)
+		goto out_release;
+
+	req->lease = id;
+	req->ptr = ctx->user_base + req->page_no * ctx->lp_size;
+	req->len = ctx->lp_size;
+
+	/* The lease now owns the context and lp_state references */
+	return 0;
+
+out_release:
+	kdb_lease_release(lp, req->mode);
+out_free:
+	kfree(lease);
+out_lp:
+	lp_put(lp);
+out_ctx:
+	vma_ctx_put(ctx);
+	return ret;
+}
+
+int kdb_lease_mark_dirty(struct kdb_file *kf, struct kdb_lease_op *op)
+{
+	struct kdb_lease *lease;
+	struct lp_state *lp;
+	int ret = 0;
+
+	/* The xarray lock keeps a concurrent put from freeing the lease */
+	xa_lock(&kf->leases);
+	lease = xa_load(&kf->leases, op->lease);
+	if (!lease) {
+		ret = -ENOENT;
+	} else if (lease->mode != KDB_MODE_EXCL) {
+		ret = -EPERM;
+	} else {
+		lp = lease->lp;
+		spin_lock(&lp->lock);
+		bitmap_set(lp->dirty_bitmap, 0, lp->cp_per_lp);
+		if (op->lsn > lp->page_lsn)
+			lp->page_lsn = op->lsn;
+		spin_unlock(&lp->lock);
+	}
+	xa_unlock(&kf->leases);
+
+	return ret;
+}
+
+int kdb_lease_put(struct kdb_file *kf, struct kdb_lease_op *op)
+{
+	struct kdb_lease *lease;
+
+	lease = xa_erase(&kf->leases, op->lease);
+	if (!lease)
+		return -ENOENT;
+
+	kdb_lease_drop(lease);
+	return 0;
+}
+
+static int kdb_batch_get(struct kdb_file *kf, struct kdb_page_req __user *ureq,
+			 u32 nr)
+{
+	struct kdb_page_req req;
+	u32 i;
+
+	for (i = 0; i < nr; i++) {
+		if (copy_from_user(&req, &ureq[i], sizeof(req)))
+			return -EFAULT;
+
+		req.status = kdb_lease_get(kf, &req);
+		if (req.status == -ERESTARTSYS)
+			req.status = -EINTR;
+
+		if (copy_to_user(&ureq[i], &req, sizeof(req)))
+			return -EFAULT;
+
+		/* Stop at a signal, the remaining entries keep their status */
+		if (req.status == -EINTR)
+			return -EINTR;
+	}
+
+	return 0;
+}
+
+static int kdb_batch_lease_op(struct kdb_file *kf,
+			      struct kdb_lease_op __user *uop, u32 nr, u32 op)
+{
+	struct kdb_lease_op lop;
+	u32 i;
+
+	for (i = 0; i < nr; i++) {
+		if (copy_from_user(&lop, &uop[i], sizeof(lop)))
+			return -EFAULT;
+
+		if (op == KDB_BATCH_MARK_DIRTY)
+			lop.status = kdb_lease_mark_dirty(kf, &lop);
+		else
+			lop.status = kdb_lease_put(kf, &lop);
+
+		if (put_user(lop.status, &uop[i].status))
+			return -EFAULT;
+	}
+
+	return 0;
+}
+
+int kdb_lease_batch(struct kdb_file *kf, const struct kdb_batch *batch)
+{
+	void __user *entries = u64_to_user_ptr(batch->entries);
+
+	if (batch->nr > KDB_BATCH_MAX)
+		return -E2BIG;
+
+	switch (batch->op) {
+	case KDB_BATCH_GET_PAGE:
+		return kdb_batch_get(kf, entries, batch->nr);
+	case KDB_BATCH_MARK_DIRTY:
+	case KDB_BATCH_PUT_PAGE:
+		return kdb_batch_lease_op(kf, entries, batch->nr, batch->op);
+	default:
+		return -EINVAL;
+	}
+}
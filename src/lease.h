@@ -0,0 +1,69 @@
+#ifndef _KDB_LEASE_H
+#define _KDB_LEASE_H
+
+#include <linux/types.h>
+#include <linux/xarray.h>
+
+struct kdb_page_req;
+struct kdb_lease_op;
+struct kdb_batch;
+
+/*
+ * Lease API for clients that do not rely on faults
+ *
+ * A lease pins one logical page of a namespace: all of its CPs are made
+ * resident and cannot be evicted until the lease is put. Leases belong
+ * to the file descriptor they were taken on and are all dropped when it
+ * is closed.
+ */
+
+/* Per open file state */
+struct kdb_file {
+	struct xarray leases;    /* Lease handle -> struct kdb_lease */
+};
+
+/**
+ * kdb_file_alloc - Allocate per-file lease state
+ * Returns the new state or NULL on failure
+ */
+struct kdb_file *kdb_file_alloc(void);
+
+/**
+ * kdb_file_release - Drop every lease of a file and free its state
+ * @kf: Per-file state
+ */
+void kdb_file_release(struct kdb_file *kf);
+
+/**
+ * kdb_lease_get - get_page(file_id, page_no, mode, want_lsn)
+ * @kf: Per-file state
+ * @req: Request, completion fields are filled in
+ * Returns 0 or a negative errno, -EAGAIN on a miss or conflict with NOWAIT
+ */
+int kdb_lease_get(struct kdb_file *kf, struct kdb_page_req *req);
+
+/**
+ * kdb_lease_mark_dirty - mark_dirty(lease, lsn), needs an exclusive lease
+ * @kf: Per-file state
+ * @op: Lease and LSN
+ * Returns 0 or a negative errno
+ */
+int kdb_lease_mark_dirty(struct kdb_file *kf, struct kdb_lease_op *op);
+
+/**
+ * kdb_lease_put - put(lease)
+ * @kf: Per-file state
+ * @op: Lease to release
+ * Returns 0 or a negative errno
+ */
+int kdb_lease_put(struct kdb_file *kf, struct kdb_lease_op *op);
+
+/**
+ * kdb_lease_batch - Run an array of get/mark_dirty/put requests
+ * @kf: Per-file state
+ * @batch: Batch descriptor, per-entry status is written back
+ * Returns 0 or a negative errno if the batch itself could not be run
+ */
+int kdb_lease_batch(struct kdb_file *kf, const struct kdb_batch *batch);
+
+#endif /* _KDB_LEASE_H */
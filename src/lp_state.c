@@ -4,14 +4,17 @@
 #include <linux/hash.h>
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
-
-/* Access to cp_pool statistics */
-extern atomic64_t cp_allocated;
-extern atomic64_t cp_total_frees;
+#include <linux/mutex.h>
+#include <linux/file.h>
+#include "kdb_trace.h"
 
 static struct kmem_cache *lp_state_cache;
 static struct kmem_cache *vma_ctx_cache;
 
+/* Live VMA contexts, walked by the stats ioctls and by reclaim */
+LIST_HEAD(kdb_ctx_list);
+DEFINE_MUTEX(kdb_ctx_lock);
+
 #define LP_HASH_BITS 10
 #define LP_HASH_SIZE (1 << LP_HASH_BITS)
 
@@ -82,21 +85,41 @@ struct vma_ctx *vma_ctx_create(u64 cp_size, u64 lp_size, u64 n_lpn)
 		return NULL;
 	}
 	
+	/* Allocate latency histograms */
+	ctx->lat = alloc_percpu(struct kdb_lat_pcpu);
+	if (!ctx->lat) {
+		kfree(ctx->lp_hash);
+		kmem_cache_free(vma_ctx_cache, ctx);
+		return NULL;
+	}
+	
 	/* Initialize hash table */
 	for (i = 0; i < LP_HASH_SIZE; i++)
 		INIT_HLIST_HEAD(&ctx->lp_hash[i]);
 	
 	spin_lock_init(&ctx->hash_lock);
 	
+	refcount_set(&ctx->ref, 1);
+	atomic_set(&ctx->nr_vmas, 1);
+	
+	/* Namespace defaults: equal weight, no hard quota */
+	ctx->weight = KDB_NS_WEIGHT_DEFAULT;
+	INIT_LIST_HEAD(&ctx->lru);
+	spin_lock_init(&ctx->lru_lock);
+	
 	/* Initialize statistics */
 	atomic64_set(&ctx->total_faults, 0);
 	atomic64_set(&ctx->total_mkwrite, 0);
 	atomic64_set(&ctx->total_lp_created, 0);
 	
+	mutex_lock(&kdb_ctx_lock);
+	list_add_tail(&ctx->ctx_node, &kdb_ctx_list);
+	mutex_unlock(&kdb_ctx_lock);
+	
 	return ctx;
 }
 
-void vma_ctx_destroy(struct vma_ctx *ctx)
+static void vma_ctx_destroy(struct vma_ctx *ctx)
 {
 	struct lp_state *lp;
 	struct hlist_node *tmp;
@@ -105,6 +128,10 @@ void vma_ctx_destroy(struct vma_ctx *ctx)
 	if (!ctx)
 		return;
 	
+	mutex_lock(&kdb_ctx_lock);
+	list_del(&ctx->ctx_node);
+	mutex_unlock(&kdb_ctx_lock);
+	
 	/* Free all logical page states */
 	spin_lock(&ctx->hash_lock);
 	for (i = 0; i < LP_HASH_SIZE; i++) {
@@ -117,14 +144,17 @@ void vma_ctx_destroy(struct vma_ctx *ctx)
 			 * when their reference count reaches zero. We just clear our 
 			 * pointers to avoid use-after-free. */
 			if (lp->cp) {
+				u32 nr_cp = 0;
 				int j;
 				for (j = 0; j < ctx->cp_per_lp; j++) {
 					if (lp->cp[j]) {
-						/* Update statistics to reflect that we're no longer tracking this page */
-						atomic64_dec(&cp_allocated);
-						atomic64_inc(&cp_total_frees);
+						/* Drop the cache reference; mapped copies go away with the PTEs */
+						cp_pool_free(lp->cp[j]);
+						nr_cp++;
 					}
 				}
+				if (nr_cp)
+					trace_kdb_evict(ctx, lp->lpn, nr_cp, "unmap");
 				kfree(lp->cp);
 			}
 			
@@ -137,13 +167,148 @@ void vma_ctx_destroy(struct vma_ctx *ctx)
 	}
 	spin_unlock(&ctx->hash_lock);
 	
+	if (ctx->backing)
+		fput(ctx->backing);
+	
 	/* Free hash table */
 	kfree(ctx->lp_hash);
+	free_percpu(ctx->lat);
 	
 	/* Free context */
 	kmem_cache_free(vma_ctx_cache, ctx);
 }
 
+void vma_ctx_stats(struct vma_ctx *ctx, struct kdb_stats *stats)
+{
+	struct lp_state *lp;
+	int i;
+	
+	stats->total_faults += atomic64_read(&ctx->total_faults);
+	stats->total_mkwrite += atomic64_read(&ctx->total_mkwrite);
+	stats->total_lp_created += atomic64_read(&ctx->total_lp_created);
+	
+	spin_lock(&ctx->hash_lock);
+	for (i = 0; i < LP_HASH_SIZE; i++) {
+		hlist_for_each_entry(lp, &ctx->lp_hash[i], hash_node) {
+			stats->allocated_lp++;
+			stats->dirty_pages += bitmap_weight(lp->dirty_bitmap,
+							    lp->cp_per_lp);
+		}
+	}
+	spin_unlock(&ctx->hash_lock);
+}
+
+void vma_ctx_lat_hist(struct vma_ctx *ctx, struct kdb_lat_hist *hist)
+{
+	int cpu, t, b;
+	
+	for_each_possible_cpu(cpu) {
+		struct kdb_lat_pcpu *lat = per_cpu_ptr(ctx->lat, cpu);
+		
+		for (t = 0; t < KDB_LAT_NR; t++)
+			for (b = 0; b < KDB_LAT_BUCKETS; b++)
+				hist->hist[t][b] += READ_ONCE(lat->hist[t][b]);
+	}
+	hist->nr_maps++;
+}
+
+void vma_ctx_reset_stats(struct vma_ctx *ctx)
+{
+	int cpu;
+	
+	atomic64_set(&ctx->total_faults, 0);
+	atomic64_set(&ctx->total_mkwrite, 0);
+	atomic64_set(&ctx->total_lp_created, 0);
+	atomic64_set(&ctx->evicted_cp, 0);
+	
+	/* Racy against concurrent faults; a few samples may survive */
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(ctx->lat, cpu), 0, sizeof(struct kdb_lat_pcpu));
+}
+
+u32 vma_ctx_hot_set(struct vma_ctx *ctx, struct kdb_hot_entry *out, u32 max)
+{
+	struct lp_state *lp;
+	u32 nr = 0;
+	int i;
+	
+	spin_lock(&ctx->hash_lock);
+	for (i = 0; i < LP_HASH_SIZE; i++) {
+		hlist_for_each_entry(lp, &ctx->lp_hash[i], hash_node) {
+			u32 nr_cp = READ_ONCE(lp->nr_resident);
+			
+			if (!nr_cp)
+				continue;
+			if (nr < max) {
+				out[nr].lpn = lp->lpn;
+				out[nr].hits = READ_ONCE(lp->hits);
+				out[nr].nr_cp = nr_cp;
+			}
+			nr++;
+		}
+	}
+	spin_unlock(&ctx->hash_lock);
+	
+	return nr;
+}
+
+int kdb_ctx_for_each(int (*fn)(struct vma_ctx *ctx, void *arg), void *arg)
+{
+	struct vma_ctx *ctx;
+	int ret = 0;
+	
+	mutex_lock(&kdb_ctx_lock);
+	list_for_each_entry(ctx, &kdb_ctx_list, ctx_node) {
+		ret = fn(ctx, arg);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&kdb_ctx_lock);
+	
+	return ret;
+}
+
+void vma_ctx_put(struct vma_ctx *ctx)
+{
+	if (ctx && refcount_dec_and_test(&ctx->ref))
+		vma_ctx_destroy(ctx);
+}
+
+void vma_ctx_vma_open(struct vma_ctx *ctx)
+{
+	atomic_inc(&ctx->nr_vmas);
+	vma_ctx_get(ctx);
+}
+
+void vma_ctx_vma_close(struct vma_ctx *ctx)
+{
+	if (atomic_dec_and_test(&ctx->nr_vmas)) {
+		mutex_lock(&kdb_ctx_lock);
+		ctx->dead = true;
+		mutex_unlock(&kdb_ctx_lock);
+	}
+	
+	vma_ctx_put(ctx);
+}
+
+struct vma_ctx *kdb_ctx_find_ns(u64 ns_id, struct mm_struct *mm)
+{
+	struct vma_ctx *ctx;
+	
+	mutex_lock(&kdb_ctx_lock);
+	list_for_each_entry(ctx, &kdb_ctx_list, ctx_node) {
+		if (!ctx->dead && (!mm || ctx->mm == mm) &&
+		    READ_ONCE(ctx->ns_id) == ns_id) {
+			vma_ctx_get(ctx);
+			mutex_unlock(&kdb_ctx_lock);
+			return ctx;
+		}
+	}
+	mutex_unlock(&kdb_ctx_lock);
+	
+	return NULL;
+}
+
 static u32 lp_hash_fn(u64 lpn, u32 bits)
 {
 	return hash_64(lpn, bits);
@@ -182,7 +347,8 @@ struct lp_state *lp_get_or_create(struct vma_ctx *ctx, u64 lpn)
 	spin_lock_init(&lp->lock);
 	lp->lpn = lpn;
 	lp->cp_per_lp = ctx->cp_per_lp;
-	atomic_set(&lp->refcount, 1);
+	atomic_set(&lp->refcount, 2);  /* Hash table + caller */
+	INIT_LIST_HEAD(&lp->lru_node);
 	
 	/* Allocate canonical page array */
 	lp->cp = kcalloc(ctx->cp_per_lp, sizeof(struct page *), GFP_KERNEL);
@@ -222,6 +388,10 @@ struct lp_state *lp_get_or_create(struct vma_ctx *ctx, u64 lpn)
 	hlist_add_head(&lp->hash_node, head);
 	spin_unlock(&ctx->hash_lock);
 	
+	spin_lock(&ctx->lru_lock);
+	list_add_tail(&lp->lru_node, &ctx->lru);
+	spin_unlock(&ctx->lru_lock);
+	
 	atomic64_inc(&ctx->total_lp_created);
 	
 	return lp;
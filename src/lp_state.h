@@ -4,9 +4,18 @@
 #include <linux/types.h>
 #include <linux/spinlock.h>
 #include <linux/bitmap.h>
+#include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/refcount.h>
+#include "../include/uapi/kdb.h"
 
 struct page;
 struct vma_ctx;
+struct address_space;
+struct mm_struct;
+struct file;
 
 /* Default configuration - can be overridden by ioctl */
 #define LP_CP_MAX 1024  /* Max canonical pages per logical page */
@@ -22,6 +31,24 @@ struct lp_state {
 	unsigned long *dirty_bitmap;       /* Dirty bitmap for canonical pages */
 	atomic_t refcount;                 /* Reference count */
 	struct hlist_node hash_node;       /* Hash table linkage */
+	
+	/* Reclaim state, protected by lock except lru_node */
+	struct list_head lru_node;         /* Context LRU (ctx->lru_lock) */
+	u32 nr_resident;                   /* Resident canonical pages */
+	bool referenced;                   /* Second chance for the clock */
+	
+	/* Lease state, protected by lock */
+	u32 lease_shared;                  /* Shared lease holders */
+	bool lease_excl;                   /* Exclusive lease held */
+	u64 gen;                           /* Bumped when a CP is evicted */
+	u64 page_lsn;                      /* Highest LSN from mark_dirty */
+	
+	u32 hits;                          /* Hotness: faults and leases, saturating */
+};
+
+/* Per-CPU fault latency histograms, indexed by KDB_LAT_* */
+struct kdb_lat_pcpu {
+	u64 hist[KDB_LAT_NR][KDB_LAT_BUCKETS];
 };
 
 /* VMA context */
@@ -40,8 +67,51 @@ struct vma_ctx {
 	atomic64_t total_faults;
 	atomic64_t total_mkwrite;
 	atomic64_t total_lp_created;
+	struct kdb_lat_pcpu __percpu *lat;  /* Fault latency histograms */
+	
+	/* Namespace quota and reclaim state */
+	u64 ns_id;                         /* Namespace (tablespace) id */
+	u32 weight;                        /* Share of the cache */
+	u64 max_cp;                        /* Hard quota in CPs, 0 = none */
+	atomic64_t resident_cp;            /* CPs currently resident */
+	atomic64_t evicted_cp;             /* CPs reclaimed from this context */
+	struct list_head lru;              /* lp_states in clock order */
+	spinlock_t lru_lock;               /* Protects lru */
+	struct address_space *mapping;     /* For zapping evicted CPs */
+	bool reclaim_skip;                 /* Nothing reclaimable (kdb_ctx_lock) */
+	
+	/* Lease API: leases hold a reference after the mapping is gone */
+	refcount_t ref;
+	atomic_t nr_vmas;                  /* VMAs sharing the context */
+	bool dead;                         /* Mapping closed (kdb_ctx_lock) */
+	struct mm_struct *mm;              /* Owning mm, compared only */
+	unsigned long user_base;           /* User address of file offset 0 */
+	
+	struct file *backing;              /* Fill source, NULL to zero-fill */
+	loff_t backing_off;                /* File offset of logical page 0 */
+	
+	struct list_head ctx_node;         /* Registry of live contexts */
 };
 
+/* Registry of live contexts, see kdb_ctx_for_each() */
+extern struct list_head kdb_ctx_list;
+extern struct mutex kdb_ctx_lock;
+
+/**
+ * vma_ctx_lat_record - Account one latency sample
+ * @ctx: VMA context
+ * @type: KDB_LAT_* histogram
+ * @ns: Latency in nanoseconds
+ *
+ * Lock free, safe to call from the fault path.
+ */
+static inline void vma_ctx_lat_record(struct vma_ctx *ctx, int type, u64 ns)
+{
+	u32 bucket = ns ? min_t(u32, ilog2(ns), KDB_LAT_BUCKETS - 1) : 0;
+	
+	this_cpu_inc(ctx->lat->hist[type][bucket]);
+}
+
 /**
  * lp_state_init - Initialize LP state subsystem
  * Returns 0 on success, negative error code on failure
@@ -63,10 +133,82 @@ void lp_state_exit(void);
 struct vma_ctx *vma_ctx_create(u64 cp_size, u64 lp_size, u64 n_lpn);
 
 /**
- * vma_ctx_destroy - Destroy a VMA context
- * @ctx: Context to destroy
+ * vma_ctx_get - Take a reference on a VMA context
+ * @ctx: Context
+ */
+static inline void vma_ctx_get(struct vma_ctx *ctx)
+{
+	refcount_inc(&ctx->ref);
+}
+
+/**
+ * vma_ctx_put - Drop a reference, destroying the context on the last one
+ * @ctx: Context
+ */
+void vma_ctx_put(struct vma_ctx *ctx);
+
+/**
+ * vma_ctx_vma_open - A VMA was duplicated or split off (fork, mprotect)
+ * @ctx: Context
+ */
+void vma_ctx_vma_open(struct vma_ctx *ctx);
+
+/**
+ * vma_ctx_vma_close - A VMA using the context went away
+ * @ctx: Context
+ *
+ * Drops the VMA's reference. When the last VMA goes away the context is
+ * hidden from namespace lookups; outstanding leases keep it alive until
+ * they are put.
+ */
+void vma_ctx_vma_close(struct vma_ctx *ctx);
+
+/**
+ * kdb_ctx_find_ns - Find the live mapping of a namespace in an mm
+ * @ns_id: Namespace id set with KDB_SET_NS
+ * @mm: Address space the mapping must belong to, NULL for any
+ * Returns a referenced context or NULL
+ */
+struct vma_ctx *kdb_ctx_find_ns(u64 ns_id, struct mm_struct *mm);
+
+/**
+ * vma_ctx_stats - Add a context's counters to @stats
+ * @ctx: VMA context
+ * @stats: Accumulator (not zeroed)
+ */
+void vma_ctx_stats(struct vma_ctx *ctx, struct kdb_stats *stats);
+
+/**
+ * vma_ctx_lat_hist - Add a context's latency histograms to @hist
+ * @ctx: VMA context
+ * @hist: Accumulator (not zeroed)
+ */
+void vma_ctx_lat_hist(struct vma_ctx *ctx, struct kdb_lat_hist *hist);
+
+/**
+ * vma_ctx_reset_stats - Clear a context's counters and histograms
+ * @ctx: VMA context
+ */
+void vma_ctx_reset_stats(struct vma_ctx *ctx);
+
+/**
+ * vma_ctx_hot_set - Collect the resident logical pages of a context
+ * @ctx: VMA context
+ * @out: Output array, unsorted
+ * @max: Capacity of @out
+ * Returns the number of resident logical pages, which may exceed @max
+ */
+u32 vma_ctx_hot_set(struct vma_ctx *ctx, struct kdb_hot_entry *out, u32 max);
+
+/**
+ * kdb_ctx_for_each - Call @fn for every live VMA context
+ * @fn: Callback, a non-zero return stops the walk
+ * @arg: Opaque argument passed to @fn
+ * Returns the last value returned by @fn
+ *
+ * Contexts cannot be destroyed while the walk is in progress.
  */
-void vma_ctx_destroy(struct vma_ctx *ctx);
+int kdb_ctx_for_each(int (*fn)(struct vma_ctx *ctx, void *arg), void *arg);
 
 /**
  * lp_get_or_create - Get or create logical page state
@@ -1,7 +1,14 @@
 #include "lp_state.h"
 #include "cp_pool.h"
+#include "evict.h"
+#include "backing.h"
 #include <linux/mm.h>
+#include <linux/pagemap.h>
 #include <linux/highmem.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include "kdb_trace.h"
 
 /**
  * kdb_fault - Handle page faults for KDB mappings
@@ -10,69 +17,135 @@
  * This function handles page faults by:
  * 1. Decoding the LPN and CP index from the page offset
  * 2. Getting or creating the logical page state
- * 3. Allocating a canonical page if needed (zero-filled)
+ * 3. Allocating a canonical page if needed (zero-filled, or read from
+ *    the backing file)
  * 4. Installing the page in the VMA
+ *
+ * Faults that find the CP resident are accounted as minor, faults that
+ * have to fill a new CP as major.
  */
 static vm_fault_t kdb_fault(struct vm_fault *vmf)
 {
 	struct vma_ctx *ctx = vmf->vma->vm_private_data;
 	u64 pgoff = vmf->pgoff;               /* 4K page index */
-	u64 lpn = pgoff / ctx->cp_per_lp;     /* Logical page number */
-	u32 cpi = pgoff % ctx->cp_per_lp;     /* Canonical page index */
+	u64 start_ns = ktime_get_ns();
+	u64 fill_ns, lat_ns;
+	u64 lpn;                              /* Logical page number */
+	u32 cpi;                              /* Canonical page index */
 	struct lp_state *lp;
-	struct page *pg;
+	struct page *pg, *new_pg = NULL;
+	bool major = false;
 	vm_fault_t ret = VM_FAULT_LOCKED;
+	int err;
 	
 	if (!ctx) {
 		pr_err("kdb: fault with NULL vma context\n");
 		return VM_FAULT_SIGBUS;
 	}
 	
+	lpn = pgoff / ctx->cp_per_lp;
+	cpi = pgoff % ctx->cp_per_lp;
+	
+	trace_kdb_fault_enter(ctx, pgoff, vmf->flags & FAULT_FLAG_WRITE);
+	
 	/* Validate bounds */
 	if (lpn >= ctx->n_lpn) {
 		pr_err("kdb: fault beyond allocated range: lpn=%llu, max=%llu\n", 
 		       lpn, ctx->n_lpn);
-		return VM_FAULT_SIGBUS;
+		ret = VM_FAULT_SIGBUS;
+		goto out;
 	}
 	
 	/* Get or create logical page state */
 	lp = lp_get_or_create(ctx, lpn);
 	if (!lp) {
 		pr_err("kdb: failed to get/create lp_state for lpn=%llu\n", lpn);
-		return VM_FAULT_OOM;
+		ret = VM_FAULT_OOM;
+		goto out;
 	}
 	
-	/* Lock the logical page */
+retry:
 	spin_lock(&lp->lock);
 	
 	/* Check if we already have this canonical page */
 	pg = lp->cp[cpi];
 	if (!pg) {
-		/* Allocate and zero-fill a new canonical page */
-		pg = cp_pool_alloc();
-		if (!pg) {
-			spin_unlock(&lp->lock);
+		/* Allocation may reclaim, so it runs without the LP lock */
+		spin_unlock(&lp->lock);
+		
+		/* Allocate a new canonical page, read from the backing file if any */
+		trace_kdb_fill_start(ctx, lpn, cpi);
+		fill_ns = ktime_get_ns();
+		new_pg = evict_alloc_cp(ctx);
+		err = new_pg ? backing_fill(ctx, pgoff, &new_pg, 1) : -ENOMEM;
+		trace_kdb_fill_done(ctx, lpn, cpi, err, ktime_get_ns() - fill_ns);
+		if (!new_pg) {
 			lp_put(lp);
 			pr_err("kdb: failed to allocate canonical page\n");
-			return VM_FAULT_OOM;
+			ret = VM_FAULT_OOM;
+			goto out;
+		}
+		if (err) {
+			cp_pool_free(new_pg);
+			lp_put(lp);
+			pr_err_ratelimited("kdb: backing read failed for lpn=%llu: %d\n",
+					   lpn, err);
+			ret = VM_FAULT_SIGBUS;
+			goto out;
 		}
 		
-		/* Store in the logical page state */
-		lp->cp[cpi] = pg;
-		
-		pr_debug("kdb: allocated CP for lpn=%llu, cpi=%u\n", lpn, cpi);
+		/* Another fault may have filled the CP meanwhile, then use its page */
+		spin_lock(&lp->lock);
+		pg = lp->cp[cpi];
+		if (!pg) {
+			/* Store in the logical page state */
+			pg = new_pg;
+			new_pg = NULL;
+			lp->cp[cpi] = pg;
+			lp->nr_resident++;
+			atomic64_inc(&ctx->resident_cp);
+			major = true;
+			
+			pr_debug("kdb: allocated CP for lpn=%llu, cpi=%u\n", lpn, cpi);
+		}
 	}
 	
 	/* Take a reference for the VMA - the kernel will drop this when the VMA is unmapped */
 	get_page(pg);
+	lp->referenced = true;
+	if (lp->hits != U32_MAX)
+		lp->hits++;
+	spin_unlock(&lp->lock);
+	
+	if (new_pg) {
+		cp_pool_free(new_pg);
+		new_pg = NULL;
+	}
+	
+	/*
+	 * Return the page locked as VM_FAULT_LOCKED requires. Eviction takes
+	 * the page lock too, so recheck that the CP was not dropped meanwhile.
+	 */
+	lock_page(pg);
+	if (READ_ONCE(lp->cp[cpi]) != pg) {
+		unlock_page(pg);
+		put_page(pg);
+		goto retry;
+	}
 	vmf->page = pg;
 	
-	spin_unlock(&lp->lock);
 	lp_put(lp);
 	
 	/* Update statistics */
 	atomic64_inc(&ctx->total_faults);
 	
+out:
+	lat_ns = ktime_get_ns() - start_ns;
+	if (!(ret & VM_FAULT_ERROR))
+		vma_ctx_lat_record(ctx, major ? KDB_LAT_MAJOR_FAULT :
+				   KDB_LAT_MINOR_FAULT, lat_ns);
+	trace_kdb_fault_exit(ctx, pgoff, major, ret, lat_ns);
+	
 	return ret;
 }
 
@@ -87,8 +160,10 @@ static vm_fault_t kdb_page_mkwrite(struct vm_fault *vmf)
 {
 	struct vma_ctx *ctx = vmf->vma->vm_private_data;
 	u64 pgoff = vmf->pgoff;
-	u64 lpn = pgoff / ctx->cp_per_lp;
-	u32 cpi = pgoff % ctx->cp_per_lp;
+	u64 start_ns = ktime_get_ns();
+	u64 lat_ns;
+	u64 lpn;
+	u32 cpi;
 	struct lp_state *lp;
 	
 	if (!ctx) {
@@ -96,6 +171,9 @@ static vm_fault_t kdb_page_mkwrite(struct vm_fault *vmf)
 		return VM_FAULT_SIGBUS;
 	}
 	
+	lpn = pgoff / ctx->cp_per_lp;
+	cpi = pgoff % ctx->cp_per_lp;
+	
 	/* Validate bounds */
 	if (lpn >= ctx->n_lpn) {
 		pr_err("kdb: mkwrite beyond allocated range: lpn=%llu, max=%llu\n", 
@@ -110,8 +188,18 @@ static vm_fault_t kdb_page_mkwrite(struct vm_fault *vmf)
 		return VM_FAULT_SIGBUS;
 	}
 	
-	/* Mark the canonical page as dirty */
+	/*
+	 * Mark the canonical page as dirty. The page lock keeps eviction
+	 * away; if the CP was evicted since the PTE was read, refault.
+	 */
+	lock_page(vmf->page);
 	spin_lock(&lp->lock);
+	if (lp->cp[cpi] != vmf->page) {
+		spin_unlock(&lp->lock);
+		unlock_page(vmf->page);
+		lp_put(lp);
+		return VM_FAULT_NOPAGE;
+	}
 	set_bit(cpi, lp->dirty_bitmap);
 	spin_unlock(&lp->lock);
 	
@@ -120,6 +208,10 @@ static vm_fault_t kdb_page_mkwrite(struct vm_fault *vmf)
 	/* Update statistics */
 	atomic64_inc(&ctx->total_mkwrite);
 	
+	lat_ns = ktime_get_ns() - start_ns;
+	vma_ctx_lat_record(ctx, KDB_LAT_MKWRITE, lat_ns);
+	trace_kdb_mkwrite(ctx, lpn, cpi, lat_ns);
+	
 	pr_debug("kdb: marked dirty: lpn=%llu, cpi=%u\n", lpn, cpi);
 	
 	return VM_FAULT_LOCKED;
@@ -134,6 +226,10 @@ static void kdb_vma_open(struct vm_area_struct *vma)
 	struct vma_ctx *ctx = vma->vm_private_data;
 	
 	pr_debug("kdb: VMA opened: %px\n", ctx);
+	
+	/* The new VMA shares the context */
+	if (ctx)
+		vma_ctx_vma_open(ctx);
 }
 
 /**
@@ -145,8 +241,8 @@ static void kdb_vma_close(struct vm_area_struct *vma)
 	struct vma_ctx *ctx = vma->vm_private_data;
 	
 	if (ctx) {
-		pr_debug("kdb: VMA closed, destroying context: %px\n", ctx);
-		vma_ctx_destroy(ctx);
+		pr_debug("kdb: VMA closed, releasing context: %px\n", ctx);
+		vma_ctx_vma_close(ctx);
 		vma->vm_private_data = NULL;
 	}
 }
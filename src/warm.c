@@ -0,0 +1,347 @@
+#include "warm.h"
+#include "lp_state.h"
+#include "cp_pool.h"
+#include "evict.h"
+#include "backing.h"
+#include "../include/uapi/kdb.h"
+#include <linux/workqueue.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/sort.h>
+#include <linux/sched.h>
+#include <linux/sched/mm.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+#define WARM_WINDOW   64   /* Hot entries reordered by LPN at a time */
+#define WARM_RUN_MAX  256  /* CPs per backing read (1MB with 4K CPs) */
+
+/* A hot set being prefetched or waiting for its namespace */
+struct warm_set {
+	struct list_head node;        /* warm_pending (warm_lock) */
+	u64 ns_id;
+	struct mm_struct *mm;         /* Grabbed, the process it was handed by */
+	u32 nr;
+	struct kdb_hot_entry *entries;
+	struct vma_ctx *ctx;          /* Referenced once started */
+	struct work_struct work;
+};
+
+static struct workqueue_struct *kdb_warm_wq;
+static LIST_HEAD(warm_pending);
+static DEFINE_MUTEX(warm_lock);
+
+/* Hottest first, ties in LPN order */
+static int warm_cmp_hits(const void *a, const void *b)
+{
+	const struct kdb_hot_entry *x = a, *y = b;
+	
+	if (x->hits != y->hits)
+		return x->hits > y->hits ? -1 : 1;
+	if (x->lpn != y->lpn)
+		return x->lpn < y->lpn ? -1 : 1;
+	return 0;
+}
+
+static int warm_cmp_lpn(const void *a, const void *b)
+{
+	const struct kdb_hot_entry *x = a, *y = b;
+	
+	if (x->lpn != y->lpn)
+		return x->lpn < y->lpn ? -1 : 1;
+	return 0;
+}
+
+static void warm_set_free(struct warm_set *ws)
+{
+	if (!ws)
+		return;
+	if (ws->ctx)
+		vma_ctx_put(ws->ctx);
+	if (ws->mm)
+		mmdrop(ws->mm);
+	kvfree(ws->entries);
+	kfree(ws);
+}
+
+/**
+ * warm_lp - Make one logical page resident
+ * @ctx: VMA context
+ * @e: Hot set entry
+ * @pages: Scratch array of WARM_RUN_MAX pages
+ * @filled: Incremented by the number of CPs installed
+ *
+ * Each run of missing CPs is read with one backing_fill() call. CPs that
+ * a concurrent fault filled first are kept and our copy is dropped.
+ * Returns 0, -ENOSPC when the namespace or the cache is full, or an errno
+ */
+static int warm_lp(struct vma_ctx *ctx, const struct kdb_hot_entry *e,
+		   struct page **pages, u64 *filled)
+{
+	struct lp_state *lp;
+	u32 cpi = 0, start, want, n, i;
+	int fill, ret = 0;
+	
+	if (e->lpn >= ctx->n_lpn)
+		return 0;
+	
+	lp = lp_get_or_create(ctx, e->lpn);
+	if (!lp)
+		return -ENOMEM;
+	
+	/* Carry the saved rank over so the next export keeps it */
+	spin_lock(&lp->lock);
+	lp->hits = max(lp->hits, e->hits);
+	spin_unlock(&lp->lock);
+	
+	while (cpi < lp->cp_per_lp) {
+		while (cpi < lp->cp_per_lp && READ_ONCE(lp->cp[cpi]))
+			cpi++;
+		start = cpi;
+		while (cpi < lp->cp_per_lp && cpi - start < WARM_RUN_MAX &&
+		       !READ_ONCE(lp->cp[cpi]))
+			cpi++;
+		want = cpi - start;
+		if (!want)
+			break;
+		
+		for (n = 0; n < want; n++) {
+			if (!evict_has_room(ctx)) {
+				ret = -ENOSPC;
+				break;
+			}
+			pages[n] = cp_pool_alloc();
+			if (!pages[n]) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+		
+		fill = n ? backing_fill(ctx, e->lpn * ctx->cp_per_lp + start,
+					pages, n) : 0;
+		if (fill)
+			ret = fill;
+		
+		/* Install what was read even if the run was cut short */
+		spin_lock(&lp->lock);
+		for (i = 0; i < n && !fill; i++) {
+			if (lp->cp[start + i])
+				continue;
+			lp->cp[start + i] = pages[i];
+			lp->nr_resident++;
+			atomic64_inc(&ctx->resident_cp);
+			pages[i] = NULL;
+			(*filled)++;
+		}
+		spin_unlock(&lp->lock);
+		
+		for (i = 0; i < n; i++)
+			if (pages[i])
+				cp_pool_free(pages[i]);
+		
+		if (ret)
+			break;
+	}
+	
+	lp_put(lp);
+	return ret;
+}
+
+static void warm_work_fn(struct work_struct *work)
+{
+	struct warm_set *ws = container_of(work, struct warm_set, work);
+	struct vma_ctx *ctx = ws->ctx;
+	u64 start_ns = ktime_get_ns();
+	u64 filled = 0;
+	struct page **pages;
+	u32 i, n, j;
+	int ret = 0;
+	
+	pages = kmalloc_array(WARM_RUN_MAX, sizeof(*pages), GFP_KERNEL);
+	if (!pages) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	
+	/*
+	 * Windows keep the overall hotness order while sorting each one by
+	 * LPN, so that neighbouring logical pages turn into sequential reads.
+	 */
+	for (i = 0; i < ws->nr && !ret; i += n) {
+		n = min_t(u32, WARM_WINDOW, ws->nr - i);
+		sort(&ws->entries[i], n, sizeof(*ws->entries), warm_cmp_lpn, NULL);
+		
+		for (j = 0; j < n && !ret; j++) {
+			/* Stop once the mapping is gone */
+			if (READ_ONCE(ctx->dead)) {
+				ret = -ENODEV;
+				break;
+			}
+			ret = warm_lp(ctx, &ws->entries[i + j], pages, &filled);
+		}
+		cond_resched();
+	}
+	
+	kfree(pages);
+out:
+	pr_info("kdb: warmed ns %llu: %llu CPs from %u LPs in %llu ms (%d)\n",
+		ws->ns_id, filled, ws->nr,
+		div_u64(ktime_get_ns() - start_ns, NSEC_PER_MSEC), ret);
+	warm_set_free(ws);
+}
+
+static void warm_start(struct warm_set *ws, struct vma_ctx *ctx)
+{
+	ws->ctx = ctx;
+	queue_work(kdb_warm_wq, &ws->work);
+}
+
+static struct warm_set *warm_find_pending(u64 ns_id, struct mm_struct *mm)
+{
+	struct warm_set *ws;
+	
+	list_for_each_entry(ws, &warm_pending, node)
+		if (ws->ns_id == ns_id && ws->mm == mm)
+			return ws;
+	return NULL;
+}
+
+int warm_get_hotset(void __user *uarg)
+{
+	struct kdb_hotset __user *uhs = uarg;
+	struct kdb_hot_entry *entries;
+	struct kdb_hotset hs;
+	struct vma_ctx *ctx;
+	u32 nr, cap;
+	int ret = 0;
+	
+	if (copy_from_user(&hs, uhs, sizeof(hs)))
+		return -EFAULT;
+	if (hs.flags)
+		return -EINVAL;
+	
+	/* ns_id names a namespace mapped by the calling process */
+	ctx = kdb_ctx_find_ns(hs.ns_id, current->mm);
+	if (!ctx)
+		return -ENOENT;
+	
+	/* Size query */
+	nr = vma_ctx_hot_set(ctx, NULL, 0);
+	if (!hs.nr) {
+		vma_ctx_put(ctx);
+		return put_user(nr, &uhs->nr);
+	}
+	
+	/* Leave room for logical pages faulted in meanwhile */
+	cap = min_t(u64, nr + WARM_WINDOW, ctx->n_lpn);
+	entries = kvmalloc_array(cap, sizeof(*entries), GFP_KERNEL);
+	if (!entries) {
+		vma_ctx_put(ctx);
+		return -ENOMEM;
+	}
+	nr = min(vma_ctx_hot_set(ctx, entries, cap), cap);
+	vma_ctx_put(ctx);
+	
+	sort(entries, nr, sizeof(*entries), warm_cmp_hits, NULL);
+	
+	/* A short buffer gets the hottest entries */
+	nr = min(nr, hs.nr);
+	if (copy_to_user(u64_to_user_ptr(hs.entries), entries,
+			 (size_t)nr * sizeof(*entries)) ||
+	    put_user(nr, &uhs->nr))
+		ret = -EFAULT;
+	
+	kvfree(entries);
+	return ret;
+}
+
+int warm_prefetch(void __user *uarg)
+{
+	struct warm_set *ws, *old;
+	struct kdb_hotset hs;
+	struct vma_ctx *ctx;
+	
+	if (copy_from_user(&hs, uarg, sizeof(hs)))
+		return -EFAULT;
+	if (hs.flags)
+		return -EINVAL;
+	if (hs.nr > KDB_HOTSET_MAX)
+		return -E2BIG;
+	
+	ws = NULL;
+	if (hs.nr) {
+		ws = kzalloc(sizeof(*ws), GFP_KERNEL);
+		if (!ws)
+			return -ENOMEM;
+		ws->ns_id = hs.ns_id;
+		ws->mm = current->mm;
+		mmgrab(ws->mm);
+		ws->nr = hs.nr;
+		INIT_WORK(&ws->work, warm_work_fn);
+		
+		ws->entries = kvmalloc_array(hs.nr, sizeof(*ws->entries),
+					     GFP_KERNEL);
+		if (!ws->entries) {
+			warm_set_free(ws);
+			return -ENOMEM;
+		}
+		if (copy_from_user(ws->entries, u64_to_user_ptr(hs.entries),
+				   (size_t)hs.nr * sizeof(*ws->entries))) {
+			warm_set_free(ws);
+			return -EFAULT;
+		}
+	}
+	
+	/* warm_lock orders us against warm_attach() from KDB_SET_NS */
+	mutex_lock(&warm_lock);
+	old = warm_find_pending(hs.ns_id, current->mm);
+	if (old)
+		list_del(&old->node);
+	
+	ctx = ws ? kdb_ctx_find_ns(hs.ns_id, current->mm) : NULL;
+	if (ctx)
+		warm_start(ws, ctx);
+	else if (ws)
+		list_add_tail(&ws->node, &warm_pending);
+	mutex_unlock(&warm_lock);
+	
+	/* An empty hot set just cancels a pending one */
+	warm_set_free(old);
+	return 0;
+}
+
+void warm_attach(struct vma_ctx *ctx)
+{
+	struct warm_set *ws;
+	
+	mutex_lock(&warm_lock);
+	ws = warm_find_pending(READ_ONCE(ctx->ns_id), ctx->mm);
+	if (ws) {
+		list_del(&ws->node);
+		vma_ctx_get(ctx);
+		warm_start(ws, ctx);
+	}
+	mutex_unlock(&warm_lock);
+}
+
+int warm_init(void)
+{
+	/* Prefetch is background work, keep it off the system workqueues */
+	kdb_warm_wq = alloc_workqueue("kdb_warm", WQ_UNBOUND, 0);
+	if (!kdb_warm_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void warm_exit(void)
+{
+	struct warm_set *ws, *tmp;
+	
+	destroy_workqueue(kdb_warm_wq);
+	
+	list_for_each_entry_safe(ws, tmp, &warm_pending, node) {
+		list_del(&ws->node);
+		warm_set_free(ws);
+	}
+}
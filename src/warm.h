@@ -0,0 +1,50 @@
+#ifndef _KDB_WARM_H
+#define _KDB_WARM_H
+
+#include <linux/types.h>
+
+struct vma_ctx;
+
+/*
+ * Warm restart
+ *
+ * The hot set of a namespace (its resident logical pages ranked by hits)
+ * is exported with KDB_GET_HOTSET and saved by userspace. After a restart
+ * KDB_PREFETCH hands it back and a background worker makes those logical
+ * pages resident again, hottest first, reading long runs of CPs from the
+ * backing file with one call each. A hot set given before the namespace
+ * is mapped waits until KDB_SET_NS assigns its id to a mapping.
+ */
+
+/**
+ * warm_init - Create the prefetch workqueue
+ * Returns 0 on success, negative error code on failure
+ */
+int warm_init(void);
+
+/**
+ * warm_exit - Wait for running prefetches and drop pending hot sets
+ */
+void warm_exit(void);
+
+/**
+ * warm_get_hotset - KDB_GET_HOTSET
+ * @uarg: User pointer to struct kdb_hotset
+ * Returns 0 or a negative errno
+ */
+int warm_get_hotset(void __user *uarg);
+
+/**
+ * warm_prefetch - KDB_PREFETCH
+ * @uarg: User pointer to struct kdb_hotset
+ * Returns 0 or a negative errno
+ */
+int warm_prefetch(void __user *uarg);
+
+/**
+ * warm_attach - Start a pending prefetch for a newly named namespace
+ * @ctx: VMA context whose ns_id was just set, kept alive by the caller
+ */
+void warm_attach(struct vma_ctx *ctx);
+
+#endif /* _KDB_WARM_H */
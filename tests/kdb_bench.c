@@ -0,0 +1,473 @@
+/*
+ * kdb_bench - Multi-threaded fault/scan benchmark for /dev/kdbcache
+ *
+ * Every thread touches 4K pages of one shared mapping with the selected
+ * access pattern and times each access. Results are printed as a single
+ * JSON object so that runs can be compared by scripts:
+ *
+ *   gcc -O2 -pthread -o kdb_bench tests/kdb_bench.c -lm
+ *   ./kdb_bench -t 8 -p zipf -d 10 > zipf_8t.json
+ *
+ * Patterns:
+ *   uniform  random pages, reads only unless -w is given
+ *   zipf     random pages with Zipfian popularity (-z theta)
+ *   seq      each thread scans its own slice of the mapping in order
+ *   mix      uniform random with -w percent writes (default 30)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#include "../include/uapi/kdb.h"
+
+#define PAGE_SIZE 4096
+
+/* Log-linear latency histogram: 16 sub-buckets per power of two */
+#define HIST_SUB_BITS  4
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS   ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+#define STOP_CHECK     256  /* Accesses between checks of the stop flag */
+
+enum pattern {
+	PAT_UNIFORM,
+	PAT_ZIPF,
+	PAT_SEQ,
+	PAT_MIX,
+};
+
+static const char *const pattern_names[] = {
+	[PAT_UNIFORM] = "uniform",
+	[PAT_ZIPF] = "zipf",
+	[PAT_SEQ] = "seq",
+	[PAT_MIX] = "mix",
+};
+
+struct bench_cfg {
+	const char *dev;
+	int threads;
+	int duration;            /* Seconds */
+	enum pattern pattern;
+	int write_pct;
+	double theta;            /* Zipf skew */
+	uint64_t size;           /* Mapping size in bytes */
+	uint64_t lp_size;
+	uint64_t cp_size;
+};
+
+/* Zipf generator after Gray et al., "Quickly generating billion-record
+ * synthetic databases"; zeta(n) is computed once up front */
+struct zipf {
+	uint64_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+	double half_pow;
+};
+
+struct thread_ctx {
+	pthread_t tid;
+	int id;
+	const struct bench_cfg *cfg;
+	const struct zipf *zipf;
+	volatile uint8_t *mem;
+	uint64_t npages;
+	uint64_t rng;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t hist[HIST_BUCKETS];
+};
+
+static volatile int stop_flag;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift64*, one state per thread */
+static uint64_t rng_next(uint64_t *s)
+{
+	uint64_t x = *s;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*s = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_double(uint64_t *s)
+{
+	return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void zipf_init(struct zipf *z, uint64_t n, double theta)
+{
+	uint64_t i;
+	double zeta2 = 1.0 + pow(0.5, theta);
+
+	z->n = n;
+	z->theta = theta;
+	z->zetan = 0;
+	for (i = 1; i <= n; i++)
+		z->zetan += 1.0 / pow((double)i, theta);
+	z->alpha = 1.0 / (1.0 - theta);
+	z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+	z->half_pow = 1.0 + pow(0.5, theta);
+}
+
+static uint64_t zipf_next(const struct zipf *z, uint64_t *s)
+{
+	double u = rng_double(s);
+	double uz = u * z->zetan;
+	uint64_t v;
+
+	if (uz < 1.0)
+		v = 0;
+	else if (uz < z->half_pow)
+		v = 1;
+	else
+		v = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+	if (v >= z->n)
+		v = z->n - 1;
+
+	/* Scatter the popular ranks over the mapping */
+	return (v * 0x9E3779B97F4A7C15ULL) % z->n;
+}
+
+static int hist_bucket(uint64_t v)
+{
+	int msb;
+
+	if (v < HIST_SUB)
+		return (int)v;
+	msb = 63 - __builtin_clzll(v);
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+	       (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Lower bound of a bucket, good to 1/16th */
+static uint64_t hist_value(int idx)
+{
+	int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+	shift = idx / HIST_SUB - 1;
+	return (uint64_t)(HIST_SUB + idx % HIST_SUB) << shift;
+}
+
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total, double pct)
+{
+	uint64_t rank = (uint64_t)ceil(total * pct / 100.0);
+	uint64_t seen = 0;
+	int i;
+
+	if (!total)
+		return 0;
+	if (!rank)
+		rank = 1;
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= rank)
+			return hist_value(i);
+	}
+	return hist_value(HIST_BUCKETS - 1);
+}
+
+static void *bench_thread(void *arg)
+{
+	struct thread_ctx *t = arg;
+	const struct bench_cfg *cfg = t->cfg;
+	uint64_t slice = t->npages / cfg->threads;
+	uint64_t seq_base = slice * t->id;
+	uint64_t seq_pos = 0;
+	uint64_t page, start, lat;
+	int write;
+	unsigned int n = 0;
+
+	if (!slice)
+		slice = 1;
+
+	for (;;) {
+		if (++n % STOP_CHECK == 0 && __atomic_load_n(&stop_flag, __ATOMIC_RELAXED))
+			break;
+
+		switch (cfg->pattern) {
+		case PAT_ZIPF:
+			page = zipf_next(t->zipf, &t->rng);
+			break;
+		case PAT_SEQ:
+			page = (seq_base + seq_pos) % t->npages;
+			seq_pos = (seq_pos + 1) % slice;
+			break;
+		default:
+			page = rng_next(&t->rng) % t->npages;
+			break;
+		}
+		write = cfg->write_pct && (int)(rng_next(&t->rng) % 100) < cfg->write_pct;
+
+		start = now_ns();
+		if (write) {
+			t->mem[page * PAGE_SIZE + (n & (PAGE_SIZE - 1))] = (uint8_t)n;
+			t->writes++;
+		} else {
+			(void)t->mem[page * PAGE_SIZE + (n & (PAGE_SIZE - 1))];
+			t->reads++;
+		}
+		lat = now_ns() - start;
+		t->hist[hist_bucket(lat)]++;
+	}
+
+	return NULL;
+}
+
+static long rss_bytes(void)
+{
+	long size, resident;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+		resident = -1;
+	fclose(f);
+	return resident < 0 ? -1 : resident * sysconf(_SC_PAGESIZE);
+}
+
+static void print_stats_json(const char *name, const struct kdb_stats *s, int last)
+{
+	printf("    \"%s\": {\"total_faults\": %llu, \"total_mkwrite\": %llu, "
+	       "\"total_cp_alloc\": %llu, \"total_lp_created\": %llu, "
+	       "\"dirty_pages\": %llu, \"allocated_cp\": %llu, "
+	       "\"allocated_lp\": %llu}%s\n",
+	       name,
+	       (unsigned long long)s->total_faults,
+	       (unsigned long long)s->total_mkwrite,
+	       (unsigned long long)s->total_cp_alloc,
+	       (unsigned long long)s->total_lp_created,
+	       (unsigned long long)s->dirty_pages,
+	       (unsigned long long)s->allocated_cp,
+	       (unsigned long long)s->allocated_lp,
+	       last ? "" : ",");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t threads     worker threads (default 4)\n"
+		"  -d seconds     run time (default 5)\n"
+		"  -p pattern     uniform|zipf|seq|mix (default uniform)\n"
+		"  -w percent     writes per 100 accesses (default 0, 30 for mix)\n"
+		"  -z theta       Zipf skew (default 0.99)\n"
+		"  -s size_mb     mapping size (default 256)\n"
+		"  -l lp_size     logical page size in bytes (default 1MB)\n"
+		"  -c cp_size     canonical page size in bytes (default 4096)\n"
+		"  -D device      device path (default /dev/%s)\n",
+		prog, KDB_DEV_NAME);
+}
+
+static int parse_pattern(const char *s, enum pattern *p)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(pattern_names) / sizeof(pattern_names[0]); i++) {
+		if (!strcmp(s, pattern_names[i])) {
+			*p = (enum pattern)i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_cfg cfg = {
+		.dev = "/dev/" KDB_DEV_NAME,
+		.threads = 4,
+		.duration = 5,
+		.pattern = PAT_UNIFORM,
+		.write_pct = -1,
+		.theta = 0.99,
+		.size = 256ULL << 20,
+		.lp_size = 1 << 20,
+		.cp_size = PAGE_SIZE,
+	};
+	struct kdb_layout layout;
+	struct kdb_stats before, after, delta;
+	struct rusage ru_before, ru_after;
+	struct thread_ctx *threads;
+	struct zipf zipf;
+	uint64_t *hist;
+	uint64_t npages, reads = 0, writes = 0, total, start, elapsed;
+	double secs;
+	void *mem;
+	int fd, opt, i, j;
+
+	while ((opt = getopt(argc, argv, "t:d:p:w:z:s:l:c:D:h")) != -1) {
+		switch (opt) {
+		case 't': cfg.threads = atoi(optarg); break;
+		case 'd': cfg.duration = atoi(optarg); break;
+		case 'p':
+			if (parse_pattern(optarg, &cfg.pattern)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'w': cfg.write_pct = atoi(optarg); break;
+		case 'z': cfg.theta = atof(optarg); break;
+		case 's': cfg.size = strtoull(optarg, NULL, 0) << 20; break;
+		case 'l': cfg.lp_size = strtoull(optarg, NULL, 0); break;
+		case 'c': cfg.cp_size = strtoull(optarg, NULL, 0); break;
+		case 'D': cfg.dev = optarg; break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (cfg.write_pct < 0)
+		cfg.write_pct = cfg.pattern == PAT_MIX ? 30 : 0;
+	if (cfg.threads < 1 || cfg.duration < 1 || cfg.write_pct > 100 ||
+	    !cfg.lp_size || cfg.size < cfg.lp_size || cfg.theta <= 0 ||
+	    cfg.theta == 1.0) {
+		usage(argv[0]);
+		return 1;
+	}
+	cfg.size -= cfg.size % cfg.lp_size;
+	npages = cfg.size / PAGE_SIZE;
+
+	fd = open(cfg.dev, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", cfg.dev, strerror(errno));
+		return 1;
+	}
+
+	layout.cp_size = cfg.cp_size;
+	layout.lp_size = cfg.lp_size;
+	layout.n_lpn = cfg.size / cfg.lp_size;
+	if (ioctl(fd, KDB_SET_LAYOUT, &layout) < 0) {
+		perror("ioctl(KDB_SET_LAYOUT)");
+		close(fd);
+		return 1;
+	}
+
+	mem = mmap(NULL, cfg.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return 1;
+	}
+
+	if (cfg.pattern == PAT_ZIPF)
+		zipf_init(&zipf, npages, cfg.theta);
+
+	threads = calloc(cfg.threads, sizeof(*threads));
+	hist = calloc(HIST_BUCKETS, sizeof(*hist));
+	if (!threads || !hist) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	if (ioctl(fd, KDB_GET_STATS, &before) < 0) {
+		perror("ioctl(KDB_GET_STATS)");
+		return 1;
+	}
+	getrusage(RUSAGE_SELF, &ru_before);
+
+	start = now_ns();
+	for (i = 0; i < cfg.threads; i++) {
+		threads[i].id = i;
+		threads[i].cfg = &cfg;
+		threads[i].zipf = &zipf;
+		threads[i].mem = mem;
+		threads[i].npages = npages;
+		threads[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+		if (pthread_create(&threads[i].tid, NULL, bench_thread, &threads[i])) {
+			fprintf(stderr, "pthread_create failed\n");
+			return 1;
+		}
+	}
+
+	sleep(cfg.duration);
+	__atomic_store_n(&stop_flag, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < cfg.threads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		reads += threads[i].reads;
+		writes += threads[i].writes;
+		for (j = 0; j < HIST_BUCKETS; j++)
+			hist[j] += threads[i].hist[j];
+	}
+	elapsed = now_ns() - start;
+	secs = elapsed / 1e9;
+
+	getrusage(RUSAGE_SELF, &ru_after);
+	if (ioctl(fd, KDB_GET_STATS, &after) < 0) {
+		perror("ioctl(KDB_GET_STATS)");
+		return 1;
+	}
+
+	/* Counters are deltas, gauges are taken at the end */
+	delta = after;
+	delta.total_faults -= before.total_faults;
+	delta.total_mkwrite -= before.total_mkwrite;
+	delta.total_cp_alloc -= before.total_cp_alloc;
+	delta.total_lp_created -= before.total_lp_created;
+
+	total = reads + writes;
+
+	printf("{\n");
+	printf("  \"config\": {\"device\": \"%s\", \"threads\": %d, \"duration_s\": %d, "
+	       "\"pattern\": \"%s\", \"write_pct\": %d, \"theta\": %.3f, "
+	       "\"size\": %llu, \"lp_size\": %llu, \"cp_size\": %llu},\n",
+	       cfg.dev, cfg.threads, cfg.duration, pattern_names[cfg.pattern],
+	       cfg.write_pct, cfg.pattern == PAT_ZIPF ? cfg.theta : 0.0,
+	       (unsigned long long)cfg.size, (unsigned long long)cfg.lp_size,
+	       (unsigned long long)cfg.cp_size);
+	printf("  \"elapsed_s\": %.3f,\n", secs);
+	printf("  \"accesses\": %llu,\n", (unsigned long long)total);
+	printf("  \"reads\": %llu,\n", (unsigned long long)reads);
+	printf("  \"writes\": %llu,\n", (unsigned long long)writes);
+	printf("  \"accesses_per_s\": %.0f,\n", total / secs);
+	printf("  \"faults_per_s\": %.0f,\n", delta.total_faults / secs);
+	printf("  \"mkwrite_per_s\": %.0f,\n", delta.total_mkwrite / secs);
+	printf("  \"minor_faults\": %ld,\n", ru_after.ru_minflt - ru_before.ru_minflt);
+	printf("  \"major_faults\": %ld,\n", ru_after.ru_majflt - ru_before.ru_majflt);
+	printf("  \"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu},\n",
+	       (unsigned long long)hist_percentile(hist, total, 50.0),
+	       (unsigned long long)hist_percentile(hist, total, 99.0),
+	       (unsigned long long)hist_percentile(hist, total, 99.9),
+	       (unsigned long long)hist_percentile(hist, total, 100.0));
+	printf("  \"rss_bytes\": %ld,\n", rss_bytes());
+	printf("  \"max_rss_kb\": %ld,\n", ru_after.ru_maxrss);
+	printf("  \"kdb_stats\": {\n");
+	print_stats_json("before", &before, 0);
+	print_stats_json("after", &after, 0);
+	print_stats_json("delta", &delta, 1);
+	printf("  }\n");
+	printf("}\n");
+
+	munmap(mem, cfg.size);
+	close(fd);
+	free(threads);
+	free(hist);
+	return 0;
+}
@@ -37,6 +37,34 @@ static void print_stats(int fd)
 	printf("=======================\n\n");
 }
 
+static void print_lat_hist(int fd, void *mapped_mem)
+{
+	static const char *names[KDB_LAT_NR] = { "minor", "major", "mkwrite" };
+	struct kdb_lat_hist hist;
+	int ret, t, b;
+	
+	memset(&hist, 0, sizeof(hist));
+	hist.addr = (uintptr_t)mapped_mem;
+	
+	ret = ioctl(fd, KDB_GET_LAT_HIST, &hist);
+	if (ret < 0) {
+		perror("ioctl(KDB_GET_LAT_HIST)");
+		return;
+	}
+	
+	printf("=== KDB Fault Latency (ns) ===\n");
+	for (t = 0; t < KDB_LAT_NR; t++) {
+		printf("%-8s", names[t]);
+		for (b = 0; b < KDB_LAT_BUCKETS; b++) {
+			if (hist.hist[t][b])
+				printf(" [%llu,%llu):%llu", 1ULL << b, 2ULL << b,
+				       (unsigned long long)hist.hist[t][b]);
+		}
+		printf("\n");
+	}
+	printf("==============================\n\n");
+}
+
 static int test_basic_mmap(int fd, void **mapped_mem)
 {
 	printf("=== Basic mmap test ===\n");
@@ -178,6 +206,187 @@ static int test_sparse_access(void *mapped_mem)
 	return errors ? -1 : 0;
 }
 
+static int test_leases(int fd, void *mapped_mem)
+{
+	printf("=== Lease API test ===\n");
+	
+	struct kdb_ns ns = { .addr = (uintptr_t)mapped_mem, .ns_id = 42 };
+	struct kdb_page_req req;
+	struct kdb_page_req reqs[4];
+	struct kdb_lease_op op;
+	struct kdb_lease_op ops[4];
+	struct kdb_batch batch;
+	int errors = 0;
+	int i;
+	
+	if (ioctl(fd, KDB_SET_NS, &ns) < 0) {
+		perror("ioctl(KDB_SET_NS)");
+		return -1;
+	}
+	
+	/* Exclusive lease on LPN 3, written through the returned pointer */
+	memset(&req, 0, sizeof(req));
+	req.file_id = 42;
+	req.page_no = 3;
+	req.mode = KDB_MODE_EXCL;
+	if (ioctl(fd, KDB_GET_PAGE, &req) < 0) {
+		perror("ioctl(KDB_GET_PAGE)");
+		return -1;
+	}
+	if (req.ptr != (uintptr_t)mapped_mem + 3 * LP_SIZE || req.len != LP_SIZE) {
+		printf("ERROR: lease ptr=0x%llx len=%u\n",
+		       (unsigned long long)req.ptr, req.len);
+		errors++;
+	}
+	memset((void *)(uintptr_t)req.ptr, 0x5a, PAGE_SIZE);
+	
+	/* A conflicting NOWAIT request must not block */
+	struct kdb_page_req conflict = req;
+	conflict.mode = KDB_MODE_SHARED;
+	conflict.flags = KDB_REQ_NOWAIT;
+	if (ioctl(fd, KDB_GET_PAGE, &conflict) == 0 || errno != EAGAIN) {
+		printf("ERROR: conflicting NOWAIT get did not return EAGAIN\n");
+		errors++;
+	}
+	
+	op.lease = req.lease;
+	op.lsn = 1000;
+	if (ioctl(fd, KDB_MARK_DIRTY, &op) < 0) {
+		perror("ioctl(KDB_MARK_DIRTY)");
+		errors++;
+	}
+	if (ioctl(fd, KDB_PUT_PAGE, &op) < 0) {
+		perror("ioctl(KDB_PUT_PAGE)");
+		errors++;
+	}
+	
+	/* Batched shared gets, checking want_lsn against the LSN above */
+	memset(reqs, 0, sizeof(reqs));
+	memset(ops, 0, sizeof(ops));
+	for (i = 0; i < 4; i++) {
+		reqs[i].file_id = 42;
+		reqs[i].page_no = 3 + i;
+		reqs[i].mode = KDB_MODE_SHARED;
+	}
+	reqs[0].want_lsn = 1000;
+	batch.entries = (uintptr_t)reqs;
+	batch.nr = 4;
+	batch.op = KDB_BATCH_GET_PAGE;
+	if (ioctl(fd, KDB_BATCH, &batch) < 0) {
+		perror("ioctl(KDB_BATCH get)");
+		return -1;
+	}
+	for (i = 0; i < 4; i++) {
+		if (reqs[i].status) {
+			printf("ERROR: batch entry %d status %d\n", i, reqs[i].status);
+			errors++;
+		}
+		ops[i].lease = reqs[i].lease;
+	}
+	if (reqs[0].page_lsn != 1000) {
+		printf("ERROR: page_lsn %llu, expected 1000\n",
+		       (unsigned long long)reqs[0].page_lsn);
+		errors++;
+	}
+	
+	batch.entries = (uintptr_t)ops;
+	batch.op = KDB_BATCH_PUT_PAGE;
+	if (ioctl(fd, KDB_BATCH, &batch) < 0) {
+		perror("ioctl(KDB_BATCH put)");
+		errors++;
+	}
+	for (i = 0; i < 4; i++) {
+		if (ops[i].status) {
+			printf("ERROR: batch put %d status %d\n", i, ops[i].status);
+			errors++;
+		}
+	}
+	
+	if (errors == 0) {
+		printf("Lease API test PASSED\n");
+	} else {
+		printf("Lease API test FAILED with %d errors\n", errors);
+	}
+	
+	return errors ? -1 : 0;
+}
+
+static int test_hotset(int fd)
+{
+	printf("=== Hot set test ===\n");
+	
+	struct kdb_hotset hs = { .ns_id = 42 };
+	struct kdb_hot_entry *entries;
+	int errors = 0;
+	int found = 0;
+	__u32 i;
+	
+	/* Size query, then export; namespace 42 was set by the lease test */
+	if (ioctl(fd, KDB_GET_HOTSET, &hs) < 0) {
+		perror("ioctl(KDB_GET_HOTSET)");
+		return -1;
+	}
+	printf("Resident logical pages in ns 42: %u\n", hs.nr);
+	if (!hs.nr) {
+		printf("ERROR: empty hot set\n");
+		return -1;
+	}
+	
+	entries = calloc(hs.nr, sizeof(*entries));
+	if (!entries)
+		return -1;
+	hs.entries = (uintptr_t)entries;
+	if (ioctl(fd, KDB_GET_HOTSET, &hs) < 0) {
+		perror("ioctl(KDB_GET_HOTSET)");
+		free(entries);
+		return -1;
+	}
+	
+	for (i = 0; i < hs.nr; i++) {
+		if (i && entries[i].hits > entries[i - 1].hits) {
+			printf("ERROR: hot set not sorted at %u\n", i);
+			errors++;
+		}
+		if (entries[i].lpn == 3)
+			found = 1;
+	}
+	if (!found) {
+		printf("ERROR: leased LPN 3 missing from the hot set\n");
+		errors++;
+	}
+	printf("Hottest: lpn=%llu hits=%u nr_cp=%u\n",
+	       (unsigned long long)entries[0].lpn, entries[0].hits,
+	       entries[0].nr_cp);
+	
+	/* Feeding it back to a live namespace only fills what is missing */
+	if (ioctl(fd, KDB_PREFETCH, &hs) < 0) {
+		perror("ioctl(KDB_PREFETCH)");
+		errors++;
+	}
+	
+	/* For an unmapped namespace it stays pending until cancelled */
+	hs.ns_id = 77;
+	if (ioctl(fd, KDB_PREFETCH, &hs) < 0) {
+		perror("ioctl(KDB_PREFETCH pending)");
+		errors++;
+	}
+	hs.nr = 0;
+	if (ioctl(fd, KDB_PREFETCH, &hs) < 0) {
+		perror("ioctl(KDB_PREFETCH cancel)");
+		errors++;
+	}
+	
+	free(entries);
+	
+	if (errors == 0) {
+		printf("Hot set test PASSED\n");
+	} else {
+		printf("Hot set test FAILED with %d errors\n", errors);
+	}
+	
+	return errors ? -1 : 0;
+}
+
 int main(void)
 {
 	int fd, ret = 0;
@@ -244,6 +453,19 @@ int main(void)
 	
 	print_stats(fd);
 	
+	if (test_leases(fd, mapped_mem) < 0) {
+		ret = 1;
+		goto cleanup;
+	}
+	
+	if (test_hotset(fd) < 0) {
+		ret = 1;
+		goto cleanup;
+	}
+	
+	print_stats(fd);
+	print_lat_hist(fd, mapped_mem);
+	
 	printf("All tests completed!\n");
 	
 cleanup: